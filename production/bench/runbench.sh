@@ -0,0 +1,136 @@
+#!/bin/sh
+# Benchmark of filterfasta throughput.
+# Generates a synthetic FASTA file, BLAST table and search file with fastagen, then runs a matrix of
+# filtering modes (normal, -l, -a, search, pipeline) across serial, OpenMP and MPI runs.
+# Results are written as one JSON object per line, best wall time of BENCH_REPEAT runs.
+# Threads of a result are those filterfasta actually used, a single thread if it fell back to one.
+# If BENCH_BASELINE names a previous results file, runs slower than baseline by more than BENCH_TOLERANCE fail.
+#
+# Settings are taken from the environment, see makefile target "bench".
+
+BENCH_BIN=${BENCH_BIN:-bin/filterfasta}
+BENCH_GEN=${BENCH_GEN:-bin/fastagen}
+BENCH_DIR=${BENCH_DIR:-bench/data}
+BENCH_OUT=${BENCH_OUT:-bench/results.jsonl}
+BENCH_RECORDS=${BENCH_RECORDS:-1000000}
+BENCH_LENGTHS=${BENCH_LENGTHS:-50:1000}
+BENCH_DIST=${BENCH_DIST:-1}
+BENCH_ANNOTS=${BENCH_ANNOTS:-3}
+BENCH_QUERIES=${BENCH_QUERIES:-200}
+BENCH_HITS=${BENCH_HITS:-50}
+BENCH_SEED=${BENCH_SEED:-1}
+BENCH_PROCS=${BENCH_PROCS:-4}
+BENCH_THREADS=${BENCH_THREADS:-4}
+BENCH_REPEAT=${BENCH_REPEAT:-3}
+BENCH_MODES=${BENCH_MODES:-"normal length annot search pipeline"}
+BENCH_CONFIGS=${BENCH_CONFIGS:-"serial openmp mpi"}
+BENCH_BASELINE=${BENCH_BASELINE:-}
+BENCH_TOLERANCE=${BENCH_TOLERANCE:-0.10}
+MPIRUN=${MPIRUN:-mpirun}
+
+QF=$BENCH_DIR/bench.fasta
+TF=$BENCH_DIR/bench.table
+SF=$BENCH_DIR/bench.search
+OF=$BENCH_DIR/bench.out
+
+mkdir -p "$BENCH_DIR" || exit 1
+
+# Generate input files again only if generator settings changed
+PARAMS="-r $BENCH_RECORDS -l $BENCH_LENGTHS -d $BENCH_DIST -k $BENCH_ANNOTS -q $BENCH_QUERIES -n $BENCH_HITS -x $BENCH_SEED"
+if [ ! -f "$QF" ] || [ "$(cat "$BENCH_DIR/bench.params" 2>/dev/null)" != "$PARAMS" ]; then
+  echo "Generating benchmark files ($PARAMS)"
+  $BENCH_GEN -o "$QF" -t "$TF" -s "$SF" $PARAMS || exit 1
+  echo "$PARAMS" > "$BENCH_DIR/bench.params"
+fi
+BYTES=$(wc -c < "$QF" | tr -d ' ')
+
+# Options of each filtering mode
+modeOpts()
+{
+  case $1 in
+    normal)   echo "" ;;
+    length)   echo "-l 100:300" ;;
+    annot)    echo "-a 2" ;;
+    search)   echo "-s $SF" ;;
+    pipeline) echo "-t $TF -p 1" ;;
+    *)        echo "Unknown benchmark mode: $1" >&2; return 1 ;;
+  esac
+}
+
+# Processes and threads of each run configuration
+configRun()
+{
+  case $1 in
+    serial) echo "1 1" ;;
+    openmp) echo "1 $BENCH_THREADS" ;;
+    mpi)    echo "$BENCH_PROCS 1" ;;
+    *)      echo "Unknown benchmark configuration: $1" >&2; return 1 ;;
+  esac
+}
+
+: > "$BENCH_OUT" || exit 1
+printf "%-9s %-7s %5s %7s %10s %10s %12s\n" mode config procs threads seconds MB/s records/s
+status=0
+for config in $BENCH_CONFIGS; do
+  set -- $(configRun $config) || exit 1
+  procs=$1
+  threads=$2
+  for mode in $BENCH_MODES; do
+    opts=$(modeOpts $mode) || exit 1
+
+    # Best wall time reported by filterfasta
+    # Threads are those actually used, filterfasta warns when it falls back to a single thread
+    best=""
+    used=$threads
+    i=0
+    while [ $i -lt "$BENCH_REPEAT" ]; do
+      rm -f "$OF" "$OF".notFound
+      log=$($MPIRUN -np $procs "$BENCH_BIN" -q "$QF" -o "$OF" -n $threads $opts 2>/dev/null)
+      t=$(echo "$log" | sed -n 's/^Total wall time = //p')
+      echo "$log" | grep -q "^Warning: .*single thread" && used=1
+      if [ -z "$t" ]; then
+        echo "Error: failed run of mode $mode, configuration $config" >&2
+        status=1
+        break
+      fi
+      best=$(echo "$t $best" | awk '{ if( NF == 1 || $1 < $2 ) print $1; else print $2 }')
+      i=$((i + 1))
+    done
+    [ -z "$best" ] && continue
+    outBytes=$(wc -c < "$OF" 2>/dev/null | tr -d ' ')
+    rm -f "$OF" "$OF".notFound
+
+    echo "$mode $config $procs $used $best $BYTES $BENCH_RECORDS ${outBytes:-0}" | awk -v out="$BENCH_OUT" '{
+      mbps = ($5 > 0) ? $6 / 1e6 / $5 : 0
+      rps = ($5 > 0) ? $7 / $5 : 0
+      printf("%-9s %-7s %5d %7d %10.4f %10.1f %12.0f\n", $1, $2, $3, $4, $5, mbps, rps)
+      printf("{\"mode\":\"%s\",\"config\":\"%s\",\"procs\":%d,\"threads\":%d,\"seconds\":%.6f,\"bytes\":%.0f,\"records\":%.0f,\"output_bytes\":%.0f,\"mbps\":%.3f,\"records_per_sec\":%.1f}\n", $1, $2, $3, $4, $5, $6, $7, $8, mbps, rps) >> out
+    }'
+  done
+done
+
+echo "Results = $BENCH_OUT"
+
+# Compare throughput with baseline results of same mode, configuration, processes and threads
+if [ -n "$BENCH_BASELINE" ]; then
+  awk -v tol="$BENCH_TOLERANCE" '
+    function field(line, name,    s) {
+      s = line
+      sub(".*\"" name "\":\"?", "", s)
+      sub("[\",}].*", "", s)
+      return s
+    }
+    {
+      key = field($0, "mode") " " field($0, "config") " " field($0, "procs") " " field($0, "threads")
+      if( FNR == NR ) { base[key] = field($0, "mbps") + 0; next }
+      if( !(key in base) ) next
+      cur = field($0, "mbps") + 0
+      if( cur < base[key] * (1 - tol) ) {
+        printf("Regression: %s = %.1f MB/s, baseline = %.1f MB/s\n", key, cur, base[key])
+        bad = 1
+      }
+    }
+    END { if( bad ) exit 1; print "No throughput regressions against baseline" }' "$BENCH_BASELINE" "$BENCH_OUT" || status=1
+fi
+
+exit $status
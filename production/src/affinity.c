@@ -0,0 +1,116 @@
+// CPU sets and sched_setaffinity() are GNU extensions
+#define _GNU_SOURCE
+#include <sched.h>
+#include "affinity.h"
+
+
+// Parse a sysfs CPU list (e.g. "0-15,32-47") of a NUMA node into a CPU set
+static int readNodeCPUs(int node, cpu_set_t *set)
+{
+  char fn[128];      // CPU list file of node
+  char line[4096];   // CPU list
+  char *p;           // Current position in CPU list
+  char *q;           // End of current number
+  long int lo;       // First CPU of range
+  long int hi;       // Last CPU of range
+  FILE *fd;          // CPU list file descriptor
+
+  snprintf(fn, sizeof(fn), "%s/node%d/cpulist", NODE_PATH, node);
+  fd = fopen(fn, "r");
+  if( fd == NULL )
+    return ERROR;
+  p = fgets(line, sizeof(line), fd);
+  fclose(fd);
+  if( p == NULL )
+    return ERROR;
+
+  CPU_ZERO(set);
+  while( *p != '\0' && *p != '\n' )
+  {
+    lo = strtol(p, &q, 10);
+    if( q == p )
+      break;
+    hi = lo;
+    if( *q == '-' )
+    {
+      p = q + 1;
+      hi = strtol(p, &q, 10);
+    }
+    for(; lo <= hi && lo < CPU_SETSIZE; lo++)
+      CPU_SET(lo, set);
+
+    p = (*q == ',') ? q + 1 : q;
+  }
+
+  return 0;
+}
+
+
+// Find NUMA nodes with CPUs in affinity mask of current process
+// Returns number of nodes found, 0 if NUMA information is not available
+int initNuma(numa_t *numa)
+{
+  cpu_set_t mask;    // Affinity mask of process
+  cpu_set_t set;     // CPUs of current node
+  cpu_set_t *cpus;   // CPUs of nodes found
+  int i;             // Iteration variable
+
+  memset(numa, 0, sizeof(numa_t));
+
+  if( sched_getaffinity(0, sizeof(cpu_set_t), &mask) != 0 )
+    return 0;
+
+  numa->nodeIDs = (int *)malloc(sizeof(int) * NODE_LIMIT);
+  numa->cpus = malloc(sizeof(cpu_set_t) * NODE_LIMIT);
+  if( numa->nodeIDs == NULL || numa->cpus == NULL )
+  {
+    freeNuma(numa);
+    return 0;
+  }
+
+  // Node IDs may not be contiguous
+  cpus = (cpu_set_t *)numa->cpus;
+  for(i = 0; i < NODE_LIMIT; i++)
+  {
+    if( readNodeCPUs(i, &set) != 0 )
+      continue;
+    CPU_AND(&set, &set, &mask);
+    if( CPU_COUNT(&set) == 0 )
+      continue;
+
+    numa->nodeIDs[numa->nnodes] = i;
+    cpus[numa->nnodes] = set;
+    numa->nnodes++;
+  }
+
+  return numa->nnodes;
+}
+
+
+// Pin calling thread to a NUMA node, consecutive threads share a node
+// Pages faulted in by thread (and its prefetch thread) are then allocated on that node
+// Returns system ID of node, ERROR if thread was not pinned
+int pinThreadNuma(numa_t *numa, int tid, int tcnt)
+{
+  int node;          // Node of thread
+
+  if( numa->nnodes < 2 || tcnt < 1 )
+    return ERROR;
+
+  node = (int)(((long long int)tid * numa->nnodes) / tcnt);
+  if( sched_setaffinity(0, sizeof(cpu_set_t), &((cpu_set_t *)numa->cpus)[node]) != 0 )
+    return ERROR;
+
+  return numa->nodeIDs[node];
+}
+
+
+// Free NUMA node memory
+int freeNuma(numa_t *numa)
+{
+  free(numa->nodeIDs);
+  free(numa->cpus);
+  memset(numa, 0, sizeof(numa_t));
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERROR        -1         // Error code from failed functions
+
+#define NODE_LIMIT   256        // Max number of NUMA nodes probed
+#define NODE_PATH    "/sys/devices/system/node"  // sysfs directory of NUMA nodes
+
+// NUMA nodes available to current process
+// Only CPUs of a node that are also in affinity mask of process are kept
+typedef struct st_numa
+{
+  int            nnodes;      // Number of NUMA nodes with CPUs available
+  int           *nodeIDs;     // System IDs of NUMA nodes
+  void          *cpus;        // CPU set of each NUMA node (cpu_set_t)
+} numa_t;
+
+int initNuma(numa_t *);
+int pinThreadNuma(numa_t *, int, int);
+int freeNuma(numa_t *);
+
+
+#endif
@@ -0,0 +1,459 @@
+// O_DIRECT and MAP_POPULATE are GNU extensions
+#define _GNU_SOURCE
+#include "aio.h"
+#include <sys/mman.h>
+#include <sys/uio.h>
+#ifdef AIO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+
+// Open file of descriptor again with O_DIRECT, flags are O_RDONLY or O_WRONLY
+// Returns ERROR if file system does not support direct I/O
+int openDirect(int fd, int flags)
+{
+  char path[64];   // Path of descriptor in /proc
+
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+  return open(path, flags | O_DIRECT);
+}
+
+
+// Read or write all bytes with pread() or pwrite(), reads stop at end-of-file
+// Returns number of bytes done, ERROR if a call failed
+static long long int syncIO(int isWrite, int fd, char *buf, long long int len, long long int off)
+{
+  long long int done;   // Bytes done
+  ssize_t n;            // Bytes done by current call
+
+  for(done = 0LL; done < len; done = done + n)
+  {
+    if( isWrite != 0 )
+      n = pwrite(fd, buf + done, (size_t)(len - done), (off_t)(off + done));
+    else
+      n = pread(fd, buf + done, (size_t)(len - done), (off_t)(off + done));
+    if( n < 0 )
+    {
+      if( errno == EINTR )
+      {
+        n = 0;
+        continue;
+      }
+      return ERROR;
+    }
+    if( n == 0 )
+      break;
+  }
+
+  return done;
+}
+
+
+// Set up ring of entries requests
+// Returns ERROR if io_uring is not available, requests are then done synchronously
+int openRing(aioring_t *r, unsigned entries)
+{
+#ifdef AIO_URING
+  struct io_uring_params p;   // Parameters of ring
+#endif
+
+  memset(r, 0, sizeof(aioring_t));
+  r->fd = ERROR;
+
+#ifdef AIO_URING
+  memset(&p, 0, sizeof(p));
+  r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if( r->fd < 0 )
+  {
+    r->fd = ERROR;
+    return ERROR;
+  }
+  r->entries = p.sq_entries;
+
+  // Queues are shared with kernel through mappings of ring descriptor
+  r->sqMapSz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cqMapSz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->sqesSz = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqMap = mmap(NULL, r->sqMapSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cqMap = mmap(NULL, r->cqMapSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes = mmap(NULL, r->sqesSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if( r->sqMap == MAP_FAILED || r->cqMap == MAP_FAILED || r->sqes == MAP_FAILED )
+  {
+    closeRing(r);
+    return ERROR;
+  }
+
+  r->sqHead = (unsigned *)((char *)r->sqMap + p.sq_off.head);
+  r->sqTail = (unsigned *)((char *)r->sqMap + p.sq_off.tail);
+  r->sqMask = (unsigned *)((char *)r->sqMap + p.sq_off.ring_mask);
+  r->sqArray = (unsigned *)((char *)r->sqMap + p.sq_off.array);
+  r->cqHead = (unsigned *)((char *)r->cqMap + p.cq_off.head);
+  r->cqTail = (unsigned *)((char *)r->cqMap + p.cq_off.tail);
+  r->cqMask = (unsigned *)((char *)r->cqMap + p.cq_off.ring_mask);
+  r->cqes = (char *)r->cqMap + p.cq_off.cqes;
+
+  return 0;
+#else
+  (void)entries;
+  return ERROR;
+#endif
+}
+
+
+// Register buffer with ring, requests inside it skip mapping of user pages
+// Requests use plain buffers if buffer cannot be registered (locked memory limit)
+int registerRing(aioring_t *r, char *buf, long long int len)
+{
+#ifdef AIO_URING
+  struct iovec iov;   // Registered buffer
+
+  if( r->fd == ERROR )
+    return ERROR;
+
+  iov.iov_base = buf;
+  iov.iov_len = (size_t)len;
+  if( syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, &iov, 1) != 0 )
+    return ERROR;
+  r->fixed = 1;
+
+  return 0;
+#else
+  (void)r;
+  (void)buf;
+  (void)len;
+  return ERROR;
+#endif
+}
+
+
+// Submit a read or write request, data identifies request in its completion
+// Returns ERROR if request was not submitted, caller does it synchronously
+static int submitRing(aioring_t *r, int isWrite, int fd, char *buf, long long int len, long long int off, unsigned long long data)
+{
+#ifdef AIO_URING
+  unsigned tail;               // Tail of submission queue
+  unsigned idx;                // Index of entry
+  struct io_uring_sqe *sqe;    // Entry of request
+
+  if( r->fd == ERROR || r->inflight >= r->entries )
+    return ERROR;
+
+  tail = *r->sqTail;
+  idx = tail & *r->sqMask;
+  sqe = &((struct io_uring_sqe *)r->sqes)[idx];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  if( r->fixed != 0 )
+  {
+    sqe->opcode = (isWrite != 0) ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = 0;
+  }
+  else
+    sqe->opcode = (isWrite != 0) ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long long)(size_t)buf;
+  sqe->len = (unsigned)len;
+  sqe->off = (unsigned long long)off;
+  sqe->user_data = data;
+  r->sqArray[idx] = idx;
+  __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+  while( syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0) < 0 )
+  {
+    // Entry was not consumed by kernel, it is taken back
+    if( errno != EINTR )
+    {
+      __atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE);
+      return ERROR;
+    }
+  }
+  r->inflight++;
+
+  return 0;
+#else
+  (void)r;
+  (void)isWrite;
+  (void)fd;
+  (void)buf;
+  (void)len;
+  (void)off;
+  (void)data;
+  return ERROR;
+#endif
+}
+
+
+// Wait for completion of a request
+// Result is bytes done or negative errno, as returned by kernel
+static int reapRing(aioring_t *r, unsigned long long *data, long long int *res)
+{
+#ifdef AIO_URING
+  unsigned head;               // Head of completion queue
+  struct io_uring_cqe *cqe;    // Completion of request
+
+  if( r->fd == ERROR || r->inflight == 0 )
+    return ERROR;
+
+  head = *r->cqHead;
+  while( head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE) )
+  {
+    if( syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR )
+      return ERROR;
+  }
+
+  cqe = &((struct io_uring_cqe *)r->cqes)[head & *r->cqMask];
+  *data = cqe->user_data;
+  *res = (long long int)cqe->res;
+  __atomic_store_n(r->cqHead, head + 1, __ATOMIC_RELEASE);
+  r->inflight--;
+
+  return 0;
+#else
+  (void)r;
+  (void)data;
+  (void)res;
+  return ERROR;
+#endif
+}
+
+
+// Read len bytes of file at off into buf, with AIO_DEPTH requests of AIO_BLOCK bytes in flight
+// Requests failed by ring and remainders of short reads are read synchronously
+// Returns number of bytes read, less than len at end-of-file, ERROR if a read failed
+long long int readRing(aioring_t *r, int fd, char *buf, long long int off, long long int len)
+{
+  int eof;                         // Flag for end-of-file found, no more requests
+  int err;                         // Trap errors
+  long long int next;              // Bytes of buffer requested
+  long long int total;             // Bytes read
+  long long int res;               // Result of completed request
+  long long int n;                 // Bytes read synchronously
+  long long int slen[AIO_DEPTH];   // Bytes of request of each slot
+  long long int soff[AIO_DEPTH];   // Offset in buffer of request of each slot
+  unsigned long long s;            // Slot of completed request
+  int i;                           // Free slot
+
+  if( r->fd == ERROR )
+    return syncIO(0, fd, buf, len, off);
+
+  eof = 0;
+  err = 0;
+  next = 0LL;
+  total = 0LL;
+  for(i = 0; i < AIO_DEPTH; i++)
+    slen[i] = 0LL;
+
+  // Requests are submitted until len bytes are requested, end-of-file or an error, then completions are waited for
+  while( (next < len && eof == 0 && err == 0) || r->inflight > 0 )
+  {
+    // Keep ring full ahead of completions
+    for(i = 0; i < AIO_DEPTH && next < len && eof == 0 && err == 0; i++)
+    {
+      if( slen[i] != 0LL )
+        continue;
+      soff[i] = next;
+      slen[i] = MIN(AIO_BLOCK, len - next);
+      next = next + slen[i];
+      if( submitRing(r, 0, fd, buf + soff[i], slen[i], off + soff[i], (unsigned long long)i) != 0 )
+      {
+        n = syncIO(0, fd, buf + soff[i], slen[i], off + soff[i]);
+        if( n < 0LL )
+          err = ERROR;
+        else
+          total = total + n;
+        eof = (n < slen[i]);
+        slen[i] = 0LL;
+      }
+    }
+
+    // Requests of this pass were all read synchronously
+    if( r->inflight == 0 )
+      continue;
+    if( reapRing(r, &s, &res) != 0 )
+    {
+      err = ERROR;
+      break;
+    }
+
+    // Failed or short request, rest of it is read synchronously
+    if( res < slen[s] )
+    {
+      res = MAX(res, 0LL);
+      n = syncIO(0, fd, buf + soff[s] + res, slen[s] - res, off + soff[s] + res);
+      if( n < 0LL )
+        err = ERROR;
+      else
+        res = res + n;
+      eof = eof || (res < slen[s]);
+    }
+    total = total + res;
+    slen[s] = 0LL;
+  }
+
+  // Requests left after an error are waited for, buffer stays in use until they complete
+  while( r->inflight > 0 && reapRing(r, &s, &res) == 0 );
+
+  return (err != 0) ? ERROR : total;
+}
+
+
+// Close ring, registered buffers are released with it
+int closeRing(aioring_t *r)
+{
+  if( r->sqes != NULL && r->sqes != MAP_FAILED )
+    munmap(r->sqes, r->sqesSz);
+  if( r->cqMap != NULL && r->cqMap != MAP_FAILED )
+    munmap(r->cqMap, r->cqMapSz);
+  if( r->sqMap != NULL && r->sqMap != MAP_FAILED )
+    munmap(r->sqMap, r->sqMapSz);
+  if( r->fd >= 0 )
+    close(r->fd);
+  memset(r, 0, sizeof(aioring_t));
+  r->fd = ERROR;
+
+  return 0;
+}
+
+
+// Begin queueing writes to output file at its current position
+// Mode AIO_DIRECT writes full blocks with O_DIRECT if position is aligned and file system supports it
+int openAioWriter(aiowr_t *aw, int fd, int mode)
+{
+  void *p;   // Aligned memory
+
+  memset(aw, 0, sizeof(aiowr_t));
+  aw->fd = fd;
+  aw->dfd = ERROR;
+  aw->off = (long long int)lseek(fd, 0, SEEK_CUR);
+  if( aw->off < 0LL )
+  {
+    fprintf(stderr, "\n");
+    perror("lseek()");
+    return ERROR;
+  }
+
+  if( posix_memalign(&p, (size_t)AIO_ALIGN, (size_t)(AIO_DEPTH * AIO_BLOCK)) != 0 )
+  {
+    fprintf(stdout, "\nError: failed to allocate output write queue\n");
+    return ERROR;
+  }
+  aw->blocks = (char *)p;
+
+  if( mode == AIO_DIRECT && (aw->off % AIO_ALIGN) == 0LL )
+    aw->dfd = openDirect(fd, O_WRONLY);
+  if( openRing(&aw->ring, AIO_DEPTH) == 0 )
+    registerRing(&aw->ring, aw->blocks, AIO_DEPTH * AIO_BLOCK);
+
+  return 0;
+}
+
+
+// Wait for a queued write, short writes are completed synchronously through page cache
+static int reapAioWriter(aiowr_t *aw)
+{
+  unsigned long long s;   // Block of completed write
+  long long int res;      // Result of write
+
+  if( reapRing(&aw->ring, &s, &res) != 0 )
+  {
+    fprintf(stderr, "\nError: failed to wait for output write\n");
+    aw->err = ERROR;
+    return ERROR;
+  }
+
+  if( res < AIO_BLOCK )
+  {
+    res = MAX(res, 0LL);
+    if( syncIO(1, aw->fd, aw->blocks + s * AIO_BLOCK + res, AIO_BLOCK - res, aw->boff[s] + res) != AIO_BLOCK - res )
+    {
+      fprintf(stderr, "\n");
+      perror("pwrite()");
+      aw->err = ERROR;
+    }
+  }
+  aw->busy[s] = 0;
+
+  return aw->err;
+}
+
+
+// Queue write of block being filled and move to next free block
+static int submitAioBlock(aiowr_t *aw)
+{
+  int s;    // Block to write
+  int wfd;  // Descriptor of write
+
+  s = aw->cur;
+  aw->boff[s] = aw->off;
+  wfd = (aw->dfd >= 0) ? aw->dfd : aw->fd;
+  if( submitRing(&aw->ring, 1, wfd, aw->blocks + s * AIO_BLOCK, AIO_BLOCK, aw->off, (unsigned long long)s) == 0 )
+    aw->busy[s] = 1;
+  else if( syncIO(1, wfd, aw->blocks + s * AIO_BLOCK, AIO_BLOCK, aw->off) != AIO_BLOCK )
+  {
+    fprintf(stderr, "\n");
+    perror("pwrite()");
+    aw->err = ERROR;
+  }
+
+  aw->off = aw->off + AIO_BLOCK;
+  aw->fill = 0LL;
+  aw->cur = (aw->cur + 1) % AIO_DEPTH;
+  while( aw->err == 0 && aw->busy[aw->cur] != 0 )
+    reapAioWriter(aw);
+
+  return aw->err;
+}
+
+
+// Queue data for output file, data can be reused when call returns
+// Caller only waits when all blocks are being written
+int writeAio(aiowr_t *aw, const char *p, long long int len)
+{
+  long long int n;   // Bytes copied to current block
+
+  while( len > 0LL && aw->err == 0 )
+  {
+    n = MIN(len, AIO_BLOCK - aw->fill);
+    memcpy(aw->blocks + aw->cur * AIO_BLOCK + aw->fill, p, (size_t)n);
+    aw->fill = aw->fill + n;
+    aw->queued = aw->queued + n;
+    p = p + n;
+    len = len - n;
+    if( aw->fill == AIO_BLOCK )
+      submitAioBlock(aw);
+  }
+
+  return aw->err;
+}
+
+
+// Wait for queued writes, write last partial block and free queue
+// Position of output file is left after data written, as with write()
+int closeAioWriter(aiowr_t *aw)
+{
+  int err;   // Trap errors
+
+  while( aw->ring.inflight > 0 && reapAioWriter(aw) == 0 );
+
+  // Partial block cannot be written with O_DIRECT
+  if( aw->err == 0 && aw->fill > 0LL &&
+      syncIO(1, aw->fd, aw->blocks + aw->cur * AIO_BLOCK, aw->fill, aw->off) != aw->fill )
+  {
+    fprintf(stderr, "\n");
+    perror("pwrite()");
+    aw->err = ERROR;
+  }
+  if( aw->queued > 0LL )
+    lseek(aw->fd, (off_t)(aw->off + aw->fill), SEEK_SET);
+
+  closeRing(&aw->ring);
+  if( aw->dfd >= 0 )
+    close(aw->dfd);
+  free(aw->blocks);
+  err = aw->err;
+  memset(aw, 0, sizeof(aiowr_t));
+  aw->dfd = ERROR;
+
+  return err;
+}
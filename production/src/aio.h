@@ -0,0 +1,78 @@
+#ifndef AIO_H
+#define AIO_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define ERROR        -1         // Error code from failed functions
+
+#define AIO_NONE     0          // Query file is memory mapped, output written with writev()
+#define AIO_RING     1          // Query file read into buffers and output queued with io_uring
+#define AIO_DIRECT   2          // Same as AIO_RING with O_DIRECT, page cache is not used
+
+#define AIO_DEPTH    8          // Requests of a ring in flight
+#define AIO_BLOCK    (1LL<<20)  // Bytes per request, 1MB
+#define AIO_ALIGN    4096LL     // Alignment of buffers, offsets and sizes of direct I/O
+#ifndef MIN
+#define MIN(a,b)     ((a < b) ? a : b)
+#define MAX(a,b)     ((a > b) ? a : b)
+#endif
+
+// Submission and completion queues of io_uring, set up without liburing
+// Requests are done with pread() and pwrite() if io_uring is not available (fd is ERROR)
+typedef struct st_aioring
+{
+  int            fd;          // io_uring file descriptor, ERROR if requests are done synchronously
+  int            fixed;       // Flag for buffer registered with ring, requests use fixed buffer
+  unsigned       entries;     // Entries of submission queue
+  unsigned       inflight;    // Requests submitted and not completed
+  unsigned      *sqHead;      // Head of submission queue, moved by kernel
+  unsigned      *sqTail;      // Tail of submission queue
+  unsigned      *sqMask;      // Mask of submission queue indices
+  unsigned      *sqArray;     // Indices of submission queue entries
+  unsigned      *cqHead;      // Head of completion queue
+  unsigned      *cqTail;      // Tail of completion queue, moved by kernel
+  unsigned      *cqMask;      // Mask of completion queue indices
+  void          *sqes;        // Submission queue entries
+  void          *cqes;        // Completion queue entries
+  void          *sqMap;       // Mapped submission queue ring
+  void          *cqMap;       // Mapped completion queue ring
+  size_t         sqMapSz;     // Bytes of submission queue ring
+  size_t         cqMapSz;     // Bytes of completion queue ring
+  size_t         sqesSz;      // Bytes of submission queue entries
+} aioring_t;
+
+// Write-behind queue of output file
+// Data is copied to aligned blocks, full blocks are written while caller goes on, last partial block is written at close
+typedef struct st_aiowr
+{
+  aioring_t      ring;        // Ring of writes
+  int            fd;          // Output file descriptor
+  int            dfd;         // Output file opened for direct I/O, ERROR if writes go through page cache
+  int            cur;         // Block being filled
+  int            err;         // Error code of a failed write
+  long long int  off;         // Output file offset of block being filled
+  long long int  fill;        // Bytes of block being filled
+  long long int  queued;      // Bytes written or queued
+  char          *blocks;      // AIO_DEPTH blocks of AIO_BLOCK bytes
+  long long int  boff[AIO_DEPTH]; // Output file offset of each block being written
+  int            busy[AIO_DEPTH]; // Flag for blocks being written
+} aiowr_t;
+
+int openDirect(int, int);
+int openRing(aioring_t *, unsigned);
+int registerRing(aioring_t *, char *, long long int);
+long long int readRing(aioring_t *, int, char *, long long int, long long int);
+int closeRing(aioring_t *);
+int openAioWriter(aiowr_t *, int, int);
+int writeAio(aiowr_t *, const char *, long long int);
+int closeAioWriter(aiowr_t *);
+
+
+#endif
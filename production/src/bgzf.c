@@ -0,0 +1,512 @@
+#include "bgzf.h"
+
+
+// Get compression of data beginning at file offset of a file descriptor, from its gzip header
+// BGZF blocks are gzip members with a BC extra subfield holding block size
+// Sets header size and block size (0 if not BGZF)
+static int readHeader(int fd, long long int off, long long int *hsz, long long int *bsz)
+{
+  unsigned char hdr[GZ_HDRSZ + 256];   // gzip header with part of extra field
+  long long int n;                     // Bytes read
+  long long int xlen;                  // Length of extra field
+  long long int i;                     // Offset of current extra subfield
+
+  *hsz = 0LL;
+  *bsz = 0LL;
+  n = (long long int)pread(fd, hdr, sizeof(hdr), (off_t)off);
+  if( n < 2LL || hdr[0] != 0x1f || hdr[1] != 0x8b )
+    return COMP_NONE;
+
+  // No extra field (FEXTRA), plain gzip
+  if( n < GZ_HDRSZ || hdr[2] != 8 || (hdr[3] & 4) == 0 )
+    return COMP_GZIP;
+
+  // Find BC subfield in extra field
+  xlen = (long long int)hdr[10] | ((long long int)hdr[11] << 8);
+  for(i = GZ_HDRSZ; (i + 6LL) <= (GZ_HDRSZ + xlen) && (i + 6LL) <= n; i = i + 4LL + ((long long int)hdr[i+2] | ((long long int)hdr[i+3] << 8)))
+  {
+    if( hdr[i] == 'B' && hdr[i+1] == 'C' && hdr[i+2] == 2 && hdr[i+3] == 0 )
+    {
+      *hsz = GZ_HDRSZ + xlen;
+      *bsz = ((long long int)hdr[i+4] | ((long long int)hdr[i+5] << 8)) + 1LL;
+      return COMP_BGZF;
+    }
+  }
+
+  return COMP_GZIP;
+}
+
+
+// Get compression of data in a file descriptor
+int getCompression(int fd)
+{
+  long long int hsz;   // Header size
+  long long int bsz;   // Block size
+
+  return readHeader(fd, 0LL, &hsz, &bsz);
+}
+
+
+// Get compression of a file, COMP_NONE if it cannot be read
+int getFileCompression(const char *fn)
+{
+  int fd;     // File descriptor
+  int comp;   // Compression
+
+  fd = open(fn, O_RDONLY);
+  if( fd < 0 )
+    return COMP_NONE;
+  comp = getCompression(fd);
+  close(fd);
+
+  return comp;
+}
+
+
+// Get compressed and uncompressed size of BGZF block at file offset
+// Returns 1 at end of file, 0 if a block was found
+int getBlockSize(int fd, long long int off, long long int *hsz, long long int *csz, long long int *usz)
+{
+  unsigned char isz[4];   // Uncompressed size at end of block
+
+  if( readHeader(fd, off, hsz, csz) != COMP_BGZF )
+  {
+    // Nothing left to read at offset
+    if( pread(fd, isz, 1, (off_t)off) == 0 )
+      return 1;
+    fprintf(stdout, "\nError: invalid BGZF block at offset %lld\n", off);
+    return ERROR;
+  }
+
+  if( *csz < (*hsz + 8LL) || pread(fd, isz, 4, (off_t)(off + *csz - 4LL)) != 4 )
+  {
+    fprintf(stdout, "\nError: truncated BGZF block at offset %lld\n", off);
+    return ERROR;
+  }
+  *usz = (long long int)isz[0] | ((long long int)isz[1] << 8) | ((long long int)isz[2] << 16) | ((long long int)isz[3] << 24);
+
+  return 0;
+}
+
+
+// Compute partitions of a BGZF file with similar uncompressed sizes, aligned to blocks
+// Offset triplets are [i]=file offset of first block, [i+1]=0, [i+2]=uncompressed bytes of partition
+// Partitions are reduced if there are not enough blocks
+int computeBlockPartitions(long long int **offs, int *parts, int fd, long long int fsz)
+{
+  long long int *coffs;    // File offset of each block
+  long long int *uoffs;    // Uncompressed offset of each block
+  long long int nblocks;   // Number of blocks
+  long long int maxBlocks; // Number of blocks allocated
+  long long int off;       // File offset of current block
+  long long int total;     // Total uncompressed bytes
+  long long int hsz;       // Header size of current block
+  long long int csz;       // Compressed size of current block
+  long long int usz;       // Uncompressed size of current block
+  long long int b;         // First block of current partition
+  long long int prev;      // First block of previous partition
+  int lparts;              // Partitions computed
+  int err;                 // Trap errors
+  int i;                   // Iteration variable
+  void *p;                 // Reallocated memory
+
+  if( *parts < 1 )
+  {
+    fprintf(stdout, "Invalid values for partition offsets, check partition count or data size\n");
+    return ERROR;
+  }
+
+  // Read headers of all blocks, skip empty blocks (end-of-file marker)
+  maxBlocks = BLOCKS_INIT;
+  coffs = (long long int *)malloc(sizeof(long long int) * maxBlocks);
+  uoffs = (long long int *)malloc(sizeof(long long int) * maxBlocks);
+  if( coffs == NULL || uoffs == NULL )
+  {
+    free(coffs);
+    free(uoffs);
+    fprintf(stdout, "\nError: failed to allocate BGZF block list\n");
+    return ERROR;
+  }
+
+  nblocks = 0LL;
+  total = 0LL;
+  for(off = 0LL; off < fsz; off = off + csz)
+  {
+    err = getBlockSize(fd, off, &hsz, &csz, &usz);
+    if( err == 1 )
+      break;
+    if( err != 0 )
+    {
+      free(coffs);
+      free(uoffs);
+      return ERROR;
+    }
+    if( usz == 0LL )
+      continue;
+
+    if( nblocks == maxBlocks )
+    {
+      p = realloc(coffs, sizeof(long long int) * (size_t)(maxBlocks * 2LL));
+      if( p != NULL )
+        coffs = (long long int *)p;
+      p = (p != NULL) ? realloc(uoffs, sizeof(long long int) * (size_t)(maxBlocks * 2LL)) : NULL;
+      if( p == NULL )
+      {
+        free(coffs);
+        free(uoffs);
+        fprintf(stdout, "\nError: failed to grow BGZF block list\n");
+        return ERROR;
+      }
+      uoffs = (long long int *)p;
+      maxBlocks = maxBlocks * 2LL;
+    }
+    coffs[nblocks] = off;
+    uoffs[nblocks] = total;
+    nblocks++;
+    total = total + usz;
+  }
+
+  if( nblocks == 0LL )
+  {
+    free(coffs);
+    free(uoffs);
+    fprintf(stderr, "\nError: query file is empty\n");
+    return ERROR;
+  }
+
+  // Each partition begins at first block at or after its share of uncompressed data
+  lparts = (int)((*parts < nblocks) ? *parts : nblocks);
+  *offs = realloc(*offs, (lparts * 3) * sizeof(long long int));
+  prev = 0LL;
+  (*offs)[0] = coffs[0];
+  (*offs)[1] = 0LL;
+  for(i = 1; i < lparts; i++)
+  {
+    for(b = prev + 1LL; b < nblocks && uoffs[b] < (total / lparts) * i; b++);
+    if( b == nblocks )
+      break;
+
+    (*offs)[(i-1)*3+2] = uoffs[b] - uoffs[prev];
+    (*offs)[i*3] = coffs[b];
+    (*offs)[i*3+1] = 0LL;
+    prev = b;
+  }
+  (*offs)[(i-1)*3+2] = total - uoffs[prev];
+
+  if( i < *parts )
+    fprintf(stdout, "Warning: adjusted partitions to (%d) based on BGZF blocks\n", i);
+  *parts = i;
+
+  free(coffs);
+  free(uoffs);
+
+  return 0;
+}
+
+
+// Read next BGZF block into uncompressed block buffer
+static int loadBlock(zreader_t *rd)
+{
+  long long int hsz;   // Header size
+  long long int csz;   // Compressed size
+  long long int usz;   // Uncompressed size
+  unsigned long crc;   // CRC32 of block trailer
+  int err;             // Trap errors
+
+  err = getBlockSize(rd->fd, rd->coff, &hsz, &csz, &usz);
+  if( err == 1 )
+  {
+    rd->eof = 1;
+    return 0;
+  }
+  if( err != 0 || csz > BGZF_MAXBLK || usz > BGZF_MAXBLK )
+    return ERROR;
+
+  if( pread(rd->fd, rd->cbuf, (size_t)csz, (off_t)rd->coff) != (ssize_t)csz )
+  {
+    fprintf(stderr, "\n");
+    perror("pread()");
+    return ERROR;
+  }
+
+  // Raw deflate data lies between header and CRC32/ISIZE trailer
+  inflateReset(&rd->strm);
+  rd->strm.next_in = rd->cbuf + hsz;
+  rd->strm.avail_in = (uInt)(csz - hsz - 8LL);
+  rd->strm.next_out = rd->ubuf;
+  rd->strm.avail_out = (uInt)BGZF_MAXBLK;
+  if( inflate(&rd->strm, Z_FINISH) != Z_STREAM_END || (long long int)(BGZF_MAXBLK - rd->strm.avail_out) != usz )
+  {
+    fprintf(stdout, "\nError: failed to inflate BGZF block at offset %lld\n", rd->coff);
+    return ERROR;
+  }
+
+  // CRC32 of uncompressed data is first word of trailer, little endian
+  crc = (unsigned long)rd->cbuf[csz-8] | ((unsigned long)rd->cbuf[csz-7] << 8) | ((unsigned long)rd->cbuf[csz-6] << 16) | ((unsigned long)rd->cbuf[csz-5] << 24);
+  if( crc32(crc32(0L, Z_NULL, 0), rd->ubuf, (uInt)usz) != crc )
+  {
+    fprintf(stdout, "\nError: CRC32 mismatch of BGZF block at offset %lld\n", rd->coff);
+    return ERROR;
+  }
+
+  rd->ulen = usz;
+  rd->upos = 0LL;
+  rd->coff = rd->coff + csz;
+
+  return 0;
+}
+
+
+// Open a reader of query data
+// BGZF blocks are read beginning at file offset, until end of file
+int openReader(zreader_t *rd, int fd, int type, long long int off)
+{
+  memset(rd, 0, sizeof(zreader_t));
+
+  rd->type = type;
+  rd->fd = fd;
+  rd->coff = off;
+
+  // gzip stream closes its descriptor, use a copy of it
+  if( type == READ_GZ )
+  {
+    rd->gz = gzdopen(dup(fd), "rb");
+    if( rd->gz == NULL )
+    {
+      fprintf(stdout, "\nError: failed to open gzip stream\n");
+      return ERROR;
+    }
+    gzbuffer(rd->gz, (unsigned int)GZ_BUFSIZ);
+  }
+  else if( type == READ_BGZF )
+  {
+    rd->cbuf = (unsigned char *)malloc(sizeof(unsigned char) * BGZF_MAXBLK);
+    rd->ubuf = (unsigned char *)malloc(sizeof(unsigned char) * BGZF_MAXBLK);
+    if( rd->cbuf == NULL || rd->ubuf == NULL || inflateInit2(&rd->strm, -MAX_WBITS) != Z_OK )
+    {
+      free(rd->cbuf);
+      free(rd->ubuf);
+      rd->cbuf = NULL;
+      rd->ubuf = NULL;
+      fprintf(stdout, "\nError: failed to allocate BGZF reader\n");
+      return ERROR;
+    }
+  }
+
+  return 0;
+}
+
+
+// Read up to requested bytes of uncompressed data
+// Returns bytes read, 0 at end of data, ERROR on failure
+long long int readReader(zreader_t *rd, char *buf, long long int len)
+{
+  long long int done;   // Bytes read
+  long long int n;      // Bytes of current read
+  int errnum;           // zlib error code
+
+  if( rd->type == READ_GZ )
+  {
+    n = (long long int)gzread(rd->gz, buf, (unsigned int)((len < INT_MAX) ? len : INT_MAX));
+    if( n < 0LL )
+    {
+      fprintf(stdout, "\nError: failed to read gzip stream (%s)\n", gzerror(rd->gz, &errnum));
+      return ERROR;
+    }
+
+    // End of data is only valid after the trailer of last member, a truncated stream ends with Z_BUF_ERROR
+    if( n == 0LL && (gzerror(rd->gz, &errnum) == NULL || errnum != Z_OK) )
+    {
+      fprintf(stdout, "\nError: gzip stream is truncated or corrupt (%s)\n", gzerror(rd->gz, &errnum));
+      return ERROR;
+    }
+    return n;
+  }
+
+  if( rd->type == READ_BGZF )
+  {
+    for(done = 0LL; done < len; done = done + n)
+    {
+      if( rd->upos == rd->ulen )
+      {
+        if( rd->eof != 0 || loadBlock(rd) != 0 )
+          return (rd->eof != 0) ? done : ERROR;
+        if( rd->eof != 0 )
+          return done;
+      }
+      n = ((len - done) < (rd->ulen - rd->upos)) ? (len - done) : (rd->ulen - rd->upos);
+      memcpy(buf + done, rd->ubuf + rd->upos, (size_t)n);
+      rd->upos = rd->upos + n;
+    }
+    return done;
+  }
+
+  while( 1 )
+  {
+    n = (long long int)read(rd->fd, buf, (size_t)len);
+    if( n < 0LL && errno == EINTR )
+      continue;
+    if( n < 0LL )
+    {
+      fprintf(stderr, "\n");
+      perror("read()");
+      return ERROR;
+    }
+    return n;
+  }
+}
+
+
+// Close reader, file descriptor of source is not closed
+int closeReader(zreader_t *rd)
+{
+  if( rd->gz != NULL )
+    gzclose(rd->gz);
+  if( rd->cbuf != NULL )
+  {
+    inflateEnd(&rd->strm);
+    free(rd->cbuf);
+    free(rd->ubuf);
+  }
+  memset(rd, 0, sizeof(zreader_t));
+
+  return 0;
+}
+
+
+// Open a writer of BGZF blocks beginning at output file offset
+int openWriter(zwriter_t *zw, int fd, int level, long long int off)
+{
+  memset(zw, 0, sizeof(zwriter_t));
+
+  zw->fd = fd;
+  zw->off = off;
+  zw->ubuf = (unsigned char *)malloc(sizeof(unsigned char) * BGZF_MAXBLK);
+  zw->cbuf = (unsigned char *)malloc(sizeof(unsigned char) * BGZF_MAXBLK);
+  if( zw->ubuf == NULL || zw->cbuf == NULL || deflateInit2(&zw->strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+  {
+    free(zw->ubuf);
+    free(zw->cbuf);
+    memset(zw, 0, sizeof(zwriter_t));
+    fprintf(stdout, "\nError: failed to allocate BGZF writer\n");
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Compress pending uncompressed block and write it at output offset
+static int writeBlock(zwriter_t *zw)
+{
+  unsigned char *c;    // Compressed block
+  long long int csz;   // Compressed block size
+  long long int n;     // Bytes written by pwrite()
+  long long int done;  // Bytes of block written
+  uLong crc;           // CRC32 of uncompressed block
+
+  // Header with BC subfield, block size is filled in after compression
+  c = zw->cbuf;
+  memset(c, 0, BGZF_HDRSZ);
+  c[0] = 0x1f;
+  c[1] = 0x8b;
+  c[2] = 8;
+  c[3] = 4;
+  c[9] = 0xff;
+  c[10] = 6;
+  c[12] = 'B';
+  c[13] = 'C';
+  c[14] = 2;
+
+  deflateReset(&zw->strm);
+  zw->strm.next_in = zw->ubuf;
+  zw->strm.avail_in = (uInt)zw->ulen;
+  zw->strm.next_out = c + BGZF_HDRSZ;
+  zw->strm.avail_out = (uInt)(BGZF_MAXBLK - BGZF_HDRSZ - 8LL);
+  if( deflate(&zw->strm, Z_FINISH) != Z_STREAM_END )
+  {
+    fprintf(stdout, "\nError: failed to deflate BGZF block\n");
+    return ERROR;
+  }
+  csz = BGZF_HDRSZ + (long long int)zw->strm.total_out + 8LL;
+  c[16] = (unsigned char)((csz - 1LL) & 0xff);
+  c[17] = (unsigned char)((csz - 1LL) >> 8);
+
+  // Trailer with CRC32 and uncompressed size
+  crc = crc32(crc32(0L, Z_NULL, 0), zw->ubuf, (uInt)zw->ulen);
+  c = c + csz - 8LL;
+  c[0] = (unsigned char)(crc & 0xff);
+  c[1] = (unsigned char)((crc >> 8) & 0xff);
+  c[2] = (unsigned char)((crc >> 16) & 0xff);
+  c[3] = (unsigned char)((crc >> 24) & 0xff);
+  c[4] = (unsigned char)(zw->ulen & 0xff);
+  c[5] = (unsigned char)((zw->ulen >> 8) & 0xff);
+  c[6] = 0;
+  c[7] = 0;
+
+  for(done = 0LL; done < csz; done = done + n)
+  {
+    n = (long long int)pwrite(zw->fd, zw->cbuf + done, (size_t)(csz - done), (off_t)(zw->off + done));
+    if( n <= 0LL )
+    {
+      fprintf(stderr, "\n");
+      perror("pwrite()");
+      return ERROR;
+    }
+  }
+
+  zw->off = zw->off + csz;
+  zw->ulen = 0LL;
+  zw->blocks++;
+
+  return 0;
+}
+
+
+// Add data to BGZF output, full blocks are compressed and written
+int writeWriter(zwriter_t *zw, const char *data, long long int len)
+{
+  long long int n;   // Bytes added to current block
+
+  while( len > 0LL )
+  {
+    n = ((BGZF_BLKDATA - zw->ulen) < len) ? (BGZF_BLKDATA - zw->ulen) : len;
+    memcpy(zw->ubuf + zw->ulen, data, (size_t)n);
+    zw->ulen = zw->ulen + n;
+    data = data + n;
+    len = len - n;
+
+    if( zw->ulen == BGZF_BLKDATA && writeBlock(zw) != 0 )
+      return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Write pending partial block, and the empty end-of-file block if requested
+int flushWriter(zwriter_t *zw, int eofBlock)
+{
+  if( zw->ulen > 0LL && writeBlock(zw) != 0 )
+    return ERROR;
+
+  if( eofBlock != 0 && writeBlock(zw) != 0 )
+    return ERROR;
+
+  return 0;
+}
+
+
+// Close writer, output file descriptor is not closed
+int closeWriter(zwriter_t *zw)
+{
+  if( zw->ubuf != NULL )
+  {
+    deflateEnd(&zw->strm);
+    free(zw->ubuf);
+    free(zw->cbuf);
+  }
+  memset(zw, 0, sizeof(zwriter_t));
+
+  return 0;
+}
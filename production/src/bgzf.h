@@ -0,0 +1,75 @@
+#ifndef BGZF_H
+#define BGZF_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define ERROR        -1         // Error code from failed functions
+
+#define COMP_NONE    0          // Query file is not compressed
+#define COMP_GZIP    1          // Query file is a gzip stream, read sequentially
+#define COMP_BGZF    2          // Query file is BGZF (blocked gzip), blocks are read in parallel
+
+#define READ_FD      0          // Reader of uncompressed data from file descriptor
+#define READ_GZ      1          // Reader of gzip stream, uncompressed data is read transparently
+#define READ_BGZF    2          // Reader of consecutive BGZF blocks
+
+#define GZ_HDRSZ     12         // Size of gzip member header without extra field
+#define BGZF_HDRSZ   18         // Size of BGZF block header, including BC extra subfield
+#define BGZF_MAXBLK  (1LL<<16)  // Max size of a BGZF block, compressed or uncompressed, 64KB
+#define GZ_BUFSIZ    (1LL<<20)  // Size of zlib buffer for gzip streams, 1MB
+#define BLOCKS_INIT  4096LL     // Initial number of BGZF blocks allocated for partitioning
+#define BGZF_BLKDATA 0xff00LL   // Uncompressed bytes per written BGZF block, compressed block always fits in 64KB
+#define BGZF_LEVEL   Z_DEFAULT_COMPRESSION  // Compression level of written BGZF blocks
+
+// Sequential reader of query data
+// Data is read from a file descriptor, a gzip stream or a range of BGZF blocks
+typedef struct st_zreader
+{
+  int            type;        // Reader type (READ_FD, READ_GZ or READ_BGZF)
+  int            fd;          // File descriptor of source
+  int            eof;         // Flag for end of source
+  gzFile         gz;          // gzip stream (READ_GZ)
+  long long int  coff;        // File offset of next BGZF block
+  long long int  ulen;        // Bytes in uncompressed block
+  long long int  upos;        // Bytes of uncompressed block already read
+  unsigned char *cbuf;        // Compressed block
+  unsigned char *ubuf;        // Uncompressed block
+  z_stream       strm;        // Inflate state for BGZF blocks
+} zreader_t;
+
+// Writer of BGZF blocks
+// Each block is compressed independently, so output of writers can be concatenated
+typedef struct st_zwriter
+{
+  int            fd;          // Output file descriptor
+  long long int  off;         // Output file offset of next block
+  long long int  ulen;        // Bytes pending in uncompressed block
+  long long int  blocks;      // Number of blocks written
+  unsigned char *ubuf;        // Uncompressed block
+  unsigned char *cbuf;        // Compressed block
+  z_stream       strm;        // Deflate state
+} zwriter_t;
+
+int getCompression(int);
+int getFileCompression(const char *);
+int getBlockSize(int, long long int, long long int *, long long int *, long long int *);
+int computeBlockPartitions(long long int **, int *, int, long long int);
+int openReader(zreader_t *, int, int, long long int);
+long long int readReader(zreader_t *, char *, long long int);
+int closeReader(zreader_t *);
+int openWriter(zwriter_t *, int, int, long long int);
+int writeWriter(zwriter_t *, const char *, long long int);
+int flushWriter(zwriter_t *, int);
+int closeWriter(zwriter_t *);
+
+
+#endif
@@ -0,0 +1,269 @@
+#include "blast.h"
+
+// Names of query and hit ID columns in "# Fields:" line of tabular output with comments (-outfmt 7)
+static const char *queryCols[] = {"query id", "query acc.ver", "query acc.", "query gi", NULL};
+static const char *hitCols[] = {"subject id", "subject acc.ver", "subject acc.", "subject gi", NULL};
+
+
+// Check if character ends a word of tabular output or an ID of XML text
+static int isBlastDelim(char c)
+{
+  return (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+}
+
+
+// Length of first word of p up to end
+static long long int wordLen(const char *p, const char *end)
+{
+  const char *q;
+
+  for(q = p; q < end && !isBlastDelim(*q); q++);
+
+  return (long long int)(q - p);
+}
+
+
+// Check if p ('<') begins element of name, up to end
+static int isTag(const char *p, const char *end, const char *name)
+{
+  long long int len = (long long int)strlen(name);
+
+  return ((end - p) > len + 1 && strncmp(p + 1, name, (size_t)len) == 0 && p[len+1] == '>');
+}
+
+
+// Text of element beginning at p ('<') with tag of len characters, up to next tag
+static const char *tagText(blastrd_t *rd, const char *p, long long int len, const char **te)
+{
+  const char *text;
+
+  text = p + len + 2;
+  *te = (const char *)memchr(text, '<', (size_t)(rd->end - text));
+  if( *te == NULL )
+    *te = rd->end;
+  rd->p = *te;
+
+  return text;
+}
+
+
+// Index of column name in list of names, ERROR if it is not in list
+static int findColumn(const char **names, const char *p, long long int len)
+{
+  int i;
+
+  for(i = 0; names[i] != NULL; i++)
+    if( (long long int)strlen(names[i]) == len && strncmp(names[i], p, len) == 0 )
+      return i;
+
+  return ERROR;
+}
+
+
+// Find columns of query and hit IDs in "# Fields:" line, from p up to eol
+static void parseFields(blastrd_t *rd, const char *p, const char *eol)
+{
+  int col;              // Current column
+  long long int len;    // Length of current name
+  const char *next;     // End of current name
+
+  rd->qcol = ERROR;
+  rd->hcol = ERROR;
+  for(col = 0; p < eol; col++)
+  {
+    while( p < eol && *p == ' ' )
+      p++;
+    next = (const char *)memchr(p, ',', (size_t)(eol - p));
+    if( next == NULL )
+      next = eol;
+    for(len = (long long int)(next - p); len > 0LL && isBlastDelim(p[len-1]); len--);
+
+    if( rd->qcol == ERROR && findColumn(queryCols, p, len) != ERROR )
+      rd->qcol = col;
+    else if( rd->hcol == ERROR && findColumn(hitCols, p, len) != ERROR )
+      rd->hcol = col;
+    p = next + 1;
+  }
+
+  // Without both columns, IDs are first two words as in tables without comments
+  if( rd->qcol == ERROR || rd->hcol == ERROR )
+  {
+    rd->qcol = 0;
+    rd->hcol = 1;
+  }
+  rd->byCols = (rd->qcol != 0 || rd->hcol != 1);
+}
+
+
+// Start reading a BLAST output, format is found from its first character
+int openBlastReader(blastrd_t *rd, const char *buf, long long int len)
+{
+  const char *p;
+
+  memset(rd, 0, sizeof(blastrd_t));
+  rd->p = buf;
+  rd->end = buf + len;
+  rd->qcol = 0;
+  rd->hcol = 1;
+
+  // XML begins with a declaration or its root element
+  for(p = buf; p < rd->end && isBlastDelim(*p); p++);
+  rd->format = (p < rd->end && *p == '<') ? BLAST_XML : BLAST_TAB;
+
+  return 0;
+}
+
+
+// Next pair of tabular output
+// Comment and empty lines are skipped, columns of IDs are taken from "# Fields:" line if present
+static int nextTabPair(blastrd_t *rd, const char **qid, long long int *qlen, const char **hid, long long int *hlen)
+{
+  int col;              // Current column
+  const char *p;        // Beginning of current line
+  const char *eol;      // End of current line
+  const char *w;        // Current word or column
+
+  while( rd->p < rd->end )
+  {
+    p = rd->p;
+    eol = (const char *)memchr(p, '\n', (size_t)(rd->end - p));
+    if( eol == NULL )
+      eol = rd->end;
+    rd->p = eol + 1;
+    rd->line++;
+
+    if( *p == '#' )
+    {
+      if( (eol - p) > 9 && strncmp(p, "# Fields:", 9) == 0 )
+        parseFields(rd, p + 9, eol);
+      continue;
+    }
+    for(w = p; w < eol && isBlastDelim(*w); w++);
+    if( w == eol )
+      continue;
+
+    // Query and hit IDs are first two words
+    if( rd->byCols == 0 )
+    {
+      *qid = w;
+      *qlen = wordLen(w, eol);
+      for(w = w + *qlen; w < eol && isBlastDelim(*w); w++);
+      if( w == eol )
+      {
+        fprintf(stdout, "\nError: could not find hit ID in line %lld of BLAST table\n", rd->line);
+        return ERROR;
+      }
+      *hid = w;
+      *hlen = wordLen(w, eol);
+      return 1;
+    }
+
+    // Query and hit IDs are first words of their tab separated columns
+    *qid = NULL;
+    *hid = NULL;
+    for(col = 0, w = p; w < eol && (*qid == NULL || *hid == NULL); col++)
+    {
+      if( col == rd->qcol )
+      {
+        *qid = w;
+        *qlen = wordLen(w, eol);
+      }
+      else if( col == rd->hcol )
+      {
+        *hid = w;
+        *hlen = wordLen(w, eol);
+      }
+      w = (const char *)memchr(w, '\t', (size_t)(eol - w));
+      w = (w != NULL) ? w + 1 : eol;
+    }
+    if( *qid == NULL || *hid == NULL || *qlen == 0LL || *hlen == 0LL )
+    {
+      fprintf(stdout, "\nError: could not find query and hit IDs in line %lld of BLAST table\n", rd->line);
+      return ERROR;
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
+
+// Next pair of XML output
+// Query ID is first word of Iteration_query-def, hit ID is Hit_id, or first word of Hit_def for databases without parsed IDs
+static int nextXMLPair(blastrd_t *rd, const char **qid, long long int *qlen, const char **hid, long long int *hlen)
+{
+  const char *p;        // Current tag
+  const char *text;     // Text of current element
+  const char *te;       // End of text of current element
+
+  while( rd->p < rd->end )
+  {
+    p = (const char *)memchr(rd->p, '<', (size_t)(rd->end - rd->p));
+    if( p == NULL )
+      break;
+    rd->p = p + 1;
+
+    // Only elements of iterations and hits are read
+    if( (rd->end - p) < 8 || (p[1] != 'I' && p[1] != 'H') )
+      continue;
+
+    if( isTag(p, rd->end, "Hit_id") )
+    {
+      text = tagText(rd, p, 6LL, &te);
+      if( (te - text) >= (long long int)strlen(BLAST_ORDID) && strncmp(text, BLAST_ORDID, strlen(BLAST_ORDID)) == 0 )
+      {
+        rd->ordId = 1;
+        continue;
+      }
+      rd->ordId = 0;
+    }
+    else if( rd->ordId != 0 && isTag(p, rd->end, "Hit_def") )
+    {
+      text = tagText(rd, p, 7LL, &te);
+      rd->ordId = 0;
+    }
+    else
+    {
+      if( isTag(p, rd->end, "Iteration_query-ID") )
+      {
+        text = tagText(rd, p, 18LL, &te);
+        rd->qid = text;
+        rd->qlen = wordLen(text, te);
+      }
+      else if( isTag(p, rd->end, "Iteration_query-def") )
+      {
+        text = tagText(rd, p, 19LL, &te);
+        if( (te - text) != (long long int)strlen(BLAST_NODEF) || strncmp(text, BLAST_NODEF, strlen(BLAST_NODEF)) != 0 )
+        {
+          rd->qid = text;
+          rd->qlen = wordLen(text, te);
+        }
+      }
+      continue;
+    }
+    *hid = text;
+    *hlen = wordLen(text, te);
+
+    if( rd->qid == NULL || rd->qlen == 0LL || *hlen == 0LL )
+    {
+      fprintf(stdout, "\nError: hit without query or hit ID in BLAST XML\n");
+      return ERROR;
+    }
+    *qid = rd->qid;
+    *qlen = rd->qlen;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+// Get next query and hit ID pair
+// Returns 1 if a pair was read, 0 at end of output, ERROR if output is not valid
+int nextBlastPair(blastrd_t *rd, const char **qid, long long int *qlen, const char **hid, long long int *hlen)
+{
+  if( rd->format == BLAST_XML )
+    return nextXMLPair(rd, qid, qlen, hid, hlen);
+
+  return nextTabPair(rd, qid, qlen, hid, hlen);
+}
@@ -0,0 +1,37 @@
+#ifndef BLAST_H
+#define BLAST_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERROR       -1         // Error code from failed functions
+
+#define BLAST_TAB    0         // Tabular output (-outfmt 6 or 7), a line per hit
+#define BLAST_XML    1         // XML output (-outfmt 5)
+
+#define BLAST_NODEF  "No definition line"   // Query definition of BLAST XML when query has none
+#define BLAST_ORDID  "gnl|BL_ORD_ID|"       // Prefix of hit IDs of databases without parsed IDs, real ID is in Hit_def
+
+// Streaming reader of query and hit ID pairs of a BLAST output in memory
+// Pairs point into data of output, nothing is copied, XML is read tag by tag without building a tree
+typedef struct st_blastrd
+{
+  const char    *p;           // Current position
+  const char    *end;         // End of data
+  int            format;      // BLAST_TAB or BLAST_XML
+  int            qcol;        // Column of query ID in tabular output
+  int            hcol;        // Column of hit ID in tabular output
+  int            byCols;      // Flag for tab separated columns given by a "# Fields:" line, otherwise IDs are first two words
+  const char    *qid;         // Query ID of current XML iteration, Iteration_query-ID if query has no definition
+  long long int  qlen;        // Length of query ID of current XML iteration
+  int            ordId;       // Flag for hit ID of current XML hit taken from its definition
+  long long int  line;        // Current line of tabular output, for error messages
+} blastrd_t;
+
+int openBlastReader(blastrd_t *, const char *, long long int);
+int nextBlastPair(blastrd_t *, const char **, long long int *, const char **, long long int *);
+
+
+#endif
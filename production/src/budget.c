@@ -0,0 +1,237 @@
+// MADV_HUGEPAGE is a Linux extension
+#define _GNU_SOURCE
+#include "budget.h"
+#include <sys/mman.h>
+
+
+// Parse a size of bytes with an optional suffix (K, M, G, KB, MB, GB, case insensitive)
+// Returns bytes or ERROR if size is not valid
+long long int parseSize(const char *s)
+{
+  char *end;                 // End of number
+  long long int n;           // Number of size
+  long long int multiplier;  // Multiplier of suffix
+
+  errno = 0;
+  n = strtoll(s, &end, 10);
+  if( end == s || n < 1LL || errno == ERANGE )
+    return ERROR;
+
+  switch( toupper((int)*end) )
+  {
+    case '\0': multiplier = 1LL; break;
+    case 'K':  multiplier = (1LL<<10); break;
+    case 'M':  multiplier = (1LL<<20); break;
+    case 'G':  multiplier = (1LL<<30); break;
+    default:   return ERROR;
+  }
+  if( *end != '\0' )
+  {
+    end++;
+    if( toupper((int)*end) == 'B' )
+      end++;
+    if( *end != '\0' )
+      return ERROR;
+  }
+
+  // Size does not fit in bytes
+  if( n > LLONG_MAX / multiplier )
+    return ERROR;
+
+  return n * multiplier;
+}
+
+
+// Read limit of a cgroup file, "max" is no limit
+// Returns bytes, 0 if there is no limit or file cannot be read
+static long long int readLimit(const char *path)
+{
+  FILE *fd;              // Limit file
+  char line[64];         // Content of limit file
+  long long int n;       // Limit
+
+  fd = fopen(path, "r");
+  if( fd == NULL )
+    return 0LL;
+  n = 0LL;
+  if( fgets(line, sizeof(line), fd) != NULL && strncmp(line, "max", 3) != 0 )
+    n = strtoll(line, NULL, 10);
+  fclose(fd);
+
+  return (n > 0LL) ? n : 0LL;
+}
+
+
+// Find path of cgroup of current process, unified hierarchy (v2) or memory controller (v1)
+// Returns 0 if path was found
+static int cgroupPath(int v2, char *path, size_t sz)
+{
+  FILE *fd;              // Cgroups of current process
+  char line[512];        // Current line, "id:controllers:path"
+  char *ctl;             // Controllers of line
+  char *p;               // Path of line
+  int found;             // Flag for cgroup found
+
+  fd = fopen(CGROUP_FILE, "r");
+  if( fd == NULL )
+    return ERROR;
+
+  found = 0;
+  while( found == 0 && fgets(line, sizeof(line), fd) != NULL )
+  {
+    ctl = strchr(line, ':');
+    p = (ctl != NULL) ? strchr(ctl + 1, ':') : NULL;
+    if( p == NULL )
+      continue;
+    *p = '\0';
+    p++;
+    p[strcspn(p, "\n")] = '\0';
+    ctl++;
+
+    if( (v2 != 0 && *ctl == '\0') || (v2 == 0 && strstr(ctl, "memory") != NULL) )
+    {
+      snprintf(path, sz, "%s", p);
+      found = 1;
+    }
+  }
+  fclose(fd);
+
+  return (found != 0) ? 0 : ERROR;
+}
+
+
+// Memory limit of node for current process
+// Limit of cgroup of process (v2, then v1), or physical memory if there is no lower limit
+long long int getMemoryLimit()
+{
+  char cg[256];          // Path of cgroup
+  char path[512];        // Limit file
+  long long int phys;    // Bytes of physical memory
+  long long int limit;   // Limit of cgroup
+
+  phys = (long long int)sysconf(_SC_PHYS_PAGES) * (long long int)sysconf(_SC_PAGESIZE);
+
+  // Limit of own cgroup, or of root of cgroup namespace
+  limit = 0LL;
+  if( cgroupPath(1, cg, sizeof(cg)) == 0 )
+  {
+    snprintf(path, sizeof(path), "%s%s/memory.max", CGROUP_V2, cg);
+    limit = readLimit(path);
+  }
+  if( limit == 0LL )
+    limit = readLimit(CGROUP_V2 "/memory.max");
+  if( limit == 0LL && cgroupPath(0, cg, sizeof(cg)) == 0 )
+  {
+    snprintf(path, sizeof(path), "%s%s/memory.limit_in_bytes", CGROUP_V1, cg);
+    limit = readLimit(path);
+  }
+  if( limit == 0LL )
+    limit = readLimit(CGROUP_V1 "/memory.limit_in_bytes");
+
+  // Memory controller v1 reports no limit as a page aligned LLONG_MAX
+  if( limit == 0LL || (phys > 0LL && limit > phys) )
+    limit = phys;
+
+  return limit;
+}
+
+
+// Check if transparent huge pages can be requested for buffers
+static int hugePagesAvailable()
+{
+  FILE *fd;              // Setting of transparent huge pages
+  char line[128];        // Content of setting, selected value in brackets
+  int huge;              // Flag for huge pages available
+
+  fd = fopen(THP_FILE, "r");
+  if( fd == NULL )
+    return 0;
+  huge = (fgets(line, sizeof(line), fd) != NULL && strstr(line, "[never]") == NULL);
+  fclose(fd);
+
+  return huge;
+}
+
+
+// Set budget of current process, total is budget of processes of node (nlocal), or BUDGET_AUTO
+// Budget is shared by threads of current process
+int initBudget(budget_t *b, long long int total, int threads, int nlocal)
+{
+  b->threads = (threads > 0) ? threads : 1;
+  b->depth = 2;
+  b->huge = hugePagesAvailable();
+  b->total = 0LL;
+  b->hits = 0LL;
+  b->limit = 0LL;
+  b->warned = 0;
+  if( total == 0LL )
+    return 0;
+
+  b->limit = getMemoryLimit();
+  if( total == BUDGET_AUTO )
+    total = b->limit;
+  if( total <= 0LL )
+    return ERROR;
+
+  b->total = total / ((nlocal > 0) ? nlocal : 1);
+  b->hits = (long long int)((double)b->total * BUDGET_HITS);
+
+  return fitBudget(b, 0LL);
+}
+
+
+// Size windows, prefetch depth and buffers with budget left after hit tables kept in memory (hitBytes)
+// Windows of too small a budget keep their minimum size, without prefetch, budget is then exceeded
+int fitBudget(budget_t *b, long long int hitBytes)
+{
+  long long int avail;   // Bytes of budget of current process for windows and buffers
+  long long int share;   // Bytes of a thread
+  long long int w;       // Bytes of windows of a thread
+  long long int used;    // Bytes of windows and buffers of all threads
+
+  if( b->total == 0LL )
+    return 0;
+
+  avail = b->total - BUDGET_RESERVE - ((hitBytes < b->hits) ? hitBytes : b->hits);
+  if( avail < 0LL )
+    avail = 0LL;
+  share = avail / b->threads;
+
+  b->outBuf = share / 16LL;
+  b->outBuf = (b->outBuf < OUTBUF_MIN) ? OUTBUF_MIN : ((b->outBuf > OUTBUF_MAX) ? OUTBUF_MAX : b->outBuf);
+
+  w = (long long int)((double)share * BUDGET_WINDOWS);
+  b->depth = (w >= 2LL * WINDOW_MIN) ? 2 : 1;
+  w = w / b->depth;
+  w = (w < WINDOW_MIN) ? WINDOW_MIN : ((w > WINDOW_MAX) ? WINDOW_MAX : w);
+  b->window = w - (w % HUGE_PAGE);
+  b->streamBuf = b->window;
+
+  // Minimum window and buffer sizes override budget
+  used = (long long int)b->threads * (b->depth * b->window + b->outBuf);
+  if( used > avail && b->warned == 0 )
+  {
+    fprintf(stdout, "Warning: memory budget of %lld bytes exceeded by %lld bytes, minimum window is %lld bytes and output buffer %lld bytes per thread\n",
+            b->total, used - avail, WINDOW_MIN, OUTBUF_MIN);
+    b->warned = 1;
+  }
+
+  return 0;
+}
+
+
+// Allocate a page aligned buffer, backed by transparent huge pages if huge is set
+// Buffer is released with free()
+void *allocBuffer(long long int sz, int huge)
+{
+  void *p;               // Aligned memory
+  long long int align;   // Alignment of buffer
+
+  align = (huge != 0 && sz >= HUGE_PAGE) ? HUGE_PAGE : (long long int)sysconf(_SC_PAGESIZE);
+  if( posix_memalign(&p, (size_t)align, (size_t)sz) != 0 )
+    return NULL;
+  if( align == HUGE_PAGE )
+    madvise(p, (size_t)sz, MADV_HUGEPAGE);
+
+  return p;
+}
@@ -0,0 +1,53 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define ERROR          -1         // Error code from failed functions
+
+#define BUDGET_AUTO    -1LL       // Budget is memory limit of cgroup of node, or its physical memory
+#define BUDGET_RESERVE (1LL<<26)  // Bytes of budget kept for MPI, stacks and code, 64MB
+#define BUDGET_HITS    0.5        // Share of budget of a process for hit tables kept in memory
+#define BUDGET_WINDOWS 0.75       // Share of memory of a thread for query file windows, rest is for output batches
+#define WINDOW_MIN     (1LL<<22)  // Smallest query file window, 4MB
+#define WINDOW_MAX     (1LL<<30)  // Largest query file window, 1GB
+#define OUTBUF_MIN     (1LL<<16)  // Smallest output stream buffer, 64KB
+#define OUTBUF_MAX     (1LL<<24)  // Largest output stream buffer, 16MB
+#define HUGE_PAGE      (1LL<<21)  // Size of a transparent huge page, 2MB
+
+#define CGROUP_FILE    "/proc/self/cgroup"             // Cgroups of current process
+#define CGROUP_V2      "/sys/fs/cgroup"                // Mount of unified cgroup hierarchy, limit in memory.max
+#define CGROUP_V1      "/sys/fs/cgroup/memory"         // Mount of memory controller, limit in memory.limit_in_bytes
+#define THP_FILE       "/sys/kernel/mm/transparent_hugepage/enabled"
+
+// Memory budget of current process
+// Sizes are set by caller to compile-time defaults, they are replaced only if a budget is set
+typedef struct st_budget
+{
+  long long int  total;       // Bytes of budget of current process, 0 = no budget
+  long long int  limit;       // Bytes of memory limit of node, cgroup limit or physical memory
+  long long int  hits;        // Bytes of hit tables kept in memory, larger tables are spilled to a file, 0 = no limit
+  long long int  window;      // Bytes of a query file window
+  long long int  streamBuf;   // Bytes of initial buffer of query file read as a stream
+  long long int  outBuf;      // Bytes of output stream buffers
+  int            depth;       // Windows of a thread, 2 = next window is loaded while current one is parsed
+  int            threads;     // Threads of current process sharing budget
+  int            huge;        // Flag for transparent huge pages backing window buffers
+  int            warned;      // Flag for budget below minimum sizes already reported
+} budget_t;
+
+long long int parseSize(const char *);
+long long int getMemoryLimit();
+int initBudget(budget_t *, long long int, int, int);
+int fitBudget(budget_t *, long long int);
+void *allocBuffer(long long int, int);
+
+
+#endif
@@ -0,0 +1,301 @@
+#include "cache.h"
+
+
+// Add an entry to result cache
+static int addEntry(cache_t *c, long long int id, long long int off, long long int len)
+{
+  long long int *tmp;
+
+  if( c->nents == c->maxEnts )
+  {
+    tmp = (long long int *)realloc(c->ents, sizeof(long long int) * 3 * (c->maxEnts * 2 + CACHE_INIT));
+    if( tmp == NULL )
+      return ERROR;
+    c->ents = tmp;
+    c->maxEnts = c->maxEnts * 2 + CACHE_INIT;
+  }
+  c->ents[c->nents*3] = id;
+  c->ents[c->nents*3+1] = off;
+  c->ents[c->nents*3+2] = len;
+  c->nents++;
+
+  return 0;
+}
+
+
+// Compare records by offset, then by length
+static int compareSpans(const void *a, const void *b)
+{
+  const long long int *x = (const long long int *)a;
+  const long long int *y = (const long long int *)b;
+
+  if( x[0] != y[0] )
+    return (x[0] < y[0]) ? -1 : 1;
+  if( x[1] != y[1] )
+    return (x[1] < y[1]) ? -1 : 1;
+
+  return 0;
+}
+
+
+// Open result cache of query file (qfd, qfsz), its fingerprint is checked as offset index
+// A missing cache, or a cache of a different query file, is empty
+int openCache(const char *fn, int qfd, long long int qfsz, cache_t *c)
+{
+  FILE *fd;                       // Result cache file
+  char line[CACHE_LINE];          // Current line
+  char magic[16];                 // First word of cache
+  char *len;                      // Record length of line
+  char *off;                      // Record offset of line
+  long long int hdr[4];           // Size, mtime, checksum and entries of cache
+  long long int id;               // Index of hit ID of line
+  int err;                        // Trap errors
+  struct stat stbuf;
+
+  memset(c, 0, sizeof(cache_t));
+  fstat(qfd, &stbuf);
+  c->qfsz = qfsz;
+  c->mtime = (long long int)stbuf.st_mtime;
+  c->checksum = getFileChecksum(qfd, qfsz);
+  if( c->checksum == ERROR || initIDTable(&c->ids, 0LL, 0LL) != 0 )
+    return ERROR;
+
+  fd = fopen(fn, "r");
+  if( fd == NULL )
+    return 0;
+
+  if( fgets(line, sizeof(line), fd) == NULL || sscanf(line, "%15s\t%lld\t%lld\t%lld\t%lld", magic, &hdr[0], &hdr[1], &hdr[2], &hdr[3]) != 5 || strcmp(magic, CACHE_MAGIC) != 0 )
+  {
+    fprintf(stdout, "Warning: %s is not a result cache, it is rewritten\n", fn);
+    fclose(fd);
+    return 0;
+  }
+  if( hdr[0] != c->qfsz || hdr[1] != c->mtime || hdr[2] != c->checksum )
+  {
+    fprintf(stdout, "Warning: result cache %s is of a different query file, it is rewritten\n", fn);
+    fclose(fd);
+    return 0;
+  }
+
+  // Hit IDs may have tabs, offset and length are last fields of line
+  err = 0;
+  while( err == 0 && fgets(line, sizeof(line), fd) != NULL )
+  {
+    line[strcspn(line, "\n")] = '\0';
+    len = strrchr(line, '\t');
+    if( len == NULL )
+      continue;
+    *len = '\0';
+    off = strrchr(line, '\t');
+    if( off == NULL || off == line )
+      continue;
+    *off = '\0';
+
+    id = addID(&c->ids, line, (long long int)(off - line), NULL);
+    if( id == ERROR || addEntry(c, id, strtoll(off + 1, NULL, 10), strtoll(len + 1, NULL, 10)) != 0 )
+      err = ERROR;
+  }
+  fclose(fd);
+  if( err == 0 && c->nents != hdr[3] )
+  {
+    fprintf(stdout, "Warning: result cache %s is truncated, it is rewritten\n", fn);
+    freeIDTable(&c->ids);
+    free(c->ents);
+    c->ents = NULL;
+    c->nents = c->maxEnts = 0LL;
+    return initIDTable(&c->ids, 0LL, 0LL);
+  }
+
+  return err;
+}
+
+
+// Split current hit IDs into IDs of cache and IDs not in cache (delta)
+// Records of cached hit IDs are kept in order of query file, records of several hit IDs once
+int splitCache(cache_t *c, idtable_t *hitIDs)
+{
+  long long int i;                // Iteration variable
+  long long int n;                // Number of distinct records
+  long long int id;               // Index of hit ID in cache
+  unsigned char *used;            // Flag of each hit ID of cache that is a current hit ID
+
+  c->delta = (unsigned char *)calloc((size_t)hitIDs->nids + 1, sizeof(unsigned char));
+  used = (unsigned char *)calloc((size_t)c->ids.nids + 1, sizeof(unsigned char));
+  if( c->delta == NULL || used == NULL )
+  {
+    free(used);
+    return ERROR;
+  }
+
+  c->ndelta = 0LL;
+  for(i = 0LL; i < hitIDs->nids; i++)
+  {
+    id = findID(&c->ids, getID(hitIDs, i), getIDLen(hitIDs, i));
+    if( id == ERROR )
+    {
+      c->delta[i] = 1;
+      c->ndelta++;
+    }
+    else
+      used[id] = 1;
+  }
+
+  // Hit IDs not found in query file have no record
+  c->spans = (long long int *)malloc(sizeof(long long int) * 2 * (c->nents + 1));
+  if( c->spans == NULL )
+  {
+    free(used);
+    return ERROR;
+  }
+  c->nspans = 0LL;
+  for(i = 0LL; i < c->nents; i++)
+  {
+    if( used[c->ents[i*3]] == 0 || c->ents[i*3+1] == ERROR )
+      continue;
+    c->spans[c->nspans*2] = c->ents[i*3+1];
+    c->spans[c->nspans*2+1] = c->ents[i*3+2];
+    c->nspans++;
+  }
+  free(used);
+
+  qsort(c->spans, (size_t)c->nspans, sizeof(long long int) * 2, compareSpans);
+  for(i = 0LL, n = 0LL; i < c->nspans; i++)
+  {
+    if( n > 0LL && c->spans[(n-1)*2] == c->spans[i*2] )
+    {
+      c->spans[(n-1)*2+1] = c->spans[i*2+1];
+      continue;
+    }
+    c->spans[n*2] = c->spans[i*2];
+    c->spans[n*2+1] = c->spans[i*2+1];
+    n++;
+  }
+  c->nspans = n;
+
+  return 0;
+}
+
+
+// Record a record of query file (off, len) matched by hit IDs (ids) of current run
+// Only hit IDs not in cache are recorded, threads record their records one at a time
+int addCachePairs(cache_t *c, const long long int *ids, long long int n, long long int off, long long int len)
+{
+  int err;                        // Trap errors
+  long long int i;                // Iteration variable
+  long long int *tmp;
+
+  err = 0;
+  #pragma omp critical(cache)
+  {
+    for(i = 0LL; i < n && err == 0; i++)
+    {
+      if( c->delta[ids[i]] == 0 )
+        continue;
+
+      if( c->npairs == c->maxPairs )
+      {
+        tmp = (long long int *)realloc(c->pairs, sizeof(long long int) * 3 * (c->maxPairs * 2 + CACHE_INIT));
+        if( tmp == NULL )
+        {
+          err = ERROR;
+          break;
+        }
+        c->pairs = tmp;
+        c->maxPairs = c->maxPairs * 2 + CACHE_INIT;
+      }
+      c->pairs[c->npairs*3] = ids[i];
+      c->pairs[c->npairs*3+1] = off;
+      c->pairs[c->npairs*3+2] = len;
+      c->npairs++;
+    }
+  }
+
+  return err;
+}
+
+
+// Write result cache with entries of previous runs and records of hit IDs not in cache (pairs of all processes)
+// Hit IDs not in cache without records are written as not found, only if whole query file was searched (complete)
+int writeCache(const char *fn, cache_t *c, idtable_t *hitIDs, const long long int *pairs, long long int npairs, int complete)
+{
+  FILE *fd;                       // Result cache file
+  char tmpname[CACHE_LINE];       // Result cache while it is written
+  long long int i;                // Iteration variable
+  long long int nents;            // Number of entries written
+  unsigned char *found;           // Flag of each hit ID not in cache with a record
+  long long int *sorted;          // Pairs sorted by hit ID and record, a record of a hit ID once
+
+  found = (unsigned char *)calloc((size_t)hitIDs->nids + 1, sizeof(unsigned char));
+  sorted = (long long int *)malloc(sizeof(long long int) * 3 * (npairs + 1));
+  if( found == NULL || sorted == NULL )
+  {
+    free(found);
+    free(sorted);
+    return ERROR;
+  }
+  memcpy(sorted, pairs, sizeof(long long int) * 3 * npairs);
+  qsort(sorted, (size_t)npairs, sizeof(long long int) * 3, compareSpans);
+
+  // Number of entries is in header, it is counted first
+  nents = c->nents;
+  for(i = 0LL; i < npairs; i++)
+  {
+    if( i > 0LL && sorted[i*3] == sorted[(i-1)*3] && sorted[i*3+1] == sorted[(i-1)*3+1] )
+      continue;
+    found[sorted[i*3]] = 1;
+    nents++;
+  }
+  for(i = 0LL; i < hitIDs->nids && complete != 0; i++)
+    if( c->delta[i] != 0 && found[i] == 0 )
+      nents++;
+
+  snprintf(tmpname, sizeof(tmpname), "%s%s", fn, CACHE_TMP);
+  fd = fopen(tmpname, "w");
+  if( fd == NULL )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    free(found);
+    free(sorted);
+    return ERROR;
+  }
+
+  fprintf(fd, "%s\t%lld\t%lld\t%lld\t%lld\n", CACHE_MAGIC, c->qfsz, c->mtime, c->checksum, nents);
+  for(i = 0LL; i < c->nents; i++)
+    fprintf(fd, "%s\t%lld\t%lld\n", getID(&c->ids, c->ents[i*3]), c->ents[i*3+1], c->ents[i*3+2]);
+  for(i = 0LL; i < npairs; i++)
+  {
+    if( i > 0LL && sorted[i*3] == sorted[(i-1)*3] && sorted[i*3+1] == sorted[(i-1)*3+1] )
+      continue;
+    fprintf(fd, "%s\t%lld\t%lld\n", getID(hitIDs, sorted[i*3]), sorted[i*3+1], sorted[i*3+2]);
+  }
+  for(i = 0LL; i < hitIDs->nids && complete != 0; i++)
+    if( c->delta[i] != 0 && found[i] == 0 )
+      fprintf(fd, "%s\t%d\t0\n", getID(hitIDs, i), ERROR);
+  free(found);
+  free(sorted);
+
+  // Previous cache is replaced once new one is complete
+  if( fclose(fd) != 0 || rename(tmpname, fn) != 0 )
+  {
+    fprintf(stderr, "\nError: failed writing result cache %s\n", fn);
+    unlink(tmpname);
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Free result cache
+int freeCache(cache_t *c)
+{
+  freeIDTable(&c->ids);
+  free(c->ents);
+  free(c->spans);
+  free(c->delta);
+  free(c->pairs);
+  memset(c, 0, sizeof(cache_t));
+
+  return 0;
+}
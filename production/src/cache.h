@@ -0,0 +1,51 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "idtable.h"
+#include "ffindex.h"
+
+#define ERROR         -1          // Error code from failed functions
+
+#define CACHE_MAGIC   "#FFCACHE01" // First word of result cache
+#define CACHE_TMP     ".tmp"      // Suffix of result cache while it is written, renamed when complete
+#define CACHE_INIT    1024LL      // Initial number of entries allocated
+#define CACHE_LINE    4096        // Max length of a line of result cache
+
+// Result cache of a query file, records matched by each hit ID of previous runs
+// Line "CACHE_MAGIC <bytes> <mtime> <checksum> <entries>" is followed by a line "<hit ID> <offset> <length>" per record of a hit ID, tab separated
+// A hit ID not found in query file has a single line with offset ERROR
+typedef struct st_cache
+{
+  long long int  qfsz;        // Size of query file
+  long long int  mtime;       // Modification time of query file
+  long long int  checksum;    // Checksum of query file, same as offset index
+  idtable_t      ids;         // Hit IDs of cache
+  long long int  nents;       // Number of entries
+  long long int  maxEnts;     // Number of entries allocated
+  long long int *ents;        // Triplets [ID index, record offset, record length] of entries
+  long long int  nspans;      // Number of cached records of current hit IDs
+  long long int *spans;       // Pairs [record offset, record length] of cached records of current hit IDs, in order of query file
+  unsigned char *delta;       // Flag of each current hit ID not in cache
+  long long int  ndelta;      // Number of current hit IDs not in cache
+  int            update;      // Flag for recording records of hit IDs not in cache
+  long long int  npairs;      // Number of records recorded
+  long long int  maxPairs;    // Number of records allocated
+  long long int *pairs;       // Triplets [hit ID index, record offset, record length] recorded for hit IDs not in cache
+} cache_t;
+
+int openCache(const char *, int, long long int, cache_t *);
+int splitCache(cache_t *, idtable_t *);
+int addCachePairs(cache_t *, const long long int *, long long int, long long int, long long int);
+int writeCache(const char *, cache_t *, idtable_t *, const long long int *, long long int, int);
+int freeCache(cache_t *);
+
+
+#endif
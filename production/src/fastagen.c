@@ -0,0 +1,474 @@
+// source code for fastagen program.
+//
+// fastagen writes a synthetic FASTA query file, and optionally a BLAST table file in tabular form and a search file, for benchmarking filterfasta.
+// Output depends only on the command line options, the same seed always produces the same files.
+//
+// Headers have the shape of NCBI nr headers (">gi|#|ref|XP_#.1| description [organism]"), several annotations of a header are joined by "^A" (start of heading = 1).
+// Hit IDs of BLAST table are annotation IDs of random records, any annotation of a header can be a hit.
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Header Files                                  //
+////////////////////////////////////////////////////////////////////////////////
+
+#include "fastagen.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Defines and Types                             //
+////////////////////////////////////////////////////////////////////////////////
+
+static const char residues[] = "ACDEFGHIKLMNPQRSTVWY";   // Amino acids of sequences
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Utility Functions                             //
+////////////////////////////////////////////////////////////////////////////////
+
+// Display help message
+static int displayGenHelp()
+{
+  fprintf(stdout, "\n");
+  fprintf(stdout, "Usage: fastagen -o OUTFILE [-h] [-t BLASTTABLE] [-s SEARCHFILE] [-r RECORDS] [-l MINLEN:MAXLEN] [-d DIST] [-k ANNOTS] [-w WIDTH] [-q QUERIES] [-n HITS] [-x SEED]\n\n");
+  fprintf(stdout, "-o, --output=OUTFILE    output FASTA file\n");
+  fprintf(stdout, "-h, --help              display this help menu\n");
+  fprintf(stdout, "-t, --table=BLASTTABLE  output BLAST results file in tabular form\n");
+  fprintf(stdout, "-s, --search=SEARCHFILE output search file, hit IDs of BLAST table\n");
+  fprintf(stdout, "-r, --records=RECORDS   number of records (default %lld)\n", GEN_RECORDS);
+  fprintf(stdout, "-l, --length=MINLEN:MAXLEN  range length of sequences (default %lld:%lld)\n", GEN_MINLEN, GEN_MAXLEN);
+  fprintf(stdout, "-d, --dist=DIST         length distribution (0 = uniform, 1 = lognormal, default %d)\n", GEN_DIST);
+  fprintf(stdout, "-k, --annots=ANNOTS     max annotations per header joined by ^A (1 to %d, default %d)\n", ANNOT_LIMIT, GEN_ANNOTS);
+  fprintf(stdout, "-w, --width=WIDTH       residues per line of sequences (0 = single line, default %d)\n", GEN_WIDTH);
+  fprintf(stdout, "-q, --queries=QUERIES   query IDs of BLAST table (default %lld)\n", GEN_QUERIES);
+  fprintf(stdout, "-n, --hits=HITS         hit IDs per query ID of BLAST table (default %lld)\n", GEN_HITS);
+  fprintf(stdout, "-x, --seed=SEED         seed of random generator (default %lld)\n", GEN_SEED);
+  fprintf(stdout, "\n");
+  exit(0);
+
+  return 0;
+}
+
+
+// Parse and validate command line options
+int parseGenCmdline(int argc, char **argv, genargs_t *args)
+{
+  char *token;               // Used to parse range lengths
+  int opt;                   // Current command line option in form of char
+  int optIdx;                // Index of current command line option
+  int ret = 0;               // Trap errors
+  long long int testOpt;     // Used to validate command line options
+
+  const struct option longOpts[] =
+   {
+     {"help",    no_argument,       NULL, 'h'},
+     {"output",  required_argument, NULL, 'o'},
+     {"table",   required_argument, NULL, 't'},
+     {"search",  required_argument, NULL, 's'},
+     {"records", required_argument, NULL, 'r'},
+     {"length",  required_argument, NULL, 'l'},
+     {"dist",    required_argument, NULL, 'd'},
+     {"annots",  required_argument, NULL, 'k'},
+     {"width",   required_argument, NULL, 'w'},
+     {"queries", required_argument, NULL, 'q'},
+     {"hits",    required_argument, NULL, 'n'},
+     {"seed",    required_argument, NULL, 'x'},
+
+     // The last element has to be filled with zeros
+     {0, 0, 0, 0}
+   };
+
+  // Set default values to genargs_t structure
+  memset(args, 0, sizeof(genargs_t));
+  args->nrecs = GEN_RECORDS;
+  args->minLen = GEN_MINLEN;
+  args->maxLen = GEN_MAXLEN;
+  args->dist = GEN_DIST;
+  args->annots = GEN_ANNOTS;
+  args->width = GEN_WIDTH;
+  args->nqueries = GEN_QUERIES;
+  args->nhits = GEN_HITS;
+  args->seed = (unsigned long long int)GEN_SEED;
+
+  // Iterate through all the command line arguments
+  optIdx = 0;
+  while( 1 )
+  {
+    opt = getopt_long(argc, argv, ":o:t:s:r:l:d:k:w:q:n:x:h", longOpts, &optIdx);
+    if( opt == -1 ) break;
+
+    // If '=' at beginning of argument, ignore it
+    if( optarg != NULL && *optarg == '=' ) optarg++;
+
+    switch( opt )
+    {
+      case 'h':	// help option
+          displayGenHelp();
+          break;
+
+      case 'o':	// output FASTA file
+          strncpy(args->of, optarg, FILE_LEN - 1);
+          break;
+
+      case 't':	// output BLAST table file
+          strncpy(args->tf, optarg, FILE_LEN - 1);
+          break;
+
+      case 's':	// output search file
+          strncpy(args->sf, optarg, FILE_LEN - 1);
+          break;
+
+      case 'r':	// number of records
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 1LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid number of records = %lld (records has to be 1 or greater)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->nrecs = testOpt;
+          break;
+
+      case 'l':	// range length of sequences
+          token = strchr(optarg, ':');
+          if( token == NULL )
+          {
+            fprintf(stderr, "\nConfig error: invalid range length format = %s (MINLEN:MAXLEN)\n", optarg);
+            ret = ERROR;
+            break;
+          }
+          args->minLen = strtoll(optarg, NULL, 10);
+          args->maxLen = strtoll(token + 1, NULL, 10);
+          if( args->minLen < 1LL || args->maxLen < args->minLen )
+          {
+            fprintf(stderr, "\nConfig error: invalid range length values = %s (1 <= MINLEN <= MAXLEN)\n", optarg);
+            ret = ERROR;
+          }
+          break;
+
+      case 'd':	// length distribution
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > 1LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid length distribution = %lld (0 = UNIFORM, 1 = LOGNORMAL)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->dist = (int)testOpt;
+          break;
+
+      case 'k':	// max annotations per header
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 1LL || testOpt > ANNOT_LIMIT )
+          {
+            fprintf(stderr, "\nConfig error: invalid annotations per header = %lld (1 to %d)\n", testOpt, ANNOT_LIMIT);
+            ret = ERROR;
+            break;
+          }
+          args->annots = (int)testOpt;
+          break;
+
+      case 'w':	// residues per line
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > INT_MAX )
+          {
+            fprintf(stderr, "\nConfig error: invalid line width = %lld (width has to be 0 or greater)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->width = (int)testOpt;
+          break;
+
+      case 'q':	// query IDs of BLAST table
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 1LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid number of query IDs = %lld (queries has to be 1 or greater)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->nqueries = testOpt;
+          break;
+
+      case 'n':	// hit IDs per query ID
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 1LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid number of hit IDs = %lld (hits has to be 1 or greater)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->nhits = testOpt;
+          break;
+
+      case 'x':	// seed of random generator
+          args->seed = strtoull(optarg, NULL, 10);
+          break;
+
+      case ':': // missing option argument
+          fprintf(stderr, "\nConfig error: missing option argument (%c)\n", optopt);
+          ret = ERROR;
+          break;
+
+      default: // unknown option
+          fprintf(stderr, "\nConfig error: unknown option (%c)\n", optopt);
+          ret = ERROR;
+          break;
+    }
+  }
+
+  // Check that an output FASTA file was provided
+  if( strlen(args->of) == 0 )
+  {
+    fprintf(stderr, "\nConfig error: missing output file\n");
+    ret = ERROR;
+  }
+
+  // A search file holds hit IDs of BLAST table
+  if( strlen(args->sf) != 0 && args->nqueries * args->nhits > args->nrecs * args->annots * 16LL )
+    fprintf(stdout, "\nWarning: most hit IDs are repeated, records are fewer than hits\n");
+
+  return ret;
+}
+
+
+// Next value of random generator (splitmix64)
+// Same sequence of values in every platform, unlike rand()
+unsigned long long int nextRandom(unsigned long long int *state)
+{
+  unsigned long long int z;
+
+  *state = *state + 0x9E3779B97F4A7C15ULL;
+  z = *state;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+  return z ^ (z >> 31);
+}
+
+
+// Random value between begin and end, both included
+long long int randomRange(unsigned long long int *state, long long int begin, long long int end)
+{
+  return begin + (long long int)(nextRandom(state) % (unsigned long long int)(end - begin + 1LL));
+}
+
+
+// Random length of a sequence
+// Lognormal lengths have median at geometric mean of range, range covers 3 standard deviations each side
+long long int randomLength(genargs_t *args, unsigned long long int *state)
+{
+  double u1;       // Uniform values for Box-Muller transform
+  double u2;
+  double mu;       // Mean of logarithm of lengths
+  double sigma;    // Standard deviation of logarithm of lengths
+  long long int len;
+
+  if( args->dist == 0 || args->minLen == args->maxLen )
+    return randomRange(state, args->minLen, args->maxLen);
+
+  u1 = ((double)(nextRandom(state) >> 11) + 1.0) / 9007199254740993.0;
+  u2 = (double)(nextRandom(state) >> 11) / 9007199254740992.0;
+  mu = (log((double)args->minLen) + log((double)args->maxLen)) / 2.0;
+  sigma = (log((double)args->maxLen) - log((double)args->minLen)) / 6.0;
+  len = (long long int)llround(exp(mu + sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2)));
+
+  return MIN(MAX(len, args->minLen), args->maxLen);
+}
+
+
+// Format annotation ID of an annotation of a record, "gi|#|ref|XP_#.1|"
+// Returns length of annotation ID
+int formatAnnotID(char *buf, size_t len, long long int rec, int annot)
+{
+  long long int id;   // Number of annotation
+
+  id = GI_BASE + rec * ANNOT_LIMIT + annot;
+
+  return snprintf(buf, len, "gi|%lld|ref|XP_%09lld.1|", id, id);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Generator Functions                           //
+////////////////////////////////////////////////////////////////////////////////
+
+// Write records of FASTA file
+// Number of annotations of each record is kept for choosing hit IDs
+int writeFastaFile(genargs_t *args, unsigned char *nannots)
+{
+  char id[64];                 // Current annotation ID
+  char *line;                  // Residues of current line
+  int a;                       // Current annotation
+  long long int r;             // Current record
+  long long int len;           // Length of current sequence
+  long long int i;             // Residues written of current sequence
+  long long int n;             // Residues of current line
+  long long int width;         // Residues per line
+  long long int bytes;         // Bytes written
+  unsigned long long int state; // State of random generator
+  FILE *fd;
+
+  fd = fopen(args->of, "wb");
+  if( fd == NULL )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    return ERROR;
+  }
+  setvbuf(fd, NULL, _IOFBF, GEN_BUFSIZ);
+
+  width = (args->width > 0) ? args->width : args->maxLen;
+  line = (char *)malloc(sizeof(char) * (width + 1));
+  if( line == NULL )
+  {
+    fprintf(stderr, "\nError: failed to allocate line buffer\n");
+    fclose(fd);
+    return ERROR;
+  }
+
+  state = args->seed;
+  bytes = 0LL;
+  for(r = 0LL; r < args->nrecs; r++)
+  {
+    // Header, annotations are joined by "^A"
+    nannots[r] = (unsigned char)randomRange(&state, 1LL, args->annots);
+    for(a = 0; a < nannots[r]; a++)
+    {
+      formatAnnotID(id, sizeof(id), r, a);
+      bytes = bytes + fprintf(fd, "%c%s synthetic protein %lld.%d [Synthetic organism %lld]", (a == 0) ? '>' : 1, id, r, a, randomRange(&state, 1LL, 1000LL));
+    }
+    bytes = bytes + (fputc('\n', fd) != EOF);
+
+    // Sequence, wrapped in lines of width residues
+    len = randomLength(args, &state);
+    for(i = 0LL; i < len; i = i + n)
+    {
+      n = MIN(width, len - i);
+      for(a = 0; a < n; a++)
+        line[a] = residues[nextRandom(&state) % (sizeof(residues) - 1)];
+      line[n] = '\n';
+      bytes = bytes + (long long int)fwrite(line, sizeof(char), n + 1, fd);
+    }
+  }
+
+  free(line);
+  if( fclose(fd) != 0 )
+  {
+    perror("fclose()");
+    return ERROR;
+  }
+
+  fprintf(stdout, "FASTA file = %s (%lld records, %lld bytes)\n", args->of, args->nrecs, bytes);
+
+  return 0;
+}
+
+
+// Write BLAST table with hit IDs of random records, and search file with same hit IDs
+// First hit of each query ID is its own record, as BLAST reports it
+int writeHitFiles(genargs_t *args, unsigned char *nannots)
+{
+  char qid[64];                // Current query ID
+  char hid[64];                // Current hit ID
+  long long int q;             // Current query ID
+  long long int h;             // Current hit ID
+  long long int qrec;          // Record of current query ID
+  long long int hrec;          // Record of current hit ID
+  long long int alen;          // Alignment length
+  unsigned long long int state; // State of random generator
+  FILE *tfd;                   // BLAST table file
+  FILE *sfd;                   // Search file
+
+  tfd = NULL;
+  sfd = NULL;
+  if( strlen(args->tf) != 0 )
+    tfd = fopen(args->tf, "wb");
+  if( strlen(args->sf) != 0 )
+    sfd = fopen(args->sf, "wb");
+  if( (strlen(args->tf) != 0 && tfd == NULL) || (strlen(args->sf) != 0 && sfd == NULL) )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    if( tfd != NULL )
+      fclose(tfd);
+    if( sfd != NULL )
+      fclose(sfd);
+    return ERROR;
+  }
+  if( tfd == NULL && sfd == NULL )
+    return 0;
+  if( tfd != NULL )
+    setvbuf(tfd, NULL, _IOFBF, GEN_BUFSIZ);
+  if( sfd != NULL )
+    setvbuf(sfd, NULL, _IOFBF, GEN_BUFSIZ);
+
+  // Hit IDs follow their own sequence of random values, FASTA file is the same with or without them
+  state = args->seed ^ 0x5DEECE66DULL;
+  for(q = 0LL; q < args->nqueries; q++)
+  {
+    qrec = randomRange(&state, 0LL, args->nrecs - 1LL);
+    formatAnnotID(qid, sizeof(qid), qrec, 0);
+    for(h = 0LL; h < args->nhits; h++)
+    {
+      hrec = (h == 0LL) ? qrec : randomRange(&state, 0LL, args->nrecs - 1LL);
+      formatAnnotID(hid, sizeof(hid), hrec, (h == 0LL) ? 0 : (int)randomRange(&state, 0LL, nannots[hrec] - 1LL));
+      alen = randomRange(&state, args->minLen, args->maxLen);
+      if( tfd != NULL )
+        fprintf(tfd, "%s\t%s\t%.2f\t%lld\t%lld\t%lld\t1\t%lld\t1\t%lld\t%.0e\t%4lld\n", qid, hid, (h == 0LL) ? 100.0 : (double)randomRange(&state, 2500LL, 9999LL) / 100.0,
+                alen, (h == 0LL) ? 0LL : randomRange(&state, 0LL, alen / 2LL), (h == 0LL) ? 0LL : randomRange(&state, 0LL, 5LL), alen, alen, pow(10.0, -(double)randomRange(&state, 5LL, 150LL)), randomRange(&state, 40LL, 2000LL));
+      if( sfd != NULL )
+        fprintf(sfd, "%s\n", hid);
+    }
+  }
+
+  if( tfd != NULL )
+  {
+    fclose(tfd);
+    fprintf(stdout, "BLAST table file = %s (%lld query IDs, %lld hits per query ID)\n", args->tf, args->nqueries, args->nhits);
+  }
+  if( sfd != NULL )
+  {
+    fclose(sfd);
+    fprintf(stdout, "Search file = %s (%lld hit IDs)\n", args->sf, args->nqueries * args->nhits);
+  }
+
+  return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Main Function                                 //
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  int err;                  // Trap errors
+  genargs_t args;           // Structure for command line options
+  unsigned char *nannots;   // Number of annotations of each record
+
+  err = parseGenCmdline(argc, argv, &args);
+  if( err != 0 )
+  {
+    fprintf(stderr, "Error: failed parsing command line options\n\n");
+    return ERROR;
+  }
+
+  nannots = (unsigned char *)malloc(sizeof(unsigned char) * args.nrecs);
+  if( nannots == NULL )
+  {
+    fprintf(stderr, "Error: failed to allocate annotation counts\n\n");
+    return ERROR;
+  }
+
+  err = writeFastaFile(&args, nannots);
+  if( err == 0 )
+    err = writeHitFiles(&args, nannots);
+  free(nannots);
+  if( err != 0 )
+  {
+    fprintf(stderr, "Error: failed writing output files\n\n");
+    return ERROR;
+  }
+
+  return 0;
+}
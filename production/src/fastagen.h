@@ -0,0 +1,61 @@
+#ifndef FASTAGEN_H
+#define FASTAGEN_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <limits.h>
+
+// Set default options
+#define GEN_RECORDS  100000LL   // Number of records of FASTA file
+#define GEN_MINLEN   50LL       // Min length of sequences
+#define GEN_MAXLEN   1000LL     // Max length of sequences
+#define GEN_DIST     1          // Length distribution, 0 = UNIFORM, 1 = LOGNORMAL
+#define GEN_ANNOTS   1          // Max number of annotations per header, joined by "^A"
+#define GEN_WIDTH    80         // Residues per line of sequences, 0 = single line
+#define GEN_QUERIES  100LL      // Number of query IDs of BLAST table
+#define GEN_HITS     50LL       // Number of hit IDs per query ID of BLAST table
+#define GEN_SEED     1LL        // Seed of random generator
+
+// Set internal configurations (Do not change)
+#define FILE_LEN     128        // Max length for filenames
+#define ERROR        -1         // Error code from failed functions
+#define ANNOT_LIMIT  255        // Max number of annotations per header
+#define GEN_BUFSIZ   (1LL<<22)  // Size of output stream buffers, 4MB
+#define GI_BASE      10000000LL // First gi number of annotation IDs
+#define MIN(a,b)     ((a < b) ? a : b)
+#define MAX(a,b)     ((a > b) ? a : b)
+#ifndef M_PI
+#define M_PI         3.14159265358979323846
+#endif
+
+// Structure for command line arguments
+typedef struct st_genargs
+{
+  char           of[FILE_LEN];  // Output FASTA file
+  char           tf[FILE_LEN];  // Output BLAST table file
+  char           sf[FILE_LEN];  // Output search file
+  long long int  nrecs;         // Number of records
+  long long int  minLen;        // Min length of sequences
+  long long int  maxLen;        // Max length of sequences
+  long long int  nqueries;      // Number of query IDs of BLAST table
+  long long int  nhits;         // Number of hit IDs per query ID
+  unsigned long long int seed;  // Seed of random generator
+  int            dist;          // Length distribution
+  int            annots;        // Max number of annotations per header
+  int            width;         // Residues per line of sequences
+} genargs_t;
+
+int parseGenCmdline(int, char **, genargs_t *);
+unsigned long long int nextRandom(unsigned long long int *);
+long long int randomRange(unsigned long long int *, long long int, long long int);
+long long int randomLength(genargs_t *, unsigned long long int *);
+int formatAnnotID(char *, size_t, long long int, int);
+int writeFastaFile(genargs_t *, unsigned char *);
+int writeHitFiles(genargs_t *, unsigned char *);
+
+
+#endif
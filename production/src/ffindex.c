@@ -0,0 +1,659 @@
+#include "ffindex.h"
+
+// String arena used by compareKeys(), qsort() has no context argument
+static const char *sortArena = NULL;
+
+
+// Check if character terminates an ID in annotations
+int isIDDelim(char c)
+{
+  return (c == ' ' || c == '\t' || c == '\n' || c == '\r' || (int)c == 1);
+}
+
+
+// Compare two IDs, shorter ID goes first if one is a prefix of the other
+static int compareIDs(const char *a, long long int aLen, const char *b, long long int bLen)
+{
+  int cmp;   // Result of comparison
+
+  cmp = memcmp(a, b, (size_t)((aLen < bLen) ? aLen : bLen));
+  if( cmp != 0 )
+    return cmp;
+  if( aLen < bLen )
+    return -1;
+  if( aLen > bLen )
+    return 1;
+
+  return 0;
+}
+
+
+// Compare two ID keys for sorting
+static int compareKeys(const void *a, const void *b)
+{
+  const idxkey_t *ka = (const idxkey_t *)a;
+  const idxkey_t *kb = (const idxkey_t *)b;
+  int cmp;
+
+  cmp = compareIDs(sortArena + ka->idOff, ka->idLen, sortArena + kb->idOff, kb->idLen);
+  if( cmp != 0 )
+    return cmp;
+
+  // Keep records in file order for equal IDs
+  return (ka->rec < kb->rec) ? -1 : (ka->rec > kb->rec);
+}
+
+
+// Compute checksum of file size and bytes at both ends of file
+long long int getFileChecksum(int fd, long long int fsz)
+{
+  char *buf;                       // Data read from file
+  long long int i;                 // Iteration variable
+  long long int sz;                // Bytes to read at each end
+  long long int off;               // Offsets of both ends
+  long long int n;                 // Bytes read
+  unsigned long long int hash;     // FNV-1a hash value
+
+  sz = (fsz < IDX_CHECKSZ) ? fsz : IDX_CHECKSZ;
+  buf = (char *)malloc(sizeof(char) * sz);
+  if( buf == NULL )
+    return ERROR;
+
+  hash = FNV_OFFSET;
+  for(i = 0LL; i < 8LL; i++)
+    hash = (hash ^ (unsigned char)(fsz >> (i * 8LL))) * FNV_PRIME;
+
+  for(off = 0LL; off <= (fsz - sz); off = off + ((fsz - sz) > 0LL ? (fsz - sz) : 1LL))
+  {
+    n = (long long int)pread(fd, buf, (size_t)sz, (off_t)off);
+    if( n != sz )
+    {
+      free(buf);
+      return ERROR;
+    }
+
+    for(i = 0LL; i < sz; i++)
+      hash = (hash ^ (unsigned char)buf[i]) * FNV_PRIME;
+  }
+  free(buf);
+
+  // Clear sign bit, negative values are reserved for errors
+  return (long long int)(hash >> 1);
+}
+
+
+// Write a complete block of data to file
+static int writeBlock(FILE *fd, const void *data, long long int sz)
+{
+  if( sz > 0LL && (long long int)fwrite(data, 1, (size_t)sz, fd) != sz )
+  {
+    fprintf(stderr, "\n");
+    perror("fwrite()");
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Grow an array to hold at least one more element
+static int growArray(void **arr, long long int *maxCnt, long long int cnt, size_t elemSz)
+{
+  void *p;   // Reallocated memory
+
+  if( cnt < *maxCnt )
+    return 0;
+
+  p = realloc(*arr, elemSz * (size_t)(*maxCnt * 2LL));
+  if( p == NULL )
+  {
+    fprintf(stdout, "\nError: failed to grow index arrays\n");
+    return ERROR;
+  }
+  *arr = p;
+  *maxCnt = *maxCnt * 2LL;
+
+  return 0;
+}
+
+
+// Write header and data blocks to a sidecar file of query file
+// Data is written to a temporary file that replaces the sidecar only when complete
+static int writeSidecar(char *qf, const char *suffix, idxhdr_t *hdr, const void **blocks, long long int *sizes, int nblocks)
+{
+  char outfile[FILENAME_MAX];     // Sidecar file
+  char tmpfile[FILENAME_MAX];     // Temporary sidecar file
+  int i;                          // Iteration variable
+  int err;                        // Trap errors
+  FILE *ofd;                      // Sidecar file stream
+
+  snprintf(outfile, FILENAME_MAX, "%s%s", qf, suffix);
+  snprintf(tmpfile, FILENAME_MAX, "%s%s.tmp", qf, suffix);
+
+  ofd = fopen(tmpfile, "wb");
+  if( ofd == NULL )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    return ERROR;
+  }
+
+  err = writeBlock(ofd, hdr, sizeof(idxhdr_t));
+  for(i = 0; i < nblocks && err == 0; i++)
+    err = writeBlock(ofd, blocks[i], sizes[i]);
+  if( fclose(ofd) != 0 )
+    err = ERROR;
+
+  if( err == 0 && rename(tmpfile, outfile) != 0 )
+  {
+    fprintf(stderr, "\n");
+    perror("rename()");
+    err = ERROR;
+  }
+  if( err != 0 )
+    remove(tmpfile);
+
+  return err;
+}
+
+
+// Map a sidecar file of query file and check that it matches query file
+// Sidecar is valid only if query file size, modification time, and checksum are unchanged
+// Returns mapped file or NULL if sidecar cannot be used
+static char *mapSidecar(char *qf, const char *suffix, const char *magic, long long int *mapSz)
+{
+  char infile[FILENAME_MAX];      // Sidecar file
+  char *map;                      // Mapped sidecar file
+  int fd;                         // File descriptor
+  idxhdr_t *hdr;                  // Sidecar header
+  struct stat stbuf;
+
+  snprintf(infile, FILENAME_MAX, "%s%s", qf, suffix);
+  fd = open(infile, O_RDONLY);
+  if( fd < 0 )
+    return NULL;
+
+  fstat(fd, &stbuf);
+  if( stbuf.st_size < (off_t)sizeof(idxhdr_t) )
+  {
+    close(fd);
+    return NULL;
+  }
+
+  *mapSz = (long long int)stbuf.st_size;
+  map = (char *)mmap(NULL, (size_t)*mapSz, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( map == MAP_FAILED )
+    return NULL;
+
+  hdr = (idxhdr_t *)map;
+  if( memcmp(hdr->magic, magic, sizeof(hdr->magic)) != 0 || hdr->version != IDX_VERSION )
+  {
+    munmap(map, (size_t)*mapSz);
+    return NULL;
+  }
+
+  // Check that query file has not changed since sidecar was built
+  fd = open(qf, O_RDONLY);
+  if( fd < 0 )
+  {
+    munmap(map, (size_t)*mapSz);
+    return NULL;
+  }
+  fstat(fd, &stbuf);
+  if( (long long int)stbuf.st_size != hdr->qfsz || (long long int)stbuf.st_mtime != hdr->mtime ||
+      getFileChecksum(fd, hdr->qfsz) != hdr->checksum )
+  {
+    close(fd);
+    munmap(map, (size_t)*mapSz);
+    return NULL;
+  }
+  close(fd);
+
+  return map;
+}
+
+
+// Encode an unsigned value as a varint, 7 bits per byte, low bits first
+// Returns number of bytes used
+static int putVarint(unsigned char *p, unsigned long long int v)
+{
+  int n;   // Bytes used
+
+  for(n = 0; v >= 0x80ULL; n++)
+  {
+    p[n] = (unsigned char)(v | 0x80ULL);
+    v = v >> 7;
+  }
+  p[n] = (unsigned char)v;
+
+  return n + 1;
+}
+
+
+// Decode a varint and move pointer past it
+// Returns 0 or ERROR if data ends before varint
+static int getVarint(const unsigned char **p, const unsigned char *end, long long int *v)
+{
+  unsigned long long int x;   // Decoded value
+  int shift;                  // Bits decoded
+
+  x = 0ULL;
+  for(shift = 0; *p < end && shift < 64; shift = shift + 7)
+  {
+    x = x | ((unsigned long long int)(**p & 0x7F) << shift);
+    if( (*(*p)++ & 0x80) == 0 )
+    {
+      *v = (long long int)x;
+      return 0;
+    }
+  }
+
+  return ERROR;
+}
+
+
+// Write length table of query file, one entry per record in file order
+// Offset of first record is followed by raw length (offset delta) and residue count of each record
+static int buildLengths(char *qf, idxhdr_t *idxhdr, idxrec_t *recs)
+{
+  unsigned char *data;            // Encoded table
+  long long int i;                // Iteration variable
+  long long int n;                // Bytes encoded
+  int err;                        // Trap errors
+  idxhdr_t hdr;                   // Length table header
+  const void *blocks[1];          // Data blocks written after header
+  long long int sizes[1];         // Size of data blocks
+
+  // Each varint uses at most 10 bytes
+  data = (unsigned char *)malloc(sizeof(unsigned char) * (size_t)((idxhdr->nrecs * 2LL + 1LL) * 10LL));
+  if( data == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate length table\n");
+    return ERROR;
+  }
+
+  n = putVarint(data, (unsigned long long int)((idxhdr->nrecs > 0LL) ? recs[0].off : 0LL));
+  for(i = 0LL; i < idxhdr->nrecs; i++)
+  {
+    n = n + putVarint(data + n, (unsigned long long int)recs[i].rlen);
+    n = n + putVarint(data + n, (unsigned long long int)recs[i].seqLen);
+  }
+
+  memcpy(&hdr, idxhdr, sizeof(idxhdr_t));
+  memcpy(hdr.magic, LEN_MAGIC, sizeof(hdr.magic));
+  hdr.nkeys = 0LL;
+  hdr.arenaLen = n;
+  blocks[0] = data;
+  sizes[0] = n;
+  err = writeSidecar(qf, LEN_SUFFIX, &hdr, blocks, sizes, 1);
+  if( err == 0 )
+    fprintf(stdout, "Length table = %s%s (%lld bytes)\n", qf, LEN_SUFFIX, (long long int)sizeof(idxhdr_t) + n);
+
+  free(data);
+
+  return err;
+}
+
+
+// Build offset index of query file and write it next to query file
+// Each record stores its offset, annotation length, raw length, and residue count
+// Every annotation ID (first one and those after '^A') is stored as a sorted key
+int buildIndex(char *qf)
+{
+  char *map;                      // Mapped query file
+  char *end;                      // End of mapped query file
+  char *last;                     // Last byte of query file, not parsed (same as memory maps)
+  char *p;                        // Current record
+  char *faq;                      // End of annotations
+  char *paq;                      // Start of current annotation
+  char *tok;                      // End of current ID
+  const char *stop;               // End of sequence data
+  int fd;                         // Query file descriptor
+  int err;                        // Trap errors
+  long long int maxRecs;          // Records allocated
+  long long int maxKeys;          // Keys allocated
+  long long int arenaSz;          // Bytes allocated in arena
+  long long int nl;               // Newlines in sequence data
+  idxhdr_t hdr;                   // Index header
+  idxrec_t *recs;                 // Records
+  idxkey_t *keys;                 // ID keys
+  char *arena;                    // ID string arena
+  void *q;                        // Reallocated memory
+  const void *blocks[3];          // Data blocks written after header
+  long long int sizes[3];         // Size of data blocks
+  struct stat stbuf;
+
+  fd = open(qf, O_RDONLY);
+  if( fd < 0 )
+  {
+    fprintf(stderr, "\n");
+    perror("open()");
+    return ERROR;
+  }
+
+  fstat(fd, &stbuf);
+  if( stbuf.st_size <= 0L )
+  {
+    fprintf(stderr, "\nError: query file is empty\n");
+    close(fd);
+    return ERROR;
+  }
+
+  memset(&hdr, 0, sizeof(idxhdr_t));
+  memcpy(hdr.magic, IDX_MAGIC, sizeof(hdr.magic));
+  hdr.version = IDX_VERSION;
+  hdr.qfsz = (long long int)stbuf.st_size;
+  hdr.mtime = (long long int)stbuf.st_mtime;
+  hdr.checksum = getFileChecksum(fd, hdr.qfsz);
+
+  // Index is built in a single sequential pass, no need to split in chunks
+  map = (char *)mmap(NULL, (size_t)hdr.qfsz, PROT_READ, MAP_PRIVATE, fd, 0);
+  if( map == MAP_FAILED )
+  {
+    fprintf(stderr, "\n");
+    perror("mmap()");
+    close(fd);
+    return ERROR;
+  }
+  posix_madvise(map, (size_t)hdr.qfsz, POSIX_MADV_SEQUENTIAL);
+  end = map + hdr.qfsz;
+  last = end - 1;
+
+  maxRecs = 1024LL;
+  maxKeys = 1024LL;
+  arenaSz = 1LL<<16;
+  recs = (idxrec_t *)malloc(sizeof(idxrec_t) * maxRecs);
+  keys = (idxkey_t *)malloc(sizeof(idxkey_t) * maxKeys);
+  arena = (char *)malloc(sizeof(char) * arenaSz);
+  if( recs == NULL || keys == NULL || arena == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate index arrays\n");
+    err = ERROR;
+    goto cleanup;
+  }
+
+  err = 0;
+  p = (char *)memchr(map, '>', (size_t)hdr.qfsz);
+  while( p != NULL )
+  {
+    if( growArray((void **)&recs, &maxRecs, hdr.nrecs, sizeof(idxrec_t)) != 0 )
+    {
+      err = ERROR;
+      break;
+    }
+
+    // Find end of annotations
+    faq = (char *)memchr(p + 1, '\n', (size_t)(end - (p + 1)));
+    if( faq == NULL )
+      faq = last;
+
+    // Add a key for every annotation
+    paq = p;
+    while( paq != NULL )
+    {
+      for(tok = paq + 1; tok < faq && !isIDDelim(*tok); tok++);
+
+      if( growArray((void **)&keys, &maxKeys, hdr.nkeys, sizeof(idxkey_t)) != 0 )
+      {
+        err = ERROR;
+        break;
+      }
+      while( (hdr.arenaLen + (tok - paq)) > arenaSz )
+      {
+        q = realloc(arena, (size_t)(arenaSz * 2LL));
+        if( q == NULL )
+        {
+          fprintf(stdout, "\nError: failed to grow index ID arena\n");
+          err = ERROR;
+          break;
+        }
+        arena = (char *)q;
+        arenaSz = arenaSz * 2LL;
+      }
+      if( err != 0 )
+        break;
+
+      keys[hdr.nkeys].idOff = hdr.arenaLen;
+      keys[hdr.nkeys].idLen = (long long int)(tok - (paq + 1));
+      keys[hdr.nkeys].rec = hdr.nrecs;
+      memcpy(arena + hdr.arenaLen, paq + 1, (size_t)keys[hdr.nkeys].idLen);
+      hdr.arenaLen = hdr.arenaLen + keys[hdr.nkeys].idLen;
+      hdr.nkeys++;
+
+      paq = (faq > paq + 1) ? (char *)memchr(paq + 1, 1, (size_t)(faq - (paq + 1))) : NULL;
+    }
+    if( err != 0 )
+      break;
+
+    // Count residues the same way as getSequence(), last byte of file is not parsed
+    recs[hdr.nrecs].off = (long long int)(p - map);
+    recs[hdr.nrecs].hlen = (long long int)(faq - p + 1);
+    recs[hdr.nrecs].seqLen = 0LL;
+    p = NULL;
+    if( (faq + 1) < last )
+    {
+      nl = scanSequence(faq + 1, last, &stop);
+      recs[hdr.nrecs].seqLen = (long long int)(stop - (faq + 1)) - nl;
+      if( stop != last )
+        p = (char *)stop;
+    }
+    recs[hdr.nrecs].rlen = (long long int)(((p != NULL) ? p : end) - map) - recs[hdr.nrecs].off;
+    hdr.nrecs++;
+  }
+
+  if( err == 0 )
+  {
+    // Sort keys for prefix searches
+    sortArena = arena;
+    qsort(keys, (size_t)hdr.nkeys, sizeof(idxkey_t), compareKeys);
+    sortArena = NULL;
+
+    blocks[0] = recs;
+    blocks[1] = keys;
+    blocks[2] = arena;
+    sizes[0] = (long long int)sizeof(idxrec_t) * hdr.nrecs;
+    sizes[1] = (long long int)sizeof(idxkey_t) * hdr.nkeys;
+    sizes[2] = hdr.arenaLen;
+    err = writeSidecar(qf, IDX_SUFFIX, &hdr, blocks, sizes, 3);
+  }
+
+  if( err == 0 )
+    fprintf(stdout, "Index file = %s%s (%lld records, %lld IDs)\n", qf, IDX_SUFFIX, hdr.nrecs, hdr.nkeys);
+
+  // Write length table of records
+  if( err == 0 )
+    err = buildLengths(qf, &hdr, recs);
+
+cleanup:
+  free(recs);
+  free(keys);
+  free(arena);
+  munmap(map, (size_t)hdr.qfsz);
+  close(fd);
+
+  return err;
+}
+
+
+// Open index file of query file and check that it matches query file
+// Returns 0 if index can be used, ERROR otherwise
+int openIndex(char *qf, ffindex_t *idx)
+{
+  idxhdr_t *hdr;                  // Index header
+
+  memset(idx, 0, sizeof(ffindex_t));
+  idx->map = mapSidecar(qf, IDX_SUFFIX, IDX_MAGIC, &idx->mapSz);
+  if( idx->map == NULL )
+    return ERROR;
+
+  // Check layout of index file
+  hdr = (idxhdr_t *)idx->map;
+  if( idx->mapSz != (long long int)(sizeof(idxhdr_t) + sizeof(idxrec_t) * hdr->nrecs + sizeof(idxkey_t) * hdr->nkeys) + hdr->arenaLen )
+  {
+    closeIndex(idx);
+    return ERROR;
+  }
+
+  idx->hdr = hdr;
+  idx->recs = (idxrec_t *)(idx->map + sizeof(idxhdr_t));
+  idx->keys = (idxkey_t *)((char *)idx->recs + sizeof(idxrec_t) * hdr->nrecs);
+  idx->arena = (char *)idx->keys + sizeof(idxkey_t) * hdr->nkeys;
+
+  return 0;
+}
+
+
+// Unmap index file
+int closeIndex(ffindex_t *idx)
+{
+  if( idx->map != NULL )
+    munmap(idx->map, (size_t)idx->mapSz);
+  memset(idx, 0, sizeof(ffindex_t));
+
+  return 0;
+}
+
+
+// Mark records that may have an annotation starting with hit ID
+// Marked records are a superset of the records matched by prefix comparison:
+//   if hit ID has no delimiter, it is a prefix of an annotation ID
+//   otherwise, part before first delimiter is equal to an annotation ID
+// Returns number of records marked
+long long int markIndexRecords(ffindex_t *idx, const char *id, long long int len, unsigned char *recMask)
+{
+  long long int lo;       // Lower bound of binary search
+  long long int hi;       // Upper bound of binary search
+  long long int mid;      // Middle of binary search
+  long long int tlen;     // Length of hit ID before first delimiter
+  long long int cnt;      // Records marked
+  int exact;              // Flag for exact comparison of IDs
+  idxkey_t *key;          // Current key
+
+  for(tlen = 0LL; tlen < len && !isIDDelim(id[tlen]); tlen++);
+  exact = (tlen < len);
+
+  // Find first key greater or equal than hit ID
+  lo = 0LL;
+  hi = idx->hdr->nkeys;
+  while( lo < hi )
+  {
+    mid = lo + (hi - lo) / 2LL;
+    key = &idx->keys[mid];
+    if( compareIDs(idx->arena + key->idOff, key->idLen, id, tlen) < 0 )
+      lo = mid + 1LL;
+    else
+      hi = mid;
+  }
+
+  cnt = 0LL;
+  for(; lo < idx->hdr->nkeys; lo++)
+  {
+    key = &idx->keys[lo];
+    if( key->idLen < tlen || memcmp(idx->arena + key->idOff, id, (size_t)tlen) != 0 )
+      break;
+    if( exact && key->idLen != tlen )
+      break;
+
+    recMask[key->rec >> 3] |= (unsigned char)(1 << (key->rec & 7LL));
+    cnt++;
+  }
+
+  return cnt;
+}
+
+
+// Find first record at or after file offset
+long long int findIndexOffset(ffindex_t *idx, long long int off)
+{
+  long long int lo;       // Lower bound of binary search
+  long long int hi;       // Upper bound of binary search
+  long long int mid;      // Middle of binary search
+
+  lo = 0LL;
+  hi = idx->hdr->nrecs;
+  while( lo < hi )
+  {
+    mid = lo + (hi - lo) / 2LL;
+    if( idx->recs[mid].off < off )
+      lo = mid + 1LL;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+
+// Open length table of query file and check that it matches query file
+// Returns 0 if table can be used, ERROR otherwise
+int openLengths(char *qf, fflens_t *lens)
+{
+  memset(lens, 0, sizeof(fflens_t));
+  lens->map = mapSidecar(qf, LEN_SUFFIX, LEN_MAGIC, &lens->mapSz);
+  if( lens->map == NULL )
+    return ERROR;
+
+  lens->hdr = (idxhdr_t *)lens->map;
+  if( lens->mapSz != (long long int)sizeof(idxhdr_t) + lens->hdr->arenaLen )
+  {
+    closeLengths(lens);
+    return ERROR;
+  }
+
+  lens->data = (unsigned char *)lens->map + sizeof(idxhdr_t);
+  rewindLengths(lens);
+
+  return 0;
+}
+
+
+// Restart decoding at first record
+int rewindLengths(fflens_t *lens)
+{
+  const unsigned char *p;   // Current position of decoder
+
+  p = lens->data;
+  lens->rec = 0LL;
+  lens->off = 0LL;
+  if( getVarint(&p, lens->data + lens->hdr->arenaLen, &lens->off) != 0 )
+    return ERROR;
+  lens->pos = (long long int)(p - lens->data);
+
+  return 0;
+}
+
+
+// Decode next record of length table
+// Returns 0 or ERROR if there are no more records
+int nextLength(fflens_t *lens, long long int *off, long long int *rlen, long long int *seqLen)
+{
+  const unsigned char *p;     // Current position of decoder
+  const unsigned char *end;   // End of encoded table
+
+  if( lens->rec >= lens->hdr->nrecs )
+    return ERROR;
+
+  p = lens->data + lens->pos;
+  end = lens->data + lens->hdr->arenaLen;
+  if( getVarint(&p, end, rlen) != 0 || getVarint(&p, end, seqLen) != 0 )
+    return ERROR;
+
+  *off = lens->off;
+  lens->off = lens->off + *rlen;
+  lens->pos = (long long int)(p - lens->data);
+  lens->rec++;
+
+  return 0;
+}
+
+
+// Unmap length table
+int closeLengths(fflens_t *lens)
+{
+  if( lens->map != NULL )
+    munmap(lens->map, (size_t)lens->mapSz);
+  memset(lens, 0, sizeof(fflens_t));
+
+  return 0;
+}
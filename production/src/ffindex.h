@@ -0,0 +1,93 @@
+#ifndef FFINDEX_H
+#define FFINDEX_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "idtable.h"
+#include "scan.h"
+
+#define IDX_SUFFIX    ".ffi"     // Suffix of index file, placed next to query file
+#define IDX_MAGIC     "FFIDX01"  // Magic string at beginning of index file
+#define LEN_SUFFIX    ".ffl"     // Suffix of length table file, placed next to query file
+#define LEN_MAGIC     "FFLEN01"  // Magic string at beginning of length table file
+#define IDX_VERSION   1LL        // Version of index and length table file layouts
+#define IDX_CHECKSZ   (1LL<<16)  // Bytes at each end of query file used for checksum, 64KB
+#define IDX_COALESCE  (1LL<<16)  // Records closer than this are read together, 64KB
+
+// Header of index and length table files
+// All fields are 8 bytes so the layout is the same on all 64-bit systems
+typedef struct st_idxhdr
+{
+  char           magic[8];    // IDX_MAGIC
+  long long int  version;     // IDX_VERSION
+  long long int  qfsz;        // Size of query file when index was built
+  long long int  mtime;       // Modification time of query file when index was built
+  long long int  checksum;    // Checksum of first and last IDX_CHECKSZ bytes of query file
+  long long int  nrecs;       // Number of records (sequences)
+  long long int  nkeys;       // Number of ID keys
+  long long int  arenaLen;    // Bytes in ID string arena (index) or encoded table (length table)
+} idxhdr_t;
+
+// Record entry, in query file order
+typedef struct st_idxrec
+{
+  long long int  off;         // Byte offset of '>' in query file
+  long long int  hlen;        // Length of annotations including '>' and newline
+  long long int  rlen;        // Raw length of record, up to next '>' or end of file
+  long long int  seqLen;      // Number of residues
+} idxrec_t;
+
+// ID key entry, sorted by ID
+// Every annotation of a record contributes one key (first one and those after '^A')
+typedef struct st_idxkey
+{
+  long long int  idOff;       // Offset of ID in string arena
+  long long int  idLen;       // Length of ID
+  long long int  rec;         // Index of record
+} idxkey_t;
+
+// Index loaded in memory
+typedef struct st_ffindex
+{
+  char          *map;         // Mapped index file
+  long long int  mapSz;       // Size of mapped index file
+  idxhdr_t      *hdr;         // Header
+  idxrec_t      *recs;        // Records
+  idxkey_t      *keys;        // Sorted ID keys
+  char          *arena;       // ID string arena
+} ffindex_t;
+
+// Length table loaded in memory, decoded sequentially
+// Encoded as varints: offset of first record, then raw length and residue count of each record
+typedef struct st_fflens
+{
+  char          *map;         // Mapped length table file
+  long long int  mapSz;       // Size of mapped length table file
+  idxhdr_t      *hdr;         // Header
+  unsigned char *data;        // Encoded table
+  long long int  pos;         // Position of decoder in encoded table
+  long long int  rec;         // Index of next record
+  long long int  off;         // Offset of next record
+} fflens_t;
+
+int isIDDelim(char);
+long long int getFileChecksum(int, long long int);
+int buildIndex(char *);
+int openIndex(char *, ffindex_t *);
+int closeIndex(ffindex_t *);
+long long int markIndexRecords(ffindex_t *, const char *, long long int, unsigned char *);
+long long int findIndexOffset(ffindex_t *, long long int);
+int openLengths(char *, fflens_t *);
+int rewindLengths(fflens_t *);
+int nextLength(fflens_t *, long long int *, long long int *, long long int *);
+int closeLengths(fflens_t *);
+
+
+#endif
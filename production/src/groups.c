@@ -0,0 +1,191 @@
+#include "groups.h"
+
+// Build groups of each hit ID from pairs of group and hit ID indices
+// Pairs are laid out as [i*2]=group, [i*2+1]=hit ID, repeated pairs are kept once
+int buildGroups(groups_t *groups, const long long int *pairs, long long int npairs, long long int ngroups, long long int nhits)
+{
+  long long int i;      // Iteration variable
+  long long int g;      // Current group
+  long long int h;      // Current hit ID
+  long long int m;      // Current member
+  long long int begin;  // Beginning of row of current hit ID before compaction
+  long long int end;    // End of row of current hit ID before compaction
+  long long int *pos;   // Next member of each hit ID
+  long long int *last;  // Last hit ID added to each group, plus 1
+
+  memset(groups, 0, sizeof(groups_t));
+  groups->ngroups = ngroups;
+  groups->nhits = nhits;
+  groups->maxRecs = GRECS_INIT;
+  groups->hitOffs = (long long int *)calloc(nhits + 1, sizeof(long long int));
+  groups->members = (long long int *)malloc(sizeof(long long int) * (npairs + 1));
+  groups->recOff = (long long int *)malloc(sizeof(long long int) * groups->maxRecs);
+  groups->recLen = (long long int *)malloc(sizeof(long long int) * groups->maxRecs);
+  groups->recHit = (long long int *)malloc(sizeof(long long int) * groups->maxRecs);
+  pos = (long long int *)malloc(sizeof(long long int) * (nhits + 1));
+  last = (long long int *)calloc(ngroups + 1, sizeof(long long int));
+  if( groups->hitOffs == NULL || groups->members == NULL || groups->recOff == NULL || groups->recLen == NULL || groups->recHit == NULL || pos == NULL || last == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate groups of hit IDs\n");
+    free(pos);
+    free(last);
+    freeGroups(groups);
+    return ERROR;
+  }
+
+  // Count groups of each hit ID, then place them in rows
+  for(i = 0LL; i < npairs; i++)
+    groups->hitOffs[pairs[i*2+1] + 1]++;
+  for(h = 0LL; h < nhits; h++)
+    groups->hitOffs[h + 1] = groups->hitOffs[h + 1] + groups->hitOffs[h];
+  memcpy(pos, groups->hitOffs, sizeof(long long int) * (nhits + 1));
+  for(i = 0LL; i < npairs; i++)
+    groups->members[pos[pairs[i*2+1]]++] = pairs[i*2];
+
+  // Remove repeated groups in each row, rows are compacted in place
+  i = 0LL;
+  begin = 0LL;
+  for(h = 0LL; h < nhits; h++)
+  {
+    end = groups->hitOffs[h + 1];
+    for(m = begin; m < end; m++)
+    {
+      g = groups->members[m];
+      if( last[g] == h + 1 )
+        continue;
+      last[g] = h + 1;
+      groups->members[i++] = g;
+    }
+    groups->hitOffs[h + 1] = i;
+    begin = end;
+  }
+  free(pos);
+  free(last);
+
+  return 0;
+}
+
+
+// Record a record extracted, its offset and bytes in output of current process
+int addGroupRecord(groups_t *groups, long long int off, long long int len, long long int hidx)
+{
+  void *p;   // Reallocated memory
+
+  if( groups->nrecs == groups->maxRecs )
+  {
+    p = realloc(groups->recOff, sizeof(long long int) * groups->maxRecs * 2LL);
+    if( p == NULL )
+      return ERROR;
+    groups->recOff = (long long int *)p;
+
+    p = realloc(groups->recLen, sizeof(long long int) * groups->maxRecs * 2LL);
+    if( p == NULL )
+      return ERROR;
+    groups->recLen = (long long int *)p;
+
+    p = realloc(groups->recHit, sizeof(long long int) * groups->maxRecs * 2LL);
+    if( p == NULL )
+      return ERROR;
+    groups->recHit = (long long int *)p;
+
+    groups->maxRecs = groups->maxRecs * 2LL;
+  }
+
+  groups->recOff[groups->nrecs] = off;
+  groups->recLen[groups->nrecs] = len;
+  groups->recHit[groups->nrecs] = hidx;
+  groups->nrecs++;
+
+  return 0;
+}
+
+
+// Sort records extracted by group, records of a group keep order of query file
+// A record is added once per hit ID it matched, it is placed once in a group shared by its hit IDs
+// Sets records, bytes and number of records of each group
+int sortGroupRecords(groups_t *groups)
+{
+  long long int r;      // Iteration variable
+  long long int g;      // Current group
+  long long int m;      // Current member
+  long long int *pos;   // Next entry of each group
+  long long int *last;  // Offset of last record placed in each group
+
+  groups->grpStart = (long long int *)calloc(groups->ngroups + 1, sizeof(long long int));
+  groups->grpBytes = (long long int *)calloc(groups->ngroups + 1, sizeof(long long int));
+  groups->grpSeqs = (long long int *)calloc(groups->ngroups + 1, sizeof(long long int));
+  pos = (long long int *)malloc(sizeof(long long int) * (groups->ngroups + 1));
+  last = (long long int *)malloc(sizeof(long long int) * (groups->ngroups + 1));
+  if( groups->grpStart == NULL || groups->grpBytes == NULL || groups->grpSeqs == NULL || pos == NULL || last == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate groups of records\n");
+    free(pos);
+    free(last);
+    return ERROR;
+  }
+
+  // Count records of each group, records of a hit ID of a record follow each other
+  for(g = 0LL; g <= groups->ngroups; g++)
+    last[g] = ERROR;
+  for(r = 0LL; r < groups->nrecs; r++)
+  {
+    for(m = groups->hitOffs[groups->recHit[r]]; m < groups->hitOffs[groups->recHit[r] + 1]; m++)
+    {
+      g = groups->members[m];
+      if( last[g] == groups->recOff[r] )
+        continue;
+      last[g] = groups->recOff[r];
+      groups->grpSeqs[g]++;
+      groups->grpBytes[g] = groups->grpBytes[g] + groups->recLen[r];
+    }
+  }
+  for(g = 0LL; g < groups->ngroups; g++)
+    groups->grpStart[g + 1] = groups->grpStart[g] + groups->grpSeqs[g];
+
+  groups->entries = (long long int *)malloc(sizeof(long long int) * (groups->grpStart[groups->ngroups] + 1));
+  if( groups->entries == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate groups of records\n");
+    free(pos);
+    free(last);
+    return ERROR;
+  }
+
+  // Place records in their groups
+  memcpy(pos, groups->grpStart, sizeof(long long int) * (groups->ngroups + 1));
+  for(g = 0LL; g <= groups->ngroups; g++)
+    last[g] = ERROR;
+  for(r = 0LL; r < groups->nrecs; r++)
+  {
+    for(m = groups->hitOffs[groups->recHit[r]]; m < groups->hitOffs[groups->recHit[r] + 1]; m++)
+    {
+      g = groups->members[m];
+      if( last[g] == groups->recOff[r] )
+        continue;
+      last[g] = groups->recOff[r];
+      groups->entries[pos[g]++] = r;
+    }
+  }
+  free(pos);
+  free(last);
+
+  return 0;
+}
+
+
+// Free groups memory
+int freeGroups(groups_t *groups)
+{
+  free(groups->hitOffs);
+  free(groups->members);
+  free(groups->recOff);
+  free(groups->recLen);
+  free(groups->recHit);
+  free(groups->grpStart);
+  free(groups->entries);
+  free(groups->grpBytes);
+  free(groups->grpSeqs);
+  memset(groups, 0, sizeof(groups_t));
+
+  return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef GROUPS_H
+#define GROUPS_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERROR        -1         // Error code from failed functions
+
+#define GRECS_INIT   4096LL     // Initial number of records allocated
+
+// Groups of hit IDs by BLAST query ID (MUSCLE pipeline)
+// Groups of each hit ID are kept as compressed rows, a hit ID may be in several groups
+// Records extracted are written once, then routed to the groups of their hit IDs
+typedef struct st_groups
+{
+  long long int  ngroups;     // Number of groups, one per BLAST query ID
+  long long int  nhits;       // Number of hit IDs
+  long long int *hitOffs;     // Index in members of first group of each hit ID, plus end of last one
+  long long int *members;     // Groups of each hit ID, rows of hit IDs in order
+  long long int  nrecs;       // Number of records extracted
+  long long int  maxRecs;     // Number of records allocated
+  long long int *recOff;      // Offset of each record in output of current process
+  long long int *recLen;      // Bytes of each record
+  long long int *recHit;      // Hit ID index of each record, a record matching several hit IDs is recorded per hit ID
+  long long int *grpStart;    // Index in entries of first record of each group, plus end of last one
+  long long int *entries;     // Records of each group, in order of output
+  long long int *grpBytes;    // Bytes of records of each group
+  long long int *grpSeqs;     // Number of records of each group
+} groups_t;
+
+int buildGroups(groups_t *, const long long int *, long long int, long long int, long long int);
+int addGroupRecord(groups_t *, long long int, long long int, long long int);
+int sortGroupRecords(groups_t *);
+int freeGroups(groups_t *);
+
+
+#endif
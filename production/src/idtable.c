@@ -0,0 +1,455 @@
+#include "idtable.h"
+
+// Compute hash value of an ID
+static unsigned long long int hashID(const char *id, long long int len)
+{
+  long long int i;              // Iteration variable
+  unsigned long long int hash;  // Hash value
+
+  hash = FNV_OFFSET;
+  for(i = 0LL; i < len; i++)
+    hash = (hash ^ (unsigned char)id[i]) * FNV_PRIME;
+
+  return hash;
+}
+
+
+// Allocate an array of table, zeroed if clear is set
+// Arrays of a spilled table are mapped from a new region at end of spill file, regions are never reused
+static void *tableAlloc(idtable_t *table, long long int sz, int clear)
+{
+  struct stat st;       // Status of spill file
+  long long int page;   // Bytes of a page
+  long long int off;    // Offset of new region
+  void *p;              // Allocated memory
+
+  if( table->spilled == 0 )
+    return (clear != 0) ? calloc(sz, 1) : malloc(sz);
+
+  // Regions grown by ftruncate() read as zeros
+  page = (long long int)sysconf(_SC_PAGESIZE);
+  if( fstat(table->sfd, &st) != 0 )
+    return NULL;
+  off = ((long long int)st.st_size + page - 1) / page * page;
+  sz = (sz + page - 1) / page * page;
+  if( ftruncate(table->sfd, off + sz) != 0 )
+    return NULL;
+  p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, table->sfd, off);
+
+  return (p == MAP_FAILED) ? NULL : p;
+}
+
+
+// Free an array of table
+static void tableFree(idtable_t *table, void *p, long long int sz)
+{
+  if( table->spilled == 0 )
+    free(p);
+  else if( p != NULL )
+    munmap(p, sz);
+}
+
+
+// Grow an array of table from oldSz to sz bytes
+static void *tableRealloc(idtable_t *table, void *p, long long int oldSz, long long int sz)
+{
+  void *q;              // Grown array
+
+  if( table->spilled == 0 )
+    return realloc(p, sz);
+
+  q = tableAlloc(table, sz, 0);
+  if( q == NULL )
+    return NULL;
+  memcpy(q, p, oldSz);
+  tableFree(table, p, oldSz);
+
+  return q;
+}
+
+
+// Move arrays of table to spill file, kernel writes their pages back to file instead of swapping them
+// Table is kept in memory if spill file cannot be grown
+static int moveIDTable(idtable_t *table)
+{
+  int i;                // Iteration variable
+  void **arrays[5];     // Arrays of table
+  long long int sz[5];  // Bytes of each array
+  void *moved[5];       // Arrays mapped from spill file
+
+  arrays[0] = (void **)&table->arena;   sz[0] = table->arenaSz;
+  arrays[1] = (void **)&table->offs;    sz[1] = sizeof(long long int) * table->maxIds;
+  arrays[2] = (void **)&table->lens;    sz[2] = sizeof(long long int) * table->maxIds;
+  arrays[3] = (void **)&table->hashes;  sz[3] = sizeof(unsigned long long int) * table->maxIds;
+  arrays[4] = (void **)&table->slots;   sz[4] = sizeof(long long int) * (table->mask + 1);
+
+  table->spilled = 1;
+  for(i = 0; i < 5; i++)
+  {
+    moved[i] = tableAlloc(table, sz[i], 0);
+    if( moved[i] == NULL )
+    {
+      while( --i >= 0 )
+        munmap(moved[i], sz[i]);
+      table->spilled = 0;
+      table->spillLimit = 0LL;
+      fprintf(stdout, "\nWarning: failed to spill ID table, keeping it in memory\n");
+      return ERROR;
+    }
+  }
+
+  for(i = 0; i < 5; i++)
+  {
+    memcpy(moved[i], *arrays[i], sz[i]);
+    free(*arrays[i]);
+    *arrays[i] = moved[i];
+  }
+
+  return 0;
+}
+
+
+// Resize hash table slots and reinsert all IDs
+static int rehashIDTable(idtable_t *table, long long int nslots)
+{
+  long long int i;      // Iteration variable
+  long long int slot;   // Current slot
+
+  tableFree(table, table->slots, sizeof(long long int) * (table->mask + 1));
+  table->slots = (long long int *)tableAlloc(table, sizeof(long long int) * nslots, 1);
+  if( table->slots == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate hash table for IDs\n");
+    return ERROR;
+  }
+  table->mask = nslots - 1;
+
+  // IDs are unique, insert without comparing
+  for(i = 0LL; i < table->nids; i++)
+  {
+    slot = (long long int)(table->hashes[i] & (unsigned long long int)table->mask);
+    while( table->slots[slot] != 0LL )
+      slot = (slot + 1) & table->mask;
+    table->slots[slot] = i + 1;
+  }
+
+  return 0;
+}
+
+
+// Initialize an empty table sized for an expected number of IDs and total bytes
+int initIDTable(idtable_t *table, long long int nids, long long int nbytes)
+{
+  long long int nslots;   // Number of slots in table
+
+  memset(table, 0, sizeof(idtable_t));
+
+  table->maxIds = (nids > IDS_INIT) ? nids : IDS_INIT;
+  table->arenaSz = (nbytes > ARENA_INIT) ? nbytes : ARENA_INIT;
+  table->arena = (char *)malloc(sizeof(char) * table->arenaSz);
+  table->offs = (long long int *)malloc(sizeof(long long int) * table->maxIds);
+  table->lens = (long long int *)malloc(sizeof(long long int) * table->maxIds);
+  table->hashes = (unsigned long long int *)malloc(sizeof(unsigned long long int) * table->maxIds);
+  table->lenMask = (unsigned char *)calloc(1, sizeof(unsigned char));
+  if( table->arena == NULL || table->offs == NULL || table->lens == NULL || table->hashes == NULL || table->lenMask == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate ID table\n");
+    freeIDTable(table);
+    return ERROR;
+  }
+
+  // Keep load factor at or below 0.5
+  nslots = 1LL;
+  while( nslots < (table->maxIds * 2LL) )
+    nslots = nslots << 1;
+
+  if( rehashIDTable(table, nslots) != 0 )
+  {
+    freeIDTable(table);
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Add an ID to table if not already in table
+// Sets isNew flag (if not NULL) to 1 if ID was added, 0 if it already existed
+// Returns index of ID or ERROR if memory allocation failed
+long long int addID(idtable_t *table, const char *id, long long int len, int *isNew)
+{
+  long long int idx;            // Index of ID
+  long long int slot;           // Current slot
+  long long int sz;             // New allocation size
+  unsigned long long int hash;  // Hash value of ID
+  void *p;                      // Reallocated memory
+
+  if( isNew != NULL )
+    *isNew = 0;
+
+  // Find ID or an empty slot
+  hash = hashID(id, len);
+  slot = (long long int)(hash & (unsigned long long int)table->mask);
+  while( table->slots[slot] != 0LL )
+  {
+    idx = table->slots[slot] - 1;
+    if( table->hashes[idx] == hash && table->lens[idx] == len && memcmp(table->arena + table->offs[idx], id, len) == 0 )
+      return idx;
+
+    slot = (slot + 1) & table->mask;
+  }
+
+  // Grow string arena, plus 1 for null-terminating character
+  if( (table->arenaLen + len + 1) > table->arenaSz )
+  {
+    sz = table->arenaSz * 2LL;
+    while( sz < (table->arenaLen + len + 1) )
+      sz = sz * 2LL;
+
+    p = tableRealloc(table, table->arena, table->arenaSz, sz);
+    if( p == NULL )
+    {
+      fprintf(stdout, "\nError: failed to grow ID string arena\n");
+      return ERROR;
+    }
+    table->arena = (char *)p;
+    table->arenaSz = sz;
+  }
+
+  // Grow ID arrays
+  if( table->nids == table->maxIds )
+  {
+    sz = table->maxIds * 2LL;
+    p = tableRealloc(table, table->offs, sizeof(long long int) * table->maxIds, sizeof(long long int) * sz);
+    if( p == NULL )
+      return ERROR;
+    table->offs = (long long int *)p;
+
+    p = tableRealloc(table, table->lens, sizeof(long long int) * table->maxIds, sizeof(long long int) * sz);
+    if( p == NULL )
+      return ERROR;
+    table->lens = (long long int *)p;
+
+    p = tableRealloc(table, table->hashes, sizeof(unsigned long long int) * table->maxIds, sizeof(unsigned long long int) * sz);
+    if( p == NULL )
+      return ERROR;
+    table->hashes = (unsigned long long int *)p;
+
+    table->maxIds = sz;
+  }
+
+  // Grow length mask
+  if( len > table->maxLen )
+  {
+    p = realloc(table->lenMask, sizeof(unsigned char) * (len + 1));
+    if( p == NULL )
+      return ERROR;
+    table->lenMask = (unsigned char *)p;
+    memset(table->lenMask + table->maxLen + 1, 0, len - table->maxLen);
+    table->maxLen = len;
+  }
+
+  // Copy ID to arena
+  idx = table->nids;
+  table->offs[idx] = table->arenaLen;
+  table->lens[idx] = len;
+  table->hashes[idx] = hash;
+  memcpy(table->arena + table->arenaLen, id, len);
+  table->arena[table->arenaLen + len] = '\0';
+  table->arenaLen = table->arenaLen + len + 1;
+  table->slots[slot] = idx + 1;
+  table->lenMask[len] = 1;
+  table->nids++;
+
+  // Keep load factor at or below 0.5
+  if( (table->nids * 2LL) > (table->mask + 1) )
+  {
+    if( rehashIDTable(table, (table->mask + 1) * 2LL) != 0 )
+      return ERROR;
+  }
+
+  // Move table to spill file once it outgrows its limit
+  if( table->spillLimit > 0LL && table->spilled == 0 && sizeIDTable(table) > table->spillLimit )
+    moveIDTable(table);
+
+  if( isNew != NULL )
+    *isNew = 1;
+
+  return idx;
+}
+
+
+// Initialize a table from a packed arena of distinct null-terminated IDs, as copied from another table
+int unpackIDTable(idtable_t *table, const char *arena, long long int nids, long long int arenaLen)
+{
+  long long int i;      // Iteration variable
+  long long int off;    // Offset of current ID in packed arena
+  long long int len;    // Length of current ID
+
+  if( initIDTable(table, nids, arenaLen) != 0 )
+    return ERROR;
+
+  off = 0LL;
+  for(i = 0LL; i < nids && off < arenaLen; i++)
+  {
+    len = (long long int)strlen(arena + off);
+    if( addID(table, arena + off, len, NULL) == ERROR )
+    {
+      freeIDTable(table);
+      return ERROR;
+    }
+    off = off + len + 1;
+  }
+
+  return 0;
+}
+
+
+// Find index of an ID that is equal to key
+// Returns ID index or ERROR if not found
+long long int findID(idtable_t *table, const char *key, long long int keyLen)
+{
+  long long int idx;            // Index of ID stored in slot
+  long long int slot;           // Current slot
+  unsigned long long int hash;  // Hash value of key
+
+  if( table->nids == 0LL )
+    return ERROR;
+
+  hash = hashID(key, keyLen);
+  slot = (long long int)(hash & (unsigned long long int)table->mask);
+  while( table->slots[slot] != 0LL )
+  {
+    idx = table->slots[slot] - 1;
+    if( table->hashes[idx] == hash && table->lens[idx] == keyLen && memcmp(table->arena + table->offs[idx], key, keyLen) == 0 )
+      return idx;
+
+    slot = (slot + 1) & table->mask;
+  }
+
+  return ERROR;
+}
+
+
+// Find lowest index of an ID that is a prefix of key
+// Hash is computed incrementally, table is probed only at lengths that have IDs
+// Returns ID index or ERROR if no ID matches
+long long int findIDPrefix(idtable_t *table, const char *key, long long int keyLen)
+{
+  long long int i;              // Iteration variable
+  long long int len;            // Current prefix length
+  long long int slot;           // Current slot
+  long long int idx;            // Index of ID stored in slot
+  long long int found;          // Lowest matching index
+  unsigned long long int hash;  // Hash value of current prefix
+
+  if( table->nids == 0LL )
+    return ERROR;
+
+  found = ERROR;
+  hash = FNV_OFFSET;
+  len = (keyLen < table->maxLen) ? keyLen : table->maxLen;
+  for(i = 0LL; i < len; i++)
+  {
+    hash = (hash ^ (unsigned char)key[i]) * FNV_PRIME;
+
+    // No ID of this length
+    if( table->lenMask[i+1] == 0 )
+      continue;
+
+    slot = (long long int)(hash & (unsigned long long int)table->mask);
+    while( table->slots[slot] != 0LL )
+    {
+      idx = table->slots[slot] - 1;
+      if( table->hashes[idx] == hash && table->lens[idx] == (i + 1) && memcmp(table->arena + table->offs[idx], key, i + 1) == 0 )
+      {
+        if( found == ERROR || idx < found )
+          found = idx;
+        break;
+      }
+
+      slot = (slot + 1) & table->mask;
+    }
+  }
+
+  return found;
+}
+
+
+// Find indices of all IDs that are a prefix of key, at most n of them
+// Returns number of IDs found
+long long int findIDPrefixes(idtable_t *table, const char *key, long long int keyLen, long long int *found, long long int n)
+{
+  long long int i;              // Iteration variable
+  long long int len;            // Current prefix length
+  long long int slot;           // Current slot
+  long long int idx;            // Index of ID stored in slot
+  long long int cnt;            // Number of matching IDs
+  unsigned long long int hash;  // Hash value of current prefix
+
+  if( table->nids == 0LL )
+    return 0LL;
+
+  cnt = 0LL;
+  hash = FNV_OFFSET;
+  len = (keyLen < table->maxLen) ? keyLen : table->maxLen;
+  for(i = 0LL; i < len && cnt < n; i++)
+  {
+    hash = (hash ^ (unsigned char)key[i]) * FNV_PRIME;
+
+    // No ID of this length
+    if( table->lenMask[i+1] == 0 )
+      continue;
+
+    slot = (long long int)(hash & (unsigned long long int)table->mask);
+    while( table->slots[slot] != 0LL )
+    {
+      idx = table->slots[slot] - 1;
+      if( table->hashes[idx] == hash && table->lens[idx] == (i + 1) && memcmp(table->arena + table->offs[idx], key, i + 1) == 0 )
+      {
+        found[cnt++] = idx;
+        break;
+      }
+
+      slot = (slot + 1) & table->mask;
+    }
+  }
+
+  return cnt;
+}
+
+
+// Set spill file of table, arrays are moved to file once table is larger than limit bytes
+// Spill file is shared by tables and is not closed with them
+int spillIDTable(idtable_t *table, int fd, long long int limit)
+{
+  table->sfd = fd;
+  table->spillLimit = limit;
+  if( limit > 0LL && table->spilled == 0 && sizeIDTable(table) > limit )
+    return moveIDTable(table);
+
+  return 0;
+}
+
+
+// Bytes allocated by table
+long long int sizeIDTable(idtable_t *table)
+{
+  return table->arenaSz + table->maxIds * (long long int)(sizeof(long long int) * 2 + sizeof(unsigned long long int)) +
+         (table->mask + 1) * (long long int)sizeof(long long int) + table->maxLen + 1;
+}
+
+
+// Free table memory
+int freeIDTable(idtable_t *table)
+{
+  tableFree(table, table->arena, table->arenaSz);
+  tableFree(table, table->offs, sizeof(long long int) * table->maxIds);
+  tableFree(table, table->lens, sizeof(long long int) * table->maxIds);
+  tableFree(table, table->slots, sizeof(long long int) * (table->mask + 1));
+  tableFree(table, table->hashes, sizeof(unsigned long long int) * table->maxIds);
+  free(table->lenMask);
+  memset(table, 0, sizeof(idtable_t));
+
+  return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define ERROR       -1         // Error code from failed functions
+
+#define FNV_OFFSET  14695981039346656037ULL  // FNV-1a 64-bit offset basis
+#define FNV_PRIME   1099511628211ULL         // FNV-1a 64-bit prime
+#define IDS_INIT    1024LL     // Initial number of IDs allocated in table
+#define ARENA_INIT  (1LL<<16)  // Initial size of string arena, 64KB
+
+// Interned store of ID strings with open-addressing hash table
+// IDs are kept null-terminated and contiguous in a single arena, without length limit
+// Prefix lookups treat the IDs as prefixes of a key, same as strncmp(id, key, strlen(id))
+typedef struct st_idtable
+{
+  long long int           nids;      // Number of IDs in table
+  long long int           maxIds;    // Number of IDs allocated
+  long long int           mask;      // Number of slots minus 1, slots are a power of 2
+  long long int           maxLen;    // Length of longest ID
+  long long int           arenaLen;  // Bytes used in string arena
+  long long int           arenaSz;   // Bytes allocated in string arena
+  char                   *arena;     // String arena
+  long long int          *offs;      // Offset of each ID in string arena
+  long long int          *lens;      // Length of each ID
+  long long int          *slots;     // ID index plus 1 stored in each slot, 0 = empty
+  unsigned long long int *hashes;    // Hash value of each ID
+  unsigned char          *lenMask;   // Non-zero if at least one ID has the given length
+  int                     sfd;       // Spill file, arrays are mapped from it once table is larger than spill limit
+  int                     spilled;   // Flag for arrays mapped from spill file
+  long long int           spillLimit; // Bytes of table kept in memory, 0 = table is never spilled
+} idtable_t;
+
+#define getID(t, i)    ((t)->arena + (t)->offs[i])  // Null-terminated ID at index
+#define getIDLen(t, i) ((t)->lens[i])               // Length of ID at index
+
+int initIDTable(idtable_t *, long long int, long long int);
+long long int addID(idtable_t *, const char *, long long int, int *);
+int unpackIDTable(idtable_t *, const char *, long long int, long long int);
+long long int findID(idtable_t *, const char *, long long int);
+long long int findIDPrefix(idtable_t *, const char *, long long int);
+long long int findIDPrefixes(idtable_t *, const char *, long long int, long long int *, long long int);
+int spillIDTable(idtable_t *, int, long long int);
+long long int sizeIDTable(idtable_t *);
+int freeIDTable(idtable_t *);
+
+
+#endif
@@ -0,0 +1,528 @@
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libfilterfasta.h"
+#include "idtable.h"
+#include "scan.h"
+#include "bgzf.h"
+
+// Reader of records of a query file
+// Records are parsed a batch at a time, batch is reduced by length and ID filters, then by each predicate
+struct st_ffreader
+{
+  const char        *data;                  // Data of query file
+  long long int      size;                  // Bytes of data
+  int                owner;                 // 1 = data is mapped, 2 = data is a decompressed buffer, 0 = data of caller
+  long long int      pos;                   // Offset of next record to parse
+  const ffidset_t   *ids;                   // ID filter, NULL if records are not selected by ID
+  long long int      minLen;                // Min number of residues selected
+  long long int      maxLen;                // Max number of residues selected, FF_ERROR = no limit
+  int                npreds;                // Number of predicates
+  ffpredicate_t      preds[FF_PREDICATES];  // Predicates, applied in order
+  void              *ctx[FF_PREDICATES];    // Contexts of predicates
+  int                nbatch;                // Records selected in current batch
+  int                next;                  // Next record of current batch to return
+  int                failed;                // Flag for a predicate stopping iteration
+  ffrecord_t         batch[FF_BATCH];       // Records of current batch
+  unsigned char      keep[FF_BATCH];        // Selection flags of records of current batch
+  char               err[FF_ERRLEN];        // Last error
+};
+
+// Set of IDs, same hash lookup and prefix semantics as hit IDs of filterfasta
+struct st_ffidset
+{
+  idtable_t          table;                 // Interned IDs
+};
+
+
+// Record an error message in reader
+static int setError(ffreader_t *rd, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(rd->err, FF_ERRLEN, fmt, ap);
+  va_end(ap);
+
+  return FF_ERROR;
+}
+
+
+// Allocate a reader with default filters
+static ffreader_t *newReader()
+{
+  ffreader_t *rd;
+
+  rd = (ffreader_t *)calloc(1, sizeof(ffreader_t));
+  if( rd != NULL )
+    rd->maxLen = FF_ERROR;
+
+  return rd;
+}
+
+
+// Open a reader of a query file
+// Uncompressed files are mapped, gzip and BGZF files are decompressed once into a buffer
+// On failure reader is still allocated if possible, so ffError() tells why, it has to be closed
+int ffOpen(ffreader_t **rd, const char *fn)
+{
+  int fd;                  // Descriptor of query file
+  int comp;                // Compression of query file
+  char *buf;               // Decompressed data
+  char *tmp;
+  long long int n;         // Bytes read by decompressor
+  long long int sz;        // Bytes allocated for decompressed data
+  struct stat stbuf;
+  zreader_t zr;            // Decompressor of query file
+  ffreader_t *r;
+
+  *rd = r = newReader();
+  if( r == NULL )
+    return FF_ERROR;
+
+  fd = open(fn, O_RDONLY);
+  if( fd < 0 || fstat(fd, &stbuf) != 0 )
+  {
+    if( fd >= 0 )
+      close(fd);
+    return setError(r, "cannot open query file %s", fn);
+  }
+  if( !S_ISREG(stbuf.st_mode) )
+  {
+    close(fd);
+    return setError(r, "query file %s is not a regular file", fn);
+  }
+  r->size = (long long int)stbuf.st_size;
+  if( r->size == 0LL )
+  {
+    close(fd);
+    return 0;
+  }
+
+  comp = getFileCompression(fn);
+  if( comp == COMP_NONE )
+  {
+    r->data = (const char *)mmap(NULL, (size_t)r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if( r->data == (const char *)MAP_FAILED )
+    {
+      r->data = NULL;
+      return setError(r, "cannot map query file %s", fn);
+    }
+    posix_madvise((void *)r->data, (size_t)r->size, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+    r->owner = 1;
+    return 0;
+  }
+
+  // BGZF is a series of gzip members, both are read by gzip stream
+  if( openReader(&zr, fd, READ_GZ, 0LL) != 0 )
+  {
+    close(fd);
+    return setError(r, "cannot decompress query file %s", fn);
+  }
+  sz = (r->size < (1LL<<20)) ? (1LL<<20) : r->size * 4LL;
+  buf = NULL;
+  r->size = 0LL;
+  while( 1 )
+  {
+    if( r->size == sz || buf == NULL )
+    {
+      sz = (buf == NULL) ? sz : sz * 2LL;
+      tmp = (char *)realloc(buf, (size_t)sz);
+      if( tmp == NULL )
+      {
+        n = FF_ERROR;
+        break;
+      }
+      buf = tmp;
+    }
+    n = readReader(&zr, buf + r->size, sz - r->size);
+    if( n <= 0LL )
+      break;
+    r->size = r->size + n;
+  }
+  closeReader(&zr);
+  close(fd);
+  if( n != 0LL )
+  {
+    free(buf);
+    r->size = 0LL;
+    return setError(r, "cannot decompress query file %s", fn);
+  }
+  r->data = buf;
+  r->owner = 2;
+
+  return 0;
+}
+
+
+// Open a reader of query data in memory of caller, data has to stay valid until reader is closed
+int ffOpenBuffer(ffreader_t **rd, const char *buf, long long int len)
+{
+  *rd = newReader();
+  if( *rd == NULL )
+    return FF_ERROR;
+  (*rd)->data = buf;
+  (*rd)->size = (buf != NULL && len > 0LL) ? len : 0LL;
+
+  return 0;
+}
+
+
+// Select records with a hit ID of ID set in any annotation, NULL removes ID filter
+int ffSetIDFilter(ffreader_t *rd, const ffidset_t *ids)
+{
+  rd->ids = ids;
+
+  return 0;
+}
+
+
+// Select records of minLen to maxLen residues, maxLen = FF_ERROR for no upper limit
+int ffSetLengths(ffreader_t *rd, long long int minLen, long long int maxLen)
+{
+  if( minLen < 0LL || (maxLen != FF_ERROR && maxLen < minLen) )
+    return setError(rd, "invalid length range %lld:%lld", minLen, maxLen);
+  rd->minLen = minLen;
+  rd->maxLen = maxLen;
+
+  return 0;
+}
+
+
+// Add a predicate over batches of records, predicates are applied in order they were added
+int ffAddPredicate(ffreader_t *rd, ffpredicate_t fn, void *ctx)
+{
+  if( rd->npreds == FF_PREDICATES )
+    return setError(rd, "too many predicates (%d max)", FF_PREDICATES);
+  rd->preds[rd->npreds] = fn;
+  rd->ctx[rd->npreds] = ctx;
+  rd->npreds++;
+
+  return 0;
+}
+
+
+// Remove records not kept from current batch
+static void compactBatch(ffreader_t *rd)
+{
+  int i;
+  int n;
+
+  for(i = 0, n = 0; i < rd->nbatch; i++)
+  {
+    if( rd->keep[i] == 0 )
+      continue;
+    if( n != i )
+      rd->batch[n] = rd->batch[i];
+    rd->keep[n] = 1;
+    n++;
+  }
+  rd->nbatch = n;
+}
+
+
+// Parse next batch of records and select them
+// Parsing is the same as filterfasta: a record begins at ">", its header ends at newline and its sequence at next ">"
+// Returns number of records selected, 0 at end of data, FF_ERROR if a predicate fails
+static int fillBatch(ffreader_t *rd)
+{
+  int i;                  // Iteration variable
+  int n;                  // Records parsed
+  const char *p;          // Current position
+  const char *end;        // End of data
+  const char *eol;        // End of current header
+  const char *stop;       // End of current sequence
+  long long int nl;       // Newlines in current sequence
+  ffrecord_t *rec;        // Current record
+
+  rd->nbatch = 0;
+  rd->next = 0;
+  while( rd->nbatch == 0 && rd->pos < rd->size )
+  {
+    end = rd->data + rd->size;
+    p = rd->data + rd->pos;
+    for(n = 0; n < FF_BATCH && p < end; n++)
+    {
+      p = (const char *)memchr(p, '>', (size_t)(end - p));
+      if( p == NULL )
+      {
+        p = end;
+        break;
+      }
+      rec = &rd->batch[n];
+      rec->hdr = p;
+      rec->off = (long long int)(p - rd->data);
+      rec->hit = FF_ERROR;
+
+      // Header of last record may not end with newline
+      eol = (const char *)memchr(p, '\n', (size_t)(end - p));
+      if( eol == NULL )
+        eol = end;
+      rec->hdrLen = (long long int)(eol - p);
+      rec->seq = (eol < end) ? eol + 1 : end;
+
+      nl = scanSequence(rec->seq, end, &stop);
+      rec->seqLen = (long long int)(stop - rec->seq);
+      rec->resLen = rec->seqLen - nl;
+
+      // Length and ID filters
+      rd->keep[n] = (rec->resLen >= rd->minLen && (rd->maxLen == FF_ERROR || rec->resLen <= rd->maxLen));
+      if( rd->keep[n] != 0 && rd->ids != NULL )
+      {
+        rec->hit = ffMatchHeader(rd->ids, rec->hdr, rec->hdrLen);
+        rd->keep[n] = (rec->hit != FF_ERROR);
+      }
+      p = stop;
+    }
+    rd->pos = (long long int)(p - rd->data);
+    rd->nbatch = n;
+    compactBatch(rd);
+
+    // Predicates only see records selected so far
+    for(i = 0; i < rd->npreds && rd->nbatch > 0; i++)
+    {
+      if( rd->preds[i](rd->batch, rd->nbatch, rd->keep, rd->ctx[i]) != 0 )
+      {
+        rd->nbatch = 0;
+        rd->failed = 1;
+        return setError(rd, "predicate %d failed", i + 1);
+      }
+      compactBatch(rd);
+    }
+  }
+
+  return rd->nbatch;
+}
+
+
+// Get next selected record
+// Returns 1 if a record was read, 0 at end of data, FF_ERROR on failure
+int ffNextRecord(ffreader_t *rd, ffrecord_t *rec)
+{
+  if( rd->failed != 0 )
+    return FF_ERROR;
+
+  if( rd->next == rd->nbatch )
+  {
+    if( fillBatch(rd) == FF_ERROR )
+      return FF_ERROR;
+    if( rd->nbatch == 0 )
+      return 0;
+  }
+  *rec = rd->batch[rd->next++];
+
+  return 1;
+}
+
+
+// Get up to maxRecs next selected records
+// Returns number of records read, 0 at end of data, FF_ERROR on failure
+int ffNextBatch(ffreader_t *rd, ffrecord_t *recs, int maxRecs)
+{
+  int n;   // Records read
+  int m;   // Records taken from current batch
+
+  if( rd->failed != 0 )
+    return FF_ERROR;
+
+  for(n = 0; n < maxRecs; n = n + m)
+  {
+    if( rd->next == rd->nbatch )
+    {
+      if( fillBatch(rd) == FF_ERROR )
+        return FF_ERROR;
+      if( rd->nbatch == 0 )
+        break;
+    }
+    m = rd->nbatch - rd->next;
+    if( m > maxRecs - n )
+      m = maxRecs - n;
+    memcpy(recs + n, rd->batch + rd->next, sizeof(ffrecord_t) * (size_t)m);
+    rd->next = rd->next + m;
+  }
+
+  return n;
+}
+
+
+// Restart reader at first record, filters and predicates are kept
+int ffRewind(ffreader_t *rd)
+{
+  rd->pos = 0LL;
+  rd->nbatch = 0;
+  rd->next = 0;
+  rd->failed = 0;
+  rd->err[0] = '\0';
+
+  return 0;
+}
+
+
+// Last error of reader, empty if there was none
+const char *ffError(const ffreader_t *rd)
+{
+  return (rd != NULL) ? rd->err : "cannot allocate reader";
+}
+
+
+// Close reader, records of reader are no longer valid
+int ffClose(ffreader_t *rd)
+{
+  if( rd == NULL )
+    return 0;
+
+  if( rd->owner == 1 )
+    munmap((void *)rd->data, (size_t)rd->size);
+  else if( rd->owner == 2 )
+    free((void *)rd->data);
+  free(rd);
+
+  return 0;
+}
+
+
+// Allocate an empty ID set
+int ffNewIDSet(ffidset_t **ids)
+{
+  *ids = (ffidset_t *)calloc(1, sizeof(ffidset_t));
+  if( *ids == NULL )
+    return FF_ERROR;
+
+  if( initIDTable(&(*ids)->table, IDS_INIT, ARENA_INIT) != 0 )
+  {
+    free(*ids);
+    *ids = NULL;
+    return FF_ERROR;
+  }
+
+  return 0;
+}
+
+
+// Add an ID to set, IDs match keys that begin with them
+// Returns index of ID, same as before if it is already in set, or FF_ERROR
+long long int ffAddID(ffidset_t *ids, const char *id, long long int len)
+{
+  if( len <= 0LL )
+    return FF_ERROR;
+
+  return addID(&ids->table, id, len, NULL);
+}
+
+
+// Add IDs of a search file to set, a line per ID, empty lines are ignored
+// Returns number of IDs in set or FF_ERROR
+long long int ffLoadIDs(ffidset_t *ids, const char *fn)
+{
+  char *line;              // Current line
+  char *tmp;
+  long long int len;       // Length of current line
+  long long int sz;        // Bytes allocated for line
+  int c;
+  FILE *fd;
+
+  fd = fopen(fn, "rb");
+  if( fd == NULL )
+    return FF_ERROR;
+
+  sz = 256LL;
+  line = (char *)malloc((size_t)sz);
+  len = 0LL;
+  while( line != NULL )
+  {
+    c = fgetc(fd);
+    if( c != '\n' && c != EOF )
+    {
+      if( len == sz )
+      {
+        sz = sz * 2LL;
+        tmp = (char *)realloc(line, (size_t)sz);
+        if( tmp == NULL )
+        {
+          free(line);
+          line = NULL;
+          break;
+        }
+        line = tmp;
+      }
+      line[len++] = (char)c;
+      continue;
+    }
+
+    // Lines may end with "\r\n"
+    if( len > 0LL && line[len-1] == '\r' )
+      len--;
+    if( len > 0LL && addID(&ids->table, line, len, NULL) == ERROR )
+    {
+      free(line);
+      line = NULL;
+      break;
+    }
+    len = 0LL;
+    if( c == EOF )
+      break;
+  }
+  fclose(fd);
+  if( line == NULL )
+    return FF_ERROR;
+  free(line);
+
+  return ids->table.nids;
+}
+
+
+// Number of IDs in set
+long long int ffCountIDs(const ffidset_t *ids)
+{
+  return ids->table.nids;
+}
+
+
+// Find lowest index of an ID of set that is a prefix of key
+// Returns ID index or FF_ERROR if no ID matches
+long long int ffFindID(const ffidset_t *ids, const char *key, long long int len)
+{
+  return findIDPrefix((idtable_t *)&ids->table, key, len);
+}
+
+
+// Match annotations of a header with IDs of set
+// Annotations begin at ">" and at each "^A" (start of heading = 1), same as hit IDs of filterfasta
+// Returns lowest ID index matched by any annotation or FF_ERROR if none matches
+long long int ffMatchHeader(const ffidset_t *ids, const char *hdr, long long int len)
+{
+  const char *p;          // Beginning of current annotation ID
+  const char *end;        // End of header
+  const char *next;       // Next "^A" or end of header
+  long long int idx;      // ID index matched by current annotation
+  long long int hidx;     // Lowest ID index matched
+
+  hidx = FF_ERROR;
+  end = hdr + len;
+  for(p = hdr + 1; p <= end; p = next + 1)
+  {
+    next = (const char *)memchr(p, 1, (size_t)(end - p));
+    if( next == NULL )
+      next = end;
+    idx = findIDPrefix((idtable_t *)&ids->table, p, (long long int)(next - p));
+    if( idx != ERROR && (hidx == FF_ERROR || idx < hidx) )
+      hidx = idx;
+  }
+
+  return hidx;
+}
+
+
+// Free ID set, readers using it as ID filter cannot be read anymore
+int ffFreeIDSet(ffidset_t *ids)
+{
+  if( ids == NULL )
+    return 0;
+
+  freeIDTable(&ids->table);
+  free(ids);
+
+  return 0;
+}
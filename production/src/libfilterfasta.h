@@ -0,0 +1,87 @@
+#ifndef LIBFILTERFASTA_H
+#define LIBFILTERFASTA_H
+
+
+// Public interface of libfilterfasta, the FASTA engine of filterfasta without MPI
+// Records are read from a mapping of the query file, or from a single buffer of a compressed query file,
+// and are given as spans into that data, nothing is copied per record
+//
+// Example, queries with any hit ID of a search file:
+//
+//   ffreader_t *rd;
+//   ffidset_t *ids;
+//   ffrecord_t rec;
+//
+//   ffNewIDSet(&ids);
+//   ffLoadIDs(ids, "search.txt");
+//   ffOpen(&rd, "query.fasta");
+//   ffSetIDFilter(rd, ids);
+//   while( ffNextRecord(rd, &rec) == 1 )
+//     fwrite(rec.hdr, 1, rec.hdrLen + 1 + rec.seqLen, stdout);
+//   ffClose(rd);
+//   ffFreeIDSet(ids);
+//
+// A reader is used by a single thread at a time, an ID set may be shared by readers once it is loaded
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FF_ERROR       -1         // Error code from failed functions
+#define FF_BATCH       1024       // Records parsed and given to predicates at a time
+#define FF_PREDICATES  16         // Max number of predicates of a reader
+#define FF_ERRLEN      256        // Max length of error message of a reader
+
+#if defined(__GNUC__)
+#define FF_EXPORT __attribute__((visibility("default")))
+#else
+#define FF_EXPORT
+#endif
+
+// Record of query file
+// Header and sequence point into data of reader, they stay valid until reader is closed
+typedef struct st_ffrecord
+{
+  const char    *hdr;         // Header, from ">" up to newline (not included), not trimmed to matched annotation
+  long long int  hdrLen;      // Bytes of header
+  const char    *seq;         // Sequence data as in query file, newlines included
+  long long int  seqLen;      // Bytes of sequence data
+  long long int  resLen;      // Number of residues, newlines are not counted
+  long long int  off;         // Offset of ">" in (uncompressed) query file
+  long long int  hit;         // Index in ID set of lowest ID matched by ID filter, FF_ERROR without ID filter
+} ffrecord_t;
+
+// Predicate over a batch of records
+// Clears keep[i] of records not selected, returns 0 or FF_ERROR to stop iteration
+typedef int (*ffpredicate_t)(const ffrecord_t *recs, int nrecs, unsigned char *keep, void *ctx);
+
+typedef struct st_ffreader ffreader_t;   // Reader of records of a query file
+typedef struct st_ffidset ffidset_t;     // Set of IDs, backed by hash table of filterfasta
+
+// Readers
+FF_EXPORT int ffOpen(ffreader_t **rd, const char *fn);
+FF_EXPORT int ffOpenBuffer(ffreader_t **rd, const char *buf, long long int len);
+FF_EXPORT int ffSetIDFilter(ffreader_t *rd, const ffidset_t *ids);
+FF_EXPORT int ffSetLengths(ffreader_t *rd, long long int minLen, long long int maxLen);
+FF_EXPORT int ffAddPredicate(ffreader_t *rd, ffpredicate_t fn, void *ctx);
+FF_EXPORT int ffNextRecord(ffreader_t *rd, ffrecord_t *rec);
+FF_EXPORT int ffNextBatch(ffreader_t *rd, ffrecord_t *recs, int maxRecs);
+FF_EXPORT int ffRewind(ffreader_t *rd);
+FF_EXPORT const char *ffError(const ffreader_t *rd);
+FF_EXPORT int ffClose(ffreader_t *rd);
+
+// ID sets
+FF_EXPORT int ffNewIDSet(ffidset_t **ids);
+FF_EXPORT long long int ffAddID(ffidset_t *ids, const char *id, long long int len);
+FF_EXPORT long long int ffLoadIDs(ffidset_t *ids, const char *fn);
+FF_EXPORT long long int ffCountIDs(const ffidset_t *ids);
+FF_EXPORT long long int ffFindID(const ffidset_t *ids, const char *key, long long int len);
+FF_EXPORT long long int ffMatchHeader(const ffidset_t *ids, const char *hdr, long long int len);
+FF_EXPORT int ffFreeIDSet(ffidset_t *ids);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,164 @@
+#include "mapwin.h"
+
+
+// Map window and fault in its pages
+static void *loadMapWindow(void *arg)
+{
+  mapwin_t *win;               // Window to load
+  long long int psz;           // System's page size
+  long long int i;             // Iteration variable
+  volatile char sum;           // Keeps page reads from being optimized out
+
+  win = (mapwin_t *)arg;
+  psz = (long long int)sysconf(_SC_PAGESIZE);
+
+  // Map offset has to be a multiple of page size
+  win->mapSz = win->len + (win->off % psz);
+  win->base = (char *)mmap(NULL, (size_t)win->mapSz, PROT_READ, MAP_PRIVATE, win->fd, (off_t)(win->off - (win->off % psz)));
+  if( win->base == MAP_FAILED )
+  {
+    win->base = NULL;
+    win->err = ERROR;
+    fprintf(stderr, "\n");
+    perror("mmap()");
+    return NULL;
+  }
+  win->data = win->base + (win->off % psz);
+
+  // Advise kernel on how to handle file and memory map
+  posix_fadvise(win->fd, (off_t)win->off, (off_t)win->len, POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
+  posix_madvise(win->base, (size_t)win->mapSz, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+
+  // Read one byte per page, parser does not stall on page faults
+  sum = 0;
+  for(i = 0LL; i < win->mapSz; i = i + psz)
+    sum = sum + win->base[i];
+  (void)sum;
+
+  return NULL;
+}
+
+
+// Read window into buffer with AIO_DEPTH requests in flight, buffer holds whole aligned blocks around window
+// Direct I/O falls back to page cache if file system does not support it
+static void *loadReadWindow(void *arg)
+{
+  mapwin_t *win;               // Window to load
+  long long int start;         // Aligned file offset of first block
+  long long int sz;            // Bytes of aligned blocks
+  long long int n;             // Bytes read
+  int dfd;                     // Query file opened for direct I/O
+  aioring_t ring;              // Ring of reads
+
+  win = (mapwin_t *)arg;
+  start = win->off - (win->off % AIO_ALIGN);
+  sz = win->off + win->len - start;
+  sz = ((sz + AIO_ALIGN - 1) / AIO_ALIGN) * AIO_ALIGN;
+
+  if( win->bufSz < sz )
+  {
+    free(win->buf);
+    win->buf = NULL;
+    win->bufSz = 0LL;
+    win->buf = (char *)allocBuffer(sz, win->huge);
+    if( win->buf == NULL )
+    {
+      win->err = ERROR;
+      fprintf(stderr, "\nError: failed to allocate query file window\n");
+      return NULL;
+    }
+    win->bufSz = sz;
+  }
+
+  dfd = (win->aio == AIO_DIRECT) ? openDirect(win->fd, O_RDONLY) : ERROR;
+  win->direct = (dfd >= 0);
+  if( openRing(&ring, AIO_DEPTH) == 0 )
+    registerRing(&ring, win->buf, sz);
+  n = readRing(&ring, (dfd >= 0) ? dfd : win->fd, win->buf, start, sz);
+  closeRing(&ring);
+  if( dfd >= 0 )
+    close(dfd);
+
+  if( n < (win->off + win->len - start) )
+  {
+    win->err = ERROR;
+    fprintf(stderr, "\n");
+    perror("read()");
+    return NULL;
+  }
+  win->data = win->buf + (win->off - start);
+
+  return NULL;
+}
+
+
+// Begin mapping a window of query file in a prefetch thread, or reading it with asynchronous I/O (aio)
+// Window is loaded in calling thread if thread cannot be created
+int startMapWindow(mapwin_t *win, int fd, long long int off, long long int len, int aio)
+{
+  char *buf;             // Buffer of previous window
+  long long int bufSz;   // Bytes allocated for buffer
+  int huge;              // Flag for buffer backed by huge pages
+
+  buf = win->buf;
+  bufSz = win->bufSz;
+  huge = win->huge;
+  memset(win, 0, sizeof(mapwin_t));
+
+  win->fd = fd;
+  win->aio = aio;
+  win->off = off;
+  win->len = len;
+  win->buf = buf;
+  win->bufSz = bufSz;
+  win->huge = huge;
+
+  if( pthread_create(&win->thread, NULL, (aio != AIO_NONE) ? loadReadWindow : loadMapWindow, win) == 0 )
+    win->active = 1;
+  else if( aio != AIO_NONE )
+    loadReadWindow(win);
+  else
+    loadMapWindow(win);
+
+  return win->err;
+}
+
+
+// Wait until window is mapped
+int waitMapWindow(mapwin_t *win)
+{
+  if( win->active != 0 )
+  {
+    pthread_join(win->thread, NULL);
+    win->active = 0;
+  }
+
+  return win->err;
+}
+
+
+// Unmap window, buffer of asynchronous I/O is kept for next window
+int closeMapWindow(mapwin_t *win)
+{
+  waitMapWindow(win);
+
+  if( win->base != NULL )
+    munmap(win->base, (size_t)win->mapSz);
+  win->base = NULL;
+  win->data = NULL;
+
+  return 0;
+}
+
+
+// Close window and free its buffer
+int freeMapWindow(mapwin_t *win)
+{
+  closeMapWindow(win);
+
+  free(win->buf);
+  win->buf = NULL;
+  win->bufSz = 0LL;
+
+  return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef MAPWIN_H
+#define MAPWIN_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "aio.h"
+#include "budget.h"
+
+#define ERROR        -1         // Error code from failed functions
+
+// Read-only memory map window of query file
+// Window is mapped and its pages faulted in by a prefetch thread while previous window is parsed
+// With asynchronous I/O, window is read into a buffer instead, buffer is kept for next windows
+// Buffer is backed by transparent huge pages if huge is set by caller, flag is kept for next windows
+typedef struct st_mapwin
+{
+  int            fd;          // Query file descriptor
+  int            aio;         // I/O backend, AIO_NONE maps window
+  int            direct;      // Flag for window read with O_DIRECT
+  int            huge;        // Flag for buffer backed by transparent huge pages
+  int            err;         // Error code of prefetch
+  int            active;      // Flag for prefetch thread running
+  long long int  off;         // File offset of window data
+  long long int  len;         // Bytes of window data
+  long long int  mapSz;       // Bytes mapped, including page alignment
+  char          *base;        // Start of mapped memory, page aligned
+  char          *data;        // Start of window data
+  char          *buf;         // Buffer of window read with asynchronous I/O, aligned
+  long long int  bufSz;       // Bytes allocated for buffer
+  pthread_t      thread;      // Prefetch thread
+} mapwin_t;
+
+int startMapWindow(mapwin_t *, int, long long int, long long int, int);
+int waitMapWindow(mapwin_t *);
+int closeMapWindow(mapwin_t *);
+int freeMapWindow(mapwin_t *);
+
+
+#endif
@@ -8,7 +8,7 @@
 // 
 // The second functionality of filterfasta is serve as pipeline program between BLAST and HMMER/MUSCLE.
 // 	HMMER  --> filterfasta extracts sequences from a FASTA input file that appear as hits in a BLAST table file and writes them in FASTA format to an output file. The output file serve as input for HMMER program.
-// 	MUSCLE --> (under development) filterfasta extracts sequences from a FASTA input file that appear as hits in a BLAST table file and writes them in FASTA format to multiple output files grouped by the hits' queries. The output files serve as input for MUSCLE program.
+// 	MUSCLE --> filterfasta extracts sequences from a FASTA input file that appear as hits in a BLAST table file and writes them in FASTA format to an output file grouped by the hits' queries, with a manifest of the groups. Each group serves as input for MUSCLE program.
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -26,6 +26,12 @@
 static int verbose;
 static int trace;
 
+// Global statistics of phases of current process and its threads
+static stats_t stats;
+
+// Global memory budget of current process, sizes of windows and buffers
+static budget_t budget;
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //                              Utility Functions                             //
@@ -42,8 +48,8 @@ int displayHelp()
   fprintf(stdout, "\n");
   fprintf(stdout, "Help menu of filterfasta program\n");
   fprintf(stdout, "--------------------------------\n");
-  fprintf(stdout, "Usage: filterfasta -q INFILE [-h] [-v] [-z] [-o OUTFILE] [-c SEQCOUNT] [-l SEQLEN | -l SEQLEN1:SEQLEN2] [-a ANNOTCOUNT] [-b BYTESLIMIT] [-t BLASTTABLE -p PIPEPROG] [-s SEARCHFILE]\n\n");
-  fprintf(stdout, "-q, --query=INFILE      input query FASTA file\n");
+  fprintf(stdout, "Usage: filterfasta -q INFILE [-h] [-v] [-z] [-i] [-g] [-o OUTFILE] [-c SEQCOUNT] [-l SEQLEN | -l SEQLEN1:SEQLEN2] [-a ANNOTCOUNT] [-b BYTESLIMIT] [-t BLASTTABLE -p PIPEPROG] [-s SEARCHFILE] [-m MERGEMODE] [-n THREADS] [-w BALANCE] [-d DISTMODE] [-j JOBFILE] [-S STATSFILE] [-f WIDTH] [-D SOCKET] [-u AIOMODE] [-M SIZE] [-k SHARDS] [-C CACHE]\n\n");
+  fprintf(stdout, "-q, --query=INFILE      input query FASTA file (%s, a pipe or gzip is read as a stream, BGZF by blocks), or shard manifest (INFILE%s) read by shards\n", STDIN_FILE, SHARD_SUFFIX);
   fprintf(stdout, "-h, --help              display this help menu\n");
   fprintf(stdout, "-v, --verbose           display processing info\n");
   fprintf(stdout, "-z, --trace             display extensive processing info for debugging\n");
@@ -53,9 +59,23 @@ int displayHelp()
   fprintf(stdout, "-l, --length=SEQLEN1:SEQLEN2  range length of sequences to extract\n");
   fprintf(stdout, "-a, --annot=ANNOTCOUNT  number of in-order fields in annotations to extract\n");
   fprintf(stdout, "-b, --bytes=BYTESLIMIT  upper bound size for output file\n");
-  fprintf(stdout, "-t, --table=BLASTTABLE  input BLAST results file in tabular form\n");
-  fprintf(stdout, "-p, --pipe=PIPEMODE     pipeline mode (1 = HMMER, 2 = MUSCLE)\n");
+  fprintf(stdout, "-t, --table=BLASTTABLE  input BLAST results file in tabular (-outfmt 6 or 7) or XML (-outfmt 5) form\n");
+  fprintf(stdout, "-p, --pipe=PIPEMODE     pipeline mode (1 = HMMER, 2 = MUSCLE, one group per BLAST query ID in OUTFILE listed in OUTFILE%s)\n", GROUPS_SUFFIX);
   fprintf(stdout, "-s, --search=SEARCHFILE input annotation file to search for sequences and extract\n");
+  fprintf(stdout, "-m, --merge=MERGEMODE  merge mode of MPI output files (0 = send to master, 1 = MPI-IO collective writes, 2 = pwrite on shared file system, 3 = no output files per process, write spans of query file)\n");
+  fprintf(stdout, "-n, --threads=THREADS   number of threads per process filtering the query file\n");
+  fprintf(stdout, "-w, --balance=BALANCE   balancing of partitions (0 = bytes, 1 = records, weighted by estimated record lookups)\n");
+  fprintf(stdout, "-d, --distribute=DISTMODE distribution of input files (0 = broadcast files, 1 = broadcast parsed hit sets, send each node only partitions of query file of its processes)\n");
+  fprintf(stdout, "-j, --jobs=JOBFILE      job manifest, a line of options per job (-o, -c, -l, -a, -b, -t, -p, -s, -f), all jobs filter a single pass over query file\n");
+  fprintf(stdout, "-S, --stats=STATSFILE   write time of phases and counters of each process and thread as JSON (%s = standard output)\n", STDIN_FILE);
+  fprintf(stdout, "-f, --format=WIDTH      rewrite sequences with uppercase residues in lines of WIDTH residues (0 = single line), size limit applies to rewritten sequences\n");
+  fprintf(stdout, "-D, --serve=SOCKET      keep query file mapped and serve requests over Unix socket SOCKET, a line of options per request (-c, -l, -a, -b, -t, -p, -s, -f), THREADS requests are served concurrently\n");
+  fprintf(stdout, "-u, --aio=AIOMODE       I/O backend (0 = memory map query file, 1 = io_uring reads of query file windows and queued writes of output file, 2 = same with O_DIRECT, page cache is not used)\n");
+  fprintf(stdout, "-M, --mem-budget=SIZE   memory of processes of a node (K, M or G suffix, auto = cgroup limit or physical memory), sizes windows and buffers, larger hit tables are spilled to OUTFILE%s<rank>\n", SPILL_SUFFIX);
+  fprintf(stdout, "-g, --bgzf              compress output file into BGZF blocks, a process or thread compresses its own blocks\n");
+  fprintf(stdout, "-k, --shard=SHARDS      split query file into SHARDS record aligned shards (INFILE%s#) listed in manifest INFILE%s and exit\n", SHARD_FILE, SHARD_SUFFIX);
+  fprintf(stdout, "-C, --cache=CACHE       result cache of records of hit IDs of previous runs, only hit IDs not in CACHE are searched, CACHE is updated\n");
+  fprintf(stdout, "-i, --index             build offset index (INFILE%s) and length table (INFILE%s) of query file and exit\n", IDX_SUFFIX, LEN_SUFFIX);
   fprintf(stdout, "\n");     
   exit(0);
   
@@ -74,6 +94,7 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
   int rseqFlag;              // Count number of range lengths provided
   int ret = 0;               // Trap errors
   int found;                 // Flag to prevent repeated length options
+  int comp;                  // Compression of query file
   long long int i;           // Loop iteration variable
   long long int multiplier;  // Multiplier for setting output file size limit
   long long int optlen;      // Length of command line argument
@@ -89,6 +110,8 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
      {"verbose", no_argument,       NULL, 'v'},
      {"help",    no_argument,       NULL, 'h'}, 
      {"trace",   no_argument,       NULL, 'z'}, 
+     {"index",   no_argument,       NULL, 'i'},
+     {"bgzf",    no_argument,       NULL, 'g'},
 
      // These options do not set a flag
      // Use '-{char}' or '--{string}'
@@ -102,6 +125,18 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
      {"bytes",   required_argument, NULL, 'b'},
      {"table",   required_argument, NULL, 't'},
      {"pipe",    required_argument, NULL, 'p'},
+     {"merge",   required_argument, NULL, 'm'},
+     {"threads", required_argument, NULL, 'n'},
+     {"balance", required_argument, NULL, 'w'},
+     {"distribute", required_argument, NULL, 'd'},
+     {"jobs",    required_argument, NULL, 'j'},
+     {"stats",   required_argument, NULL, 'S'},
+     {"format",  required_argument, NULL, 'f'},
+     {"serve",   required_argument, NULL, 'D'},
+     {"aio",     required_argument, NULL, 'u'},
+     {"mem-budget", required_argument, NULL, 'M'},
+     {"cache",   required_argument, NULL, 'C'},
+     {"shard",   required_argument, NULL, 'k'},
 
      // The last element has to be filled with zeros
      {0, 0, 0, 0}
@@ -116,6 +151,21 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
   args->bytesLimit = BYTES_LIMIT;
   args->pipeMode = PIPE_MODE;
   args->searchMode = SEARCH_MODE;
+  args->indexMode = INDEX_MODE;
+  args->shardCnt = SHARD_CNT;
+  args->shardMode = 0;
+  args->cacheMode = CACHE_MODE;
+  args->bgzfMode = BGZF_MODE;
+  args->mergeMode = MERGE_MODE;
+  args->threadCnt = THREAD_CNT;
+  args->balanceMode = BALANCE_MODE;
+  args->distMode = DIST_MODE;
+  args->batchMode = BATCH_MODE;
+  args->statsMode = STATS_MODE;
+  args->formatWidth = FORMAT_WIDTH;
+  args->serveMode = SERVE_MODE;
+  args->aioMode = AIO_MODE;
+  args->memBudget = MEM_BUDGET;
   
   // Default verbose option is off
   verbose = VERBOSE_OPT;
@@ -128,7 +178,7 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
   while( 1 )
   {
     // Get command line option
-    opt = getopt_long(argc, argv, ":q:o:s:c:l:a:b:t:p:vhz", longOpts, &optIdx);
+    opt = getopt_long(argc, argv, ":q:o:s:c:l:a:b:t:p:m:n:w:d:j:S:f:D:u:M:k:C:vhzig", longOpts, &optIdx);
     
     // If all command line options have been parsed, exit loop
     if( opt == -1 ) break;
@@ -396,6 +446,7 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
           {
             multiplier = 1LL;
             strncpy(loptarg, optarg, optlen);
+            *(loptarg+optlen) = '\0';
           }
 
           testOpt = strtoll(loptarg, NULL, 10);
@@ -416,6 +467,14 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
           trace = 1;
           break;
 
+      case 'i': // build offset index
+          args->indexMode = 1;
+          break;
+
+      case 'g': // compress output file
+          args->bgzfMode = 1;
+          break;
+
       case 't': // BLAST table file
           // If '=' at beginning of argument, ignore it
           if( *optarg == '=' ) optarg++;
@@ -437,6 +496,174 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
           args->pipeMode = (int)testOpt;
           break;
 
+      case 'm': // select merge mode of output files
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > 3LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid merge mode setting = %lld (0 = MASTER, 1 = MPI-IO, 2 = PWRITE, 3 = SPANS)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->mergeMode = (int)testOpt;
+          break;
+
+      case 'n': // select number of threads per process
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 1LL || testOpt > THREAD_LIMIT )
+          {
+            fprintf(stderr, "\nConfig error: invalid threads setting = %lld (1 to %d)\n", testOpt, THREAD_LIMIT);
+            ret = ERROR;
+            break;
+          }
+          args->threadCnt = (int)testOpt;
+          break;
+
+      case 'w': // select balancing policy of partitions
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > 1LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid balance setting = %lld (0 or 1)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->balanceMode = (int)testOpt;
+          break;
+
+      case 'd': // select distribution mode of input files
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > 1LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid distribute setting = %lld (0 = FILES, 1 = HITS)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->distMode = (int)testOpt;
+          break;
+
+      case 'f': // rewrite sequences in lines of a fixed width
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > (long long int)INT_MAX )
+          {
+            fprintf(stderr, "\nConfig error: invalid format width = %lld (0 = single line)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->formatWidth = (int)testOpt;
+          break;
+
+      case 'j': // job manifest
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          if( strlen(optarg) >= FILE_LEN )
+          {
+            fprintf(stderr, "\nConfig error: job manifest name is longer than %d characters\n", FILE_LEN - 1);
+            ret = ERROR;
+            break;
+          }
+          strcpy(args->jf, optarg);
+          args->batchMode = 1;
+          break;
+
+      case 'S': // statistics file
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          if( strlen(optarg) >= FILE_LEN )
+          {
+            fprintf(stderr, "\nConfig error: statistics file name is longer than %d characters\n", FILE_LEN - 1);
+            ret = ERROR;
+            break;
+          }
+          strcpy(args->stf, optarg);
+          args->statsMode = 1;
+          break;
+
+      case 'D': // serve requests over a Unix socket
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          if( strlen(optarg) >= FILE_LEN )
+          {
+            fprintf(stderr, "\nConfig error: socket path is longer than %d characters\n", FILE_LEN - 1);
+            ret = ERROR;
+            break;
+          }
+          strcpy(args->sock, optarg);
+          args->serveMode = 1;
+          break;
+
+      case 'u': // select I/O backend of query file and output file
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 0LL || testOpt > 2LL )
+          {
+            fprintf(stderr, "\nConfig error: invalid aio setting = %lld (0 = MMAP, 1 = IO_URING, 2 = DIRECT)\n", testOpt);
+            ret = ERROR;
+            break;
+          }
+          args->aioMode = (int)testOpt;
+          break;
+
+      case 'M': // set memory budget of processes of a node
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+
+          testOpt = (strcmp(optarg, "auto") == 0) ? 0LL : parseSize(optarg);
+          if( testOpt == ERROR )
+          {
+            fprintf(stderr, "\nConfig error: invalid memory budget = %s (bytes with K, M or G suffix, or auto)\n", optarg);
+            ret = ERROR;
+            break;
+          }
+          args->memBudget = (testOpt == 0LL) ? BUDGET_AUTO : testOpt;
+          break;
+
+      case 'k': // split query file into shards
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+
+          testOpt = strtoll(optarg, NULL, 10);
+          if( testOpt < 1LL || testOpt > SHARD_LIMIT )
+          {
+            fprintf(stderr, "\nConfig error: invalid shard count = %lld (1 to %d)\n", testOpt, SHARD_LIMIT);
+            ret = ERROR;
+            break;
+          }
+          args->shardCnt = (int)testOpt;
+          break;
+
+      case 'C': // result cache
+          // If '=' at beginning of argument, ignore it
+          if( *optarg == '=' ) optarg++;
+    
+          if( strlen(optarg) >= FILE_LEN )
+          {
+            fprintf(stderr, "\nConfig error: result cache name is longer than %d characters\n", FILE_LEN - 1);
+            ret = ERROR;
+            break;
+          }
+          strcpy(args->cf, optarg);
+          args->cacheMode = 1;
+          break;
+
       case '?': // unknown option
           // A getopt_long error occurred due to non-valid option or missing argument to option
           // getopt_long prints error automatically
@@ -475,6 +702,49 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
   }
   else
   {
+    // Offsets of compressed data are not offsets of query file, no index files or output spans
+    comp = (strcmp(args->qf, STDIN_FILE) == 0) ? COMP_NONE : getFileCompression(args->qf);
+    if( comp != COMP_NONE )
+    {
+      if( args->indexMode != 0 || args->shardCnt != 0 )
+      {
+        fprintf(stderr, "\nConfig error: cannot build index files or shards of a compressed query file\n");
+        ret = ERROR;
+      }
+      if( args->mergeMode == 3 )
+        args->mergeMode = (mpi->procCnt > 1) ? 2 : 0;
+    }
+
+    // Streams cannot be partitioned, shared by processes or read again
+    if( isStreamFile(args->qf) != 0 )
+    {
+      if( mpi->procCnt > 1 )
+      {
+        fprintf(stderr, "\nConfig error: query stream can only be read by a single process\n");
+        ret = ERROR;
+      }
+      if( (args->indexMode != 0 || args->shardCnt != 0) && comp == COMP_NONE )
+      {
+        fprintf(stderr, "\nConfig error: cannot build index files or shards of a query stream\n");
+        ret = ERROR;
+      }
+      if( args->mergeMode == 3 )
+        args->mergeMode = 0;
+    }
+
+    // Shards of a manifest are read by processes as their own query files, output is not spans of a single query file
+    args->shardMode = (isStreamFile(args->qf) == 0 && isShardManifest(args->qf) != 0) ? 1 : 0;
+    if( args->shardMode != 0 )
+    {
+      if( args->indexMode != 0 || args->shardCnt != 0 || args->serveMode != 0 )
+      {
+        fprintf(stderr, "\nConfig error: a shard manifest cannot be indexed, split again or served\n");
+        ret = ERROR;
+      }
+      if( args->mergeMode == 3 )
+        args->mergeMode = (mpi->procCnt > 1) ? 2 : 0;
+    }
+
     // Check that input query file and output file are not the same
     // Do not allow file overwriting
     if( strncmp(args->qf, args->of, FILE_LEN) == 0 )
@@ -526,6 +796,117 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
     fprintf(stdout, "\nWarning: ignoring BLAST table file, pipeline mode is not set\n");
   }
 
+  // Records of groups are routed after filtering, output is neither spans of query file nor compressed
+  if( args->pipeMode == 2 )
+  {
+    if( args->threadCnt > 1 )
+    {
+      fprintf(stdout, "\nWarning: MUSCLE pipeline uses a single thread\n");
+      args->threadCnt = 1;
+    }
+    if( args->bgzfMode != 0 )
+    {
+      fprintf(stdout, "\nWarning: MUSCLE pipeline does not compress output file\n");
+      args->bgzfMode = 0;
+    }
+    if( args->mergeMode == 3 )
+      args->mergeMode = (mpi->procCnt > 1) ? 2 : 0;
+  }
+
+  // Records of a single pass are filtered by every job, options of jobs are read from job manifest
+  if( args->batchMode != 0 )
+  {
+    if( args->threadCnt > 1 )
+    {
+      fprintf(stdout, "\nWarning: batch mode uses a single thread\n");
+      args->threadCnt = 1;
+    }
+    if( args->indexMode != 0 || args->shardCnt != 0 )
+    {
+      fprintf(stderr, "\nConfig error: conflict between batch mode and building index files or shards\n");
+      ret = ERROR;
+    }
+    if( args->pipeMode != 0 || args->searchMode != 0 || args->seqLenBuf != 0 || args->rseqLenBuf != 0 )
+    {
+      fprintf(stdout, "\nWarning: ignoring filtering options of command line, jobs are filtered by options of job manifest\n");
+      args->pipeMode = 0;
+      args->searchMode = 0;
+      args->seqLenBuf = 0;
+      args->rseqLenBuf = 0;
+    }
+  }
+
+  // Server keeps a single mapping of query file, requests bring their own filtering options and hit sets
+  if( args->serveMode != 0 )
+  {
+    if( mpi->procCnt > 1 )
+    {
+      fprintf(stderr, "\nConfig error: server mode runs a single process\n");
+      ret = ERROR;
+    }
+    if( args->batchMode != 0 || args->indexMode != 0 || args->statsMode != 0 )
+    {
+      fprintf(stderr, "\nConfig error: conflict between server mode and batch mode, building index files or statistics\n");
+      ret = ERROR;
+    }
+  }
+
+  // Records of hit IDs are cached by offsets of a plain query file, a single set of hit IDs per run
+  if( args->cacheMode != 0 )
+  {
+    if( args->pipeMode == 0 && args->searchMode == 0 )
+    {
+      fprintf(stderr, "\nConfig error: result cache requires pipeline or search mode\n");
+      ret = ERROR;
+    }
+    if( args->batchMode != 0 || args->serveMode != 0 || args->indexMode != 0 || args->shardCnt != 0 || args->shardMode != 0 )
+    {
+      fprintf(stderr, "\nConfig error: conflict between result cache and batch mode, server mode, building index files or shards, or a shard manifest\n");
+      ret = ERROR;
+    }
+    if( strlen(args->qf) != 0 && (isStreamFile(args->qf) != 0 || getFileCompression(args->qf) != COMP_NONE) )
+    {
+      fprintf(stderr, "\nConfig error: result cache requires an uncompressed query file\n");
+      ret = ERROR;
+    }
+    if( strncmp(args->cf, args->qf, FILE_LEN) == 0 || strncmp(args->cf, args->of, FILE_LEN) == 0 )
+    {
+      fprintf(stderr, "\nConfig error: result cache refers to the same file as query or output file\n");
+      ret = ERROR;
+    }
+  }
+
+  // Validation for threads
+  if( args->threadCnt > 1 )
+  {
+#ifndef _OPENMP
+    if( args->serveMode == 0 )
+    {
+      fprintf(stdout, "\nWarning: threads are not supported by this build, using a single thread\n");
+      args->threadCnt = 1;
+    }
+#endif
+    // Sequence count and size limits depend on order of queries
+    // Pipeline and search modes stop once as many sequences as hit IDs are extracted, outputs of threads are trimmed in order of queries
+    // Compressed output of threads cannot be trimmed
+    // Threads of server mode serve requests, each request is filtered by a single thread
+    if( args->serveMode == 0 && ( args->seqCnt != SEQ_COUNT || args->bytesLimit != BYTES_LIMIT ) )
+    {
+      fprintf(stdout, "\nWarning: sequence count and size limits use a single thread\n");
+      args->threadCnt = 1;
+    }
+    else if( args->serveMode == 0 && args->bgzfMode != 0 && ( args->pipeMode != 0 || args->searchMode != 0 ) )
+    {
+      fprintf(stdout, "\nWarning: pipeline and search modes with compressed output use a single thread\n");
+      args->threadCnt = 1;
+    }
+  }
+
+  // Compressed output is not a copy of query file data, no output spans
+  // Size limit applies to uncompressed output
+  if( args->bgzfMode != 0 && args->mergeMode == 3 )
+    args->mergeMode = (mpi->procCnt > 1) ? 2 : 0;
+
   // Exit if error
   if( ret != 0 ) return ret;
  
@@ -535,7 +916,8 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
     fprintf(stdout, "\n--------------Configuration--------------\n");
     if( mpi->procCnt > 1 )
       fprintf(stdout, "MPI enabled (process %d of %d in %s)\n", mpi->procRank, mpi->procCnt, mpi->procName);
-    fprintf(stdout, "Query file = %s\n", args->qf);
+    fprintf(stdout, "Query file = %s%s\n", args->qf, (args->shardMode != 0) ? " (shard manifest)" : "");
+    fprintf(stdout, "Parsing kernel = %s\n", getScannerName());
     fprintf(stdout, "Output file = %s\n", args->of);
     fprintf(stdout, "Max sequence count = %lld\n", args->seqCnt);
     fprintf(stdout, "Max bytes of output file = %lld\n", args->bytesLimit);
@@ -564,6 +946,42 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
       fprintf(stdout, "BLAST table file = %s\n", args->btable);
     if( args->searchMode != 0 )
       fprintf(stdout, "Search file = %s\n", args->sf);
+    if( args->mergeMode == 0 )
+      fprintf(stdout, "Merge mode = MASTER\n");
+    else if( args->mergeMode == 1 )
+      fprintf(stdout, "Merge mode = MPI-IO\n");
+    else if( args->mergeMode == 2 )
+      fprintf(stdout, "Merge mode = PWRITE\n");
+    else if( args->mergeMode == 3 )
+      fprintf(stdout, "Merge mode = SPANS\n");
+    fprintf(stdout, "Threads per process = %d\n", args->threadCnt);
+    if( args->bgzfMode != 0 )
+      fprintf(stdout, "Output compression = BGZF\n");
+    fprintf(stdout, "Partition balance = %s\n", (args->balanceMode != 0) ? "RECORDS" : "BYTES");
+    if( mpi->procCnt > 1 )
+      fprintf(stdout, "Input distribution = %s\n", (args->distMode != 0) ? "HITS" : "FILES");
+    if( args->indexMode != 0 )
+      fprintf(stdout, "Build index files = %s%s, %s%s\n", args->qf, IDX_SUFFIX, args->qf, LEN_SUFFIX);
+    if( args->shardCnt != 0 )
+      fprintf(stdout, "Build shards = %d, manifest %s%s\n", args->shardCnt, args->qf, SHARD_SUFFIX);
+    if( args->cacheMode != 0 )
+      fprintf(stdout, "Result cache = %s\n", args->cf);
+    if( args->batchMode != 0 )
+      fprintf(stdout, "Job manifest = %s\n", args->jf);
+    if( args->statsMode != 0 )
+      fprintf(stdout, "Statistics file = %s\n", args->stf);
+    if( args->formatWidth == 0 )
+      fprintf(stdout, "Sequence format = uppercase, single line\n");
+    else if( args->formatWidth > 0 )
+      fprintf(stdout, "Sequence format = uppercase, %d residues per line\n", args->formatWidth);
+    if( args->serveMode != 0 )
+      fprintf(stdout, "Server socket = %s\n", args->sock);
+    if( args->aioMode != AIO_NONE )
+      fprintf(stdout, "I/O backend = %s\n", (args->aioMode == AIO_DIRECT) ? "DIRECT" : "IO_URING");
+    if( args->memBudget == BUDGET_AUTO )
+      fprintf(stdout, "Memory budget = AUTO\n");
+    else if( args->memBudget > 0LL )
+      fprintf(stdout, "Memory budget = %lld bytes\n", args->memBudget);
 
     // Print any remaining command line arguments (not options)
     if( optind < argc )
@@ -582,47 +1000,25 @@ int parseCmdline(int argc, char **argv, args_t *args, mpi_t *mpi)
 // Get sequence annotations
 int getAnnot(iomap_t *iomap, query_t *query)
 {
-  char *p;  // Temporary pointer to move through annotations
+  char *p;    // Temporary pointer to move through annotations
+  char *end;  // End of data being parsed, not parsed itself
 
-  // Find start of query
-  p = query->fsq;
-  while( 1 )
-  {
-    // Reached end of memory map
-    if( p == iomap->fMap || p == query->fbuf )
-    {
-      return ERROR;
-    }
-    // Found start of query
-    else if( *p == '>' )
-    {
-      query->iaq = p;
-      break;
-    }
+  // Annotations begin with ">" of query
+  query->hdrCopy = 0;
 
-    // Move one character forward
-    p++;
-  }
+  // Find start of query
+  end = iomap->fMap;
+  p = (char *)memchr(query->fsq, '>', (size_t)(end - query->fsq));
+  if( p == NULL )
+    return ERROR;
+  query->iaq = p;
 
   // Find end of sequence annotations
   p = p + 1;
-  while( 1 )
-  {
-    // Reached end of memory map
-    if( p == iomap->fMap || p == query->fbuf )
-    {
-      return ERROR;
-    }
-    // Found end of annotations
-    else if( *p == '\n' )
-    {
-      query->faq = p;
-      break;
-    }
-
-    // Move one character forward
-    p++;
-  }
+  p = (char *)memchr(p, '\n', (size_t)(end - p));
+  if( p == NULL )
+    return ERROR;
+  query->faq = p;
 
   return 0;
 }
@@ -631,40 +1027,24 @@ int getAnnot(iomap_t *iomap, query_t *query)
 // Get sequence data
 int getSequence(long long int *seqSz, iomap_t *iomap, query_t *query)
 {
-  char *p;  // Temporary pointer to move through sequence data
+  const char *stop;   // Start of next query or end of data
+  char *end;          // End of data being parsed, not parsed itself
+  long long int nl;   // Newlines in sequence data
 
   // Set start of sequence data
-  *seqSz = 0LL;
   query->isq = query->faq + 1;
+  end = iomap->fMap;
 
-  // Find end of sequence data
-  p = query->isq;
-  while( 1 )
-  {
-    // Reached end of memory map
-    if( p == iomap->fMap || p == query->fbuf )
-    {
-      // Set pointer to possible end of query
-      query->fsq = p;    
-      break;
-    }
-    // Found a newline, sequence continues but do not count as size
-    else if( *p == '\n' )
-    {
-      p++;
-      continue; 
-    }
-    // Found start of next query, set pointer to end of current query sequence
-    else if( *p == '>' )
-    {
-      query->fsq = p - 1;
-      break;
-    }
-    
-    // Increments for each character in sequence
-    (*seqSz)++;
-    p++;
-  }  
+  // Find end of sequence data, newlines do not count as size
+  nl = scanSequence(query->isq, end, &stop);
+  *seqSz = (long long int)(stop - query->isq) - nl;
+
+  // Reached end of data, set pointer to possible end of query
+  if( stop == end )
+    query->fsq = end;
+  // Found start of next query, set pointer to end of current query sequence
+  else
+    query->fsq = (char *)stop - 1;
 
   // No sequence data found
   if( *seqSz == 0LL )
@@ -679,30 +1059,21 @@ int getSequence(long long int *seqSz, iomap_t *iomap, query_t *query)
 }
 
 
-// Set up memory map of input query file using the specified size
-int initQueryMap(long long int msz, long long int offset, iomap_t *iomap, mpi_t *mpi)
+// Check if query file has to be read as a stream (standard input, not a regular file or gzip)
+// BGZF files are read by blocks, they are not streams
+// Returns 1 if file is a stream, 0 otherwise
+int isStreamFile(char *fn)
 {
-  // Create memory map of input query file
-  offset = offset + iomap->fileOffs[mpi->procRank*3];
-  msz = msz + iomap->fileOffs[mpi->procRank*3+1];
-  iomap->iMap = (char *)mmap(NULL, msz, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(iomap->qfd), offset);
-  if( iomap->iMap == MAP_FAILED )
-  {
-    fprintf(stderr, "\n");
-    perror("mmap()");
-    return ERROR;
-  }
+  struct stat stbuf;
 
-  // Advise kernel on how to handle memory maps
-  posix_madvise(iomap->iMap, msz, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+  if( strcmp(fn, STDIN_FILE) == 0 )
+    return 1;
 
-  // Lock map to memory
-  if( mlock(iomap->iMap, msz) != 0 )
-    fprintf(stdout, "Warning: Process %d, failed to lock map\n", mpi->procRank);
+  if( stat(fn, &stbuf) == 0 && !S_ISREG(stbuf.st_mode) )
+    return 1;
 
-  // Update mapping pointers
-  iomap->fMap = (iomap->iMap + msz) - 1;
-  iomap->iMap = iomap->iMap + iomap->fileOffs[mpi->procRank*3+1];
+  if( getFileCompression(fn) == COMP_GZIP )
+    return 1;
 
   return 0;
 }
@@ -714,7 +1085,10 @@ int openQueryFile(char *fn, iomap_t *iomap)
   struct stat stbuf;
 
   // Open input query file
-  iomap->qfd = fopen(fn, "rb");
+  if( strcmp(fn, STDIN_FILE) == 0 )
+    iomap->qfd = stdin;
+  else
+    iomap->qfd = fopen(fn, "rb");
   if( iomap->qfd == NULL )
   {
     fprintf(stderr, "\n");
@@ -722,9 +1096,19 @@ int openQueryFile(char *fn, iomap_t *iomap)
     return ERROR;
   }
 
+  // Standard input, pipes and other non-seekable sources are read as a stream, size is unknown
+  // gzip files are also streams, they can only be inflated sequentially
+  fstat(fileno(iomap->qfd), &stbuf);
+  iomap->stream = isStreamFile(fn);
+  iomap->comp = S_ISREG(stbuf.st_mode) ? getCompression(fileno(iomap->qfd)) : COMP_NONE;
+  if( iomap->stream != 0 )
+  {
+    iomap->qfsz = 0LL;
+    return 0;
+  }
+
   // Set file size
   // Check if file is empty
-  fstat(fileno(iomap->qfd), &stbuf);
   if( stbuf.st_size <= 0L )
   {
     fprintf(stderr, "\nError: query file is empty\n");
@@ -733,351 +1117,981 @@ int openQueryFile(char *fn, iomap_t *iomap)
   }
   iomap->qfsz = (long long int)stbuf.st_size;
 
-  // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ
-  setvbuf(iomap->qfd, NULL, _IOFBF, STRM_BUFSIZ);
+  // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ, or as set by memory budget
+  setvbuf(iomap->qfd, NULL, _IOFBF, budget.outBuf);
  
   return 0;
 }
 
 
 // Parse annotations
+// Fields are counted from the header token table, beginning after ">" or "^A" of matched annotation
 int parseAnnot(int annotCnt, long long int *annotSz, query_t *query)
 {
-  char *p;   // Temporary pointer to move through the annotations
+  long long int k;   // Index of delimiter ending requested fields
+
+  // Found requested number of fields, compute bytes to write
+  k = query->tok->first[query->hann] + (long long int)annotCnt - 1LL;
+  if( k < query->tok->nfields )
+    *annotSz = query->tok->field[k] - (long long int)(query->iaq - query->tok->hdr);
+  // Reached end of annotations, need to write complete annotation
+  // Use size set in getSequence()
+  else
+    *annotSz = *annotSz - 1;
 
-  // Loop through the annotations until the requested field count is found or end of annotation is reached. Bytes to write are computed. 
-  p = query->iaq;
-  while( 1 )
-  {
-    // Reached end of annotations, need to write complete annotation
-    // Use size set in getSequence()
-    if( p == query->faq )
-    {
-      *annotSz = *annotSz - 1;
-      break;
-    }
-    // Found an annotation field.
-    // Delimited by either '|' (vertical bar) or '^A' (start of heading = 1) 
-    else if( (*p == '|') || ((int)(*p) == 1) )
+  return 0;
+}
+
+
+// Check if sequence length is selected by single or range sequence length options
+// If no length options were provided, then all sequences are selected
+// Returns 1 if sequence is selected, 0 otherwise
+int selectLength(args_t *args, long long int seqSz)
+{
+  long long int i;   // Loop iteration variable
+
+  if( (args->seqLenBuf == 0) && (args->rseqLenBuf == 0) )
+    return 1;
+
+  // Check if size of sequence is any of the single lengths
+  for(i = 0LL; i < args->seqLenBuf; i++)
+    if( args->seqLen[i] == seqSz )
+      return 1;
+
+  // Check if size of sequence is in any of the range lengths
+  for(i = 0LL; i < args->rseqLenBuf; i++)
+    if( (args->rseqLen[i*2] <= seqSz) && (args->rseqLen[(i*2)+1] >= seqSz) )
+      return 1;
+
+  return 0;
+}
+
+
+// Match sequence annotations with hit IDs
+// Checks first annotation and remaining annotations delimited by '^A' (start of heading = 1), as found by header token table
+// Every hit ID found in any annotation is matched once, lowest one selects annotation where header begins, same as comparing hit list in order
+// Matched hit ID indices grow as needed, an annotation matches at most one hit ID per prefix length
+// Returns 1 if sequence is selected, 0 otherwise, ERROR if matched hit IDs cannot be allocated
+int matchHitIDs(args_t *args, query_t *query, hits_t *hits)
+{
+  long long int i;          // Iteration variable
+  long long int j;          // Iteration variable
+  long long int k;          // Iteration variable
+  long long int m;          // Hit IDs matched so far
+  long long int n;          // Hit IDs found in current annotation
+  long long int beg;        // Offset of current annotation ID
+  long long int len;        // Length of current annotation ID
+  long long int mann;       // Index of matched annotation
+  long long int hidx;       // Hit ID index selected
+  long long int need;       // Hit ID indices needed for current annotation
+  long long int *p;         // Reallocated hit ID indices
+  hdrtok_t *tok;            // Annotations of current header
+
+  hidx = ERROR;
+  mann = 0LL;
+  query->nhits = 0LL;
+  tok = query->tok;
+  for(i = 0LL; i < tok->nannots; i++)
+  {
+    // Compare hit IDs and current annotation ID, which ends at next "^A" or at end of header
+    // Plus 1 to skip ">" or "^A" at beginning of each annotation
+    beg = tok->annot[i] + 1;
+    len = ((i + 1) < tok->nannots) ? tok->annot[i+1] - beg : tok->len - beg;
+    need = query->nhits + MIN(len, hits->hitIDs.maxLen);
+    if( need > query->maxHits )
     {
-      // Decrement fields found
-      annotCnt--;
+      need = MAX(need, query->maxHits * 2LL);
+      p = (long long int *)realloc(query->mhits, sizeof(long long int) * need);
+      if( p == NULL )
+      {
+        fprintf(stdout, "\nError: failed to allocate matched hit IDs\n");
+        return ERROR;
+      }
+      query->mhits = p;
+      query->maxHits = need;
+    }
+    n = findIDPrefixes(&hits->hitIDs, tok->hdr + beg, len, query->mhits + query->nhits, query->maxHits - query->nhits);
 
-      // Check if number of requested fields have been found
-      if( annotCnt == 0 )
+    // Hit IDs found in a previous annotation are kept once
+    for(j = query->nhits, m = query->nhits; j < query->nhits + n; j++)
+    {
+      if( hidx == ERROR || query->mhits[j] < hidx )
       {
-        // Compute bytes to write
-        *annotSz = (long long int)(p - query->iaq); 
-        break;
+        hidx = query->mhits[j];
+        mann = i;
       }
+      for(k = 0LL; k < query->nhits && query->mhits[k] != query->mhits[j]; k++);
+      if( k == query->nhits )
+        query->mhits[m++] = query->mhits[j];
     }
-    
-    // Move forward one character 
+    query->nhits = m;
+  }
+
+  // No hit ID found
+  if( hidx == ERROR )
+    return 0;
+
+  // Hit IDs are shared by threads
+  for(i = 0LL; i < query->nhits; i++)
+  {
+    #pragma omp atomic write
+    hits->charVect[query->mhits[i]] = 1;
+  }
+  query->hidx = hidx;
+
+  // If annotations require parsing, begin at matched annotation
+  // Query file is mapped read-only, "^A" is written as ">" by writeQuery()
+  if( mann != 0LL && args->annotCnt != 0 )
+  {
+    query->iaq = (char *)tok->hdr + tok->annot[mann];
+    query->hann = mann;
+    query->hdrCopy = 1;
+  }
+
+  return 1;
+}
+
+
+// Record current query in result cache for hit IDs not in cache, every hit ID matched by matchHitIDs() is recorded
+// Query begins at rec, before annotations are moved to a matched annotation
+int recordCacheHits(iomap_t *iomap, query_t *query, const char *rec)
+{
+  long long int off;              // File offset of query
+
+  off = getFileOffset(iomap, rec);
+  if( off == ERROR )
+    return 0;
+
+  return addCachePairs(iomap->cache, query->mhits, query->nhits, off, (long long int)(query->fsq - rec + 1));
+}
+
+
+// Get bytes of current memory map parsed by extractQueries(), up to end of last query parsed
+long long int getParsedBytes(iomap_t *iomap, query_t *query)
+{
+  if( query->fsq <= iomap->iMap )
+    return 0LL;
+
+  return (long long int)(query->fsq - iomap->iMap + 1);
+}
+
+
+// Get file offset of data in current memory map
+// Returns ERROR if data is not from query file
+long long int getFileOffset(iomap_t *iomap, const char *p)
+{
+  // Stream data cannot be read again, compressed data is not in query file
+  if( iomap->stream != 0 || iomap->comp != COMP_NONE )
+    return ERROR;
+
+  if( p >= iomap->iMap && p <= iomap->fMap )
+    return iomap->mapOff + (long long int)(p - iomap->iMap);
+
+  return ERROR;
+}
+
+
+// Write data of current query to output file, output batch or output span list
+// Data from query file is kept as file spans, a matched "^A" annotation character and other data is copied to pool
+// Batched data keeps its query file offset, so runs of query file can be copied by the kernel
+// Returns number of bytes written
+long long int writeQuery(iomap_t *iomap, query_t *query, const char *p, long long int len)
+{
+  int err;             // Trap errors
+  long long int off;   // File offset of data
+  long long int n;     // Bytes written for matched annotation character
+
+  // Matched annotation begins with "^A" in query file, write ">" instead
+  n = 0LL;
+  if( query->hdrCopy != 0 && p == query->iaq && len > 0LL )
+  {
+    if( iomap->spans != NULL )
+      err = addPoolSpan(iomap->spans, ">", 1LL);
+    else if( iomap->ovec != NULL )
+      err = addOutVec(iomap->ovec, ">", 1LL, ERROR);
+    else
+      err = (fputc('>', iomap->ofd) == EOF) ? ERROR : 0;
+    if( err != 0 )
+      return 0LL;
     p++;
+    len--;
+    n = 1LL;
+  }
+
+  if( iomap->spans == NULL && iomap->ovec == NULL )
+    return n + (long long int)fwrite(p, sizeof(char), len, iomap->ofd);
+
+  off = getFileOffset(iomap, p);
+
+  // Batch output, written when current memory map is done
+  if( iomap->spans == NULL )
+  {
+    if( addOutVec(iomap->ovec, p, len, off) != 0 )
+      return n;
+    return n + len;
   }
 
+  if( off == ERROR )
+  {
+    if( addPoolSpan(iomap->spans, p, len) != 0 )
+      return n;
+  }
+  else if( addFileSpan(iomap->spans, off, len) != 0 )
+    return n;
+
+  return n + len;
+}
+
+
+// Write data that does not stay valid until output batch is flushed, data is copied to output span pool or to output batch
+// Returns number of bytes written
+long long int writeCopy(iomap_t *iomap, const char *p, long long int len)
+{
+  if( iomap->spans != NULL )
+    return (addPoolSpan(iomap->spans, p, len) != 0) ? 0LL : len;
+
+  if( iomap->ovec != NULL )
+    return (copyOutVec(iomap->ovec, p, len) != 0) ? 0LL : len;
+
+  return (long long int)fwrite(p, sizeof(char), len, iomap->ofd);
+}
+
+
+// Write sequence data of current query, either from query file or rewritten
+// Returns number of bytes written
+long long int writeSequence(iomap_t *iomap, query_t *query, const char *p, long long int len)
+{
+  if( query->fmt != NULL && p == query->fmt->buf )
+    return writeCopy(iomap, p, len);
+
+  return writeQuery(iomap, query, p, len);
+}
+
+
+// Check if sequence count quota has been met or quotas are met by previous processes
+// Returns 1 if quotas are met, 0 otherwise
+int isQuotaMet(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi)
+{
+  // Sequence count limit only works in serial mode or with quotas shared by processes
+  // Final counters are published before stopping, so following processes stop too
+  if( mpi->procCnt == 1 || iomap->quota != NULL )
+  {
+    // Normal mode: sequence cuota is met
+    // Pipeline or search mode: sequence quota is met
+    if( iomap->xCnt == args->seqCnt || ((hits->pipeMode != 0 || hits->searchMode != 0) && iomap->xCnt == hits->htotal) )
+    {
+      if( iomap->quota != NULL )
+        publishQuota(iomap->quota, mpi);
+      return 1;
+    }
+  }
+
+  // Quotas are met by previous processes or all hit IDs are found
+  if( iomap->quota != NULL && checkQuota(iomap->quota, mpi) != 0 )
+    return 1;
+
   return 0;
 }
 
 
-// Extract queries in current memory map
-int extractQueries(args_t *args, iomap_t *iomap, query_t *query, hits_t *hits, mpi_t *mpi, long long int *bytesWritten, int *done)
+// Select current query and write it to output
+// Returns 1 if query does not fit in size limit, ERROR if it cannot be recorded, 0 otherwise
+int filterQuery(args_t *args, iomap_t *iomap, query_t *query, hits_t *hits, long long int *bytesWritten, long long int annotSz, long long int seqSz, long long int rawSeqSz)
 {
-  char *paq;                   // Pointer for comparing multiple query annotations
-  int err;                     // Trap errors
   int seqSelect;               // Flag for sequences selected
-  long long int hlen;          // Length of hit ID
   long long int lerr;          // Trap number of elements written by write()
-  long long int annotSz;       // Size of annotations in bytes
-  long long int seqSz;         // Size of sequence data in bytes
-  long long int rawSeqSz;      // Size of sequence data in bytes before parsing
   long long int wCnt;          // Bytes to write
-  long long int i;             // Loop iteration variable
-
-  // Loop until end of mapped memory is reached or sequence count quota is reached
-  while( 1 )
+  long long int recOff;        // Bytes written before current query
+  const char *seq;             // Sequence data to write
+  long long int seqLen;        // Bytes of sequence data to write
+  double t0 = 0.0;             // Time of beginning of selection
+  double t1 = 0.0;             // Time of beginning of write
+  statsrec_t *rec = NULL;      // Statistics of current thread
+  const char *qbeg;            // Beginning of current query
+  long long int i;             // Iteration variable
+
+  // Reset sequence selected flag and hit IDs matched
+  STATS(t0 = statsTime();)
+  seqSelect = 0;
+  query->nhits = 0LL;
+  
+  // Perform BLAST hits table filtering
+  if( hits->pipeMode != 0 || hits->searchMode != 0 )
   {
-    // Sequence count limit only works in serial mode
-    if( mpi->procCnt == 1 )
+    // Look up annotation IDs in hit IDs table
+    qbeg = query->iaq;
+    seqSelect = matchHitIDs(args, query, hits);
+    if( seqSelect == ERROR )
+      return ERROR;
+
+    // Records of hit IDs not in result cache are added to cache
+    if( seqSelect == 1 && iomap->cache != NULL && iomap->cache->update != 0 && recordCacheHits(iomap, query, qbeg) != 0 )
     {
-      // Normal mode: sequence cuota is met, set done flag
-      if( iomap->xCnt == args->seqCnt )
-      {
-        *done = 1;
-        break;
-      }
-  
-      // Pipeline or search mode: sequence quota is met, set done flag
-      if( hits->pipeMode != 0 || hits->searchMode != 0 )
-      {
-        if( iomap->xCnt == hits->htotal )
-        {
-          *done = 1;
-          break;
-        }
-      }
+      fprintf(stdout, "\nError: failed to record query in result cache\n");
+      return ERROR;
     }
-    
-    // Get next sequence annotations
-    err = getAnnot(iomap, query);
-    if( err != 0 )
-      break;
-      
-    // Compute annotation size
+
+    // Annotations may now begin at matched annotation
     annotSz = (long long int)(query->faq - query->iaq + 1);
-  
-    // Get next query sequence
-    err = getSequence(&seqSz, iomap, query);
-    if( err != 0 )
-      break;
-   
-    // Compute raw sequence size
-    rawSeqSz = (long long int)(query->fsq - query->isq + 1);
+  }
+  // Perform normal filtering
+  else
+  {
+    seqSelect = selectLength(args, seqSz);
+  } 
+
+  STATS(rec = statsThread(&stats); t1 = statsTime(); rec->phase[PH_LOOKUP] += t1 - t0;)
+
+  // Current query was not selected
+  if( seqSelect != 1 )
+    return 0;
+
+  recOff = *bytesWritten;
+
+  // Rewrite sequence data if it is written, size limit applies to rewritten sequence
+  seq = query->isq;
+  seqLen = rawSeqSz;
+  if( args->formatWidth != FORMAT_WIDTH && args->annotCnt >= 0 )
+  {
+    if( formatSequence(query->fmt, query->isq, rawSeqSz, args->formatWidth) != 0 )
+      return ERROR;
+    seq = query->fmt->buf;
+    seqLen = query->fmt->len;
+  }
 
-    // Reset sequence selected flag
-    seqSelect = 0;
+  // (default) Do not parse annotations, write all including sequences
+  if( args->annotCnt == INT_MAX || args->annotCnt == INT_MIN+1 )
+  {
+    // Check if next entire query (raw annotations and sequence) fits in output file based on size limit option
+    if( args->annotCnt == INT_MAX )
+      wCnt = annotSz + seqLen;
+    // Check if next entire raw annotations fits in output file based on size limit option
+    else
+      wCnt = annotSz;
     
-    // Perform BLAST hits table filtering
-    if( hits->pipeMode != 0 || hits->searchMode != 0 )
+    // Reached limit on number of bytes, we are done
+    if( (wCnt + *bytesWritten) > args->bytesLimit )
+    {
+      if( iomap->quota != NULL )
+        iomap->quota->full = 1;
+      return 1;
+    }
+
+    // Write complete sequence to file
+    // Write annotation, rewritten sequence is written after it
+    lerr = writeQuery(iomap, query, query->iaq, (seq != query->isq) ? annotSz : wCnt);
+    *bytesWritten = *bytesWritten + lerr;
+    if( seq != query->isq && args->annotCnt == INT_MAX )
+    {
+      lerr = writeSequence(iomap, query, seq, seqLen);
+      *bytesWritten = *bytesWritten + lerr;
+    }
+  }
+  // Parse annotations
+  else if( args->annotCnt != 0 )
+  {
+    // Find how many bytes to use from annotations and write them
+    parseAnnot(abs(args->annotCnt), &annotSz, query);
+
+    if( args->annotCnt > 0 )
     {
-      // Need to compare all sequences in query file with table file, do not select anything yet
-      for(i = 0LL; i < hits->htotal && seqSelect == 0; i++)
+      // Check if next entire query (raw annotations and sequence) fits in output file based on size limit option
+      wCnt = annotSz + seqLen + 1; 
+    
+      // Reached limit on number of bytes, we are done
+      if( (wCnt + *bytesWritten) > args->bytesLimit )
       {
-        // Compare hit ids and first annotation ids
-        // Plus 1 to skip ">" at beginning of each sequence
-        hlen = (long long int)strlen(hits->hitList[i]);
-        if( strncmp(hits->hitList[i], query->iaq+1, hlen) == 0 )
-        {
-          seqSelect = 1;
-          hits->charVect[i] = 1;
-          continue;
-        }
-        
-        // Compare hit ids and remaining annotation ids
-        paq = query->iaq;
-        while( paq != query->faq )
-        {
-          // "Start of Heading" symbol delimits multiple annotations of a single query
-          paq++;
-          if( *paq == (char)1 )
-          {
-            if( strncmp(hits->hitList[i], paq+1, hlen) == 0 )
-            {
-              // If annotations require parsing, begin at matched annotation
-              if( args->annotCnt != 0 )
-              {
-                *paq = '>';
-                query->iaq = paq;
-              }
-              seqSelect = 1;
-              hits->charVect[i] = 1;
-              break;
-            } 
-          } 
-        }
+        if( iomap->quota != NULL )
+          iomap->quota->full = 1;
+        return 1;
       }
+
+      // Write annotation
+      lerr = writeQuery(iomap, query, query->iaq, annotSz);
+      *bytesWritten = *bytesWritten + lerr;
+    
+      lerr = writeQuery(iomap, query, "\n", 1);
+      *bytesWritten = *bytesWritten + lerr;
+
+      // Write sequence data
+      lerr = writeSequence(iomap, query, seq, seqLen);
+      *bytesWritten = *bytesWritten + lerr;
     }
-    // Perform normal filtering
     else
     {
-      // If single and range sequence lengths were not provided, then extract all sequences
-      if( (args->seqLenBuf == 0) && (args->rseqLenBuf == 0) )
-      {
-        seqSelect = 1;
-      }
-      // Either single or range sequence lengths were provided
-      else
+      // Check if next entire raw annotations fits in output file based on size limit option
+      wCnt = annotSz; 
+
+      // Reached limit on number of bytes, we are done
+      if( (wCnt + *bytesWritten) > args->bytesLimit )
       {
-        // If single sequence lengths were provided
-        if( args->seqLenBuf > 0 )
-        {
-          // Check if size of sequence is the desired
-          for(i = 0LL; (i < args->seqLenBuf) && (args->seqLen[i] == seqSz); i++)
-          {
-            seqSelect = 1;
-            break;
-          }
-        }
-      
-        // If range sequence lengths were provided
-        if( args->rseqLenBuf > 0 )
-        {
-          // Check if size of sequence is the desired
-          for(i = 0LL; (i < args->rseqLenBuf) && (args->rseqLen[i*2] <= seqSz) && (args->rseqLen[(i*2)+1] >= seqSz); i++)
-          {
-            seqSelect = 1;
-            break;
-          }
-        }
+        if( iomap->quota != NULL )
+          iomap->quota->full = 1;
+        return 1;
       }
-    } 
 
-    // If the current query was selected, prepare it for output
-    if( seqSelect == 1 )
+      // Write annotation without ">" symbol
+      lerr = writeQuery(iomap, query, query->iaq+1, annotSz-1);
+      *bytesWritten = *bytesWritten + lerr;
+      
+      lerr = writeQuery(iomap, query, "\n", 1);
+      *bytesWritten = *bytesWritten + lerr;
+    }
+  }
+  // Do not write annotations
+  else
+  {
+    // Check if next entire query (raw annotations and sequence) fits in output file based on size limit option
+    // Reached limit on number of bytes, we are done
+    wCnt = seqLen;
+    if( (wCnt + *bytesWritten) > args->bytesLimit )
     {
-      // (default) Do not parse annotations, write all including sequences
-      if( args->annotCnt == INT_MAX || args->annotCnt == INT_MIN+1 )
-      {
-        // Check if next entire query (raw annotations and sequence) fits in output file based on size limit option
-        if( args->annotCnt == INT_MAX )
-          wCnt = annotSz + rawSeqSz;
-        // Check if next entire raw annotations fits in output file based on size limit option
-        else
-          wCnt = annotSz;
-        
-        // Reached limit on number of bytes, we are done
-        if( (wCnt + *bytesWritten) > args->bytesLimit )
-        {
-          *done = 1;
-          break;
-        }
+      if( iomap->quota != NULL )
+        iomap->quota->full = 1;
+      return 1;
+    }
 
-        // Write complete sequence to file
-        // Write annotation
-        lerr = fwrite(query->iaq, sizeof(char), wCnt, iomap->ofd);
-        *bytesWritten = *bytesWritten + lerr;
-      }
-      // Parse annotations
-      else if( args->annotCnt != 0 )
-      {
-        // Find how many bytes to use from annotations and write them
-        parseAnnot(abs(args->annotCnt), &annotSz, query);
+    // Write sequence data
+    lerr = writeSequence(iomap, query, seq, wCnt);
+    *bytesWritten = *bytesWritten + lerr;
+  } 
 
-        if( args->annotCnt > 0 )
-        {
-          // Check if next entire query (raw annotations and sequence) fits in output file based on size limit option
-          wCnt = annotSz + rawSeqSz + 1; 
-        
-          // Reached limit on number of bytes, we are done
-          if( (wCnt + *bytesWritten) > args->bytesLimit )
-          {
-            *done = 1;
-            break;
-          }
+  // Count sequences written to output file    
+  iomap->xCnt++;
+  STATS(rec->phase[PH_WRITE] += statsTime() - t1; rec->count[CN_RECS_SELECTED]++;)
+  if( iomap->quota != NULL && addQuotaRecord(iomap->quota, *bytesWritten, query->mhits, query->nhits) != 0 )
+    return ERROR;
 
-          // Write annotation
-          lerr = fwrite(query->iaq, sizeof(char), annotSz, iomap->ofd);
-          *bytesWritten = *bytesWritten + lerr;
-        
-          lerr = fwrite("\n", sizeof(char), 1, iomap->ofd);
-          *bytesWritten = *bytesWritten + lerr;
+  // Query is routed to groups of each hit ID it matched after filtering
+  for(i = 0LL; hits->pipeMode == 2 && i < query->nhits; i++)
+    if( addGroupRecord(&hits->groups, recOff, *bytesWritten - recOff, query->mhits[i]) != 0 )
+      return ERROR;
 
-          // Write sequence data
-          lerr = fwrite(query->isq, sizeof(char), rawSeqSz, iomap->ofd);
-          *bytesWritten = *bytesWritten + lerr;
-        }
-        else
-        {
-          // Check if next entire raw annotations fits in output file based on size limit option
-          wCnt = annotSz; 
+  return 0;
+}
 
-          // Reached limit on number of bytes, we are done
-          if( (wCnt + *bytesWritten) > args->bytesLimit )
-          {
-            *done = 1;
-             break;
-          }
 
-          // Write annotation without ">" symbol
-          lerr = fwrite(query->iaq+1, sizeof(char), annotSz-1, iomap->ofd);
-          *bytesWritten = *bytesWritten + lerr;
-          
-          lerr = fwrite("\n", sizeof(char), 1, iomap->ofd);
-          *bytesWritten = *bytesWritten + lerr;
-        }
-      }
-      // Do not write annotations
-      else
-      {
-        // Check if next entire query (raw annotations and sequence) fits in output file based on size limit option
-        // Reached limit on number of bytes, we are done
-        wCnt = rawSeqSz;
-        if( (wCnt + *bytesWritten) > args->bytesLimit )
-        {
-          *done = 1;
-          break;
-        }
+// Select current query by each job of batch mode and write it to outputs of jobs
+// Every job begins at current query, matched annotations of a job do not move query of other jobs
+// Returns 1 if quotas of all jobs are met, ERROR if query cannot be recorded, 0 otherwise
+int filterJobs(iomap_t *iomap, query_t *query, mpi_t *mpi, long long int annotSz, long long int seqSz, long long int rawSeqSz)
+{
+  int i;             // Iteration variable
+  int err;           // Trap errors
+  int active;        // Number of jobs with quotas not met
+  job_t *job;        // Current job
+  query_t jquery;    // Current query of job
+
+  active = 0;
+  for(i = 0; i < iomap->njobs; i++)
+  {
+    job = &iomap->jobs[i];
+    if( job->done != 0 )
+      continue;
 
-        // Write sequence data
-        lerr = fwrite(query->isq, sizeof(char), wCnt, iomap->ofd);
-        *bytesWritten = *bytesWritten + lerr;
-      } 
-   
-      // Count sequences written to output file    
-      iomap->xCnt++;
+    // Output of job is batched from current memory map
+    job->map.iMap = iomap->iMap;
+    job->map.fMap = iomap->fMap;
+    job->map.mapOff = iomap->mapOff;
+
+    if( isQuotaMet(&job->args, &job->map, &job->hits, mpi) != 0 )
+    {
+      job->done = 1;
+      continue;
     }
+
+    // Matched hit ID indices are shared by jobs and may grow
+    jquery = *query;
+    err = filterQuery(&job->args, &job->map, &jquery, &job->hits, &job->out.bytesWritten, annotSz, seqSz, rawSeqSz);
+    query->mhits = jquery.mhits;
+    query->maxHits = jquery.maxHits;
+    if( err == ERROR )
+      return ERROR;
+    if( err != 0 )
+      job->done = 1;
+    else
+      active++;
   }
 
-  return 0;
+  return (active == 0) ? 1 : 0;
 }
 
 
-// Adjust memory map to data in query file based on a requested size
-// Copies first section of query to a temporary buffer in case it lies between partitions
-int adjustMapBegin(long long int *offset, iomap_t *iomap, query_t *query)
+// Set header tokens needed for matching hit IDs or trimming annotation fields of current mode or of any job
+// Matching needs every annotation, trimming needs fields, trimming without matching only needs fields of first annotation
+// Returns 1 if headers are tokenized, 0 otherwise
+int setHeaderTokens(args_t *args, iomap_t *iomap, hits_t *hits, int *fields, long long int *limit)
 {
-  char *c;                // Character read
-  long long int buflen;   // New length of temporary buffer
-  long long int i;        // Iteration variable
+  int i;             // Iteration variable
+  int match;         // Flag for matching hit IDs
+  int trim;          // Flag for trimming annotation fields
+  int jfields;       // Fields needed by current job
+  long long int jlimit;  // Delimiters needed by current job
 
-  // Read current memory map in order
-  i = 0LL;
-  c = iomap->iMap;
-  while( c != iomap->fMap )
+  *fields = 0;
+  *limit = 0LL;
+
+  // Batch mode needs tokens of every job
+  if( iomap->jobs != NULL )
   {
-    // End-of-file, no adjustment
-    if( (int)(*c) == EOF )
-    {
-      fprintf(stdout, "\nError: end-of-file detected in memory map in adjustMapBegin()\n");
-      return ERROR;
-    }
-    // Found the beginning of a sequence
-    else if ( *c == '>' )
+    for(i = 0; i < iomap->njobs; i++)
     {
-      // Set map to begin with this sequence
-      *offset = i;
-      
-      // Query found and data pertaining to previous query in temporary buffer 
-      if( *offset > 0LL )
+      if( setHeaderTokens(&iomap->jobs[i].args, &iomap->jobs[i].map, &iomap->jobs[i].hits, &jfields, &jlimit) != 0 )
       {
-        // Reallocate buffer to fit new data lying between memory maps
-        buflen = query->buflen + *offset;
-        query->buf = (char *)realloc(query->buf, buflen);
-        if( query->buf == NULL )
-        {
-          fprintf(stdout, "\nError: failed to reallocate buffer for inter-mapped queries in adjustMapBegin()\n");
-          return ERROR;
-        }
- 
-        // Set pointer to end of buffer
-        query->fbuf = query->buf + buflen - 1;
-
-        // Copy query
-        memcpy(query->buf + query->buflen, iomap->iMap, *offset);
-        query->buflen = buflen;
-
-        // Adjust initial pointer of memory map
-        iomap->iMap = iomap->iMap + *offset;
+        *fields = *fields | jfields;
+        *limit = MAX(*limit, jlimit);
       }
-
-      return 0;
     }
-
-    // Read next character
-    c++;
-    i++;
+    return (*limit > 0LL) ? 1 : 0;
   }
 
-  // Print error since we should have reached at least 1 query in memory map
-  // If a single query is larger than one map, not correct behavior
-  fprintf(stdout, "\nError: end of memory map reached in adjustMapBegin(), no query found\n");
+  match = (hits->pipeMode != 0 || hits->searchMode != 0) ? 1 : 0;
+  trim = (args->annotCnt != INT_MAX && args->annotCnt != INT_MIN+1 && args->annotCnt != 0) ? 1 : 0;
+  if( match == 0 && trim == 0 )
+    return 0;
 
-  return ERROR;
+  *fields = trim;
+  *limit = (match == 0) ? (long long int)abs(args->annotCnt) : LLONG_MAX;
+
+  return 1;
 }
 
-// Adjust memory map to data in query file based on a requested size
-// Copies last query to a temporary buffer in case it lies between partitions
-int adjustMapEnd(iomap_t *iomap, query_t *query)
+
+// Extract queries in current memory map
+// Headers are tokenized once per query, tokens are shared by all jobs of batch mode
+// In batch mode, each query is filtered by all jobs
+int extractQueries(args_t *args, iomap_t *iomap, query_t *query, hits_t *hits, mpi_t *mpi, long long int *bytesWritten, int *done)
+{
+  int i;                       // Iteration variable
+  int err;                     // Trap errors
+  int fail;                    // Flag for failed tokenizing or filtering
+  long long int annotSz;       // Size of annotations in bytes
+  long long int seqSz;         // Size of sequence data in bytes
+  long long int rawSeqSz;      // Size of sequence data in bytes before parsing
+  double t0 = 0.0;             // Time of beginning of parsing
+  statsrec_t *rec = NULL;      // Statistics of current thread
+  int fields;                  // Flag for tokenizing fields of headers
+  long long int limit;         // Delimiters tokenized per header
+  hdrtok_t tok;                // Annotations and fields of current header
+  seqfmt_t fmt;                // Rewritten sequence of current query
+
+  STATS(rec = statsThread(&stats);)
+
+  query->tok = (setHeaderTokens(args, iomap, hits, &fields, &limit) != 0) ? &tok : NULL;
+  initHeaderTokens(&tok, fields, limit);
+  initSeqFormat(&fmt);
+  query->fmt = &fmt;
+  query->mhits = NULL;
+  query->maxHits = 0LL;
+  fail = 0;
+
+  // Loop until end of mapped memory is reached or sequence count quota is reached
+  while( 1 )
+  {
+    // Sequence count quota is met, set done flag
+    if( iomap->jobs == NULL && isQuotaMet(args, iomap, hits, mpi) != 0 )
+    {
+      *done = 1;
+      break;
+    }
+    
+    // Get next sequence annotations
+    STATS(t0 = statsTime();)
+    err = getAnnot(iomap, query);
+    if( err != 0 )
+      break;
+      
+    // Compute annotation size
+    annotSz = (long long int)(query->faq - query->iaq + 1);
+
+    // Find annotations and fields of header in a single pass
+    query->hann = 0LL;
+    if( query->tok != NULL && tokenizeHeader(query->tok, query->iaq, query->faq) != 0 )
+    {
+      fail = 1;
+      break;
+    }
+  
+    // Get next query sequence
+    err = getSequence(&seqSz, iomap, query);
+    if( err != 0 )
+      break;
+   
+    // Compute raw sequence size
+    rawSeqSz = (long long int)(query->fsq - query->isq + 1);
+    STATS(rec->phase[PH_PARSE] += statsTime() - t0; rec->count[CN_RECS_SCANNED]++;)
+
+    // Select query and prepare it for output
+    if( iomap->jobs != NULL )
+      err = filterJobs(iomap, query, mpi, annotSz, seqSz, rawSeqSz);
+    else
+      err = filterQuery(args, iomap, query, hits, bytesWritten, annotSz, seqSz, rawSeqSz);
+    if( err == ERROR )
+    {
+      fail = 1;
+      break;
+    }
+
+    // Reached limit on number of bytes or quotas of all jobs, we are done
+    // Full flag is published, sequences of following processes do not fit either
+    if( err != 0 )
+    {
+      if( iomap->jobs == NULL && iomap->quota != NULL )
+        publishQuota(iomap->quota, mpi);
+      *done = 1;
+      break;
+    }
+  }
+
+  // Header tokens are only valid in current memory map, rewritten sequences are already copied to output
+  freeHeaderTokens(&tok);
+  freeSeqFormat(&fmt);
+  free(query->mhits);
+  query->tok = NULL;
+  query->fmt = NULL;
+  query->mhits = NULL;
+  query->maxHits = 0LL;
+  if( fail != 0 )
+    return ERROR;
+
+  // Write batched output while memory map and temporary buffer are still valid
+  STATS(t0 = statsTime();)
+  if( iomap->ovec != NULL && flushOutVec(iomap->ovec) != 0 )
+    return ERROR;
+  for(i = 0; i < iomap->njobs; i++)
+    if( iomap->jobs[i].map.ovec != NULL && flushOutVec(iomap->jobs[i].map.ovec) != 0 )
+      return ERROR;
+  STATS(rec->phase[PH_WRITE] += statsTime() - t0;)
+
+  return 0;
+}
+
+
+// Allocate sequence count and size quotas of a process or a thread
+// Returns 1 if no quota applies, ERROR if quotas cannot be allocated, 0 otherwise
+int allocQuota(args_t *args, hits_t *hits, quota_t *quota)
+{
+  memset(quota, 0, sizeof(quota_t));
+  if( args->seqCnt == SEQ_COUNT && args->bytesLimit == BYTES_LIMIT && hits->pipeMode == 0 && hits->searchMode == 0 )
+    return 1;
+
+  quota->seqCnt = args->seqCnt;
+  quota->bytesLimit = args->bytesLimit;
+  if( hits->pipeMode != 0 || hits->searchMode != 0 )
+  {
+    quota->hitCnt = hits->htotal;
+    quota->seqCnt = MIN(quota->seqCnt, hits->htotal);
+  }
+
+  quota->maxRecs = QUOTA_INIT;
+  quota->cum = (long long int *)malloc(sizeof(long long int) * quota->maxRecs);
+  quota->hend = (long long int *)malloc(sizeof(long long int) * quota->maxRecs);
+  quota->maxHits = QUOTA_INIT;
+  quota->hlist = (long long int *)malloc(sizeof(long long int) * quota->maxHits);
+  if( quota->cum == NULL || quota->hend == NULL || quota->hlist == NULL )
+  {
+    freeQuota(quota);
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Free quotas of a process or a thread
+int freeQuota(quota_t *quota)
+{
+  free(quota->cum);
+  free(quota->hend);
+  free(quota->hlist);
+  free(quota->shared);
+  quota->cum = quota->hend = quota->hlist = quota->shared = NULL;
+
+  return 0;
+}
+
+
+// Initialize sequence count and size quotas shared by processes
+// Quotas are shared if several processes write uncompressed output, same in all processes
+// Threads of a process keep their own quotas, sequences they keep are recorded in quotas of their process
+// Pipeline and search modes have a quota of hit IDs, processes stop when all of them are found
+int initQuota(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, quota_t *quota)
+{
+  int err;               // Trap errors
+  long long int *base;   // Shared counters in master
+
+  memset(quota, 0, sizeof(quota_t));
+  iomap->quota = NULL;
+  if( mpi->procCnt == 1 || args->bgzfMode != 0 || iomap->stream != 0 )
+    return 0;
+  err = allocQuota(args, hits, quota);
+  if( err == 1 )
+    return 0;
+  quota->shared = (long long int *)malloc(sizeof(long long int) * mpi->procCnt * 3);
+  if( err == 0 && quota->shared == NULL )
+    err = ERROR;
+
+  // Master holds sequences, bytes and full flag of each process
+  if( MPI_Win_allocate((mpi->procRank == 0) ? (MPI_Aint)(sizeof(long long int) * mpi->procCnt * 3) : 0, sizeof(long long int), MPI_INFO_NULL, mpi->MPI_MY_WORLD, &base, &quota->win) != MPI_SUCCESS )
+    err = ERROR;
+  else if( mpi->procRank == 0 )
+    memset(base, 0, sizeof(long long int) * mpi->procCnt * 3);
+
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( err != 0 )
+  {
+    fprintf(stdout, "\nError: failed to allocate quotas shared by processes\n");
+    freeQuota(quota);
+    return ERROR;
+  }
+
+  // Counters are read and written with atomic accumulate operations until quotas are trimmed
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, quota->win);
+  iomap->quota = quota;
+
+  return 0;
+}
+
+
+// Publish counters of current process to master, they are visible to other processes once flushed
+int publishQuota(quota_t *quota, mpi_t *mpi)
+{
+  long long int own[3];    // Counters of current process
+
+  // Quotas of a thread are not shared
+  if( quota->shared == NULL )
+    return 0;
+
+  own[0] = quota->nrecs;
+  own[1] = (quota->nrecs > 0LL) ? quota->cum[quota->nrecs - 1] : 0LL;
+  own[2] = quota->full;
+  MPI_Accumulate(own, 3, MPI_LONG_LONG_INT, 0, (MPI_Aint)mpi->procRank * 3, 3, MPI_LONG_LONG_INT, MPI_REPLACE, quota->win);
+  MPI_Win_flush(0, quota->win);
+
+  return 0;
+}
+
+
+// Publish counters of current process and fetch counters of all processes, every QUOTA_CHECK records
+// Counters of other processes may be behind, they only grow
+// Returns 1 if previous processes met a quota, 0 otherwise
+// Pipeline and search modes have a sequence quota no larger than hit IDs, later processes never stop earlier ones
+int checkQuota(quota_t *quota, mpi_t *mpi)
+{
+  int i;                   // Iteration variable
+  long long int prev[3];   // Counters of previous processes
+
+  quota->scanned++;
+  if( quota->shared == NULL || quota->scanned < quota->next )
+    return 0;
+  quota->next = quota->scanned + QUOTA_CHECK;
+
+  publishQuota(quota, mpi);
+  MPI_Get_accumulate(NULL, 0, MPI_LONG_LONG_INT, quota->shared, mpi->procCnt * 3, MPI_LONG_LONG_INT, 0, 0, mpi->procCnt * 3, MPI_LONG_LONG_INT, MPI_NO_OP, quota->win);
+  MPI_Win_flush(0, quota->win);
+
+  prev[0] = prev[1] = prev[2] = 0LL;
+  for(i = 0; i < mpi->procRank; i++)
+  {
+    prev[0] = prev[0] + quota->shared[i*3];
+    prev[1] = prev[1] + quota->shared[i*3+1];
+    prev[2] = prev[2] + quota->shared[i*3+2];
+  }
+
+  if( prev[0] >= quota->seqCnt || prev[1] >= quota->bytesLimit || prev[2] != 0LL )
+    return 1;
+
+  return 0;
+}
+
+
+// Record bytes written after a sequence extracted and hit ID indices (hidx) of its n hit IDs
+int addQuotaRecord(quota_t *quota, long long int bytes, const long long int *hidx, long long int n)
+{
+  void *p;                 // Reallocated memory
+  long long int nhits;     // Hit ID indices recorded
+
+  if( quota->nrecs == quota->maxRecs )
+  {
+    p = realloc(quota->cum, sizeof(long long int) * quota->maxRecs * 2LL);
+    if( p == NULL )
+      return ERROR;
+    quota->cum = (long long int *)p;
+
+    p = realloc(quota->hend, sizeof(long long int) * quota->maxRecs * 2LL);
+    if( p == NULL )
+      return ERROR;
+    quota->hend = (long long int *)p;
+
+    quota->maxRecs = quota->maxRecs * 2LL;
+  }
+
+  nhits = (quota->nrecs > 0LL) ? quota->hend[quota->nrecs - 1] : 0LL;
+  if( nhits + n > quota->maxHits )
+  {
+    p = realloc(quota->hlist, sizeof(long long int) * (quota->maxHits * 2LL + n));
+    if( p == NULL )
+      return ERROR;
+    quota->hlist = (long long int *)p;
+    quota->maxHits = quota->maxHits * 2LL + n;
+  }
+
+  memcpy(quota->hlist + nhits, hidx, sizeof(long long int) * n);
+  quota->cum[quota->nrecs] = bytes;
+  quota->hend[quota->nrecs] = nhits + n;
+  quota->nrecs++;
+
+  return 0;
+}
+
+
+// Get number of sequences of quotas that fit after sequences, bytes and full flag of previous processes or threads (prev)
+long long int keepQuota(quota_t *quota, const long long int *prev)
+{
+  long long int keep;      // Sequences kept
+
+  // A previous process stopped at a sequence that did not fit, no sequence follows it
+  keep = (prev[2] != 0LL) ? 0LL : MIN(quota->nrecs, MAX(0LL, quota->seqCnt - prev[0]));
+  while( keep > 0LL && (prev[1] + quota->cum[keep - 1]) > quota->bytesLimit )
+    keep--;
+
+  return keep;
+}
+
+
+// Trim outputs of threads of current process in order of query file, same as quotas of processes
+// Threads follow sequences already extracted by current process (iomap), found flags of hit IDs before threads are in found
+// Sequences kept are recorded in quotas of current process, if quotas are shared by processes
+int trimThreadQuotas(quota_t *tq, int tcnt, spanlist_t *tspans, long long int *tbytes, long long int *txcnt, iomap_t *iomap, hits_t *hits, const int *found, long long int bytesWritten)
+{
+  int t;                   // Iteration variable
+  long long int i;         // Iteration variable
+  long long int prev[3];   // Sequences, bytes and full flag of previous threads
+  long long int keep;      // Sequences kept of current thread
+  long long int nhits;     // Hit ID indices of sequences kept
+  long long int *tkeep;    // Sequences kept of each thread
+
+  tkeep = (long long int *)malloc(sizeof(long long int) * tcnt);
+  if( tkeep == NULL )
+    return ERROR;
+
+  prev[0] = iomap->xCnt;
+  prev[1] = bytesWritten;
+  prev[2] = 0LL;
+  for(t = 0; t < tcnt; t++)
+  {
+    keep = keepQuota(&tq[t], prev);
+    tkeep[t] = keep;
+    prev[0] = prev[0] + tq[t].nrecs;
+    prev[1] = prev[1] + tbytes[t];
+    prev[2] = prev[2] + tq[t].full;
+    if( keep == tq[t].nrecs )
+      continue;
+
+    VERBOSE(fprintf(stdout, "Quotas keep %lld of %lld sequences extracted by thread %d\n", keep, tq[t].nrecs, t);)
+    txcnt[t] = keep;
+    tbytes[t] = (keep > 0LL) ? tq[t].cum[keep - 1] : 0LL;
+    truncateSpans(&tspans[t], tbytes[t]);
+  }
+
+  // Hit IDs of sequences removed are found only if found before threads or by sequences kept
+  for(t = 0; t < tcnt && hits->charVect != NULL && tq[0].hitCnt > 0LL; t++)
+  {
+    nhits = (tkeep[t] > 0LL) ? tq[t].hend[tkeep[t] - 1] : 0LL;
+    for(i = nhits; tq[t].nrecs > 0LL && i < tq[t].hend[tq[t].nrecs - 1]; i++)
+      hits->charVect[tq[t].hlist[i]] = found[tq[t].hlist[i]];
+  }
+  for(t = 0; t < tcnt && hits->charVect != NULL && tq[0].hitCnt > 0LL; t++)
+  {
+    nhits = (tkeep[t] > 0LL) ? tq[t].hend[tkeep[t] - 1] : 0LL;
+    for(i = 0LL; i < nhits; i++)
+      hits->charVect[tq[t].hlist[i]] = 1;
+  }
+
+  // Sequences kept follow output of previous threads in output of current process
+  for(t = 0; t < tcnt && iomap->quota != NULL; t++)
+  {
+    for(i = 0LL; i < tkeep[t]; i++)
+    {
+      nhits = (i > 0LL) ? tq[t].hend[i - 1] : 0LL;
+      if( addQuotaRecord(iomap->quota, bytesWritten + tq[t].cum[i], tq[t].hlist + nhits, tq[t].hend[i] - nhits) != 0 )
+      {
+        free(tkeep);
+        return ERROR;
+      }
+    }
+    bytesWritten = bytesWritten + tbytes[t];
+  }
+  free(tkeep);
+
+  return 0;
+}
+
+
+// Trim output of current process to the sequences that fit after output of previous processes
+// Output file or output spans are truncated, hit IDs of sequences removed are not found
+int trimQuota(quota_t *quota, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  long long int own[3];    // Sequences, bytes and full flag of current process
+  long long int prev[3];   // Sums of previous processes
+  long long int keep;      // Sequences kept
+  long long int len;       // Bytes kept
+  long long int nhits;     // Hit ID indices of sequences kept
+  long long int i;         // Iteration variable
+  int err;                 // Trap errors
+
+  if( iomap->quota == NULL )
+    return 0;
+  MPI_Win_unlock_all(quota->win);
+  MPI_Win_free(&quota->win);
+  iomap->quota = NULL;
+
+  own[0] = quota->nrecs;
+  own[1] = *bytesWritten;
+  own[2] = quota->full;
+  prev[0] = prev[1] = prev[2] = 0LL;
+  MPI_Exscan(own, prev, 3, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+  if( mpi->procRank == 0 )
+    prev[0] = prev[1] = prev[2] = 0LL;
+
+  keep = keepQuota(quota, prev);
+  len = (keep > 0LL) ? quota->cum[keep - 1] : 0LL;
+
+  err = 0;
+  if( keep < quota->nrecs )
+  {
+    VERBOSE(fprintf(stdout, "Quotas keep %lld of %lld sequences extracted\n", keep, quota->nrecs);)
+    if( iomap->spans != NULL )
+      err = truncateSpans(iomap->spans, len);
+    else if( iomap->ofd != NULL )
+      err = ftruncate(fileno(iomap->ofd), (off_t)len);
+
+    // Sequences kept may have same hit IDs as sequences removed
+    if( quota->hitCnt > 0LL )
+    {
+      nhits = (keep > 0LL) ? quota->hend[keep - 1] : 0LL;
+      for(i = nhits; i < quota->hend[quota->nrecs - 1]; i++)
+        hits->charVect[quota->hlist[i]] = 0;
+      for(i = 0LL; i < nhits; i++)
+        hits->charVect[quota->hlist[i]] = 1;
+    }
+    iomap->xCnt = keep;
+    *bytesWritten = len;
+
+    // Queries of groups are recorded in the same order, once per hit ID, queries kept end before len
+    while( hits->pipeMode == 2 && hits->groups.nrecs > 0LL && hits->groups.recOff[hits->groups.nrecs - 1] >= len )
+      hits->groups.nrecs--;
+  }
+
+  freeQuota(quota);
+
+  return (err != 0) ? ERROR : 0;
+}
+
+
+// Adjust end of memory map window to end before beginning of last query
+// Last query may lie between windows, next window begins at it
+int adjustMapEnd(long long int *next, iomap_t *iomap)
 {
   char *c;          // Character read
   long long int i;  // Iteration variable
@@ -1093,21 +2107,12 @@ int adjustMapEnd(iomap_t *iomap, query_t *query)
       fprintf(stdout, "\nError: end-of-file detected in memory map in adjustMapEnd()\n");
       return ERROR;
     }
-    // Found the beginning of a sequence, copy last query to temp buffer
+    // Found the beginning of a sequence, next window begins at it
     else if ( *c == '>' )
     {
       // Adjust end pointer of memory map  
       iomap->fMap = iomap->fMap - (i + 1);
- 
-      // Allocate buffer
-      query->buflen = i + 1;
-      query->buf = (char *)malloc(sizeof(char) * query->buflen);
-      
-      // Set pointer to end of buffer
-      query->fbuf = query->buf + query->buflen - 1;
-      
-      // Copy last query because maybe it lies between partitions
-      memcpy(query->buf, iomap->fMap + 1, query->buflen);
+      *next = iomap->mapOff + (long long int)(c - iomap->iMap);
     
       return 0;  
     }
@@ -1141,6 +2146,8 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
   long long int next_sz;
   int fileFlag;
   long long int totalBytesWritten;
+  int useAio = 0;                 // Flag for writes of master queued with io_uring
+  aiowr_t aw;                     // Write-behind queue of combined output file
 
   // Single process, do nothing
   if( mpi->procCnt == 1 )
@@ -1166,8 +2173,8 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
     }
     else
     {
-      // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ
-      setvbuf(ofd, NULL, _IOFBF, STRM_BUFSIZ);
+      // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ, or as set by memory budget
+      setvbuf(ofd, NULL, _IOFBF, budget.outBuf);
 
       // Check that some output was generated
       for(i = 0; i < mpi->procCnt; i++)
@@ -1179,8 +2186,14 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
         fileFlag = ERROR;
       }
       else
+      {
         // Set size and hint kernel about output file
         ftruncate(fileno(ofd), totalBytesWritten);
+
+        // Chunks are written while next chunk is read or received
+        if( args->aioMode != AIO_NONE && openAioWriter(&aw, fileno(ofd), args->aioMode) == 0 )
+          useAio = 1;
+      }
     }
   }
  
@@ -1225,7 +2238,10 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
         posix_fadvise(fileno(iomap->ofd), curr_off, next_sz, POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
  
         // Write the current chunk 
-        bytesWrite = fwrite(outbuf, sizeof(char), curr_sz, ofd);
+        if( useAio != 0 )
+          bytesWrite = (writeAio(&aw, outbuf, curr_sz) == 0) ? curr_sz : 0;
+        else
+          bytesWrite = fwrite(outbuf, sizeof(char), curr_sz, ofd);
         if( bytesWrite != curr_sz )
           fprintf(stdout, "Process did not write chunk size correctly\n");
       
@@ -1256,7 +2272,10 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
         MPI_Recv(outbuf, curr_sz, MPI_CHAR, i, 0, mpi->MPI_MY_WORLD, &status);
 
         // Write chunk
-        bytesWrite = fwrite(outbuf, sizeof(char), curr_sz, ofd);
+        if( useAio != 0 )
+          bytesWrite = (writeAio(&aw, outbuf, curr_sz) == 0) ? curr_sz : 0;
+        else
+          bytesWrite = fwrite(outbuf, sizeof(char), curr_sz, ofd);
         if( bytesWrite != curr_sz )
           fprintf(stderr, "Error: bytes written do not match in fwrite(), partition query file\n");
         
@@ -1271,6 +2290,8 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
     }
 
     // Free resources
+    if( useAio != 0 && closeAioWriter(&aw) != 0 )
+      fprintf(stderr, "Error: failed to write combined output file\n");
     fflush(ofd);
     fclose(ofd);
   }
@@ -1304,731 +2325,3050 @@ int combineOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int b
         MPI_Send(dataBuf, curr_sz, MPI_CHAR, 0, 0, mpi->MPI_MY_WORLD);
       }
 
-      free(dataBuf);
-    }
+      free(dataBuf);
+    }
+  }
+
+  // Free bytes written array
+  free(dataLen);
+
+  return 0;
+}
+
+
+// Merges output files into a single file without sending data to master
+// Output offset of each process is the exclusive prefix sum of bytes written, so order is the same as combineOutputFiles()
+// Data is written with MPI-IO collective writes (merge mode 1) or pwrite() on a shared file system (merge mode 2)
+// Output spans are written with pwrite() from query file and pool (merge mode 3), also for a single process
+int mergeOutputFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, long long int bytesWritten)
+{
+  char *dataBuf;                  // Data buffer
+  int fileFlag;                   // Flag for errors in any process
+  int allFileFlag;                // Flag for errors in all processes
+  int fd;                         // Output file descriptor (pwrite)
+  long long int outOff;           // Offset of current process in output file
+  long long int totalBytesWritten; // Bytes written by all processes
+  long long int nchunks;          // Chunks of current process
+  long long int maxChunks;        // Chunks of process with most data
+  long long int chunk;            // Current chunk
+  long long int currOff;          // Offset of current chunk
+  long long int currSz;           // Size of current chunk
+  long long int bytesRead;        // Bytes read from output file of current process
+  long long int bytesWrite;       // Bytes written to combined output file
+  long long int n;                // Bytes written by pwrite()
+  MPI_File fh;                    // Output file handle (MPI-IO)
+  MPI_Status status;
+
+  // Single process, do nothing unless output was kept as spans
+  if( mpi->procCnt == 1 && args->mergeMode != 3 )
+    return 0;
+
+  // Compute offset of current process and total size of output file
+  outOff = 0LL;
+  MPI_Exscan(&bytesWritten, &outOff, 1, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+  if( mpi->procRank == 0 )
+    outOff = 0LL;
+  MPI_Allreduce(&bytesWritten, &totalBytesWritten, 1, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+  if( totalBytesWritten == 0 )
+  {
+    // Same as removing empty output file
+    if( args->mergeMode == 3 )
+    {
+      if( mpi->procRank == 0 )
+        fprintf(stdout, "\nWarning: removing empty output file\n");
+      remove(args->of);
+      return 0;
+    }
+
+    fprintf(stdout, "Error: failed to create combined output file\n");
+    return ERROR;
+  }
+
+  // Collective writes need the same number of calls in all processes
+  nchunks = (bytesWritten + BCAST_LIMIT - 1) / BCAST_LIMIT;
+  MPI_Allreduce(&nchunks, &maxChunks, 1, MPI_LONG_LONG_INT, MPI_MAX, mpi->MPI_MY_WORLD);
+
+  // Open combined output file and set its size
+  fileFlag = 0;
+  fd = -1;
+  if( args->mergeMode == 1 )
+  {
+    if( MPI_File_open(mpi->MPI_MY_WORLD, args->of, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS )
+    {
+      fprintf(stderr, "\nError: MPI_File_open() failed for combined output file\n");
+      return ERROR;
+    }
+    // Truncates a previous output file
+    MPI_File_set_size(fh, (MPI_Offset)totalBytesWritten);
+  }
+  else
+  {
+    // Master creates file, then all processes open it
+    if( mpi->procRank == 0 )
+    {
+      fd = open(args->of, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if( fd < 0 || ftruncate(fd, (off_t)totalBytesWritten) != 0 )
+      {
+        fprintf(stderr, "\n");
+        perror("open()");
+        fileFlag = ERROR;
+      }
+    }
+    MPI_Bcast(&fileFlag, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+    if( fileFlag == 0 && mpi->procRank != 0 )
+    {
+      fd = open(args->of, O_WRONLY);
+      if( fd < 0 )
+      {
+        fprintf(stderr, "\n");
+        perror("open()");
+        fileFlag = ERROR;
+      }
+    }
+    MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+    if( allFileFlag != 0 )
+    {
+      fprintf(stdout, "Error: failed to create combined output file\n");
+      if( fd >= 0 )
+        close(fd);
+      return ERROR;
+    }
+  }
+
+  // Write output spans, query file data is read again
+  if( args->mergeMode == 3 )
+  {
+    fileFlag = writeSpans(iomap->spans, fileno(iomap->qfd), fd, outOff);
+    close(fd);
+    MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+
+    return (allFileFlag != 0) ? ERROR : 0;
+  }
+
+  // Set file position at beginning 
+  rewind(iomap->ofd);
+  posix_fadvise(fileno(iomap->ofd), 0, bytesWritten, POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
+  
+  // Copy data of current process in chunks
+  dataBuf = (char *)malloc(sizeof(char) * MAX(1LL, MIN(BCAST_LIMIT, bytesWritten)));
+  currOff = 0LL;
+  for(chunk = 0LL; chunk < maxChunks; chunk++)
+  {
+    // Read chunk, processes with less data write nothing
+    currSz = MIN(BCAST_LIMIT, bytesWritten - currOff);
+    bytesRead = 0LL;
+    if( currSz > 0LL )
+    {
+      bytesRead = fread(dataBuf, sizeof(char), currSz, iomap->ofd);
+      if( bytesRead != currSz )
+      {
+        fprintf(stderr, "Error: bytes read do not match in fread(), merge output files\n");
+        fileFlag = ERROR;
+      }
+    }
+
+    // Write chunk
+    if( args->mergeMode == 1 )
+    {
+      if( MPI_File_write_at_all(fh, (MPI_Offset)(outOff + currOff), dataBuf, (int)bytesRead, MPI_CHAR, &status) != MPI_SUCCESS )
+        fileFlag = ERROR;
+    }
+    else
+    {
+      for(bytesWrite = 0LL; bytesWrite < bytesRead; bytesWrite = bytesWrite + n)
+      {
+        n = (long long int)pwrite(fd, dataBuf + bytesWrite, bytesRead - bytesWrite, (off_t)(outOff + currOff + bytesWrite));
+        if( n <= 0LL )
+        {
+          fprintf(stderr, "\n");
+          perror("pwrite()");
+          fileFlag = ERROR;
+          break;
+        }
+      }
+    }
+    currOff = currOff + bytesRead;
+  }
+  free(dataBuf);
+
+  if( args->mergeMode == 1 )
+    MPI_File_close(&fh);
+  else
+    close(fd);
+
+  // Check that all processes wrote their data
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
+    return ERROR;
+
+  return 0;
+}
+
+
+// Write to output file hit IDs from BLAST table file not found in query file
+int writeHitsNotFound(char *of, hits_t *hits, mpi_t *mpi)
+{
+  char outfile[FILE_LEN];
+  int *allCharVect;
+  int fileFlag;
+  int i;
+  int bytesWrite;
+  int fsize;
+  struct stat stbuf;
+
+  // Flag to signal file errors
+  fileFlag = 0;
+
+  // Master writes to file
+  if( mpi->procRank == 0 )
+  {
+    // Create output filename
+    snprintf(outfile, FILE_LEN, "%s.notFound", of);
+
+    // Open output file
+    hits->ofd = fopen(outfile, "wb");
+    if( hits->ofd == NULL )
+    {
+      fprintf(stderr, "\n");
+      perror("fopen()");
+      fileFlag = ERROR;
+    }
+    else
+      // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ, or as set by memory budget
+      setvbuf(hits->ofd, NULL, _IOFBF, budget.outBuf);
+  }
+
+  // Check if file can be written
+  MPI_Bcast(&fileFlag, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( fileFlag != 0 )
+    return ERROR;
+ 
+  allCharVect = (int *)malloc(sizeof(int) * hits->htotal);
+
+  // Sum all processes characteristic vector
+  MPI_Reduce(hits->charVect, allCharVect, hits->htotal, MPI_INT, MPI_SUM, 0, mpi->MPI_MY_WORLD);
+
+  // Determine which hit IDs were not found using the characteristic vector
+  if( mpi->procRank == 0 )
+  {
+    for( i = 0; i < hits->htotal; i++ )
+    {
+      // If characteristic vector is zero, hit ID was not found
+      if( allCharVect[i] == 0 )
+      {
+        bytesWrite = fwrite(getID(&hits->hitIDs, i), sizeof(char), getIDLen(&hits->hitIDs, i), hits->ofd);
+        fputc('\n', hits->ofd);
+      }
+    }
+
+    // Flush output file
+    fflush(hits->ofd);
+    
+    // Close output file
+    fstat(fileno(hits->ofd), &stbuf);
+    fsize = stbuf.st_size;
+    fclose(hits->ofd);
+
+    // Remove output file if empty
+    if( fsize <= 0L )
+    {
+      fprintf(stdout, "\nWarning: removing empty output file of hit IDs\n");
+      remove(outfile);
+    }
+  }
+ 
+  // Free resources 
+  free(allCharVect);
+
+  return 0;
+}
+
+
+// Write a chunk of records of a group at an output offset, or send it to master
+int writeGroupChunk(int fd, int send, mpi_t *mpi, char *buf, long long int len, long long int off)
+{
+  long long int hdr[2];   // Output offset and bytes of chunk
+  long long int n;        // Bytes written by pwrite()
+
+  if( send != 0 )
+  {
+    hdr[0] = off;
+    hdr[1] = len;
+    MPI_Send(hdr, 2, MPI_LONG_LONG_INT, 0, 0, mpi->MPI_MY_WORLD);
+    MPI_Send(buf, (int)len, MPI_CHAR, 0, 0, mpi->MPI_MY_WORLD);
+    return 0;
+  }
+
+  while( len > 0LL )
+  {
+    n = (long long int)pwrite(fd, buf, (size_t)len, (off_t)off);
+    if( n <= 0LL )
+    {
+      fprintf(stderr, "\n");
+      perror("pwrite()");
+      return ERROR;
+    }
+    buf = buf + n;
+    len = len - n;
+    off = off + n;
+  }
+
+  return 0;
+}
+
+
+// Write queries of each group to output file, groups in order of query IDs and queries in order of query file
+// Queries were written once to temporary output file of each process, then routed to groups of their hit IDs
+// Offset of a group is the sum of bytes of previous groups, offset of a process in a group is the exclusive prefix sum of its bytes
+// Queries are written with pwrite() on a shared file system, or sent to master (merge mode 0)
+// Master writes manifest of groups, a line per query ID with output offset, bytes and number of sequences
+int writeGroups(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi)
+{
+  char outfile[FILE_LEN];         // Manifest file
+  char *buf;                      // Data buffer
+  int fileFlag;                   // Flag for errors in any process
+  int allFileFlag;                // Flag for errors in all processes
+  int fd;                         // Output file descriptor
+  int sfd;                        // Temporary output file descriptor
+  int send;                       // Flag for chunks sent to master
+  int r;                          // Iteration variable
+  long long int g;                // Current group
+  long long int e;                // Current entry of group
+  long long int q;                // Current query
+  long long int ng;               // Number of groups
+  long long int done;             // Bytes of current query read
+  long long int n;                // Bytes of current read
+  long long int len;              // Bytes in buffer
+  long long int off;              // Output offset of buffer
+  long long int base;             // Output offset of current group
+  long long int total;            // Bytes of all groups
+  long long int hdr[2];           // Output offset and bytes of chunk received
+  long long int *rankOff;         // Offset of current process in each group
+  long long int *grpTotal;        // Bytes of each group in all processes
+  long long int *grpSeqs;         // Queries of each group in all processes
+  groups_t *groups;               // Groups of hit IDs
+  FILE *mfd;                      // Manifest file stream
+  MPI_Status status;
+
+  groups = &hits->groups;
+  ng = groups->ngroups;
+  fileFlag = sortGroupRecords(groups);
+  rankOff = (long long int *)calloc(ng + 1, sizeof(long long int));
+  grpTotal = (long long int *)malloc(sizeof(long long int) * (ng + 1));
+  grpSeqs = (long long int *)malloc(sizeof(long long int) * (ng + 1));
+  buf = (char *)malloc(sizeof(char) * BCAST_LIMIT);
+  if( rankOff == NULL || grpTotal == NULL || grpSeqs == NULL || buf == NULL )
+    fileFlag = ERROR;
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
+  {
+    free(rankOff);
+    free(grpTotal);
+    free(grpSeqs);
+    free(buf);
+    return ERROR;
+  }
+
+  // Offsets of current process in groups and sizes of groups
+  if( mpi->procCnt > 1 )
+  {
+    MPI_Exscan(groups->grpBytes, rankOff, (int)ng, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+    if( mpi->procRank == 0 )
+      memset(rankOff, 0, sizeof(long long int) * (ng + 1));
+    MPI_Allreduce(groups->grpBytes, grpTotal, (int)ng, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+    MPI_Allreduce(groups->grpSeqs, grpSeqs, (int)ng, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+  }
+  else
+  {
+    memcpy(grpTotal, groups->grpBytes, sizeof(long long int) * ng);
+    memcpy(grpSeqs, groups->grpSeqs, sizeof(long long int) * ng);
+  }
+  total = 0LL;
+  for(g = 0LL; g < ng; g++)
+    total = total + grpTotal[g];
+
+  // Same as removing empty output file
+  if( total == 0LL )
+  {
+    if( mpi->procRank == 0 )
+    {
+      fprintf(stdout, "\nWarning: removing empty output file\n");
+      remove(args->of);
+    }
+    free(rankOff);
+    free(grpTotal);
+    free(grpSeqs);
+    free(buf);
+    return 0;
+  }
+
+  // Master creates file, then all processes open it unless they send their chunks
+  send = (mpi->procCnt > 1 && mpi->procRank != 0 && args->mergeMode == 0) ? 1 : 0;
+  fd = -1;
+  if( mpi->procRank == 0 )
+  {
+    fd = open(args->of, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if( fd < 0 || ftruncate(fd, (off_t)total) != 0 )
+    {
+      fprintf(stderr, "\n");
+      perror("open()");
+      fileFlag = ERROR;
+    }
+  }
+  MPI_Bcast(&fileFlag, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( fileFlag == 0 && mpi->procRank != 0 && send == 0 )
+  {
+    fd = open(args->of, O_WRONLY);
+    if( fd < 0 )
+    {
+      fprintf(stderr, "\n");
+      perror("open()");
+      fileFlag = ERROR;
+    }
+  }
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
+  {
+    fprintf(stdout, "Error: failed to create output file of groups\n");
+    if( fd >= 0 )
+      close(fd);
+    free(rankOff);
+    free(grpTotal);
+    free(grpSeqs);
+    free(buf);
+    return ERROR;
+  }
+
+  // Copy queries of each group from temporary output file in chunks
+  sfd = fileno(iomap->ofd);
+  base = 0LL;
+  for(g = 0LL; g < ng; g++)
+  {
+    off = base + rankOff[g];
+    base = base + grpTotal[g];
+    len = 0LL;
+    for(e = groups->grpStart[g]; e < groups->grpStart[g + 1]; e++)
+    {
+      q = groups->entries[e];
+      for(done = 0LL; done < groups->recLen[q]; done = done + n)
+      {
+        if( len == BCAST_LIMIT )
+        {
+          if( writeGroupChunk(fd, send, mpi, buf, len, off) != 0 )
+            fileFlag = ERROR;
+          off = off + len;
+          len = 0LL;
+        }
+        n = MIN(groups->recLen[q] - done, BCAST_LIMIT - len);
+        if( pread(sfd, buf + len, (size_t)n, (off_t)(groups->recOff[q] + done)) != n )
+        {
+          fprintf(stderr, "Error: bytes read do not match in pread(), output file of groups\n");
+          fileFlag = ERROR;
+        }
+        len = len + n;
+      }
+    }
+    if( len > 0LL && writeGroupChunk(fd, send, mpi, buf, len, off) != 0 )
+      fileFlag = ERROR;
+  }
+
+  // Master writes chunks of other processes, an empty chunk ends data of a process
+  if( send != 0 )
+  {
+    hdr[0] = ERROR;
+    hdr[1] = 0LL;
+    MPI_Send(hdr, 2, MPI_LONG_LONG_INT, 0, 0, mpi->MPI_MY_WORLD);
+  }
+  else if( mpi->procRank == 0 && args->mergeMode == 0 )
+  {
+    for(r = 1; r < mpi->procCnt; r++)
+    {
+      while( 1 )
+      {
+        MPI_Recv(hdr, 2, MPI_LONG_LONG_INT, r, 0, mpi->MPI_MY_WORLD, &status);
+        if( hdr[0] < 0LL )
+          break;
+        MPI_Recv(buf, (int)hdr[1], MPI_CHAR, r, 0, mpi->MPI_MY_WORLD, &status);
+        if( writeGroupChunk(fd, 0, mpi, buf, hdr[1], hdr[0]) != 0 )
+          fileFlag = ERROR;
+      }
+    }
+  }
+  if( fd >= 0 )
+    close(fd);
+
+  // Master writes manifest of groups
+  if( mpi->procRank == 0 )
+  {
+    if( snprintf(outfile, FILE_LEN, "%s%s", args->of, GROUPS_SUFFIX) >= FILE_LEN )
+    {
+      fprintf(stdout, "\nError: manifest file name of groups of %s is too long\n", args->of);
+      fileFlag = ERROR;
+    }
+    else if( (mfd = fopen(outfile, "wb")) == NULL )
+    {
+      fprintf(stderr, "\n");
+      perror("fopen()");
+      fileFlag = ERROR;
+    }
+    else
+    {
+      setvbuf(mfd, NULL, _IOFBF, budget.outBuf);
+      base = 0LL;
+      n = 0LL;
+      for(g = 0LL; g < ng; g++)
+      {
+        fprintf(mfd, "%s\t%lld\t%lld\t%lld\n", getID(&hits->queryIDs, g), base, grpTotal[g], grpSeqs[g]);
+        base = base + grpTotal[g];
+        if( grpSeqs[g] > 0LL )
+          n++;
+      }
+      fclose(mfd);
+      VERBOSE(fprintf(stdout, "Groups written = %lld of %lld (%lld bytes)\n", n, ng, total);)
+    }
+  }
+  free(rankOff);
+  free(grpTotal);
+  free(grpSeqs);
+  free(buf);
+
+  // Check that all processes wrote their groups
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
+    return ERROR;
+
+  return 0;
+}
+
+
+// Partition a range of query file and memory map into chunks for processing
+// Next read-only window is mapped by a prefetch thread while current window is parsed
+// Windows overlap, each one begins at last query of previous window, so no query is copied between windows
+// Windows are sized by memory budget, if budget has no room for two windows next window is loaded after current one is closed
+// A window holding no beginning of query after its first one is loaded again with twice the size
+// Extracts sequences from every record between begin and end file offsets
+int scanQueryRange(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int begin, long long int end, long long int *bytesWritten)
+{
+  int err;                        // Trap errors
+  int done;                       // Flag to signal when sequence count quota has been met
+  long long int nmap;             // Current number of memory map
+  long long int msz;              // Memory map window size
+  long long int psz;              // System's page size
+  long long int next;             // File offset of next memory map window
+  long long int pend;             // File offset of end of partition
+  long long int xcnt;             // Count sequences extracted in current partition
+  long long int woff;             // File offset of current window
+  char *c;                        // Character read
+  mapwin_t wins[2];               // Current and prefetched memory map windows
+  mapwin_t *win;                  // Current memory map window
+  query_t query;                  // Query extraction control struct
+  double t0 = 0.0;                // Time of beginning of wait for window
+  statsrec_t *rec = NULL;         // Statistics of current thread
+
+  STATS(rec = statsThread(&stats);)
+
+  // Check that chunk limits of input memory map respect system's page size
+  // If chunk size is less than page size, set chunks to 1024 page sizes
+  // If chunk size if not a multiple of page size, set chunks to 1024 page sizes
+  // Else use default chunks value
+  psz = (long long int)sysconf(_SC_PAGESIZE);
+  msz = budget.window;
+  if( (msz < psz) || (msz % psz != 0) )
+    msz = psz * 1024LL;	// 4MB
+
+  next = begin;
+  pend = end;
+ 
+  // Process file in memory map windows
+  err = 0;
+  done = 0;
+  xcnt = 0LL;
+  memset(wins, 0, sizeof(wins));
+  wins[0].huge = budget.huge;
+  wins[1].huge = budget.huge;
+  startMapWindow(&wins[0], fileno(iomap->qfd), next, MIN(msz, pend - next), args->aioMode);
+  for(nmap = 0LL; next < pend && !done; nmap++)
+  {
+    // Wait for prefetch of current window
+    win = &wins[nmap % budget.depth];
+    STATS(t0 = statsTime();)
+    err = waitMapWindow(win);
+    STATS(rec->phase[PH_MAP] += statsTime() - t0; rec->count[CN_WINDOWS]++;)
+    if( err != 0 )
+    {
+      fprintf(stderr, "Error: failed to map query file window\n");
+      break;
+    }
+
+    // Debug statement, only for a single thread
+    VERBOSE(if( isWorkerThread() == 0 ) fprintf(stdout, "Processing partition %lld (%lld bytes)\n", nmap+1, win->len);)
+    TRACE(if( args->aioMode == AIO_DIRECT && win->direct == 0 ) fprintf(stdout, "Direct I/O not supported by query file, window read through page cache\n");)
+
+    iomap->iMap = win->data;
+    iomap->fMap = win->data + win->len - 1;
+    iomap->mapOff = win->off;
+
+    // Not last window, end it before last query because maybe it lies between windows
+    next = pend;
+    if( (win->off + win->len) < pend )
+    {
+      // Query larger than window, window is loaded again with twice the size
+      for(c = win->data + win->len - 1; c != win->data && *c != '>'; c--);
+      if( c == win->data )
+      {
+        woff = win->off;
+        msz = msz * 2LL;
+        VERBOSE(if( isWorkerThread() == 0 ) fprintf(stdout, "Query larger than window at offset %lld, windows grown to %lld bytes\n", woff, msz);)
+        closeMapWindow(win);
+        startMapWindow(&wins[(nmap + 1) % budget.depth], fileno(iomap->qfd), woff, MIN(msz, pend - woff), args->aioMode);
+        next = woff;
+        continue;
+      }
+
+      err = adjustMapEnd(&next, iomap);
+      if( err != 0 )
+      {
+        fprintf(stdout, "Error: adjustMapEnd()\n");
+        break;
+      }
+
+      // Last query is parsed again by next window
+      STATS(rec->count[CN_STRADDLE]++; rec->count[CN_STRADDLE_BYTES] += win->off + win->len - next;)
+
+      // Prefetch next window beginning at last query while current window is parsed
+      if( budget.depth > 1 )
+        startMapWindow(&wins[(nmap + 1) % 2], fileno(iomap->qfd), next, MIN(msz, pend - next), args->aioMode);
+    }
+
+    // Initialize query struct pointers 
+    memset(&query, 0, sizeof(query_t));
+    query.iaq = iomap->iMap;
+    query.faq = iomap->iMap;
+    query.isq = iomap->iMap;
+    query.fsq = iomap->iMap;
+
+    // Extract sequences from current memory map
+    err = extractQueries(args, iomap, &query, hits, mpi, bytesWritten, &done);
+    STATS(rec->count[CN_BYTES_SCANNED] += getParsedBytes(iomap, &query);)
+    if( err != 0 )
+    {
+      fprintf(stderr, "\nError: failed extractQueries()\n");
+      break;
+    }
+
+    // Clear memory map, a single window is loaded again for next part of range
+    closeMapWindow(win);
+    if( budget.depth == 1 && next < pend && !done )
+      startMapWindow(win, fileno(iomap->qfd), next, MIN(msz, pend - next), args->aioMode);
+    
+    // Compute queries extracted in current partition
+    xcnt = iomap->xCnt - xcnt;
+
+    // Debug statement
+    VERBOSE(if( isWorkerThread() == 0 ) fprintf(stdout, "Subtotal sequences extracted = %lld\n", xcnt);)
+    xcnt = iomap->xCnt;
+  }
+
+  // Clear memory maps left after an error or a met quota, and buffers of asynchronous reads
+  freeMapWindow(&wins[0]);
+  freeMapWindow(&wins[1]);
+
+  return err;
+}
+
+
+// Extracts sequences from every record of the partition of current process
+int scanQueryFile(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  return scanQueryRange(args, iomap, hits, mpi, iomap->partOff, iomap->partOff + iomap->qfsz, bytesWritten);
+}
+
+
+// Check if caller is one of the threads filtering a partition
+int isWorkerThread()
+{
+#ifdef _OPENMP
+  return omp_in_parallel();
+#else
+  return 0;
+#endif
+}
+
+
+// Filter partition of current process with one thread per record aligned partition
+// Partitions of threads follow partition of their process in query file offset triplets
+// Each thread filters its partition into its own output span list (shared read-only hit IDs)
+// Span lists are then written in order of query file, so output is the same as a single thread
+// Threads inflating BGZF partitions or compressing output write to temporary files instead, copied in order of query file
+int scanQueryThreads(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  int err;                        // Trap errors
+  int t;                          // Iteration variable
+  int tcnt;                       // Number of thread partitions
+  int node;                       // NUMA node of a thread
+  long long int *toffs;           // Offset triplets of thread partitions
+  long long int *tbytes;          // Bytes written by each thread
+  long long int *txcnt;           // Sequences extracted by each thread
+  int *terr;                      // Errors of each thread
+  int *tfds;                      // Temporary output file of each thread, BGZF partitions only
+  char tmpname[FILE_LEN];         // Name of temporary output file
+  spanlist_t *tspans;             // Output span list of each thread
+  quota_t *tq;                    // Quotas of each thread, NULL if no quota applies
+  int *found;                     // Found flags of hit IDs before threads
+  outvec_t *tvecs;                // Batched output to temporary file of each thread
+  zwriter_t *tzws;                // BGZF compression of output of each thread
+  iomap_t tmap;                   // I/O control struct of a thread
+  mpi_t tmpi;                     // MPI control struct of a thread
+  numa_t numa;                    // NUMA nodes of current process
+
+  // Record aligned partitions of threads of current process
+  tcnt = mpi->threadCnt;
+  toffs = iomap->fileOffs + (mpi->procRank * tcnt * 3);
+
+  tbytes = (long long int *)calloc(tcnt, sizeof(long long int));
+  txcnt = (long long int *)calloc(tcnt, sizeof(long long int));
+  terr = (int *)calloc(tcnt, sizeof(int));
+  tspans = (spanlist_t *)calloc(tcnt, sizeof(spanlist_t));
+  tvecs = (outvec_t *)calloc(tcnt, sizeof(outvec_t));
+  tzws = (zwriter_t *)calloc(tcnt, sizeof(zwriter_t));
+  tfds = (int *)malloc(sizeof(int) * tcnt);
+  tq = (quota_t *)calloc(tcnt, sizeof(quota_t));
+  found = NULL;
+  err = (tbytes == NULL || txcnt == NULL || terr == NULL || tspans == NULL || tvecs == NULL || tzws == NULL || tfds == NULL || tq == NULL) ? ERROR : 0;
+
+  // Each thread stops at its own quotas, outputs of threads are trimmed to quotas in order of query file once all are done
+  for(t = 0; t < tcnt && err == 0; t++)
+  {
+    err = allocQuota(args, hits, &tq[t]);
+    if( err == 1 )
+    {
+      free(tq);
+      tq = NULL;
+      err = 0;
+      break;
+    }
+  }
+  if( err == 0 && tq != NULL && tq[0].hitCnt > 0LL )
+  {
+    found = (int *)malloc(sizeof(int) * (hits->htotal + 1));
+    if( found == NULL )
+      err = ERROR;
+    else
+      memcpy(found, hits->charVect, sizeof(int) * hits->htotal);
+  }
+  for(t = 0; t < tcnt && err == 0; t++)
+    tfds[t] = ERROR;
+  for(t = 0; t < tcnt && err == 0; t++)
+  {
+    err = initSpans(&tspans[t]);
+
+    // Temporary file is removed at once, it is closed when done
+    if( err == 0 && (iomap->comp == COMP_BGZF || args->bgzfMode != 0) )
+    {
+      if( snprintf(tmpname, FILE_LEN, "%s%s%d.%d", args->of, TMP_SUFFIX, mpi->procRank, t) >= FILE_LEN )
+      {
+        fprintf(stdout, "\nError: temporary file name of %s is too long\n", args->of);
+        err = ERROR;
+        break;
+      }
+      tfds[t] = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+      if( tfds[t] < 0 )
+      {
+        fprintf(stderr, "\n");
+        perror("open()");
+        err = ERROR;
+        break;
+      }
+      unlink(tmpname);
+      err = initOutVec(&tvecs[t], fileno(iomap->qfd), tfds[t]);
+
+      // Each thread compresses its own blocks
+      if( err == 0 && args->bgzfMode != 0 )
+      {
+        err = openWriter(&tzws[t], tfds[t], BGZF_LEVEL, 0LL);
+        tvecs[t].zw = &tzws[t];
+      }
+    }
+  }
+  if( err != 0 )
+  {
+    fprintf(stdout, "\nError: failed to allocate thread partitions\n");
+    for(t = 0; t < tcnt && tspans != NULL && tvecs != NULL && tzws != NULL && tfds != NULL; t++)
+    {
+      freeSpans(&tspans[t]);
+      freeOutVec(&tvecs[t]);
+      closeWriter(&tzws[t]);
+      if( tfds[t] >= 0 )
+        close(tfds[t]);
+    }
+    for(t = 0; t < tcnt && tq != NULL; t++)
+      freeQuota(&tq[t]);
+    free(tq);
+    free(found);
+    free(tfds);
+    free(tzws);
+    free(tvecs);
+    free(tspans);
+    free(terr);
+    free(txcnt);
+    free(tbytes);
+    return ERROR;
+  }
+
+  // Threads are spread over NUMA nodes available to current process, if more than one
+  initNuma(&numa);
+  VERBOSE(fprintf(stdout, "Processing %d thread partitions (%d NUMA nodes)\n", tcnt, numa.nnodes);)
+
+  // Quotas of threads are not shared, threads do not stop each other
+  #pragma omp parallel for num_threads(tcnt) schedule(static, 1) private(tmap, tmpi, node)
+  for(t = 0; t < tcnt; t++)
+  {
+    // Pin thread before its pages are faulted in
+    node = pinThreadNuma(&numa, t, tcnt);
+    TRACE(if( node != ERROR ) fprintf(stdout, "Thread %d pinned to NUMA node %d\n", t, node);)
+
+    tmap = *iomap;
+    tmap.xCnt = 0LL;
+    tmap.ofd = NULL;
+    tmap.ovec = NULL;
+    tmap.spans = &tspans[t];
+    tmap.quota = (tq != NULL) ? &tq[t] : NULL;
+    tmpi = *mpi;
+    tmpi.procCnt = mpi->procCnt * tcnt;
+
+    // Output to temporary file, kept as a single span of it
+    if( tfds[t] >= 0 )
+    {
+      tmap.spans = NULL;
+      tmap.ovec = &tvecs[t];
+    }
+
+    // BGZF partitions, other than first one of query file, begin at first query after beginning of their blocks
+    if( iomap->comp == COMP_BGZF )
+      terr[t] = scanBlockRange(args, &tmap, hits, &tmpi, &toffs[t*3], (mpi->procRank * tcnt + t) > 0, &tbytes[t]);
+    else
+      terr[t] = scanQueryRange(args, &tmap, hits, &tmpi, toffs[t*3] + toffs[t*3+1], toffs[t*3] + toffs[t*3+1] + toffs[t*3+2], &tbytes[t]);
+    txcnt[t] = tmap.xCnt;
+
+    // Compressed output replaces bytes extracted
+    if( terr[t] == 0 && tvecs[t].zw != NULL )
+    {
+      terr[t] = flushWriter(&tzws[t], 0);
+      tbytes[t] = tzws[t].off;
+    }
+    if( terr[t] == 0 && tfds[t] >= 0 )
+      terr[t] = addFileSpan(&tspans[t], 0LL, tbytes[t]);
+  }
+
+  // Keep sequences of threads that fit in quotas after previous threads
+  for(t = 0; t < tcnt; t++)
+    if( terr[t] != 0 )
+      err = ERROR;
+  if( err == 0 && tq != NULL )
+    err = trimThreadQuotas(tq, tcnt, tspans, tbytes, txcnt, iomap, hits, found, *bytesWritten);
+
+  // Write output of threads in order, or keep it as spans of current process
+  for(t = 0; t < tcnt; t++)
+  {
+
+    VERBOSE(fprintf(stdout, "Thread %d sequences extracted = %lld\n", t, txcnt[t]);)
+    if( err == 0 )
+    {
+      if( iomap->spans != NULL )
+        err = appendSpans(iomap->spans, &tspans[t]);
+      else if( tfds[t] >= 0 )
+        err = writeSpans(&tspans[t], tfds[t], fileno(iomap->ofd), *bytesWritten);
+      else
+        err = writeSpans(&tspans[t], fileno(iomap->qfd), fileno(iomap->ofd), *bytesWritten);
+    }
+    iomap->xCnt = iomap->xCnt + txcnt[t];
+    *bytesWritten = *bytesWritten + tbytes[t];
+    freeSpans(&tspans[t]);
+    freeOutVec(&tvecs[t]);
+    closeWriter(&tzws[t]);
+    if( tfds[t] >= 0 )
+      close(tfds[t]);
+  }
+
+  // Compressed output of current process continues after blocks of threads
+  if( iomap->ovec != NULL && iomap->ovec->zw != NULL )
+    iomap->ovec->zw->off = *bytesWritten;
+
+  freeNuma(&numa);
+  for(t = 0; t < tcnt && tq != NULL; t++)
+    freeQuota(&tq[t]);
+  free(tq);
+  free(found);
+  free(tfds);
+  free(tzws);
+  free(tvecs);
+  free(tspans);
+  free(terr);
+  free(txcnt);
+  free(tbytes);
+
+  return err;
+}
+
+
+// Extracts sequences from every record of the shards of current process, in order of shard manifest
+// Each shard in turn is the query file of current process, its output follows output of previous shards
+// Threads split each shard, a shard too small for them is read by a single thread
+int scanShardFiles(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  char path[FILE_LEN];            // Current shard file
+  int i;                          // Iteration variable
+  int j;                          // Iteration variable
+  int err;                        // Trap errors
+  int nparts;                     // Number of thread partitions of current shard
+  long long int *offs;            // Offset triplets of thread partitions of current shard
+  iomap_t smap;                   // Query file of next shard
+  shardmf_t *mf;                  // Shard manifest
+
+  mf = iomap->shards;
+  offs = NULL;
+  err = 0;
+  for(i = mf->first; i < mf->last && err == 0; i++)
+  {
+    // Previous shard is closed once next one is open, output copied from query file follows it
+    if( i != mf->cur )
+    {
+      memset(&smap, 0, sizeof(iomap_t));
+      if( getShardPath(mf, i, path, FILE_LEN) != 0 || openQueryFile(path, &smap) != 0 )
+      {
+        fprintf(stderr, "\nError: failed opening shard %d of manifest\n", i);
+        err = ERROR;
+        break;
+      }
+      if( iomap->ovec != NULL && flushOutVec(iomap->ovec) != 0 )
+        err = ERROR;
+      for(j = 0; j < iomap->njobs; j++)
+        if( iomap->jobs[j].map.ovec != NULL && flushOutVec(iomap->jobs[j].map.ovec) != 0 )
+          err = ERROR;
+      fclose(iomap->qfd);
+      iomap->qfd = smap.qfd;
+      iomap->qfsz = smap.qfsz;
+      mf->cur = i;
+      if( iomap->ovec != NULL )
+        iomap->ovec->qfd = fileno(iomap->qfd);
+      for(j = 0; j < iomap->njobs; j++)
+      {
+        iomap->jobs[j].map.qfd = iomap->qfd;
+        if( iomap->jobs[j].map.ovec != NULL )
+          iomap->jobs[j].map.ovec->qfd = fileno(iomap->qfd);
+      }
+    }
+    if( err == 0 && iomap->qfsz != mf->shards[i].end - mf->shards[i].begin )
+    {
+      fprintf(stderr, "\nError: size of shard %d does not match manifest\n", i);
+      err = ERROR;
+      break;
+    }
+    if( err != 0 )
+      break;
+    VERBOSE(fprintf(stdout, "Process %d reading shard %d of %d (%s, %lld bytes)\n", mpi->procRank, i+1, mf->nshards, mf->shards[i].name, iomap->qfsz);)
+
+    // Record aligned partitions of threads of current process
+    nparts = mpi->threadCnt;
+    if( nparts > 1 && computePartitionOffsets(&offs, &nparts, fileno(iomap->qfd), (long int)iomap->qfsz, '>') != 0 )
+      nparts = 1;
+    iomap->partOff = 0LL;
+    if( nparts > 1 && nparts == mpi->threadCnt )
+    {
+      memcpy(iomap->fileOffs + (mpi->procRank * mpi->threadCnt * 3), offs, sizeof(long long int) * nparts * 3);
+      err = scanQueryThreads(args, iomap, hits, mpi, bytesWritten);
+    }
+    else
+      err = scanQueryRange(args, iomap, hits, mpi, 0LL, iomap->qfsz, bytesWritten);
+  }
+  free(offs);
+
+  return err;
+}
+
+
+// Read query data from a reader through a fixed-size buffer and extract queries
+// Last query of a refill may continue in next read, it is carried over to beginning of buffer
+// Buffer only grows if a single query is larger than it
+// Range ends at first query beginning at or after limit bytes, or at end of data
+// If skipHead is set, data before first query belongs to previous range and is skipped
+int streamQueryRange(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, zreader_t *rd, long long int limit, int skipHead, long long int *bytesWritten)
+{
+  char *buf;                      // Stream buffer
+  char *c;                        // Character read
+  void *p;                        // Reallocated memory
+  int err;                        // Trap errors
+  int eof;                        // Flag for end of stream
+  int last;                       // Flag for last refill of range
+  int done;                       // Flag to signal when sequence count quota has been met
+  long long int bufsz;            // Size of stream buffer
+  long long int len;              // Bytes in stream buffer
+  long long int end;              // Bytes of stream buffer parsed in current refill
+  long long int pos;              // Offset in range of beginning of stream buffer
+  long long int lim;              // Offset in stream buffer of end of range
+  long long int n;                // Bytes read by readReader()
+  long long int nrefill;          // Current number of refill
+  long long int xcnt;             // Count sequences extracted in current refill
+  query_t query;                  // Query extraction control struct
+  double t0 = 0.0;                // Time of beginning of refill
+  statsrec_t *rec = NULL;         // Statistics of current thread
+
+  STATS(rec = statsThread(&stats);)
+
+  bufsz = budget.streamBuf;
+  buf = (char *)malloc(sizeof(char) * bufsz);
+  if( buf == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate stream buffer\n");
+    return ERROR;
+  }
+
+  err = 0;
+  eof = 0;
+  done = 0;
+  len = 0LL;
+  pos = 0LL;
+  xcnt = 0LL;
+  for(nrefill = 0LL; !done; nrefill++)
+  {
+    // Fill buffer after data carried over
+    STATS(t0 = statsTime();)
+    while( eof == 0 && len < bufsz )
+    {
+      n = readReader(rd, buf + len, bufsz - len);
+      if( n < 0LL )
+      {
+        err = ERROR;
+        break;
+      }
+      if( n == 0LL )
+        eof = 1;
+      len = len + n;
+    }
+    STATS(rec->phase[PH_MAP] += statsTime() - t0;)
+    if( err != 0 || len == 0LL )
+      break;
+
+    // Skip to first query of range, range is empty if it begins after limit
+    if( skipHead != 0 )
+    {
+      c = (char *)memchr(buf, '>', (size_t)len);
+      if( c == NULL || (pos + (long long int)(c - buf)) >= limit )
+      {
+        if( c != NULL || eof != 0 || (pos + len) >= limit )
+          break;
+        pos = pos + len;
+        len = 0LL;
+        continue;
+      }
+      memmove(buf, c, (size_t)(len - (long long int)(c - buf)));
+      pos = pos + (long long int)(c - buf);
+      len = len - (long long int)(c - buf);
+      skipHead = 0;
+    }
+
+    // Range ends in buffer, end at first query beginning at or after limit
+    end = len;
+    last = eof;
+    lim = limit - pos;
+    if( lim < len )
+    {
+      c = (char *)memchr(buf + lim, '>', (size_t)(len - lim));
+      if( c != NULL )
+      {
+        end = (long long int)(c - buf);
+        last = 1;
+      }
+    }
+
+    // Not end of range, end before last query because maybe it continues in next refill
+    if( last == 0 )
+    {
+      for(c = buf + len - 1; c != buf && *c != '>'; c--);
+
+      // Single query larger than buffer, grow buffer and read more
+      if( c == buf )
+      {
+        p = realloc(buf, (size_t)(bufsz * 2LL));
+        if( p == NULL )
+        {
+          fprintf(stdout, "\nError: failed to grow stream buffer\n");
+          err = ERROR;
+          break;
+        }
+        buf = (char *)p;
+        bufsz = bufsz * 2LL;
+        continue;
+      }
+      end = (long long int)(c - buf);
+    }
+    if( end == 0LL )
+      break;
+
+    // Debug statement, only for a single thread
+    VERBOSE(if( isWorkerThread() == 0 ) fprintf(stdout, "Processing stream refill %lld (%lld bytes)\n", nrefill+1, end);)
+
+    // Parse buffer as a memory map, last byte is not parsed
+    STATS(rec->count[CN_WINDOWS]++;)
+    iomap->iMap = buf;
+    iomap->fMap = buf + end - 1;
+    iomap->mapOff = 0LL;
+    memset(&query, 0, sizeof(query_t));
+    query.iaq = buf;
+    query.faq = buf;
+    query.isq = buf;
+    query.fsq = buf;
+
+    err = extractQueries(args, iomap, &query, hits, mpi, bytesWritten, &done);
+    STATS(rec->count[CN_BYTES_SCANNED] += getParsedBytes(iomap, &query);)
+    if( err != 0 )
+    {
+      fprintf(stderr, "\nError: failed extractQueries()\n");
+      break;
+    }
+
+    // Compute queries extracted in current refill
+    xcnt = iomap->xCnt - xcnt;
+
+    // Debug statement
+    VERBOSE(if( isWorkerThread() == 0 ) fprintf(stdout, "Subtotal sequences extracted = %lld\n", xcnt);)
+    xcnt = iomap->xCnt;
+
+    if( last != 0 )
+      break;
+
+    // Carry last query over to beginning of buffer
+    STATS(rec->count[CN_STRADDLE]++; rec->count[CN_STRADDLE_BYTES] += len - end;)
+    memmove(buf, buf + end, (size_t)(len - end));
+    pos = pos + end;
+    len = len - end;
+  }
+
+  free(buf);
+
+  return err;
+}
+
+
+// Read query file as a stream and extract queries
+// Data is read through zlib, which also reads uncompressed data transparently
+int streamQueryFile(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  int err;                        // Trap errors
+  zreader_t rd;                   // Reader of query file
+
+  err = openReader(&rd, fileno(iomap->qfd), READ_GZ, 0LL);
+  if( err != 0 )
+    return ERROR;
+
+  err = streamQueryRange(args, iomap, hits, mpi, &rd, LLONG_MAX, 0, bytesWritten);
+  closeReader(&rd);
+
+  return err;
+}
+
+
+// Inflate BGZF blocks of a partition and extract queries
+// Partition triplet is [i]=file offset of first block, [i+1]=0, [i+2]=uncompressed bytes of partition
+// Blocks are inflated until first query beginning after partition, so queries between partitions are complete
+int scanBlockRange(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *offs, int skipHead, long long int *bytesWritten)
+{
+  int err;                        // Trap errors
+  zreader_t rd;                   // Reader of BGZF blocks
+
+  err = openReader(&rd, fileno(iomap->qfd), READ_BGZF, offs[0]);
+  if( err != 0 )
+    return ERROR;
+
+  err = streamQueryRange(args, iomap, hits, mpi, &rd, offs[2], skipHead, bytesWritten);
+  closeReader(&rd);
+
+  return err;
+}
+
+
+// Extracts sequences from every record of the BGZF partition of current process
+int scanBlockFile(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  return scanBlockRange(args, iomap, hits, mpi, iomap->fileOffs + (mpi->procRank * 3), mpi->procRank > 0, bytesWritten);
+}
+
+
+// Read a span of records from query file and extract queries in it
+// Last byte of span is not parsed, same as end of memory map
+int extractSpan(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int sbegin, long long int send, char **buf, long long int *buflen, long long int *bytesWritten, int *done)
+{
+  long long int i;                // Iteration variable
+  long long int n;                // Bytes read by pread()
+  int err;                        // Trap errors
+  query_t query;                  // Query extraction control struct
+  double t0 = 0.0;                // Time of beginning of read
+  statsrec_t *rec = NULL;         // Statistics of current thread
+
+  STATS(rec = statsThread(&stats); t0 = statsTime();)
+
+  if( (send - sbegin) > *buflen )
+  {
+    free(*buf);
+    *buflen = send - sbegin;
+    *buf = (char *)malloc(sizeof(char) * (*buflen));
+    if( *buf == NULL )
+    {
+      *buflen = 0LL;
+      fprintf(stdout, "\nError: failed to allocate buffer for indexed records\n");
+      return ERROR;
+    }
+  }
+
+  for(i = 0LL; i < (send - sbegin); i = i + n)
+  {
+    n = (long long int)pread(fileno(iomap->qfd), *buf + i, (size_t)((send - sbegin) - i), (off_t)(sbegin + i));
+    if( n <= 0LL )
+    {
+      fprintf(stderr, "\n");
+      perror("pread()");
+      return ERROR;
+    }
+  }
+
+  STATS(rec->phase[PH_MAP] += statsTime() - t0; rec->count[CN_WINDOWS]++;)
+
+  iomap->iMap = *buf;
+  iomap->fMap = *buf + (send - sbegin) - 1;
+  iomap->mapOff = sbegin;
+  memset(&query, 0, sizeof(query_t));
+  query.iaq = *buf;
+  query.faq = *buf;
+  query.isq = *buf;
+  query.fsq = *buf;
+
+  err = extractQueries(args, iomap, &query, hits, mpi, bytesWritten, done);
+  STATS(rec->count[CN_BYTES_SCANNED] += getParsedBytes(iomap, &query);)
+  if( err != 0 )
+  {
+    fprintf(stderr, "\nError: failed extractQueries()\n");
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Extract queries using offset index of query file
+// Only records that may match a hit ID are read, close records are read together
+// Records are parsed by extractQueries(), so selection and output are the same as scanning query file
+int extractIndexedQueries(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  char *buf;                      // Records read from query file
+  int err;                        // Trap errors
+  int done;                       // Flag to signal when sequence count quota has been met
+  long long int i;                // Iteration variable
+  long long int rec;              // Current record
+  long long int nrecs;            // Number of records marked
+  long long int pbegin;           // File offset of partition of current process
+  long long int pend;             // File offset of end of partition
+  long long int sbegin;           // File offset of current span of records
+  long long int send;             // File offset of end of current span
+  long long int buflen;           // Bytes allocated in buffer
+  long long int bytesRead;        // Bytes read from query file
+  unsigned char *recMask;         // Bit vector of records marked
+  ffindex_t *idx;                 // Offset index
+
+  idx = iomap->qidx;
+  recMask = (unsigned char *)calloc((size_t)((idx->hdr->nrecs + 7LL) / 8LL + 1LL), sizeof(unsigned char));
+  if( recMask == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate index record mask\n");
+    return ERROR;
+  }
+
+  // Mark records that may contain hit IDs
+  for(i = 0LL; i < hits->htotal; i++)
+    markIndexRecords(idx, getID(&hits->hitIDs, i), getIDLen(&hits->hitIDs, i), recMask);
+
+  // Process records in partition of current process only
+  pbegin = iomap->partOff;
+  pend = pbegin + iomap->qfsz;
+
+  err = 0;
+  done = 0;
+  nrecs = 0LL;
+  buflen = 0LL;
+  bytesRead = 0LL;
+  buf = NULL;
+  for(rec = findIndexOffset(idx, pbegin); rec < idx->hdr->nrecs && idx->recs[rec].off < pend && !done; rec++)
+  {
+    if( (recMask[rec >> 3] & (1 << (rec & 7LL))) == 0 )
+      continue;
+
+    // Extend span with following marked records that are close
+    sbegin = idx->recs[rec].off;
+    send = sbegin + idx->recs[rec].rlen;
+    nrecs++;
+    while( (rec + 1) < idx->hdr->nrecs && idx->recs[rec+1].off < pend )
+    {
+      for(i = rec + 1; i < idx->hdr->nrecs && idx->recs[i].off < pend && (idx->recs[i].off - send) <= IDX_COALESCE; i++)
+        if( (recMask[i >> 3] & (1 << (i & 7LL))) != 0 )
+          break;
+
+      if( i == idx->hdr->nrecs || idx->recs[i].off >= pend || (idx->recs[i].off - send) > IDX_COALESCE )
+        break;
+
+      send = idx->recs[i].off + idx->recs[i].rlen;
+      rec = i;
+      nrecs++;
+    }
+
+    err = extractSpan(args, iomap, hits, mpi, sbegin, send, &buf, &buflen, bytesWritten, &done);
+    if( err != 0 )
+      break;
+    bytesRead = bytesRead + (send - sbegin);
+  }
+
+  VERBOSE(fprintf(stdout, "Indexed records read = %lld (%lld bytes)\n", nrecs, bytesRead);)
+
+  iomap->iMap = NULL;
+  iomap->fMap = NULL;
+  free(buf);
+  free(recMask);
+
+  return err;
+}
+
+
+// Extract queries using result cache
+// Cached records of hit IDs are read, with records of offset index that may contain hit IDs not in cache
+// Records are parsed by extractQueries(), so selection and output are the same as scanning query file
+int extractCachedQueries(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  char *buf;                      // Records read from query file
+  int err;                        // Trap errors
+  int done;                       // Flag to signal when sequence count quota has been met
+  long long int i;                // Current cached record
+  long long int rec;              // Current record of offset index
+  long long int nrecs;            // Number of records read
+  long long int pbegin;           // File offset of partition of current process
+  long long int pend;             // File offset of end of partition
+  long long int off;              // File offset of current record
+  long long int end;              // End of current record
+  long long int sbegin;           // File offset of current span of records
+  long long int send;             // File offset of end of current span
+  long long int buflen;           // Bytes allocated in buffer
+  long long int bytesRead;        // Bytes read from query file
+  unsigned char *recMask;         // Bit vector of records of offset index marked
+  ffindex_t *idx;                 // Offset index, NULL if all hit IDs are in cache
+  cache_t *c;                     // Result cache
+
+  c = iomap->cache;
+  idx = (c->ndelta > 0LL) ? iomap->qidx : NULL;
+  recMask = NULL;
+  if( idx != NULL )
+  {
+    recMask = (unsigned char *)calloc((size_t)((idx->hdr->nrecs + 7LL) / 8LL + 1LL), sizeof(unsigned char));
+    if( recMask == NULL )
+    {
+      fprintf(stdout, "\nError: failed to allocate index record mask\n");
+      return ERROR;
+    }
+
+    // Mark records that may contain hit IDs not in cache
+    for(i = 0LL; i < hits->htotal; i++)
+      if( c->delta[i] != 0 )
+        markIndexRecords(idx, getID(&hits->hitIDs, i), getIDLen(&hits->hitIDs, i), recMask);
+  }
+
+  // Process records in partition of current process only
+  pbegin = iomap->partOff;
+  pend = pbegin + iomap->qfsz;
+  for(i = 0LL; i < c->nspans && c->spans[i*2] < pbegin; i++);
+  rec = (idx != NULL) ? findIndexOffset(idx, pbegin) : 0LL;
+
+  // Cached records and marked records are read in order of query file, close records are read together
+  err = 0;
+  done = 0;
+  nrecs = 0LL;
+  buflen = 0LL;
+  bytesRead = 0LL;
+  buf = NULL;
+  sbegin = ERROR;
+  send = ERROR;
+  while( !done )
+  {
+    while( idx != NULL && rec < idx->hdr->nrecs && idx->recs[rec].off < pend && (recMask[rec >> 3] & (1 << (rec & 7LL))) == 0 )
+      rec++;
+    if( idx != NULL && rec < idx->hdr->nrecs && idx->recs[rec].off < pend && (i == c->nspans || c->spans[i*2] >= pend || idx->recs[rec].off < c->spans[i*2]) )
+    {
+      off = idx->recs[rec].off;
+      end = off + idx->recs[rec].rlen;
+      rec++;
+    }
+    else if( i < c->nspans && c->spans[i*2] < pend )
+    {
+      off = c->spans[i*2];
+      end = off + c->spans[i*2+1];
+      i++;
+    }
+    else
+      break;
+    nrecs++;
+
+    // Extend span with records that are close
+    if( sbegin != ERROR && (off - send) <= IDX_COALESCE )
+    {
+      send = MAX(send, end);
+      continue;
+    }
+
+    if( sbegin != ERROR )
+    {
+      err = extractSpan(args, iomap, hits, mpi, sbegin, send, &buf, &buflen, bytesWritten, &done);
+      if( err != 0 )
+        break;
+      bytesRead = bytesRead + (send - sbegin);
+    }
+    sbegin = off;
+    send = end;
+  }
+  if( err == 0 && !done && sbegin != ERROR )
+  {
+    err = extractSpan(args, iomap, hits, mpi, sbegin, send, &buf, &buflen, bytesWritten, &done);
+    bytesRead = bytesRead + (send - sbegin);
+  }
+
+  VERBOSE(fprintf(stdout, "Cached and indexed records read = %lld (%lld bytes)\n", nrecs, bytesRead);)
+
+  iomap->iMap = NULL;
+  iomap->fMap = NULL;
+  free(buf);
+  free(recMask);
+
+  return err;
+}
+
+
+// Extract queries using length table of query file
+// Only records with a selected sequence length are read, close records are read together
+// Records are parsed by extractQueries(), so selection and output are the same as scanning query file
+int extractLengthQueries(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, long long int *bytesWritten)
+{
+  char *buf;                      // Records read from query file
+  int err;                        // Trap errors
+  int done;                       // Flag to signal when sequence count quota has been met
+  int more;                       // Flag for records remaining in length table
+  long long int off;              // File offset of current record
+  long long int rlen;             // Raw length of current record
+  long long int seqLen;           // Sequence length of current record
+  long long int nrecs;            // Number of records selected
+  long long int pbegin;           // File offset of partition of current process
+  long long int pend;             // File offset of end of partition
+  long long int sbegin;           // File offset of current span of records
+  long long int send;             // File offset of end of current span
+  long long int buflen;           // Bytes allocated in buffer
+  long long int bytesRead;        // Bytes read from query file
+  fflens_t *lens;                 // Length table
+
+  lens = iomap->qlens;
+  rewindLengths(lens);
+
+  // Process records in partition of current process only
+  pbegin = iomap->partOff;
+  pend = pbegin + iomap->qfsz;
+
+  err = 0;
+  done = 0;
+  nrecs = 0LL;
+  buflen = 0LL;
+  bytesRead = 0LL;
+  buf = NULL;
+  sbegin = ERROR;
+  send = ERROR;
+  more = (nextLength(lens, &off, &rlen, &seqLen) == 0);
+  while( !done )
+  {
+    // Skip records before partition and records not selected
+    if( more && (off < pbegin || (off < pend && selectLength(args, seqLen) == 0)) )
+    {
+      more = (nextLength(lens, &off, &rlen, &seqLen) == 0);
+      continue;
+    }
+
+    // Extend current span if record is close
+    if( more && off < pend && sbegin != ERROR && (off - send) <= IDX_COALESCE )
+    {
+      send = off + rlen;
+      nrecs++;
+      more = (nextLength(lens, &off, &rlen, &seqLen) == 0);
+      continue;
+    }
+
+    // Extract current span
+    if( sbegin != ERROR )
+    {
+      err = extractSpan(args, iomap, hits, mpi, sbegin, send, &buf, &buflen, bytesWritten, &done);
+      if( err != 0 )
+        break;
+      bytesRead = bytesRead + (send - sbegin);
+      sbegin = ERROR;
+    }
+
+    // Reached end of partition
+    if( !more || off >= pend )
+      break;
+
+    // Start a new span
+    sbegin = off;
+    send = off + rlen;
+    nrecs++;
+    more = (nextLength(lens, &off, &rlen, &seqLen) == 0);
+  }
+
+  VERBOSE(fprintf(stdout, "Length table records read = %lld (%lld bytes)\n", nrecs, bytesRead);)
+
+  iomap->iMap = NULL;
+  iomap->fMap = NULL;
+  free(buf);
+
+  return err;
+}
+
+
+// Open output file of current process, or output span list
+// Output is batched and compressed as requested, quotas are shared with other processes
+int openOutput(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, output_t *out)
+{
+  int len;   // Length of output file name
+
+  out->bytesWritten = 0;
+
+  // Keep output as spans of query file, no output file per process
+  if( args->mergeMode == 3 )
+  {
+    if( initSpans(&out->spans) != 0 )
+      return ERROR;
+    iomap->spans = &out->spans;
+    iomap->ofd = NULL;
+  }
+  else
+  {
+    // Create output filename
+    // Queries of groups are written to a temporary output file, removed when opened
+    if( hits->pipeMode == 2 )
+      len = snprintf(out->outfile, FILE_LEN, "%s%s%d", args->of, TMP_SUFFIX, mpi->procRank);
+    else if( mpi->procCnt > 1 )
+      len = snprintf(out->outfile, FILE_LEN, "%s%d", args->of, mpi->procRank);
+    else
+      len = snprintf(out->outfile, FILE_LEN, "%s", args->of);
+    if( len >= FILE_LEN )
+    {
+      fprintf(stdout, "\nError: output file name of %s is too long\n", args->of);
+      return ERROR;
+    }
+
+    // Open output file
+    iomap->ofd = fopen(out->outfile, "w+b");
+    if( iomap->ofd == NULL )
+    {
+      fprintf(stderr, "\n");
+      perror("fopen()");
+      return ERROR;
+    }
+    if( hits->pipeMode == 2 )
+      unlink(out->outfile);
+
+    // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ, or as set by memory budget
+    setvbuf(iomap->ofd, NULL, _IOFBF, budget.outBuf);
+
+    // Batch output with writev() and copy_file_range() instead of stream buffers
+    if( initOutVec(&out->ovec, fileno(iomap->qfd), fileno(iomap->ofd)) == 0 )
+      iomap->ovec = &out->ovec;
+
+    // Compress batched output into BGZF blocks
+    if( args->bgzfMode != 0 )
+    {
+      if( iomap->ovec == NULL || openWriter(&out->zw, fileno(iomap->ofd), BGZF_LEVEL, 0LL) != 0 )
+      {
+        fprintf(stdout, "\nError: failed to initialize compressed output\n");
+        if( iomap->ovec != NULL )
+          freeOutVec(&out->ovec);
+        iomap->ovec = NULL;
+        fclose(iomap->ofd);
+        return ERROR;
+      }
+      out->ovec.zw = &out->zw;
+    }
+
+    // Queue writes of batched output, extraction does not wait for them
+    // Compressed output is written by BGZF writer
+    else if( args->aioMode != AIO_NONE && iomap->ovec != NULL )
+    {
+      if( openAioWriter(&out->aw, fileno(iomap->ofd), args->aioMode) != 0 )
+      {
+        fprintf(stdout, "\nError: failed to initialize asynchronous output\n");
+        freeOutVec(&out->ovec);
+        iomap->ovec = NULL;
+        fclose(iomap->ofd);
+        return ERROR;
+      }
+      out->ovec.aw = &out->aw;
+    }
+  }
+
+  // Share sequence count and size quotas with other processes
+  if( initQuota(args, iomap, hits, mpi, &out->quota) != 0 )
+  {
+    if( iomap->ovec != NULL && out->ovec.aw != NULL )
+      closeAioWriter(&out->aw);
+    if( iomap->ovec != NULL )
+      freeOutVec(&out->ovec);
+    iomap->ovec = NULL;
+    if( iomap->ofd != NULL )
+      fclose(iomap->ofd);
+    else
+      freeSpans(&out->spans);
+    iomap->spans = NULL;
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Close output of current process after query file is filtered
+// Output of all processes is combined into output file, queries of groups are written by query ID
+int closeOutput(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, output_t *out, int err)
+{
+  long int fsize;                 // Size of output file
+  long long int allxCnt;
+  int ferr;                       // Error of filtering of any process, outputs are still combined
+  double t0 = 0.0;                // Time of beginning of combining outputs
+  struct stat stbuf;
+
+  // Flush stream buffers to output file 
+  if( iomap->ofd != NULL )
+    fflush(iomap->ofd);
+
+  if( iomap->ovec != NULL )
+  {
+    // Compressed size replaces bytes extracted for combining output files
+    // Output of last process ends with end-of-file block
+    if( out->ovec.zw != NULL )
+    {
+      if( flushWriter(&out->zw, mpi->procRank == (mpi->procCnt - 1)) != 0 )
+        err = ERROR;
+      VERBOSE(fprintf(stdout, "Output bytes compressed = %lld into %lld (%lld BGZF blocks)\n", out->bytesWritten, out->zw.off, out->zw.blocks);)
+      out->bytesWritten = out->zw.off;
+      closeWriter(&out->zw);
+    }
+
+    // Wait for queued writes before output file is read again
+    if( out->ovec.aw != NULL )
+    {
+      TRACE(if( args->aioMode == AIO_DIRECT && out->aw.dfd < 0 ) fprintf(stdout, "Direct I/O not supported by output file, writes go through page cache\n");)
+      if( closeAioWriter(&out->aw) != 0 )
+        err = ERROR;
+    }
+    VERBOSE(fprintf(stdout, "Output bytes copied = %lld, written = %lld\n", out->ovec.copied, out->ovec.written);)
+    freeOutVec(&out->ovec);
+    iomap->ovec = NULL;
+  }
+
+  // Keep sequences of current process that fit in quotas after previous processes
+  STATS(t0 = statsTime();)
+  if( trimQuota(&out->quota, iomap, hits, mpi, &out->bytesWritten) != 0 )
+    err = ERROR;
+  STATS(stats.threads[0].count[CN_BYTES_WRITTEN] += out->bytesWritten;)
+
+  // Check if an error occurred, exit status of all processes reports it
+  if( err != 0 )
+    fprintf(stdout, "An error occurred while processing partitions\n");
+  ferr = err;
+  MPI_Allreduce(MPI_IN_PLACE, &ferr, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+
+  // Print statistics
+  VERBOSE(fprintf(stdout, "Total sequences extracted = %lld\n", iomap->xCnt);)
+
+  // Combine total of all sequences extracted
+  if( mpi->procCnt > 1 )
+  {
+    MPI_Reduce(&iomap->xCnt, &allxCnt, 1, MPI_LONG_LONG_INT, MPI_SUM, 0, mpi->MPI_MY_WORLD);
+    if( mpi->procRank == 0 )
+      VERBOSE(fprintf(stdout, "Combined total sequences extracted = %lld\n", allxCnt);)
+  }
+
+  // Write to file hit IDs not found in query file
+  if( hits->pipeMode != 0 || hits->searchMode != 0 )
+  {
+    err = writeHitsNotFound(args->of, hits, mpi);
+    if( err != 0 )
+      fprintf(stdout, "Error: failed to write hit IDs not found\n");
+  }
+
+  // Write queries of all processes grouped by query ID
+  if( hits->pipeMode == 2 )
+  {
+    err = writeGroups(args, iomap, hits, mpi);
+    if( err != 0 )
+      fprintf(stdout, "Error: failed to write groups of output file\n");
+    fclose(iomap->ofd);
+    iomap->ofd = NULL;
+    STATS(stats.threads[0].phase[PH_COMBINE] += statsTime() - t0;)
+
+    VERBOSE(fprintf(stdout, "\n");)
+
+    return (ferr != 0) ? ERROR : err;
+  }
+
+  // Write output spans of all processes to a single file
+  if( args->mergeMode == 3 )
+  {
+    VERBOSE(fprintf(stdout, "Output spans = %lld (%lld bytes in pool)\n", out->spans.nspans, out->spans.poolLen);)
+    err = mergeOutputFiles(args, iomap, mpi, out->bytesWritten);
+    if( err != 0 )
+      fprintf(stdout, "Error: failed to write output spans\n");
+    freeSpans(&out->spans);
+    iomap->spans = NULL;
+    STATS(stats.threads[0].phase[PH_COMBINE] += statsTime() - t0;)
+
+    VERBOSE(fprintf(stdout, "\n");)
+
+    return (ferr != 0) ? ERROR : err;
+  }
+
+#ifdef BCAST_OUTFILES 
+  // Send all data sizes (bytes written) to master for writing all results in a single file
+  // Or write all results directly at offsets computed from data sizes
+  if( args->mergeMode == 0 )
+    err = combineOutputFiles(args, iomap, mpi, out->bytesWritten);
+  else
+    err = mergeOutputFiles(args, iomap, mpi, out->bytesWritten);
+  if( err != 0 )
+    fprintf(stdout, "Error: failed to combine output files\n");
+#endif
+
+  // Close output file
+  fstat(fileno(iomap->ofd), &stbuf);
+  fsize = stbuf.st_size;
+  fclose(iomap->ofd);
+  iomap->ofd = NULL;
+  STATS(stats.threads[0].phase[PH_COMBINE] += statsTime() - t0;)
+
+  // Remove output file if empty
+  if( fsize <= 0L )
+  {
+    fprintf(stdout, "\nWarning: removing empty output file\n");
+    remove(out->outfile);
+  }
+  
+  VERBOSE(fprintf(stdout, "\n");)
+
+  return (ferr != 0) ? ERROR : err;
+}
+
+
+// Partition query file and extract sequences of current process
+// In batch mode, all jobs filter a single pass over query file, then output of each job is combined
+int partQueryFile(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi)
+{
+  int i;                          // Iteration variable
+  int err;                        // Trap errors
+  long long int bytesWritten;     // Count number of bytes written, outputs of jobs count their own
+  output_t out;                   // Output file of current process
+  job_t *job;                     // Current job
+
+  // Each job writes its own output, input of a job is query file of the pass
+  if( iomap->jobs != NULL )
+  {
+    for(i = 0; i < iomap->njobs; i++)
+    {
+      job = &iomap->jobs[i];
+      job->map = *iomap;
+      job->map.jobs = NULL;
+      job->map.njobs = 0;
+      job->done = 0;
+      if( openOutput(&job->args, &job->map, &job->hits, mpi, &job->out) != 0 )
+      {
+        fprintf(stdout, "Error: failed to open output of job %d\n", i+1);
+        return ERROR;
+      }
+    }
+  }
+  else if( openOutput(args, iomap, hits, mpi, &out) != 0 )
+    return ERROR;
+  
+  VERBOSE(fprintf(stdout, "\n----------------Filtering----------------\n");)
+
+  // Read only records listed in offset index or length table, if available
+  bytesWritten = 0;
+  if( iomap->stream != 0 )
+    err = streamQueryFile(args, iomap, hits, mpi, &bytesWritten);
+  else if( iomap->cache != NULL && (iomap->cache->ndelta == 0LL || iomap->qidx != NULL) )
+    err = extractCachedQueries(args, iomap, hits, mpi, &bytesWritten);
+  else if( iomap->qidx != NULL )
+    err = extractIndexedQueries(args, iomap, hits, mpi, &bytesWritten);
+  else if( iomap->qlens != NULL )
+    err = extractLengthQueries(args, iomap, hits, mpi, &bytesWritten);
+  else if( iomap->shards != NULL )
+    err = scanShardFiles(args, iomap, hits, mpi, &bytesWritten);
+  else if( mpi->threadCnt > 1 )
+    err = scanQueryThreads(args, iomap, hits, mpi, &bytesWritten);
+  else if( iomap->comp == COMP_BGZF )
+    err = scanBlockFile(args, iomap, hits, mpi, &bytesWritten);
+  else
+    err = scanQueryFile(args, iomap, hits, mpi, &bytesWritten);
+
+  if( iomap->jobs == NULL )
+  {
+    out.bytesWritten = bytesWritten;
+    return closeOutput(args, iomap, hits, mpi, &out, err);
+  }
+
+  // Combine output of each job, same order in all processes
+  for(i = 0; i < iomap->njobs; i++)
+  {
+    job = &iomap->jobs[i];
+    VERBOSE(fprintf(stdout, "Job %d output file = %s\n", i+1, job->args.of);)
+    if( closeOutput(&job->args, &job->map, &job->hits, mpi, &job->out, err) != 0 )
+      err = ERROR;
+  }
+
+  return err;
+}
+
+
+// Add a query and hit ID pair of BLAST output to hit sets
+// IDs point into mapped BLAST output, they are copied to ID tables
+int addBlastIDs(hits_t *hits, const char *qid, long long int qlen, const char *hid, long long int hlen)
+{
+  long long int qidx;    // Index of current query ID
+  long long int hidx;    // Index of current hit ID
+  long long int *tmp;
+
+  // Add query ID to list if not already in list
+  qidx = addID(&hits->queryIDs, qid, qlen, NULL);
+  if( qidx == ERROR )
+    return ERROR;
+  hits->qtotal = hits->queryIDs.nids;
+  
+  // HMMER pipe program
+  if( hits->pipeMode == 1 )
+  { 
+    // Add hit ID to list if not query ID and does not exist in hit list already
+    if( qlen != hlen || strncmp(qid, hid, qlen) != 0 )
+    {
+      if( addID(&hits->hitIDs, hid, hlen, NULL) == ERROR )
+        return ERROR;
+      hits->htotal = hits->hitIDs.nids;
+    }
+  }
+  // MUSCLE pipe program
+  // Every hit ID is added, group of a query ID also has its own sequence
+  else if( hits->pipeMode == 2 )
+  {
+    hidx = addID(&hits->hitIDs, hid, hlen, NULL);
+    if( hidx == ERROR )
+      return ERROR;
+    hits->htotal = hits->hitIDs.nids;
+
+    // Pairs grow with BLAST output, it is not counted beforehand
+    if( hits->npairs == hits->maxPairs )
+    {
+      tmp = (long long int *)realloc(hits->idxList, sizeof(long long int) * 2 * (hits->maxPairs * 2 + IDS_INIT));
+      if( tmp == NULL )
+      {
+        fprintf(stdout, "\nError: failed to allocate query and hit ID pairs\n");
+        return ERROR;
+      }
+      hits->idxList = tmp;
+      hits->maxPairs = hits->maxPairs * 2 + IDS_INIT;
+    }
+    hits->idxList[hits->npairs*2] = qidx;
+    hits->idxList[hits->npairs*2+1] = hidx;
+    hits->npairs++;
+  }
+
+  return 0;
+}
+
+
+// Free hits structure memory
+int freeHitsMemory(hits_t *hits)
+{
+  if( hits->pipeMode != 0 )
+  {
+    freeIDTable(&hits->queryIDs);
+    freeIDTable(&hits->hitIDs);
+    freeGroups(&hits->groups);
+    free(hits->idxList);
+    free(hits->charVect);
+  }
+  
+  if( hits->searchMode != 0 )
+  {
+    freeIDTable(&hits->hitIDs);
+    free(hits->charVect);
+  }
+
+  if( hits->spillLimit > 0LL )
+    close(hits->sfd);
+  hits->spillLimit = 0LL;
+ 
+  return 0;
+}
+
+
+// Open spill file of hit tables of current process, tables larger than hits share of memory budget are mapped from it
+// Spill file is removed at once, its space is released when it is closed
+int openSpillFile(args_t *args, hits_t *hits, mpi_t *mpi)
+{
+  char spillname[FILE_LEN];  // Spill file of current process
+
+  hits->spillLimit = 0LL;
+  if( budget.hits <= 0LL || (hits->pipeMode == 0 && hits->searchMode == 0) )
+    return 0;
+
+  if( snprintf(spillname, FILE_LEN, "%s%s%d", args->of, SPILL_SUFFIX, mpi->procRank) >= FILE_LEN )
+  {
+    fprintf(stdout, "\nError: spill file name of %s is too long\n", args->of);
+    return ERROR;
+  }
+  hits->sfd = open(spillname, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if( hits->sfd < 0 )
+  {
+    fprintf(stderr, "\n");
+    perror("open()");
+    return ERROR;
+  }
+  unlink(spillname);
+  hits->spillLimit = budget.hits;
+
+  return 0;
+}
+
+
+// Open result cache, master splits hit IDs into hit IDs of cache and hit IDs not in cache
+// Cached records and flags of hit IDs not in cache are sent to all processes
+// Cache is updated only if quotas do not stop search of query file
+int openResultCache(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, cache_t *cache)
+{
+  int err;               // Trap errors
+  long long int cnt[2];  // Number of cached records and of hit IDs not in cache
+  struct stat stbuf;
+
+  err = 0;
+  if( mpi->procRank == 0 )
+  {
+    fstat(fileno(iomap->qfd), &stbuf);
+    err = openCache(args->cf, fileno(iomap->qfd), (long long int)stbuf.st_size, cache);
+    if( err == 0 )
+      err = splitCache(cache, &hits->hitIDs);
+    if( err != 0 )
+      fprintf(stdout, "\nError: failed to open result cache %s\n", args->cf);
+    cnt[0] = cache->nspans;
+    cnt[1] = cache->ndelta;
+  }
+  MPI_Bcast(&err, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( err != 0 )
+  {
+    freeCache(cache);
+    return ERROR;
+  }
+
+  if( mpi->procCnt > 1 )
+  {
+    MPI_Bcast(cnt, 2, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+    if( mpi->procRank != 0 )
+    {
+      cache->nspans = cnt[0];
+      cache->ndelta = cnt[1];
+      cache->spans = (long long int *)malloc(sizeof(long long int) * 2 * (cache->nspans + 1));
+      cache->delta = (unsigned char *)calloc((size_t)hits->htotal + 1, sizeof(unsigned char));
+      err = (cache->spans == NULL || cache->delta == NULL) ? ERROR : 0;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+    if( err != 0 )
+    {
+      fprintf(stdout, "\nError: failed to allocate result cache\n");
+      freeCache(cache);
+      return ERROR;
+    }
+    MPI_Bcast(cache->spans, (int)(cache->nspans * 2), MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+    MPI_Bcast(cache->delta, (int)hits->htotal, MPI_UNSIGNED_CHAR, 0, mpi->MPI_MY_WORLD);
+  }
+
+  // Records found after a quota is met are not searched, hit IDs of a partial search are not cached
+  cache->update = (cache->ndelta > 0LL && args->seqCnt == SEQ_COUNT && args->bytesLimit == BYTES_LIMIT) ? 1 : 0;
+  iomap->cache = cache;
+  VERBOSE(if( mpi->procRank == 0 ) fprintf(stdout, "Result cache = %lld of %lld hit IDs cached (%lld records), %lld hit IDs %s\n",
+            hits->htotal - cache->ndelta, hits->htotal, cache->nspans, cache->ndelta,
+            (cache->ndelta == 0LL) ? "not in cache" : ((iomap->qidx != NULL) ? "not in cache searched by offset index" : "not in cache searched by scanning query file"));)
+
+  return 0;
+}
+
+
+// Add records of hit IDs not in cache found by all processes to result cache, master writes it
+// Hit IDs not found are cached only if search of query file did not stop once all hit IDs were found
+int updateResultCache(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, cache_t *cache, int err)
+{
+  int i;                 // Iteration variable
+  int n;                 // Number of values recorded by current process
+  int *counts;           // Number of values recorded by each process
+  int *displs;           // Offset of values of each process
+  int total;             // Number of values recorded by all processes
+  int complete;          // Flag for search of whole query file
+  long long int allxCnt; // Sequences extracted by all processes
+  long long int *pairs;  // Records recorded by all processes
+
+  if( cache->update == 0 )
+    return 0;
+
+  // Every process takes part, an error of any process leaves cache as it is
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( err != 0 )
+    return ERROR;
+  MPI_Allreduce(&iomap->xCnt, &allxCnt, 1, MPI_LONG_LONG_INT, MPI_SUM, mpi->MPI_MY_WORLD);
+  complete = (allxCnt < hits->htotal) ? 1 : 0;
+
+  n = (int)(cache->npairs * 3);
+  counts = NULL;
+  displs = NULL;
+  pairs = NULL;
+  total = 0;
+  if( mpi->procRank == 0 )
+  {
+    counts = (int *)malloc(sizeof(int) * mpi->procCnt);
+    displs = (int *)malloc(sizeof(int) * mpi->procCnt);
+    err = (counts == NULL || displs == NULL) ? ERROR : 0;
+  }
+  MPI_Gather(&n, 1, MPI_INT, counts, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( mpi->procRank == 0 && err == 0 )
+  {
+    for(i = 0; i < mpi->procCnt; i++)
+    {
+      displs[i] = total;
+      total = total + counts[i];
+    }
+    pairs = (long long int *)malloc(sizeof(long long int) * (total + 1));
+    err = (pairs == NULL) ? ERROR : 0;
+  }
+  MPI_Bcast(&err, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( err == 0 )
+    MPI_Gatherv(cache->pairs, n, MPI_LONG_LONG_INT, pairs, counts, displs, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+
+  if( mpi->procRank == 0 && err == 0 )
+  {
+    err = writeCache(args->cf, cache, &hits->hitIDs, pairs, (long long int)(total / 3), complete);
+    VERBOSE(if( err == 0 ) fprintf(stdout, "Result cache updated = %d records of %lld hit IDs not in cache%s\n", total / 3, cache->ndelta, (complete != 0) ? "" : ", hit IDs not found are not cached");)
+  }
+  free(pairs);
+  free(displs);
+  free(counts);
+  MPI_Bcast(&err, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+
+  return err;
+}
+
+
+// Load IDs from search file for sequence extraction
+int loadSearchIDs(char *fn, hits_t *hits)
+{
+  int err;               // Trap errors
+  long int fsize;        // Size of file
+  struct stat stbuf;
+ 
+  // Check if a search file was provided
+  if( hits->searchMode == 0 )
+    return 0;
+
+  // Open search file
+  hits->tfd = fopen(fn, "rb");
+  if( hits->tfd == NULL )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    return ERROR;
+  }
+
+  // Check that file is not empty
+  fstat(fileno(hits->tfd), &stbuf);
+  fsize = stbuf.st_size;
+  if( fsize <= 0L )
+  {
+    fprintf(stderr, "\nError: BLAST table file is empty\n");
+    fclose(hits->tfd);
+    return ERROR;
+  }
+
+  // Memory map file
+  hits->iMap = (char *)mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fileno(hits->tfd), 0);
+  if( hits->iMap == MAP_FAILED )
+  {
+    fprintf(stderr, "\nError: could not map table file\n");
+    fclose(hits->tfd);
+    return ERROR;
+  }
+
+  // Advise kernel on how to handle memory maps
+  posix_madvise(hits->iMap, fsize, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+
+  // Update mapping pointers
+  hits->fMap = (hits->iMap + fsize) - 1;
+  
+  // Close BLAST table file
+  fclose(hits->tfd);
+
+  // Load search IDs and unmap search file
+  err = loadSearchBuffer(hits, hits->iMap, (long long int)fsize);
+  munmap(hits->iMap, fsize);
+
+  return err;
+}
+
+
+// Load search IDs from contents of a search file, every line is a search ID
+int loadSearchBuffer(hits_t *hits, const char *buf, long long int sz)
+{
+  long long int len;     // Length of current search ID
+  const char *pch;       // Start of current line
+  const char *eol;       // End of current line
+  const char *end;       // End of contents
+
+  // Allocate table for search IDs
+  // Assume short lines to size table, it grows as needed
+  if( initIDTable(&hits->hitIDs, sz / 32, sz) != 0 )
+    return ERROR;
+  spillIDTable(&hits->hitIDs, hits->sfd, hits->spillLimit);
+
+  // Read contents line by line and load search IDs
+  hits->total = 0LL;
+  pch = buf;
+  end = buf + sz;
+  while( pch < end )
+  {
+    // Find end of current line, last line may not end with newline
+    eol = (const char *)memchr(pch, '\n', (size_t)(end - pch));
+    if( eol == NULL )
+      eol = end;
+    len = (long long int)(eol - pch);
+    hits->total++;
+
+    // Do not add empty lines nor duplicate search IDs
+    if( len > 0LL )
+    {
+      if( addID(&hits->hitIDs, pch, len, NULL) == ERROR )
+      {
+        fprintf(stdout, "Error: failed loading search IDs\n");
+        freeIDTable(&hits->hitIDs);
+        return ERROR;
+      }
+    }
+
+    pch = eol + 1;
+  }
+  hits->htotal = hits->hitIDs.nids;
+
+  // Allocate characteristic vector
+  hits->charVect = (int *)calloc(hits->htotal, sizeof(int));
+  
+  return 0;
+}
+
+
+// Load query and hit IDs from BLAST table file
+int loadBlastTable(char *fn, hits_t *hits)
+{
+  int err;               // Trap errors
+  long int fsize;        // Size of file
+  const char *qid;       // Current query ID
+  const char *hid;       // Current hit ID
+  long long int qlen;    // Length of current query ID
+  long long int hlen;    // Length of current hit ID
+  blastrd_t rd;          // Reader of query and hit ID pairs
+  struct stat stbuf;
+
+  // Check if pipeline mode
+  if( hits->pipeMode == 0 )
+    return 0;
+
+  // Open BLAST table file
+  hits->tfd = fopen(fn, "rb");
+  if( hits->tfd == NULL )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    return ERROR;
+  }
+
+  // Check that file is not empty
+  fstat(fileno(hits->tfd), &stbuf);
+  fsize = stbuf.st_size;
+  if( fsize <= 0L )
+  {
+    fprintf(stderr, "\nError: BLAST table file is empty\n");
+    fclose(hits->tfd);
+    return ERROR;
+  }
+
+  // Memory map file
+  hits->iMap = (char *)mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fileno(hits->tfd), 0);
+  if( hits->iMap == MAP_FAILED )
+  {
+    fprintf(stderr, "\nError: could not map table file\n");
+    fclose(hits->tfd);
+    return ERROR;
+  }
+
+  // Advise kernel on how to handle memory maps
+  posix_madvise(hits->iMap, fsize, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+
+  // Update mapping pointers
+  hits->fMap = (hits->iMap + fsize) - 1;
+  
+  // Close BLAST table file
+  fclose(hits->tfd);
+
+  // Allocate tables for BLAST query and hit IDs, they grow as needed
+  // Sized for short tabular lines, hit IDs are most of each line
+  if( initIDTable(&hits->queryIDs, fsize / 256 + 1, fsize / 16 + 1) != 0 || initIDTable(&hits->hitIDs, fsize / 64 + 1, fsize / 4 + 1) != 0 )
+  {
+    freeIDTable(&hits->queryIDs);
+    munmap(hits->iMap, fsize);
+    return ERROR;
+  }
+  spillIDTable(&hits->queryIDs, hits->sfd, hits->spillLimit);
+  spillIDTable(&hits->hitIDs, hits->sfd, hits->spillLimit);
+
+  // Read query and hit ID pairs of tabular or XML output in a single pass over mapped file
+  hits->total = 0LL;
+  hits->qtotal = 0;
+  hits->htotal = 0;
+  hits->npairs = 0LL;
+  hits->maxPairs = 0LL;
+  hits->idxList = NULL;
+  openBlastReader(&rd, hits->iMap, (long long int)fsize);
+  while( (err = nextBlastPair(&rd, &qid, &qlen, &hid, &hlen)) == 1 )
+  {
+    hits->total++;
+    err = addBlastIDs(hits, qid, qlen, hid, hlen);
+    if( err != 0 )
+      break;
+  }
+  munmap(hits->iMap, fsize);
+  if( err != 0 )
+  {
+    fprintf(stdout, "Error: failed parsing BLAST query and hit IDs\n");
+    freeHitsMemory(hits);
+    return ERROR;
+  }
+  VERBOSE(fprintf(stdout, "BLAST %s output = %lld hits, %lld query IDs, %lld hit IDs\n", (rd.format == BLAST_XML) ? "XML" : "tabular", hits->total, hits->qtotal, hits->htotal);)
+
+  // Group hit IDs by query ID
+  if( hits->pipeMode == 2 && buildGroups(&hits->groups, hits->idxList, hits->npairs, hits->qtotal, hits->htotal) != 0 )
+  {
+    freeHitsMemory(hits);
+    return ERROR;
   }
 
-  // Free bytes written array
-  free(dataLen);
+  // Allocate characteristic vector
+  hits->charVect = (int *)calloc(hits->htotal, sizeof(int));
 
   return 0;
 }
 
 
-// Write to output file hit IDs from BLAST table file not found in query file
-int writeHitsNotFound(char *of, hits_t *hits, mpi_t *mpi)
+// Load hit sets in master and broadcast them to all processes, in chunks of BCAST_LIMIT
+// ID tables are sent as packed arenas of distinct IDs, other processes do not read nor parse the input files
+int distributeHits(args_t *args, hits_t *hits, mpi_t *mpi)
 {
-  char outfile[FILE_LEN];
-  int *allCharVect;
-  int fileFlag;
-  int i;
-  int bytesWrite;
-  int fsize;
-  struct stat stbuf;
-
-  // Flag to signal file errors
-  fileFlag = 0;
+  int t;                  // Iteration variable
+  int err;                // Trap errors
+  int fileFlag;           // Flag for buffer allocated in current process
+  int allFileFlag;        // Flag for buffers allocated in all processes
+  long long int hdr[7];   // Line count, distinct query and hit IDs, then IDs and arena bytes of each table
+  long long int off;      // Offset of current chunk
+  long long int sz;       // Size of current chunk
+  char *buffer;           // Packed arena of current table
+  idtable_t *table;       // Current table
+
+  if( hits->pipeMode == 0 && hits->searchMode == 0 )
+    return 0;
 
-  // Master writes to file
+  // Master parses and deduplicates IDs
+  err = 0;
   if( mpi->procRank == 0 )
   {
-    // Create output filename
-    snprintf(outfile, FILE_LEN, "%s.notFound", of);
-
-    // Open output file
-    hits->ofd = fopen(outfile, "wb");
-    if( hits->ofd == NULL )
-    {
-      fprintf(stderr, "\n");
-      perror("fopen()");
-      fileFlag = ERROR;
-    }
-    else
-      // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ
-      setvbuf(hits->ofd, NULL, _IOFBF, STRM_BUFSIZ);
+    err = loadBlastTable(args->btable, hits);
+    if( err == 0 )
+      err = loadSearchIDs(args->sf, hits);
   }
-
-  // Check if file can be written
-  MPI_Bcast(&fileFlag, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
-  if( fileFlag != 0 )
+  MPI_Bcast(&err, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( err != 0 )
     return ERROR;
- 
-  allCharVect = (int *)malloc(sizeof(int) * hits->htotal);
-
-  // Sum all processes characteristic vector
-  MPI_Reduce(hits->charVect, allCharVect, hits->htotal, MPI_INT, MPI_SUM, 0, mpi->MPI_MY_WORLD);
+  if( mpi->procCnt == 1 )
+    return 0;
 
-  // Determine which hit IDs were not found using the characteristic vector
   if( mpi->procRank == 0 )
   {
-    for( i = 0; i < hits->htotal; i++ )
+    hdr[0] = hits->total;
+    hdr[1] = hits->qtotal;
+    hdr[2] = hits->htotal;
+    hdr[3] = hits->queryIDs.nids;
+    hdr[4] = hits->queryIDs.arenaLen;
+    hdr[5] = hits->hitIDs.nids;
+    hdr[6] = hits->hitIDs.arenaLen;
+    VERBOSE(fprintf(stdout, "Master is distributing hit sets (%lld bytes)\n", hdr[4] + hdr[6]);)
+  }
+  MPI_Bcast(hdr, 7, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+
+  // Search mode only has hit IDs
+  for(t = (hits->pipeMode != 0) ? 0 : 1; t < 2; t++)
+  {
+    table = (t == 0) ? &hits->queryIDs : &hits->hitIDs;
+
+    // Master sends its own arena
+    fileFlag = 0;
+    buffer = table->arena;
+    if( mpi->procRank != 0 )
     {
-      // If characteristic vector is zero, hit ID was not found
-      if( allCharVect[i] == 0 )
+      buffer = (char *)malloc(sizeof(char) * MAX(1LL, hdr[4+t*2]));
+      if( buffer == NULL )
       {
-        bytesWrite = fwrite(hits->hitList[i], sizeof(char), strlen(hits->hitList[i]), hits->ofd);
-        fputc('\n', hits->ofd);
+        fprintf(stdout, "\nError: failed to allocate buffer for hit sets\n");
+        fileFlag = ERROR;
       }
     }
+    MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+    if( allFileFlag != 0 )
+    {
+      if( mpi->procRank != 0 )
+        free(buffer);
+      freeHitsMemory(hits);
+      return ERROR;
+    }
 
-    // Flush output file
-    fflush(hits->ofd);
-    
-    // Close output file
-    fstat(fileno(hits->ofd), &stbuf);
-    fsize = stbuf.st_size;
-    fclose(hits->ofd);
+    for(off = 0LL; off < hdr[4+t*2]; off = off + sz)
+    {
+      sz = MIN(BCAST_LIMIT, hdr[4+t*2] - off);
+      MPI_Bcast(buffer + off, (int)sz, MPI_BYTE, 0, mpi->MPI_MY_WORLD);
+    }
 
-    // Remove output file if empty
-    if( fsize <= 0L )
+    // Other processes rebuild table, IDs are already distinct
+    if( mpi->procRank != 0 )
     {
-      fprintf(stdout, "\nWarning: removing empty output file of hit IDs\n");
-      remove(outfile);
+      err = unpackIDTable(table, buffer, hdr[3+t*2], hdr[4+t*2]);
+      free(buffer);
+      if( err == 0 )
+        spillIDTable(table, hits->sfd, hits->spillLimit);
+      if( err != 0 )
+        fileFlag = ERROR;
     }
   }
- 
-  // Free resources 
-  free(allCharVect);
 
-  return 0;
-}
+  // Groups of hit IDs are sent as rows of their groups
+  if( hits->pipeMode == 2 )
+  {
+    if( mpi->procRank != 0 && buildGroups(&hits->groups, NULL, 0LL, hdr[3], hdr[5]) != 0 )
+      fileFlag = ERROR;
+    MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+    if( allFileFlag != 0 )
+    {
+      freeHitsMemory(hits);
+      return ERROR;
+    }
 
+    for(off = 0LL; off <= hdr[5]; off = off + sz)
+    {
+      sz = MIN(BCAST_LIMIT / (long long int)sizeof(long long int), hdr[5] + 1 - off);
+      MPI_Bcast(hits->groups.hitOffs + off, (int)sz, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+    }
 
-// Partition query file and memory map into chunks for processing
-int partQueryFile(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi)
-{
-  char outfile[FILE_LEN];         // Output file
-  int err;                        // Trap errors
-  int done;                       // Flag to signal when sequence count quota has been met
-  long int fsize;                 // Size of output file
-  long long int mrem;             // Remaining maps to process
-  long long int offset;           // Memory map offset
-  long long int nmap;             // Current number of memory map
-  long long int nmaps;            // Number of memory maps needed for file iteration 
-  long long int msz;              // Current memory map size
-  long long int psz;              // System's page size
-  long long int shift;            // Bytes to shift initial map pointer
-  long long int mpishift;         // Bytes to shift initial map pointer for MPI programs
-  long long int xcnt;             // Count sequences extracted in current partition
-  long long int allxCnt;
-  long long int bytesWritten;     // Count number of bytes written to output file
-  struct stat stbuf;
-  query_t query;                  // Query extraction control struct
+    if( mpi->procRank != 0 )
+    {
+      free(hits->groups.members);
+      hits->groups.members = (long long int *)malloc(sizeof(long long int) * (hits->groups.hitOffs[hdr[5]] + 1));
+      if( hits->groups.members == NULL )
+        fileFlag = ERROR;
+    }
+    MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+    if( allFileFlag != 0 )
+    {
+      freeHitsMemory(hits);
+      return ERROR;
+    }
 
-  // Check that chunk limits of input memory map respect system's page size
-  // If chunk size is less than page size, set chunks to 1024 page sizes
-  // If chunk size if not a multiple of page size, set chunks to 1024 page sizes
-  // Else use default chunks value
-  psz = (long long int)sysconf(_SC_PAGESIZE);
-  msz = IMAP_LIMIT;
-  if( (msz < psz) || (msz % psz != 0) )
-    msz = psz * 1024LL;	// 4MB
+    for(off = 0LL; off < hits->groups.hitOffs[hdr[5]]; off = off + sz)
+    {
+      sz = MIN(BCAST_LIMIT / (long long int)sizeof(long long int), hits->groups.hitOffs[hdr[5]] - off);
+      MPI_Bcast(hits->groups.members + off, (int)sz, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+    }
+  }
 
-  // Create output filename
-  if( mpi->procCnt > 1 )
-    snprintf(outfile, FILE_LEN, "%s%d", args->of, mpi->procRank);
-  else
-    strncpy(outfile, args->of, FILE_LEN);
+  if( mpi->procRank != 0 )
+  {
+    hits->total = hdr[0];
+    hits->qtotal = hdr[1];
+    hits->htotal = hdr[2];
+    hits->charVect = (int *)calloc(MAX(1LL, hits->htotal), sizeof(int));
+    if( hits->charVect == NULL )
+      fileFlag = ERROR;
+  }
 
-  // Open output file
-  iomap->ofd = fopen(outfile, "w+b");
-  if( iomap->ofd == NULL )
+  // Check that all processes rebuilt hit sets
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
   {
-    fprintf(stderr, "\n");
-    perror("fopen()");
+    freeHitsMemory(hits);
     return ERROR;
   }
 
-  // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ
-  setvbuf(iomap->ofd, NULL, _IOFBF, STRM_BUFSIZ);
-  
-  VERBOSE(fprintf(stdout, "\n----------------Filtering----------------\n");)
- 
-  // Estimate iterations needed to process complete file in chunks
-  // Later this value may be modified to fit query file appropiately
-  nmaps = (long long int)ceil((double)iomap->qfsz / msz);
- 
-  // Process file in memory map chunks
-  err = 0;
-  done = 0;
-  bytesWritten = 0;
-  xcnt = 0LL;
-  shift = 0LL;
-  mpishift = iomap->fileOffs[mpi->procRank*3+1];
-  memset(&query, 0, sizeof(query_t));
-  for(nmap = 0; nmap < nmaps && !done; nmap++)
-  {
-    // Compute remaining memory maps to process
-    mrem = nmaps - (nmap + 1);
+  return 0;
+}
 
-    // Compute memory map offset
-    offset = nmap * msz;
 
-    // Compute memory map size for last chunk
-    // Set size to remaining bytes in file
-    if( mrem == 0 )
-       msz = iomap->qfsz - offset;
+// Load jobs of job manifest for batch mode
+// Master reads job manifest and broadcasts it, a line of options per job, empty lines and lines beginning with '#' are skipped
+// Options of a job are parsed as a command line following query file, merge mode, distribution mode and compression of command line
+// Hit sets of each job are loaded by all processes, or loaded by master and broadcast
+int loadJobs(args_t *args, iomap_t *iomap, mpi_t *mpi)
+{
+  char *buffer;                     // Contents of job manifest
+  char *line;                       // Current line
+  char *eol;                        // End of current line
+  char *token;                      // Current option or argument
+  char *save;                       // State of strtok_r()
+  char *jargv[JOBARG_CNT + 10];     // Command line of current job
+  char jline[JOBLINE_LEN];          // Copy of current line
+  char mergeArg[16];                // Merge mode of command line
+  char distArg[16];                 // Distribution mode of command line
+  char formatArg[16];               // Format width of command line
+  char prog[] = "filterfasta";
+  char qopt[] = "-q";
+  char mopt[] = "-m";
+  char dopt[] = "-d";
+  char gopt[] = "-g";
+  char fopt[] = "-f";
+  int i;                            // Iteration variable
+  int jargc;                        // Number of arguments of current job
+  int err;                          // Trap errors
+  int lverbose;                     // Verbose option of command line
+  int ltrace;                       // Trace option of command line
+  long long int len;                // Size of job manifest
+  struct stat stbuf;
+  FILE *fd;
+  job_t *job;                       // Current job
 
-    // Advise to kernel access pattern for file
-    posix_fadvise(fileno(iomap->qfd), offset, msz, POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
-    
-    // Debug statement
-    VERBOSE(fprintf(stdout, "Processing partition %lld of %lld (%lld bytes)\n", nmap+1, nmaps, msz);)
-    
-    // Create memory map, if needed
-    err = initQueryMap(msz, offset, iomap, mpi);
-    if( err != 0 )
+  iomap->jobs = NULL;
+  iomap->njobs = 0;
+
+  // Master reads job manifest
+  len = 0LL;
+  buffer = NULL;
+  if( mpi->procRank == 0 )
+  {
+    fd = fopen(args->jf, "rb");
+    if( fd == NULL )
     {
-      fprintf(stderr, "Error: failed initQueryMap()\n");
-      break;
+      fprintf(stderr, "\n");
+      perror("fopen()");
+      len = ERROR;
     }
-    
-    // Modify size of memory map to end at the before the beginning of sequence
-    // Provides a way to handle sequences that are between memory map chunks
-    if( nmap > 0LL )
+    else
     {
-      // Adjust at beginning for this map
-      err = adjustMapBegin(&shift, iomap, &query);
-      if( err != 0 )
-      {
-        fprintf(stdout, "Error: adjustMapBegin()\n");
-        munmap(iomap->iMap - shift - mpishift, msz);
-        free(query.buf);
-        break;
-      }
-
-      // Initialize query struct pointers
-      query.iaq = query.buf;
-      query.faq = query.buf;
-      query.isq = query.buf;
-      query.fsq = query.buf;
-
-      // Extract queries
-      err = extractQueries(args, iomap, &query, hits, mpi, &bytesWritten, &done);
-      if( err != 0 )
+      fstat(fileno(fd), &stbuf);
+      len = (long long int)stbuf.st_size;
+      if( len > (long long int)JOB_LIMIT * JOBLINE_LEN )
       {
-        fprintf(stderr, "\nError: failed extractQueries()\n");
-        munmap(iomap->iMap - shift - mpishift, msz);
-        free(query.buf);
-        break;
+        fprintf(stderr, "\nConfig error: job manifest is too large (%lld bytes)\n", len);
+        len = ERROR;
       }
-
-      // Reset buffer
-      free(query.buf);
-      query.buflen = 0;
-      query.fbuf = query.buf;
-    }
-  
-    // Initialize query struct pointers 
-    query.iaq = iomap->iMap;
-    query.faq = iomap->iMap;
-    query.isq = iomap->iMap;
-    query.fsq = iomap->iMap;
- 
-    // This is performed before the first call to adjustMapBegin()
-    // Not last partition
-    if( mrem > 0LL )
-    {
-      err = adjustMapEnd(iomap, &query);
-      if( err != 0 )
+      else
       {
-        fprintf(stdout, "Error: adjustMapEnd()\n");
-        munmap(iomap->iMap - shift - mpishift, msz);
-        free(query.buf);
-        break;
+        buffer = (char *)malloc(sizeof(char) * (len + 1));
+        if( buffer == NULL || (long long int)fread(buffer, sizeof(char), len, fd) != len )
+          len = ERROR;
       }
+      fclose(fd);
     }
-
-    // Extract sequences from current memory map
-    err = extractQueries(args, iomap, &query, hits, mpi, &bytesWritten, &done);
-    if( err != 0 )
-    {
-      fprintf(stderr, "\nError: failed extractQueries()\n");
-      munmap(iomap->iMap - shift - mpishift, msz);
-      free(query.buf);
-      break;
-    }
-
-    // Clear memory map
-    munmap(iomap->iMap - shift - mpishift, msz);
-    
-    // Compute queries extracted in current partition
-    xcnt = iomap->xCnt - xcnt;
-
-    // Debug statement
-    VERBOSE(fprintf(stdout, "Subtotal sequences extracted = %lld\n", xcnt);)
-    xcnt = iomap->xCnt;
   }
- 
-  // Flush stream buffers to output file 
-  fflush(iomap->ofd);
-
-  // Check if an error occurred
-  if( err != 0 )
-    fprintf(stdout, "An error occurred while processing partitions\n");
-
-  // Print statistics
-  VERBOSE(fprintf(stdout, "Total sequences extracted = %lld\n", iomap->xCnt);)
-
-  // Combine total of all sequences extracted
-  if( mpi->procCnt > 1 )
+  MPI_Bcast(&len, 1, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+  if( len == ERROR )
   {
-    MPI_Reduce(&iomap->xCnt, &allxCnt, 1, MPI_LONG_LONG_INT, MPI_SUM, 0, mpi->MPI_MY_WORLD);
-    if( mpi->procRank == 0 )
-      VERBOSE(fprintf(stdout, "Combined total sequences extracted = %lld\n", allxCnt);)
+    free(buffer);
+    return ERROR;
   }
-
-  // Write to file hit IDs not found in query file
-  if( hits->pipeMode != 0 || hits->searchMode != 0 )
+  if( mpi->procRank != 0 )
   {
-    err = writeHitsNotFound(args->of, hits, mpi);
-    if( err != 0 )
-      fprintf(stdout, "Error: failed to write hit IDs not found\n");
+    buffer = (char *)malloc(sizeof(char) * (len + 1));
+    if( buffer == NULL )
+    {
+      fprintf(stdout, "\nError: failed to allocate job manifest\n");
+      MPI_Abort(mpi->MPI_MY_WORLD, ERROR);
+    }
   }
+  if( len > 0LL )
+    MPI_Bcast(buffer, (int)len, MPI_CHAR, 0, mpi->MPI_MY_WORLD);
+  buffer[len] = '\0';
 
-#ifdef BCAST_OUTFILES 
-  // Send all data sizes (bytes written) to master for writing all results in a single file
-  err = combineOutputFiles(args, iomap, mpi, bytesWritten);
-  if( err != 0 )
-    fprintf(stdout, "Error: failed to combine output files\n");
-#endif
+  iomap->jobs = (job_t *)calloc(JOB_LIMIT, sizeof(job_t));
+  if( iomap->jobs == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate jobs\n");
+    free(buffer);
+    return ERROR;
+  }
 
-  // Close output file
-  fstat(fileno(iomap->ofd), &stbuf);
-  fsize = stbuf.st_size;
-  fclose(iomap->ofd);
+  // Options of command line shared by all jobs
+  snprintf(mergeArg, sizeof(mergeArg), "%d", args->mergeMode);
+  snprintf(distArg, sizeof(distArg), "%d", args->distMode);
+  snprintf(formatArg, sizeof(formatArg), "%d", args->formatWidth);
+  lverbose = verbose;
+  ltrace = trace;
 
-  // Remove output file if empty
-  if( fsize <= 0L )
+  // Parse options of each job
+  err = 0;
+  for(line = buffer; line != NULL && err == 0; line = (eol != NULL) ? eol + 1 : NULL)
   {
-    fprintf(stdout, "\nWarning: removing empty output file\n");
-    remove(outfile);
-  }
-  
-  VERBOSE(fprintf(stdout, "\n");)
+    eol = strchr(line, '\n');
+    len = (eol != NULL) ? (long long int)(eol - line) : (long long int)strlen(line);
+    if( len >= JOBLINE_LEN )
+    {
+      fprintf(stderr, "\nConfig error: line of job manifest is too long (%d characters max)\n", JOBLINE_LEN - 1);
+      err = CFGERROR;
+      break;
+    }
+    memcpy(jline, line, (size_t)len);
+    jline[len] = '\0';
+
+    jargc = 0;
+    jargv[jargc++] = prog;
+    jargv[jargc++] = qopt;
+    jargv[jargc++] = args->qf;
+    jargv[jargc++] = mopt;
+    jargv[jargc++] = mergeArg;
+    jargv[jargc++] = dopt;
+    jargv[jargc++] = distArg;
+    if( args->bgzfMode != 0 )
+      jargv[jargc++] = gopt;
+    // Format of command line is used by jobs without their own format
+    if( args->formatWidth != FORMAT_WIDTH )
+    {
+      jargv[jargc++] = fopt;
+      jargv[jargc++] = formatArg;
+    }
+    i = jargc;
+    for(token = strtok_r(jline, " \t\r", &save); token != NULL && *token != '#'; token = strtok_r(NULL, " \t\r", &save))
+    {
+      if( jargc == (JOBARG_CNT + 10) )
+      {
+        fprintf(stderr, "\nConfig error: too many options in line of job manifest (%d max)\n", JOBARG_CNT);
+        err = CFGERROR;
+        break;
+      }
+      jargv[jargc++] = token;
+    }
 
-  return err;
-}
+    // Empty line or comment
+    if( err != 0 || jargc == i )
+      continue;
 
+    if( iomap->njobs == JOB_LIMIT )
+    {
+      fprintf(stderr, "\nConfig error: too many jobs in job manifest (%d max)\n", JOB_LIMIT);
+      err = CFGERROR;
+      break;
+    }
 
-// Parse BLAST query and hit IDs from current line
-int parseBlastTableIDs(hits_t *hits, char *line)
-{
-  char *currQueryId;     // Current query ID
-  char *currHitId;       // Current hit ID
-  int   hexists;         // Flag to prevent duplicate hit ID for HMMER
-  long long int i;       // Iteration variable
-  long long int qlen;    // Length of current query ID
-  long long int hlen;    // Length of current hit ID
-  int qNull;
-  int hNull;
+    // Reset getopt_long() for command line of job
+    job = &iomap->jobs[iomap->njobs];
+    optind = 0;
+    if( parseCmdline(jargc, jargv, &job->args, mpi) != 0 )
+    {
+      fprintf(stderr, "Config error: invalid options of job %d\n", iomap->njobs + 1);
+      err = CFGERROR;
+      break;
+    }
+    verbose = lverbose;
+    trace = ltrace;
 
-  // Parse query ID from current line  
-  currQueryId = strtok(line, " \t");
-  if( currQueryId == NULL )
-  {
-    fprintf(stdout, "\nError: could not find query ID\n");
-    return ERROR;
-  }
+    // Jobs are filtered by a single thread of each process
+    if( job->args.batchMode != 0 )
+    {
+      fprintf(stderr, "\nConfig error: job %d cannot read a job manifest\n", iomap->njobs + 1);
+      err = CFGERROR;
+      break;
+    }
+    job->args.threadCnt = 1;
+    job->args.indexMode = 0;
+    job->args.shardCnt = 0;
+    job->args.cacheMode = 0;
 
-  // Parse database hit ID from current line
-  currHitId = strtok(NULL, " \t");
-  if( currHitId == NULL )
-  {
-    fprintf(stdout, "\nError: could not find hit ID\n");
-    return ERROR;
+    // Do not allow jobs to overwrite output files of other jobs
+    for(i = 0; i < iomap->njobs; i++)
+    {
+      if( strncmp(iomap->jobs[i].args.of, job->args.of, FILE_LEN) == 0 )
+      {
+        fprintf(stderr, "\nConfig error: jobs %d and %d refer to the same output file\n", i + 1, iomap->njobs + 1);
+        err = CFGERROR;
+        break;
+      }
+    }
+    iomap->njobs++;
   }
+  verbose = lverbose;
+  trace = ltrace;
+  free(buffer);
 
-  // Check that it fits into array
-  // Plus 1 to account for null-terminating character added by strtok()
-  qNull = 0;
-  qlen = (long long int)strlen(currQueryId) + 1;
-  if( qlen > HITS_ID_LEN )
+  if( err == 0 && iomap->njobs == 0 )
   {
-    fprintf(stdout, "\nError: current query ID is too large, size = %lld\n", qlen);
-    qlen = HITS_ID_LEN - 1;
-    qNull = 1;
+    fprintf(stderr, "\nConfig error: no jobs in job manifest\n");
+    err = CFGERROR;
   }
-
-  // Check that it fits into array
-  // Plus 1 to account for null-terminating character added by strtok()
-  hNull = 0;
-  hlen = (long long int)strlen(currHitId) + 1;
-  if( hlen > HITS_ID_LEN )
+  if( err != 0 )
   {
-    fprintf(stdout, "\nWarning: current hit ID is too large, size = %lld\n", hlen);
-    hlen = HITS_ID_LEN - 1;
-    hNull = 1;
+    freeJobs(iomap);
+    return err;
   }
 
-  // Copy first query ID to list or copy query ID to list if not already in list
-  if( (hits->qtotal == 0LL) || (strncmp(currQueryId, hits->queryList[hits->qtotal-1], qlen) != 0) )
+  // Load hit sets of each job
+  for(i = 0; i < iomap->njobs && err == 0; i++)
   {
-    strncpy(hits->queryList[hits->qtotal], currQueryId, qlen);
-    if( qNull == 1 )
-      hits->queryList[hits->qtotal][qlen] = '\0';
-    hits->qtotal++;
-  }
-  
-  // HMMER pipe program
-  if( hits->pipeMode == 1 )
-  { 
-    // Copy hit ID to list if not query ID and does not exist in hit list already
-    if( strncmp(currQueryId, currHitId, MIN(qlen,hlen)) != 0 )
+    job = &iomap->jobs[i];
+    job->hits.pipeMode = job->args.pipeMode;
+    job->hits.searchMode = job->args.searchMode;
+    if( args->distMode != 0 )
+      err = distributeHits(&job->args, &job->hits, mpi);
+    else
     {
-      // Do not add duplicate hit IDs, check against all in hit list
-      hexists = 0;
-      for(i = 0LL; i < hits->htotal; i++)
-      {
-        if( strncmp(currHitId, hits->hitList[i], hlen) == 0 )
-        {
-          hexists = 1;
-          break;
-        }
-      }    
-
-      // Copy hit ID to list if not query ID and does not exist in hit list already
-      if( hexists == 0 )
-      {
-        strncpy(hits->hitList[hits->htotal], currHitId, hlen);
-        if( hNull == 1 )
-          hits->hitList[hits->htotal][hlen] = '\0';
-        hits->htotal++;
-      }
+      err = loadBlastTable(job->args.btable, &job->hits);
+      if( err == 0 )
+        err = loadSearchIDs(job->args.sf, &job->hits);
     }
+    if( err != 0 )
+      fprintf(stderr, "Error: failed loading hit IDs of job %d\n", i + 1);
   }
-  else if( hits->pipeMode == 2 )
+  if( err != 0 )
   {
-    fprintf(stdout, "\nWarning: MUSCLE pipeline is still under development\n");
+    freeJobs(iomap);
     return ERROR;
   }
 
+  VERBOSE(fprintf(stdout, "Jobs in job manifest = %d\n", iomap->njobs);)
+  for(i = 0; i < iomap->njobs; i++)
+    TRACE(fprintf(stdout, "Job %d: output = %s, lengths = %d, ranges = %d, annotations = %d, count = %lld, bytes = %lld, pipeline = %d, search = %d\n", i + 1, iomap->jobs[i].args.of, iomap->jobs[i].args.seqLenBuf, iomap->jobs[i].args.rseqLenBuf, iomap->jobs[i].args.annotCnt, iomap->jobs[i].args.seqCnt, iomap->jobs[i].args.bytesLimit, iomap->jobs[i].args.pipeMode, iomap->jobs[i].args.searchMode);)
+
   return 0;
 }
 
 
-// Free hits structure memory
-int freeHitsMemory(hits_t *hits)
+// Free hit sets and jobs of batch mode
+int freeJobs(iomap_t *iomap)
 {
-  long long int i;  // Iteration variable
-    
-  if( hits->pipeMode != 0 )
+  int i;   // Iteration variable
+
+  if( iomap->jobs == NULL )
+    return 0;
+
+  for(i = 0; i < iomap->njobs; i++)
+    freeHitsMemory(&iomap->jobs[i].hits);
+  free(iomap->jobs);
+  iomap->jobs = NULL;
+  iomap->njobs = 0;
+
+  return 0;
+}
+
+
+// Extract queries of a span of mapped query file of server
+// Batched output of span is written to client before returning
+int extractMappedSpan(args_t *args, iomap_t *iomap, hits_t *hits, mpi_t *mpi, char *map, long long int sbegin, long long int send, long long int *bytesWritten, int *done)
+{
+  query_t query;    // Query extraction control struct
+
+  iomap->iMap = map + sbegin;
+  iomap->fMap = map + send - 1;
+  iomap->mapOff = sbegin;
+  memset(&query, 0, sizeof(query_t));
+  query.iaq = iomap->iMap;
+  query.faq = iomap->iMap;
+  query.isq = iomap->iMap;
+  query.fsq = iomap->iMap;
+
+  return extractQueries(args, iomap, &query, hits, mpi, bytesWritten, done);
+}
+
+
+// Filter mapped query file of server for a request and stream selected queries to client
+// Hit IDs and length options select records of offset index if it is up to date, otherwise query file is scanned by windows
+int runRequest(servectx_t *ctx, args_t *args, hits_t *hits, int fd, long long int *bytesWritten)
+{
+  int err;                        // Trap errors
+  int done;                       // Flag to signal when sequence count quota has been met
+  long long int i;                // Iteration variable
+  long long int rec;              // Current record
+  long long int nrecs;            // Number of records of index
+  long long int sbegin;           // File offset of current span of records
+  long long int send;             // File offset of end of current span
+  const char *p;                  // Beginning of next record after window
+  unsigned char *recMask;         // Bit vector of records marked
+  ffindex_t *idx;                 // Offset index, NULL if query file is scanned
+  iomap_t iomap;                  // Mapping of request
+  outvec_t ovec;                  // Batched output to client
+
+  // Request shares mapping of server, output goes to client only
+  memcpy(&iomap, ctx->iomap, sizeof(iomap_t));
+  iomap.ofd = NULL;
+  iomap.spans = NULL;
+  iomap.quota = NULL;
+  iomap.qlens = NULL;
+  iomap.jobs = NULL;
+  iomap.njobs = 0;
+  iomap.xCnt = 0LL;
+  if( initOutVec(&ovec, fileno(iomap.qfd), fd) != 0 )
+    return ERROR;
+  // Kernel copies are not written to sockets, data is written from mapping
+  ovec.useCopy = 0;
+  iomap.ovec = &ovec;
+
+  // Mark records of index selected by hit IDs or sequence lengths
+  idx = NULL;
+  recMask = NULL;
+  if( ctx->qidx != NULL && (hits->pipeMode != 0 || hits->searchMode != 0 || args->seqLenBuf > 0 || args->rseqLenBuf > 0) )
   {
-    for(i = 0LL; i < hits->total; i++)
+    idx = ctx->qidx;
+    recMask = (unsigned char *)calloc((size_t)((idx->hdr->nrecs + 7LL) / 8LL + 1LL), sizeof(unsigned char));
+    if( recMask == NULL )
     {
-      free(hits->queryList[i]);
-      free(hits->hitList[i]);
+      fprintf(stdout, "\nError: failed to allocate index record mask\n");
+      freeOutVec(&ovec);
+      return ERROR;
+    }
+    if( hits->pipeMode != 0 || hits->searchMode != 0 )
+    {
+      for(i = 0LL; i < hits->htotal; i++)
+        markIndexRecords(idx, getID(&hits->hitIDs, i), getIDLen(&hits->hitIDs, i), recMask);
+    }
+    else
+    {
+      for(rec = 0LL; rec < idx->hdr->nrecs; rec++)
+        if( selectLength(args, idx->recs[rec].seqLen) != 0 )
+          recMask[rec >> 3] |= (unsigned char)(1 << (rec & 7LL));
     }
-    free(hits->queryList);
-    free(hits->hitList);
-    free(hits->idxList);
-    free(hits->charVect);
   }
-  
-  if( hits->searchMode != 0 )
+
+  err = 0;
+  done = 0;
+  if( idx != NULL )
   {
-    for(i = 0LL; i < hits->total; i++)
-      free(hits->hitList[i]);
-    free(hits->hitList);
-    free(hits->charVect);
+    // Extract spans of marked records, close records are extracted together
+    nrecs = idx->hdr->nrecs;
+    for(rec = 0LL; rec < nrecs && !done && err == 0; rec++)
+    {
+      if( (recMask[rec >> 3] & (1 << (rec & 7LL))) == 0 )
+        continue;
+
+      sbegin = idx->recs[rec].off;
+      send = sbegin + idx->recs[rec].rlen;
+      for(i = rec + 1; i < nrecs && (idx->recs[i].off - send) <= IDX_COALESCE; i++)
+      {
+        if( (recMask[i >> 3] & (1 << (i & 7LL))) == 0 )
+          continue;
+        send = idx->recs[i].off + idx->recs[i].rlen;
+        rec = i;
+      }
+
+      err = extractMappedSpan(args, &iomap, hits, ctx->mpi, ctx->map, sbegin, send, bytesWritten, &done);
+    }
   }
- 
-  return 0;
+  else
+  {
+    // Scan windows of query file, each window ends at beginning of a record
+    for(sbegin = 0LL; sbegin < ctx->mapSz && !done && err == 0; sbegin = send)
+    {
+      send = sbegin + SERVE_WINDOW;
+      if( send >= ctx->mapSz )
+        send = ctx->mapSz;
+      else
+      {
+        p = ctx->map + send;
+        while( (p = (const char *)memchr(p, '>', (size_t)(ctx->mapSz - (p - ctx->map)))) != NULL && *(p - 1) != '\n' )
+          p++;
+        send = (p != NULL) ? (long long int)(p - ctx->map) : ctx->mapSz;
+      }
+
+      err = extractMappedSpan(args, &iomap, hits, ctx->mpi, ctx->map, sbegin, send, bytesWritten, &done);
+    }
+  }
+
+  free(recMask);
+  freeOutVec(&ovec);
+
+  return err;
 }
 
 
-// Load IDs from search file for sequence extraction
-int loadSearchIDs(char *fn, hits_t *hits)
+// Serve a request of a client
+// First line has options of request, as a line of job manifest
+// With "-s -", search IDs follow a line per ID, up to an empty line or end of request
+// Selected queries are written back to client, or a line beginning with "Error:" if request fails
+int serveRequest(int fd, void *arg)
 {
-  long int fsize;        // Size of file
-  long long int i;       // Iteration variable
-  long long int nch;     // Number of characters in current line
-  long long int longest; // Longest line in BLAST file
-  char *line;            // Current processing line
-  struct stat stbuf;
-  long long int len;
-  int exists;
-  long long int j;
-  char *pch;
-  int done;
- 
-  // Check if a search file was provided
-  if( hits->searchMode == 0 )
-    return 0;
+  char line[JOBLINE_LEN];           // Options of request, then current piece of search IDs
+  char *token;                      // Current option or argument
+  char *save;                       // State of strtok_r()
+  char *ids;                        // Search IDs sent by client
+  char *tmp;
+  char *jargv[JOBARG_CNT + 10];     // Command line of request
+  char formatArg[16];               // Format width of server
+  char prog[] = "filterfasta";
+  char qopt[] = "-q";
+  char fopt[] = "-f";
+  const char *allowed = "clabtpsf"; // Options of requests, all of them take an argument
+  const char *longOpts[] = {"--count", "--length", "--annot", "--bytes", "--table", "--pipe", "--search", "--format", NULL};
+  const char *msg;                  // Error sent to client
+  int i;                            // Iteration variable
+  int jargc;                        // Number of arguments of request
+  int optArg;                       // Flag for next token being an option argument
+  int err;                          // Trap errors
+  int lverbose;                     // Verbose option of server
+  int ltrace;                       // Trace option of server
+  int eol;                          // Flag for previous piece of search IDs ending a line
+  long long int n;                  // Length of current piece of line
+  long long int idsLen;             // Bytes of search IDs
+  long long int idsSz;              // Bytes allocated for search IDs
+  long long int bytesWritten;       // Bytes written to client
+  long long int reqId;              // Number of current request
+  double start;                     // Time of beginning of request
+  FILE *in;                         // Request of client
+  args_t args;                      // Options of request
+  hits_t hits;                      // Hit IDs of request
+  servectx_t *ctx;                  // Server
+
+  ctx = (servectx_t *)arg;
+  start = MPI_Wtime();
+  ids = NULL;
+  idsLen = 0LL;
+  idsSz = 0LL;
+  bytesWritten = 0LL;
+  msg = NULL;
+  err = 0;
+  memset(&args, 0, sizeof(args_t));
+  memset(&hits, 0, sizeof(hits_t));
 
-  // Open search file
-  hits->tfd = fopen(fn, "rb");
-  if( hits->tfd == NULL )
+  // Descriptor of client is still used for writing after reading stream is closed
+  in = fdopen(dup(fd), "r");
+  if( in == NULL )
   {
-    fprintf(stderr, "\n");
-    perror("fopen()");
+    perror("fdopen()");
+    close(fd);
     return ERROR;
   }
 
-  // Check that file is not empty
-  fstat(fileno(hits->tfd), &stbuf);
-  fsize = stbuf.st_size;
-  if( fsize <= 0L )
+  if( fgets(line, JOBLINE_LEN, in) == NULL || strchr(line, '\n') == NULL )
   {
-    fprintf(stderr, "\nError: BLAST table file is empty\n");
-    fclose(hits->tfd);
-    return ERROR;
+    msg = "Error: missing or too long options of request\n";
+    err = CFGERROR;
   }
 
-  // Memory map file
-  hits->iMap = (char *)mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fileno(hits->tfd), 0);
-  if( hits->iMap == MAP_FAILED )
+  // Command line of request begins with query file and format of server
+  jargc = 0;
+  jargv[jargc++] = prog;
+  jargv[jargc++] = qopt;
+  jargv[jargc++] = ctx->args->qf;
+  if( ctx->args->formatWidth != FORMAT_WIDTH )
   {
-    fprintf(stderr, "\nError: could not map table file\n");
-    fclose(hits->tfd);
-    return ERROR;
+    snprintf(formatArg, sizeof(formatArg), "%d", ctx->args->formatWidth);
+    jargv[jargc++] = fopt;
+    jargv[jargc++] = formatArg;
   }
 
-  // Advise kernel on how to handle memory maps
-  posix_madvise(hits->iMap, fsize, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
-
-  // Update mapping pointers
-  hits->fMap = (hits->iMap + fsize) - 1;
-  
-  // Close BLAST table file
-  fclose(hits->tfd);
-
-  // Compute number of lines and longest line in file
-  hits->total = 0LL;
-  nch = 0LL;      
-  longest = 0LL;
-  pch = hits->iMap;
-  while( 1 )
+  // Only filtering options are accepted, requests do not write files
+  optArg = 0;
+  for(token = (err == 0) ? strtok_r(line, " \t\r\n", &save) : NULL; token != NULL && err == 0; token = strtok_r(NULL, " \t\r\n", &save))
   {
-    nch++;
-    if( *pch == '\n' || pch == hits->fMap )
-    {  
-      hits->total++;
-      if( nch > longest )
-        longest = nch;
-      nch = 0LL;
-    
-      if( pch == hits->fMap )
-        break;
+    if( jargc == (JOBARG_CNT + 10) )
+    {
+      msg = "Error: too many options in request\n";
+      err = CFGERROR;
+      break;
+    }
+    jargv[jargc++] = token;
+    if( optArg != 0 )
+    {
+      optArg = 0;
+      continue;
     }
-    pch++;
-  }
-  longest++;
 
-  // Allocate array for search IDs
-  hits->hitList = (char **)malloc(sizeof(char *) * hits->total);
-  for(i = 0LL; i < hits->total; i++)
-    hits->hitList[i] = (char *)malloc(sizeof(char) * HITS_ID_LEN);
+    if( token[0] == '-' && token[1] != '-' && token[1] != '\0' && strchr(allowed, token[1]) != NULL )
+      optArg = (token[2] == '\0');
+    else if( strncmp(token, "--", 2) == 0 )
+    {
+      for(i = 0; longOpts[i] != NULL; i++)
+        if( strncmp(token, longOpts[i], strlen(longOpts[i])) == 0 && (token[strlen(longOpts[i])] == '\0' || token[strlen(longOpts[i])] == '=') )
+          break;
+      if( longOpts[i] == NULL )
+        err = CFGERROR;
+      else
+        optArg = (token[strlen(longOpts[i])] == '\0');
+    }
+    else
+      err = CFGERROR;
+    if( err != 0 )
+      msg = "Error: option not allowed in request (-c, -l, -a, -b, -t, -p, -s, -f)\n";
+  }
 
-  // Allocate buffer for reading lines
-  line = (char *)malloc(sizeof(char) * longest);
- 
-  // Read file line by line and load search IDs
-  hits->htotal = 0;
-  pch = hits->iMap;
-  done = 0;
-  while( done == 0 )
+  // Parser of command line uses getopt_long() and global options, one request at a time
+  if( err == 0 )
   {
-    // Read current line
-    len = 0;
-    while( 1 )
+    pthread_mutex_lock(&ctx->parseLock);
+    lverbose = verbose;
+    ltrace = trace;
+    optind = 0;
+    err = parseCmdline(jargc, jargv, &args, ctx->mpi);
+    verbose = lverbose;
+    trace = ltrace;
+    pthread_mutex_unlock(&ctx->parseLock);
+    if( err != 0 )
+      msg = "Error: invalid options of request\n";
+    else if( args.pipeMode == 2 )
     {
-      len++;
-      if( *pch == '\n' || pch == hits->fMap )
-      {  
-        memcpy(line, pch-len+1, len);
-        line[len] = '\0';
-      
-        if( pch == hits->fMap )
-          done = 1;
-        else 
-          pch++;
-        break;
-      }
-      pch++;
+      msg = "Error: MUSCLE pipeline is not served, groups are written to files\n";
+      err = CFGERROR;
     }
+  }
 
-    // Copy search ID and replace newline with null-terminating character
-    if( len <= 1 )
-      continue;
-    else if( (len + 1) > HITS_ID_LEN )
-      len = HITS_ID_LEN;
-    
-    // Ignore newline
-    len--;  
-    
-    // Do not add duplicate hit IDs, check against all in hit list
-    exists = 0;
-    for(j = 0LL; j < hits->htotal; j++)
+  // Load hit IDs of request, search IDs may be sent by client
+  if( err == 0 )
+  {
+    hits.pipeMode = args.pipeMode;
+    hits.searchMode = args.searchMode;
+    if( args.searchMode != 0 && strcmp(args.sf, STDIN_FILE) == 0 )
     {
-      if( strncmp(line, hits->hitList[j], len) == 0 )
+      // Long lines are read in pieces
+      eol = 1;
+      while( fgets(line, JOBLINE_LEN, in) != NULL && !(eol != 0 && line[0] == '\n') )
       {
-        exists = 1;
-        break;
+        n = (long long int)strlen(line);
+        eol = (line[n-1] == '\n');
+        if( idsLen + n > idsSz )
+        {
+          idsSz = (idsSz == 0LL) ? (1LL<<16) : idsSz * 2LL;
+          while( idsSz < idsLen + n )
+            idsSz = idsSz * 2LL;
+          tmp = (char *)realloc(ids, (size_t)idsSz);
+          if( tmp == NULL )
+          {
+            err = ERROR;
+            break;
+          }
+          ids = tmp;
+        }
+        memcpy(ids + idsLen, line, (size_t)n);
+        idsLen = idsLen + n;
       }
-    }    
-
-    // Copy search ID to list if not exists in list already
-    if( exists == 0 )
+      // Lines may end with "\r\n"
+      for(i = 0; err == 0 && i < idsLen; i++)
+        if( ids[i] == '\r' )
+          ids[i] = '\n';
+      if( err == 0 )
+        err = loadSearchBuffer(&hits, (ids != NULL) ? ids : "", idsLen);
+    }
+    else
     {
-      strncpy(hits->hitList[hits->htotal], line, len);
-      hits->hitList[hits->htotal][len] = '\0';
-      hits->htotal++;
+      err = loadBlastTable(args.btable, &hits);
+      if( err == 0 )
+        err = loadSearchIDs(args.sf, &hits);
     }
+    if( err != 0 )
+      msg = "Error: failed loading hit IDs of request\n";
   }
 
-  // Free line buffer
-  free(line);
+  if( err == 0 && runRequest(ctx, &args, &hits, fd, &bytesWritten) != 0 )
+  {
+    fprintf(stderr, "Error: failed serving request\n");
+    err = ERROR;
+  }
+  else if( err != 0 && (long long int)write(fd, msg, strlen(msg)) < 0 )
+    perror("write()");
 
-  // Read current line
-  munmap(hits->iMap, fsize);
+  pthread_mutex_lock(&ctx->parseLock);
+  reqId = ++ctx->nreqs;
+  pthread_mutex_unlock(&ctx->parseLock);
+  if( ctx->verbose != 0 )
+    fprintf(stdout, "Request %lld: %s, %lld bytes written in %f seconds\n", reqId, (err == 0) ? "done" : "failed", bytesWritten, MPI_Wtime() - start);
 
-  // Allocate characteristic vector
-  hits->charVect = (int *)calloc(hits->htotal, sizeof(int));
-  
-  return 0;
+  free(ids);
+  freeHitsMemory(&hits);
+  fclose(in);
+  close(fd);
+
+  return err;
 }
 
 
-// Load query and hit IDs from BLAST table file
-int loadBlastTable(char *fn, hits_t *hits)
+// Serve extraction requests over a Unix socket until server is stopped by SIGINT or SIGTERM
+// Query file and its offset index are mapped once and shared by requests, each request has its own hit IDs
+int serveQueries(args_t *args, iomap_t *iomap, mpi_t *mpi)
 {
-  char *line;            // Current processing line
-  int err;               // Trap errors
-  int done;
-  char *pch;
-  int i;                 // Iteration variable
-  long int fsize;        // Size of file
-  long long int nch;     // Number of characters in current line
-  long long int longest; // Longest line in BLAST file
+  int err;             // Trap errors
+  ffindex_t qindex;    // Offset index of query file
+  servectx_t ctx;      // Server
+  server_t srv;        // Connections of server
   struct stat stbuf;
 
-  // Check if pipeline mode
-  if( hits->pipeMode == 0 )
-    return 0;
-
-  // Open BLAST table file
-  hits->tfd = fopen(fn, "rb");
-  if( hits->tfd == NULL )
+  // Requests read records anywhere in query file
+  if( iomap->stream != 0 || iomap->comp != COMP_NONE )
   {
-    fprintf(stderr, "\n");
-    perror("fopen()");
-    return ERROR;
+    fprintf(stderr, "\nConfig error: server mode needs an uncompressed regular query file\n");
+    return CFGERROR;
   }
 
-  // Check that file is not empty
-  fstat(fileno(hits->tfd), &stbuf);
-  fsize = stbuf.st_size;
-  if( fsize <= 0L )
+  memset(&ctx, 0, sizeof(servectx_t));
+  memset(&qindex, 0, sizeof(ffindex_t));
+  fstat(fileno(iomap->qfd), &stbuf);
+  ctx.mapSz = (long long int)stbuf.st_size;
+  if( ctx.mapSz <= 0LL )
   {
-    fprintf(stderr, "\nError: BLAST table file is empty\n");
-    fclose(hits->tfd);
+    fprintf(stderr, "\nError: query file is empty\n");
     return ERROR;
   }
-
-  // Memory map file
-  hits->iMap = (char *)mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fileno(hits->tfd), 0);
-  if( hits->iMap == MAP_FAILED )
+  ctx.map = (char *)mmap(NULL, (size_t)ctx.mapSz, PROT_READ, MAP_SHARED, fileno(iomap->qfd), 0);
+  if( ctx.map == MAP_FAILED )
   {
-    fprintf(stderr, "\nError: could not map table file\n");
-    fclose(hits->tfd);
+    fprintf(stderr, "\nError: could not map query file\n");
     return ERROR;
   }
+  posix_madvise(ctx.map, (size_t)ctx.mapSz, POSIX_MADV_RANDOM | POSIX_MADV_WILLNEED);
 
-  // Advise kernel on how to handle memory maps
-  posix_madvise(hits->iMap, fsize, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
-
-  // Update mapping pointers
-  hits->fMap = (hits->iMap + fsize) - 1;
-  
-  // Close BLAST table file
-  fclose(hits->tfd);
-
-  // Compute number of lines and longest line in file
-  hits->total = 0LL;
-  nch = 0LL;      
-  longest = 0LL;
-  pch = hits->iMap;
-  while( 1 )
+  // Use offset index of query file, if it is up to date
+  if( openIndex(args->qf, &qindex) == 0 )
   {
-    nch++;
-    if( *pch == '\n' || pch == hits->fMap )
-    {  
-      hits->total++;
-      if( nch > longest )
-        longest = nch;
-      nch = 0LL;
-    
-      if( pch == hits->fMap )
-        break;
-    }
-    pch++;
+    ctx.qidx = &qindex;
+    VERBOSE(fprintf(stdout, "Using index file = %s%s (%lld records)\n", args->qf, IDX_SUFFIX, qindex.hdr->nrecs);)
   }
-  longest++;
-
-  // Allocate array for BLAST query IDs
-  hits->queryList = (char **)malloc(sizeof(char *) * hits->total);
-  for(i = 0LL; i < hits->total; i++)
-    hits->queryList[i] = (char *)malloc(sizeof(char) * HITS_ID_LEN);
-
-  // Allocate array for BLAST hit IDs
-  hits->hitList = (char **)malloc(sizeof(char *) * hits->total);
-  for(i = 0LL; i < hits->total; i++)
-    hits->hitList[i] = (char *)malloc(sizeof(char) * HITS_ID_LEN);
-
-  // Allocate array for hit/query index array
-  hits->idxList = (long long int *)malloc(sizeof(long long int) * hits->total);
-
-  // Allocate buffer for reading lines
-  line = (char *)malloc(sizeof(char) * longest);
-  
-  // Read file line by line and parse BLAST query and hit IDs
-  hits->qtotal = 0;
-  hits->htotal = 0;
-  pch = hits->iMap;
-  done = 0;
-  while( done == 0 )
-  {
-    nch = 0;
-    while( 1 )
-    {
-      nch++;
-      if( *pch == '\n' || pch == hits->fMap )
-      {  
-        memcpy(line, pch-nch+1, nch);
-        line[nch] = '\0';
-      
-        if( pch == hits->fMap )
-          done = 1;
-        else 
-          pch++;
-        break;
-      }
-      pch++;
-    }
+  else
+    VERBOSE(fprintf(stdout, "No valid index file, requests scan query file\n");)
 
-    // Parse BLAST query and hit IDs
-    err = parseBlastTableIDs(hits, line);
-    if( err != 0 )
-    {
-      fprintf(stdout, "Error: failed parsing BLAST query and hit IDs\n");
-      free(line);
-      freeHitsMemory(hits);
-      munmap(hits->iMap, fsize);
-      return ERROR;
-    }
-  }
-  
-  // Free line buffer
-  free(line);
+  ctx.args = args;
+  ctx.iomap = iomap;
+  ctx.mpi = mpi;
+  ctx.verbose = verbose || trace;
+  pthread_mutex_init(&ctx.parseLock, NULL);
 
-  // Read current line
-  munmap(hits->iMap, fsize);
+  err = openServer(&srv, args->sock, args->threadCnt, serveRequest, &ctx);
+  if( err == 0 )
+  {
+    VERBOSE(fprintf(stdout, "Serving requests on socket = %s (%d workers)\n", args->sock, srv.nworkers);)
+    fflush(stdout);
+    err = runServer(&srv);
+    closeServer(&srv);
+    VERBOSE(fprintf(stdout, "Server stopped, %lld requests served\n", ctx.nreqs);)
+  }
 
-  // Allocate characteristic vector
-  hits->charVect = (int *)calloc(hits->htotal, sizeof(int));
+  pthread_mutex_destroy(&ctx.parseLock);
+  closeIndex(&qindex);
+  munmap(ctx.map, (size_t)ctx.mapSz);
 
-  return 0;
+  return err;
 }
 
 
@@ -2165,6 +5505,7 @@ int distributeInputFiles(args_t *args, mpi_t *mpi)
   MPI_Comm MPI_TMP_WORLD;
   char **inputFiles;
   int inputFileCnt;
+  int nodeCnt;
   int i;
   int j;
 
@@ -2174,6 +5515,14 @@ int distributeInputFiles(args_t *args, mpi_t *mpi)
 
   // Determine which nodes need the input files
   err = getInputFilesComm(mpi, &MPI_TMP_WORLD);
+
+  // A plain query file is sent to other nodes by partitions of their processes, after partitions are computed
+  if( mpi->procRank == 0 )
+  {
+    MPI_Comm_size(MPI_TMP_WORLD, &nodeCnt);
+    args->sliceMode = (args->distMode != 0 && args->shardMode == 0 && nodeCnt > 1 && isStreamFile(args->qf) == 0 && getFileCompression(args->qf) == COMP_NONE) ? 1 : 0;
+  }
+  MPI_Bcast(&args->sliceMode, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
   if( MPI_TMP_WORLD == MPI_COMM_NULL)
     return 0;
 
@@ -2187,10 +5536,11 @@ int distributeInputFiles(args_t *args, mpi_t *mpi)
   }
 
   // Count number of input files, the query file is mandatory
+  // BLAST table and search file are parsed by master and sent as hit sets
   inputFileCnt = 1;
-  if( args->pipeMode != 0 )
+  if( args->pipeMode != 0 && args->distMode == 0 )
     inputFileCnt++;
-  if( args->searchMode != 0 )
+  if( args->searchMode != 0 && args->distMode == 0 )
     inputFileCnt++;
 
   // Copy filenames into an array
@@ -2199,13 +5549,14 @@ int distributeInputFiles(args_t *args, mpi_t *mpi)
     inputFiles[i] = (char *)malloc(sizeof(char) * FILE_LEN);
   
   strncpy(inputFiles[0], args->qf, FILE_LEN);
-  if( args->pipeMode != 0 )
+  if( inputFileCnt > 1 && args->pipeMode != 0 )
     strncpy(inputFiles[1], args->btable, FILE_LEN);
-  if( args->searchMode != 0 )
+  if( inputFileCnt > 1 && args->searchMode != 0 )
     strncpy(inputFiles[1], args->sf, FILE_LEN);
 
 // Distribute all input files
-for( i = 0; i < inputFileCnt; i++ )
+// Shards of a manifest are already in each node, query file is not sent
+for( i = (args->shardMode != 0) ? 1 : 0; i < inputFileCnt; i++ )
 {
 
   // Master process reads input file
@@ -2235,8 +5586,8 @@ for( i = 0; i < inputFileCnt; i++ )
       }
       else
       {
-        // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ
-        setvbuf(fd, NULL, _IOFBF, STRM_BUFSIZ);
+        // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ, or as set by memory budget
+        setvbuf(fd, NULL, _IOFBF, budget.outBuf);
         fprintf(stdout, "Master is distributing input file: %s\n", inputFiles[i]);
       }
     }
@@ -2257,8 +5608,8 @@ for( i = 0; i < inputFileCnt; i++ )
     if( fd == NULL )
       fileFlag = ERROR;
     else
-      // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ
-      setvbuf(fd, NULL, _IOFBF, STRM_BUFSIZ);
+      // Set buffering options, _IOFBF = full buffering of size STRM_BUFSIZ, or as set by memory budget
+      setvbuf(fd, NULL, _IOFBF, budget.outBuf);
   }
 
   // Check that all processes where able to create file
@@ -2281,6 +5632,15 @@ for( i = 0; i < inputFileCnt; i++ )
     return ERROR;
   }
 
+  // Query file of other nodes is created with its size, data of partitions is written by scatterQueryFile()
+  if( i == 0 && args->sliceMode != 0 )
+  {
+    if( mpi->procRank != 0 && ftruncate(fileno(fd), fsize) != 0 )
+      fprintf(stdout, "Process %d could not set size of query file\n", mpi->procRank);
+    fclose(fd);
+    continue;
+  }
+
   // Advise to kernel access pattern for file
   posix_fadvise(fileno(fd), 0, MIN(BCAST_LIMIT, fsize), POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
   
@@ -2340,28 +5700,420 @@ for( i = 0; i < inputFileCnt; i++ )
 
 
 
+// Send partitions of query file to processes of other nodes than master, in chunks of BCAST_LIMIT
+// Each process writes its own partitions to query file of its node, other data of that file is not sent
+int scatterQueryFile(char *fn, iomap_t *iomap, mpi_t *mpi)
+{
+  char masterName[MPI_MAX_PROCESSOR_NAME];  // Processor name of master
+  int *remote;           // Flag for each process in other node than master
+  int isRemote;          // Flag for current process in other node than master
+  int fileFlag;          // Flag for partitions written by current process
+  int allFileFlag;       // Flag for partitions written by all processes
+  int r;                 // Iteration variable
+  int fd;                // File descriptor of query file of current node
+  int last;              // Partition index of last thread of process
+  int sent;              // Number of processes partitions are sent to
+  long long int begin;   // File offset of data of process
+  long long int end;     // End of data of process
+  long long int off;     // Offset of current chunk
+  long long int sz;      // Size of current chunk
+  char *buffer;          // Data buffer
+  MPI_Status status;
+
+  if( iomap->sliced == 0 )
+    return 0;
+
+  // Processes in same node as master read its query file
+  memcpy(masterName, mpi->procName, MPI_MAX_PROCESSOR_NAME);
+  MPI_Bcast(masterName, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, mpi->MPI_MY_WORLD);
+  isRemote = (strcmp(masterName, mpi->procName) != 0) ? 1 : 0;
+  remote = (int *)malloc(sizeof(int) * mpi->procCnt);
+  MPI_Gather(&isRemote, 1, MPI_INT, remote, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+ 
+  buffer = malloc(sizeof(char) * BCAST_LIMIT);
+  fileFlag = (buffer == NULL || remote == NULL) ? ERROR : 0;
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
+  {
+    free(buffer);
+    free(remote);
+    return ERROR;
+  }
+
+  // Data of a process begins at page size offset of its first partition
+  if( mpi->procRank == 0 )
+  {
+    sent = 0;
+    for(r = 1; r < mpi->procCnt; r++)
+    {
+      if( remote[r] == 0 )
+        continue;
+
+      last = (r + 1) * mpi->threadCnt - 1;
+      begin = iomap->fileOffs[r*mpi->threadCnt*3];
+      end = iomap->fileOffs[last*3] + iomap->fileOffs[last*3+1] + iomap->fileOffs[last*3+2];
+      posix_fadvise(fileno(iomap->qfd), begin, end - begin, POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
+      for(off = begin; off < end; off = off + sz)
+      {
+        sz = MIN(BCAST_LIMIT, end - off);
+        if( pread(fileno(iomap->qfd), buffer, sz, off) != sz )
+          fprintf(stdout, "Master did not read chunk size correctly\n");
+        MPI_Send(buffer, (int)sz, MPI_BYTE, r, 0, mpi->MPI_MY_WORLD);
+      }
+      sent++;
+    }
+    VERBOSE(fprintf(stdout, "Master sent partitions of query file to %d processes\n", sent);)
+  }
+  else if( isRemote != 0 )
+  {
+    fd = open(fn, O_WRONLY);
+    if( fd < 0 )
+    {
+      fprintf(stdout, "Process %d could not open query file for writing\n", mpi->procRank);
+      fileFlag = ERROR;
+    }
+
+    // All chunks are received even if query file could not be written
+    begin = iomap->fileOffs[mpi->procRank*mpi->threadCnt*3];
+    end = iomap->partOff + iomap->qfsz;
+    for(off = begin; off < end; off = off + sz)
+    {
+      sz = MIN(BCAST_LIMIT, end - off);
+      MPI_Recv(buffer, (int)sz, MPI_BYTE, 0, 0, mpi->MPI_MY_WORLD, &status);
+      if( fd >= 0 && pwrite(fd, buffer, sz, off) != sz )
+      {
+        fprintf(stdout, "Process did not write chunk size correctly\n");
+        fileFlag = ERROR;
+      }
+    }
+    if( fd >= 0 )
+      close(fd);
+  }
+  free(buffer);
+  free(remote);
+
+  // Check that all processes wrote their partitions
+  MPI_Allreduce(&fileFlag, &allFileFlag, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( allFileFlag != 0 )
+    return ERROR;
+
+  return 0;
+}
+
+
+// Compute partition offsets of query file, aligned to records or to BGZF blocks
+int computeQueryOffsets(iomap_t *iomap, int *nparts)
+{
+  if( iomap->comp == COMP_BGZF )
+    return computeBlockPartitions(&iomap->fileOffs, nparts, fileno(iomap->qfd), iomap->qfsz);
+
+  return computePartitionOffsets(&iomap->fileOffs, nparts, fileno(iomap->qfd), iomap->qfsz, '>');
+}
+
+
+// Estimate work of query file in bins, each process samples bins of its own share of query file
+// Work of a bin is bytes scanned plus a lookup cost per record, records are counted in a sample of the bin
+// Sets cumulative work at end of each bin, same in all processes
+int estimateWork(iomap_t *iomap, mpi_t *mpi, double **cum, long long int *binSz, int *nbins)
+{
+  int b;                // Iteration variable
+  int lbins;            // Bins sampled by current process
+  long long int off;    // File offset of current bin
+  long long int len;    // Bytes of current bin
+  long long int slen;   // Bytes sampled of current bin
+  long long int cnt;    // Records in sample
+  double *work;         // Work of bins of current process
+
+  lbins = mpi->threadCnt * BALANCE_BINS;
+  *nbins = mpi->procCnt * lbins;
+  *binSz = MAX(1LL, (iomap->qfsz + *nbins - 1) / *nbins);
+  work = (double *)malloc(sizeof(double) * lbins);
+  *cum = (double *)malloc(sizeof(double) * (*nbins));
+  if( work == NULL || *cum == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate work estimates\n");
+    free(work);
+    free(*cum);
+    *cum = NULL;
+    return ERROR;
+  }
+
+  // Sample middle of each bin, a failed read only counts bytes
+  for(b = 0; b < lbins; b++)
+  {
+    off = (long long int)(mpi->procRank * lbins + b) * (*binSz);
+    len = MIN(*binSz, iomap->qfsz - off);
+    work[b] = 0.0;
+    if( len <= 0LL )
+      continue;
+    slen = MIN(len, BALANCE_SAMPLE);
+    cnt = countSymbol(fileno(iomap->qfd), off + (len - slen) / 2LL, slen, '>');
+    work[b] = (double)len + RECORD_COST * (double)MAX(0LL, cnt) * ((double)len / (double)slen);
+  }
+
+  MPI_Allgather(work, lbins, MPI_DOUBLE, *cum, lbins, MPI_DOUBLE, mpi->MPI_MY_WORLD);
+  for(b = 1; b < *nbins; b++)
+    (*cum)[b] = (*cum)[b-1] + (*cum)[b];
+  free(work);
+
+  return 0;
+}
+
+
+// Find record aligned partitions of query file, one per thread of each process
+// Each process finds boundaries of its own partitions in parallel, boundaries are then exchanged between processes
+// Split points are equal in bytes, or in estimated work of records if balance mode is set
+// Returns 1 if a partition would be empty, so master computes partitions instead
+int computeDistributedOffsets(iomap_t *iomap, mpi_t *mpi, int balance)
+{
+  int nparts;               // Number of partitions
+  int tcnt;                 // Number of partitions of current process
+  int t;                    // Iteration variable
+  int k;                    // Index of current partition
+  int b;                    // Bin of split point
+  int nbins;                // Number of bins of work estimates
+  long long int binSz;      // Bytes per bin of work estimates
+  long long int split;      // Split point of current partition
+  long long int psz;        // System's page size
+  long long int *bnds;      // File offset where each partition begins
+  long long int *lbnds;     // File offset where each partition of current process begins
+  double *cum;              // Cumulative work at end of each bin
+  double target;            // Work before current partition
+  double prev;              // Work before bin of split point
+
+  tcnt = mpi->threadCnt;
+  nparts = mpi->procCnt * tcnt;
+  cum = NULL;
+  if( balance != 0 && estimateWork(iomap, mpi, &cum, &binSz, &nbins) != 0 )
+    return ERROR;
+
+  bnds = (long long int *)malloc(sizeof(long long int) * (nparts + 1));
+  lbnds = (long long int *)malloc(sizeof(long long int) * tcnt);
+  if( bnds == NULL || lbnds == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate partition boundaries\n");
+    free(bnds);
+    free(lbnds);
+    free(cum);
+    return ERROR;
+  }
+
+  // Split point of each partition of current process moves back to beginning of its record
+  for(t = 0; t < tcnt; t++)
+  {
+    k = mpi->procRank * tcnt + t;
+    if( k == 0 )
+    {
+      lbnds[t] = 0LL;
+      continue;
+    }
+
+    split = (iomap->qfsz / nparts) * k;
+    if( cum != NULL )
+    {
+      target = cum[nbins-1] * k / nparts;
+      for(b = 0; b < (nbins - 1) && cum[b] < target; b++);
+      prev = (b > 0) ? cum[b-1] : 0.0;
+      split = (long long int)b * binSz;
+      if( cum[b] > prev )
+        split = split + (long long int)((target - prev) / (cum[b] - prev) * (double)MIN(binSz, iomap->qfsz - split));
+    }
+
+    // Failed read or no record, checked below as an empty partition
+    lbnds[t] = findSymbolBefore(fileno(iomap->qfd), MIN(split, iomap->qfsz), '>');
+    if( lbnds[t] == 0LL )
+      lbnds[t] = ERROR;
+  }
+
+  MPI_Allgather(lbnds, tcnt, MPI_LONG_LONG_INT, bnds, tcnt, MPI_LONG_LONG_INT, mpi->MPI_MY_WORLD);
+  bnds[nparts] = iomap->qfsz;
+  free(lbnds);
+  free(cum);
+
+  // Every process checks the same boundaries, partitions cannot be empty
+  for(k = 1; k <= nparts; k++)
+  {
+    if( bnds[k] <= bnds[k-1] )
+    {
+      free(bnds);
+      return 1;
+    }
+  }
+
+  // Partition begins at a page size offset, map offset is left to its record
+  psz = (long long int)sysconf(_SC_PAGESIZE);
+  for(k = 0; k < nparts; k++)
+  {
+    iomap->fileOffs[k*3] = (bnds[k] / psz) * psz;
+    iomap->fileOffs[k*3+1] = bnds[k] - iomap->fileOffs[k*3];
+    iomap->fileOffs[k*3+2] = bnds[k+1] - bnds[k];
+  }
+  free(bnds);
+
+  return 0;
+}
+
+
+// Open shards of a shard manifest, master reads manifest and sends it to all processes
+// Each process reads a contiguous range of shards in order of manifest, processes without shards are terminated
+int openShardFiles(args_t *args, iomap_t *iomap, mpi_t *mpi, shardmf_t *mf)
+{
+  char path[FILE_LEN];            // First shard of current process
+  int procCnt;                    // Number of MPI processes
+  int err;                        // Trap errors
+  int fail;                       // Error of any process
+
+  err = 0;
+  if( mpi->procRank == 0 )
+  {
+    err = openShards(args->qf, mf);
+    if( err == 1 )
+      fprintf(stderr, "\nError: %s is not a shard manifest\n", args->qf);
+    err = (err != 0) ? ERROR : 0;
+  }
+  MPI_Bcast(&err, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( err != 0 )
+    return ERROR;
+
+  // Manifest, then its shards
+  MPI_Bcast(mf, sizeof(shardmf_t), MPI_BYTE, 0, mpi->MPI_MY_WORLD);
+  if( mpi->procRank != 0 )
+  {
+    mf->shards = (shard_t *)calloc(mf->nshards, sizeof(shard_t));
+    err = (mf->shards == NULL) ? ERROR : 0;
+  }
+  MPI_Allreduce(&err, &fail, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( fail != 0 )
+  {
+    freeShards(mf);
+    return ERROR;
+  }
+  MPI_Bcast(mf->shards, mf->nshards * sizeof(shard_t), MPI_BYTE, 0, mpi->MPI_MY_WORLD);
+
+  // Adjust MPI processes, one shard at least per process
+  procCnt = mpi->procCnt;
+  if( mf->nshards < procCnt )
+  {
+    mpi->procCnt = mf->nshards;
+    VERBOSE(if( mpi->procRank == 0 ) fprintf(stdout, "Warning: %d shards for %d processes, using %d processes\n", mf->nshards, procCnt, mpi->procCnt);)
+    if( adjustMPIProcs(mpi, procCnt) != 0 )
+      return ERROR;
+
+    // Terminate unnecessary processes
+    if( mpi->procRank >= mpi->procCnt )
+    {
+      freeShards(mf);
+      MPI_Finalize();
+      exit(0);
+    }
+  }
+
+  // Shards of current process, first one is opened now
+  mf->first = (int)(((long long int)mpi->procRank * mf->nshards) / mpi->procCnt);
+  mf->last = (int)(((long long int)(mpi->procRank + 1) * mf->nshards) / mpi->procCnt);
+  mf->cur = mf->first;
+  err = getShardPath(mf, mf->first, path, FILE_LEN);
+  if( err == 0 )
+    err = openQueryFile(path, iomap);
+  if( err == 0 && (iomap->stream != 0 || iomap->comp != COMP_NONE || iomap->qfsz != mf->shards[mf->first].end - mf->shards[mf->first].begin) )
+  {
+    fprintf(stderr, "\nError: shard file %s does not match manifest\n", path);
+    fclose(iomap->qfd);
+    err = ERROR;
+  }
+  MPI_Allreduce(&err, &fail, 1, MPI_INT, MPI_MIN, mpi->MPI_MY_WORLD);
+  if( fail != 0 )
+  {
+    if( err == 0 )
+      fclose(iomap->qfd);
+    freeShards(mf);
+    return ERROR;
+  }
+  iomap->shards = mf;
+  VERBOSE(fprintf(stdout, "Process %d reading shards %d to %d of %d\n", mpi->procRank, mf->first + 1, mf->last, mf->nshards);)
+
+  return 0;
+}
+
+
 // Preprocess query file for memory map offsets
-int setOffs(iomap_t *iomap, mpi_t *mpi)
+// Query file is split in one partition per thread of each process, partitions of a process are consecutive
+// Processes find boundaries of their own partitions, if one would be empty master computes fewer partitions
+// If there are less partitions than requested, threads per process are reduced before processes
+int setOffs(iomap_t *iomap, mpi_t *mpi, int balance)
 {
   int procCnt;     // Number of MPI processes
+  int parts[2];    // Number of MPI processes and threads per process
+  int nparts;      // Number of partitions computed
+  int first;       // Partition index of first thread of current process
+  int last;        // Partition index of last thread of current process
   int err;
  
-  iomap->fileOffs = malloc((mpi->procCnt * 3) * sizeof iomap->fileOffs);
+  iomap->fileOffs = malloc((mpi->procCnt * mpi->threadCnt * 3) * sizeof iomap->fileOffs);
+
+  // Stream is read by a single process and thread, size is unknown
+  if( iomap->stream != 0 )
+  {
+    iomap->fileOffs[0] = iomap->fileOffs[1] = iomap->fileOffs[2] = 0LL;
+    iomap->partOff = 0LL;
+    mpi->threadCnt = 1;
+    return 0;
+  }
  
+  // Shards are split by threads of their process when they are read
+  if( iomap->shards != NULL )
+  {
+    memset(iomap->fileOffs, 0, (mpi->procCnt * mpi->threadCnt * 3) * sizeof iomap->fileOffs);
+    iomap->partOff = 0LL;
+    return 0;
+  }
+
+  // BGZF blocks are walked by master, plain query file is split by all processes
+  // Query file of other nodes does not have data yet, master computes partitions
+  err = 1;
+  if( iomap->comp == COMP_NONE && iomap->sliced == 0 )
+  {
+    err = computeDistributedOffsets(iomap, mpi, balance);
+    if( err == ERROR )
+      return ERROR;
+    if( err == 0 )
+      VERBOSE(if( mpi->procRank == 0 ) fprintf(stdout, "Partition boundaries found by %d processes\n", mpi->procCnt);)
+  }
+  if( err == 0 )
+  {
+    first = mpi->procRank * mpi->threadCnt;
+    last = first + mpi->threadCnt - 1;
+    iomap->partOff = iomap->fileOffs[first*3] + iomap->fileOffs[first*3+1];
+    iomap->qfsz = iomap->fileOffs[last*3] + iomap->fileOffs[last*3+1] + iomap->fileOffs[last*3+2] - iomap->partOff;
+    return 0;
+  }
+
   // Master performs preprocessing of input query file
   // Preprocess query file for memory map offsets
   procCnt = mpi->procCnt;
+  parts[0] = mpi->procCnt;
+  parts[1] = mpi->threadCnt;
   if( mpi->procRank == 0 )
   {
-    err = computePartitionOffsets(&iomap->fileOffs, &mpi->procCnt, fileno(iomap->qfd), iomap->qfsz, '>');
+    nparts = parts[0] * parts[1];
+    err = computeQueryOffsets(iomap, &nparts);
+    while( err == 0 && parts[1] > 1 && nparts < (parts[0] * parts[1]) )
+    {
+      parts[1] = MAX(1, nparts / parts[0]);
+      nparts = parts[0] * parts[1];
+      err = computeQueryOffsets(iomap, &nparts);
+    }
+    parts[0] = nparts / parts[1];
     if( err != 0 )
-      mpi->procCnt = ERROR;
+      parts[0] = ERROR;
   }
 
   // Distribute err flag to check if mastered failed and need to abort program
-  err = MPI_Bcast(&mpi->procCnt, 1, MPI_INT, 0, mpi->MPI_MY_WORLD);
-  if( err != MPI_SUCCESS || mpi->procCnt == ERROR )
+  err = MPI_Bcast(parts, 2, MPI_INT, 0, mpi->MPI_MY_WORLD);
+  if( err != MPI_SUCCESS || parts[0] == ERROR )
     return ERROR;
+  mpi->procCnt = parts[0];
+  mpi->threadCnt = parts[1];
 
   // Adjust MPI processes
   if( mpi->procCnt < procCnt )
@@ -2382,12 +6134,22 @@ int setOffs(iomap_t *iomap, mpi_t *mpi)
   }
 
   // Synchronize and distribute query file offsets
-  err = MPI_Bcast(iomap->fileOffs, procCnt * 3, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
+  err = MPI_Bcast(iomap->fileOffs, mpi->procCnt * mpi->threadCnt * 3, MPI_LONG_LONG_INT, 0, mpi->MPI_MY_WORLD);
   if( err != MPI_SUCCESS )
     return ERROR;
   
   // Update query mappings with computed offsets
-  iomap->qfsz = iomap->fileOffs[mpi->procRank*3+2];
+  // Partition of current process spans partitions of its threads
+  first = mpi->procRank * mpi->threadCnt;
+  last = first + mpi->threadCnt - 1;
+  // BGZF partitions are sized by uncompressed data
+  iomap->partOff = iomap->fileOffs[first*3] + iomap->fileOffs[first*3+1];
+  iomap->qfsz = iomap->fileOffs[last*3] + iomap->fileOffs[last*3+1] + iomap->fileOffs[last*3+2] - iomap->partOff;
+  if( iomap->comp == COMP_BGZF )
+  {
+    for(iomap->qfsz = 0LL; first <= last; first++)
+      iomap->qfsz = iomap->qfsz + iomap->fileOffs[first*3+2];
+  }
 
   return 0;
 }
@@ -2402,10 +6164,19 @@ int main(int argc, char **argv)
 {
   int i;           // Iteration variable
   int err;         // Trap errors
+  int provided;    // Thread support level provided by MPI
+  int nlocal;      // Number of processes of node of current process
+  long long int hitBytes; // Bytes of hit tables kept in memory
+  MPI_Comm nodeComm; // Processes of node of current process
   args_t args;     // Structure for command line options
   iomap_t iomap;   // I/O, memory map control struct
   hits_t hits;     // BLAST table IDs struct
+  ffindex_t qindex; // Offset index of query file
+  fflens_t qlens;   // Length table of query file
+  shardmf_t shards; // Shard manifest of query file
+  cache_t cache;    // Result cache of hit IDs of previous runs
   double start, finish;
+  double t0 = 0.0;  // Time of beginning of current phase
   mpi_t mpi;
 
   // Clear structures
@@ -2413,9 +6184,14 @@ int main(int argc, char **argv)
   memset(&iomap, 0, sizeof(iomap_t));
   memset(&hits, 0, sizeof(hits_t));
   memset(&mpi, 0, sizeof(mpi_t));
+  memset(&qindex, 0, sizeof(ffindex_t));
+  memset(&qlens, 0, sizeof(fflens_t));
+  memset(&shards, 0, sizeof(shardmf_t));
+  memset(&cache, 0, sizeof(cache_t));
 
   // Initialize MPI environment
-  MPI_Init(&argc, &argv);
+  // Only main thread of a process calls MPI
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   MPI_Comm_dup(MPI_COMM_WORLD, &mpi.MPI_MY_WORLD);
   MPI_Comm_size(mpi.MPI_MY_WORLD, &mpi.procCnt);
   MPI_Comm_rank(mpi.MPI_MY_WORLD, &mpi.procRank);
@@ -2424,8 +6200,13 @@ int main(int argc, char **argv)
   // Compute wall time
   start = MPI_Wtime();
 
+  // Select vector kernel for parsing query file
+  initScanner();
+
   // Parse command line options
   // The loop and the barrier are used simply to prevent the MPI processes from printing concurrently.
+  // A process failing its own checks stays in the loop, all processes exit once every process has parsed
+  err = 0;
   for(i = 0; i < mpi.procCnt; i++)
   {
     MPI_Barrier(mpi.MPI_MY_WORLD);
@@ -2433,14 +6214,47 @@ int main(int argc, char **argv)
     {
       err = parseCmdline(argc, argv, &args, &mpi);
       if( err != 0 )
-      {
         fprintf(stderr, "Error: failed parsing command line options\n\n");
-        MPI_Comm_free(&mpi.MPI_MY_WORLD);
-        MPI_Finalize();
-        return CFGERROR;
-      }
     }
   }
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN, mpi.MPI_MY_WORLD);
+  if( err != 0 )
+  {
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return CFGERROR;
+  }
+
+  // Allocate statistics of threads of current process
+  err = initStats(&stats, args.threadCnt, args.statsMode);
+  if( err != 0 )
+  {
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return ERROR;
+  }
+  STATS(t0 = statsTime();)
+
+  // Memory budget of node is shared by its processes, then by threads of each process
+  budget.window = IMAP_LIMIT;
+  budget.streamBuf = STREAM_BUFSIZ;
+  budget.outBuf = STRM_BUFSIZ;
+  nlocal = 1;
+  if( args.memBudget != 0LL )
+  {
+    MPI_Comm_split_type(mpi.MPI_MY_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_size(nodeComm, &nlocal);
+    MPI_Comm_free(&nodeComm);
+  }
+  err = initBudget(&budget, args.memBudget, args.threadCnt, nlocal);
+  if( err != 0 )
+  {
+    fprintf(stderr, "Error: failed setting memory budget\n\n");
+    freeStats(&stats);
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return ERROR;
+  }
 
 #ifdef BCAST_INFILES
   // Distribute input files as necessary
@@ -2454,9 +6268,42 @@ int main(int argc, char **argv)
   }
   MPI_Barrier(mpi.MPI_MY_WORLD);
 #endif
+  STATS(stats.threads[0].phase[PH_DISTRIBUTE] += statsTime() - t0; t0 = statsTime();)
 
-  // Open input query file
-  err = openQueryFile(args.qf, &iomap);
+  // Build offset index of query file and exit
+  if( args.indexMode != 0 )
+  {
+    err = 0;
+    if( mpi.procRank == 0 )
+    {
+      err = buildIndex(args.qf);
+      if( err != 0 )
+        fprintf(stderr, "Error: failed building index file\n\n");
+    }
+    MPI_Bcast(&err, 1, MPI_INT, 0, mpi.MPI_MY_WORLD);
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return (err != 0) ? ERROR : 0;
+  }
+
+  // Split query file into shards and exit
+  if( args.shardCnt != 0 )
+  {
+    err = 0;
+    if( mpi.procRank == 0 )
+    {
+      err = buildShards(args.qf, args.shardCnt);
+      if( err != 0 )
+        fprintf(stderr, "Error: failed building shard files\n\n");
+    }
+    MPI_Bcast(&err, 1, MPI_INT, 0, mpi.MPI_MY_WORLD);
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return (err != 0) ? ERROR : 0;
+  }
+
+  // Open input query file, or first shard of current process of a shard manifest
+  err = (args.shardMode != 0) ? openShardFiles(&args, &iomap, &mpi, &shards) : openQueryFile(args.qf, &iomap);
   if( err != 0 )
   {
     fprintf(stderr, "Error: failed opening query file\n\n");
@@ -2464,10 +6311,25 @@ int main(int argc, char **argv)
     MPI_Finalize();
     return ERROR;
   }
+  STATS(stats.threads[0].phase[PH_OPEN] += statsTime() - t0; t0 = statsTime();)
+
+  // Serve extraction requests over mapped query file until server is stopped
+  if( args.serveMode != 0 )
+  {
+    err = serveQueries(&args, &iomap, &mpi);
+    if( err != 0 )
+      fprintf(stderr, "Error: failed serving requests\n\n");
+    fclose(iomap.qfd);
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return (err == CFGERROR) ? CFGERROR : ((err != 0) ? ERROR : 0);
+  }
 
   // Create array for offsets of memory mappings
   // [i]=file_offset from beginning of file, [i+1]=map offset from file offset, [i+2]=total map size
-  err = setOffs(&iomap, &mpi);
+  mpi.threadCnt = args.threadCnt;
+  iomap.sliced = args.sliceMode;
+  err = setOffs(&iomap, &mpi, args.balanceMode);
   if( err != 0 )
   {
     fprintf(stderr, "Error: failed to set offsets\n\n");
@@ -2477,15 +6339,28 @@ int main(int argc, char **argv)
     MPI_Finalize();
     return ERROR;
   }
+  STATS(stats.threads[0].phase[PH_OFFSETS] += statsTime() - t0; t0 = statsTime();)
 
-if(mpi.procRank == 0)
-for(i = 0; i < mpi.procCnt; i++)
-  fprintf(stdout, "[%lld, %lld, %lld]\n", iomap.fileOffs[i*3], iomap.fileOffs[i*3+1], iomap.fileOffs[i*3+2]);
-
+  // Send partitions of query file to processes of other nodes
+  err = scatterQueryFile(args.qf, &iomap, &mpi);
+  if( err != 0 )
+  {
+    fprintf(stderr, "Error: failed scattering query file\n\n");
+    free(iomap.fileOffs);
+    fclose(iomap.qfd);
+    MPI_Comm_free(&mpi.MPI_MY_WORLD);
+    MPI_Finalize();
+    return ERROR;
+  }
+  STATS(stats.threads[0].phase[PH_DISTRIBUTE] += statsTime() - t0;)
 
   // Load BLAST table to memory
+  STATS(t0 = statsTime();)
   hits.pipeMode = args.pipeMode;
-  err = loadBlastTable(args.btable, &hits);
+  hits.searchMode = args.searchMode;
+  err = openSpillFile(&args, &hits, &mpi);
+  if( err == 0 )
+    err = (args.distMode != 0) ? 0 : loadBlastTable(args.btable, &hits);
   if( err != 0 )   
   {
     fprintf(stderr, "Error: failed loading BLAST table file\n\n");
@@ -2497,8 +6372,8 @@ for(i = 0; i < mpi.procCnt; i++)
   }
 
   // Load IDs from search file contents for sequence extraction
-  hits.searchMode = args.searchMode;
-  err = loadSearchIDs(args.sf, &hits);
+  // Or master loads hit sets and broadcasts them
+  err = (args.distMode != 0) ? distributeHits(&args, &hits, &mpi) : loadSearchIDs(args.sf, &hits);
   if( err != 0 )
   {
     fprintf(stderr, "Error: failed loading search IDs file\n\n");
@@ -2509,14 +6384,108 @@ for(i = 0; i < mpi.procCnt; i++)
     return ERROR;
   }
 
+  // Load options and hit sets of jobs for filtering them in a single pass
+  if( args.batchMode != 0 )
+  {
+    err = loadJobs(&args, &iomap, &mpi);
+    if( err != 0 )
+    {
+      fprintf(stderr, "Error: failed loading job manifest\n\n");
+      free(iomap.fileOffs);
+      freeHitsMemory(&hits);
+      fclose(iomap.qfd);
+      MPI_Comm_free(&mpi.MPI_MY_WORLD);
+      MPI_Finalize();
+      return (err == CFGERROR) ? CFGERROR : ERROR;
+    }
+  }
+  STATS(stats.threads[0].phase[PH_LOAD] += statsTime() - t0;)
+
+  // Windows and buffers get budget left by hit tables kept in memory
+  hitBytes = 0LL;
+  if( hits.pipeMode != 0 && hits.queryIDs.spilled == 0 )
+    hitBytes += sizeIDTable(&hits.queryIDs);
+  if( (hits.pipeMode != 0 || hits.searchMode != 0) && hits.hitIDs.spilled == 0 )
+    hitBytes += sizeIDTable(&hits.hitIDs);
+  fitBudget(&budget, hitBytes);
+  VERBOSE(if( budget.total > 0LL ) fprintf(stdout, "Process %d memory budget = %lld bytes (node limit %lld bytes, %d processes), window = %lld bytes x %d per thread, output buffer = %lld bytes, hit tables = %lld bytes in memory%s\n",
+            mpi.procRank, budget.total, budget.limit, nlocal, budget.window, budget.depth, budget.outBuf, hitBytes,
+            (hits.queryIDs.spilled != 0 || hits.hitIDs.spilled != 0) ? ", larger ones spilled to file" : "");)
+
+  // Use offset index of query file in pipeline and search modes, if it is up to date
+  // Shards are scanned, index and length table of query file do not apply to them
+  if( iomap.shards != NULL )
+  {
+    VERBOSE(fprintf(stdout, "Reading query file by shards\n");)
+  }
+  else if( iomap.stream != 0 )
+  {
+    VERBOSE(fprintf(stdout, "Reading query file as a stream\n");)
+  }
+  else if( iomap.comp == COMP_BGZF )
+  {
+    VERBOSE(fprintf(stdout, "Reading query file by BGZF blocks\n");)
+  }
+  else if( hits.pipeMode != 0 || hits.searchMode != 0 )
+  {
+    if( openIndex(args.qf, &qindex) == 0 )
+    {
+      iomap.qidx = &qindex;
+      VERBOSE(fprintf(stdout, "Using index file = %s%s (%lld records)\n", args.qf, IDX_SUFFIX, qindex.hdr->nrecs);)
+    }
+    else
+      VERBOSE(fprintf(stdout, "No valid index file, scanning query file\n");)
+  }
+  // Use length table of query file when selecting by sequence length, if it is up to date
+  else if( args.seqLenBuf > 0 || args.rseqLenBuf > 0 )
+  {
+    if( openLengths(args.qf, &qlens) == 0 )
+    {
+      iomap.qlens = &qlens;
+      VERBOSE(fprintf(stdout, "Using length table = %s%s (%lld records)\n", args.qf, LEN_SUFFIX, qlens.hdr->nrecs);)
+    }
+    else
+      VERBOSE(fprintf(stdout, "No valid length table, scanning query file\n");)
+  }
+
+  // Records of hit IDs of previous runs are read from result cache, other hit IDs are searched
+  if( args.cacheMode != 0 )
+  {
+    err = openResultCache(&args, &iomap, &hits, &mpi, &cache);
+    if( err != 0 )
+    {
+      fprintf(stderr, "Error: failed opening result cache\n\n");
+      free(iomap.fileOffs);
+      freeHitsMemory(&hits);
+      closeIndex(&qindex);
+      closeLengths(&qlens);
+      fclose(iomap.qfd);
+      MPI_Comm_free(&mpi.MPI_MY_WORLD);
+      MPI_Finalize();
+      return ERROR;
+    }
+  }
+
   // Partition input file into chunks for query processing
   // Extract sequences from input query file and write to output file
+  STATS(t0 = statsTime();)
   err = partQueryFile(&args, &iomap, &hits, &mpi);
+  STATS(stats.threads[0].phase[PH_FILTER] += statsTime() - t0;)
+  if( args.cacheMode != 0 && updateResultCache(&args, &iomap, &hits, &mpi, &cache, err) != 0 )
+  {
+    fprintf(stderr, "Error: failed updating result cache\n\n");
+    err = ERROR;
+  }
+  closeIndex(&qindex);
+  closeLengths(&qlens);
   if( err != 0 )
   {
     fprintf(stderr, "Error: failed extracting sequences\n\n");
     free(iomap.fileOffs);
     freeHitsMemory(&hits);
+    freeJobs(&iomap);
+    freeShards(&shards);
+    freeCache(&cache);
     fclose(iomap.qfd);
     MPI_Comm_free(&mpi.MPI_MY_WORLD);
     MPI_Finalize();
@@ -2526,6 +6495,9 @@ for(i = 0; i < mpi.procCnt; i++)
   // Free resources 
   free(iomap.fileOffs);
   freeHitsMemory(&hits);
+  freeJobs(&iomap);
+  freeShards(&shards);
+  freeCache(&cache);
   fclose(iomap.qfd);
 
   // Compute wall time
@@ -2533,6 +6505,12 @@ for(i = 0; i < mpi.procCnt; i++)
   finish = MPI_Wtime();
   if( mpi.procRank == 0 )
     fprintf(stdout, "Total wall time = %f\n\n", finish - start);
+
+  // Reduce statistics of processes and write them to statistics file
+  STATS(stats.threads[0].phase[PH_TOTAL] = finish - start;)
+  if( writeStats(&stats, args.stf, mpi.MPI_MY_WORLD, mpi.procName) != 0 )
+    fprintf(stderr, "Error: failed writing statistics file\n\n");
+  freeStats(&stats);
   
   // Finalize MPI environment
   MPI_Comm_free(&mpi.MPI_MY_WORLD);
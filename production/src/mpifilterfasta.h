@@ -22,15 +22,49 @@
 #include <math.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <errno.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "utilities.h"
+#include "idtable.h"
+#include "scan.h"
+#include "ffindex.h"
+#include "spans.h"
+#include "outvec.h"
+#include "mapwin.h"
+#include "affinity.h"
+#include "bgzf.h"
+#include "groups.h"
+#include "stats.h"
+#include "serve.h"
+#include "blast.h"
+#include "budget.h"
+#include "shard.h"
+#include "cache.h"
 
 // Set default options
 #define OUTPUT_FILE "filter.out"  // Default output file name
+#define STDIN_FILE  "-"        // Query file name for standard input
 #define SEQ_COUNT   LLONG_MAX  // Max number of sequences to extract
 #define ANNOT_CNT   INT_MAX    // default = ALL, -# = write first # annotation fields without the sequence, 0 = NONE,  # = write first # annotation fields with sequence
 #define BYTES_LIMIT LLONG_MAX  // Max number of bytes to extract
 #define PIPE_MODE   0          // 0 = NONE, 1 = HMMER, 2 = MUSCLE
 #define SEARCH_MODE 0          // 0 = NONE, 1 = ENABLE 
+#define INDEX_MODE  0          // 0 = NONE, 1 = build offset index of query file
+#define SHARD_CNT   0          // 0 = NONE, # = split query file into # shards with a manifest
+#define CACHE_MODE  0          // 0 = NONE, 1 = read and update result cache of hit IDs of previous runs
+#define BGZF_MODE   0          // 0 = NONE, 1 = compress output file into BGZF blocks
+#define MERGE_MODE  0          // 0 = MASTER, 1 = MPI-IO, 2 = PWRITE, 3 = SPANS
+#define THREAD_CNT  1          // Number of threads per process
+#define BALANCE_MODE 0         // 0 = BYTES, 1 = RECORDS (bytes plus estimated record lookups)
+#define DIST_MODE   0          // 0 = FILES, 1 = HITS (broadcast parsed hit sets, scatter partitions of query file)
+#define STATS_MODE  0          // 0 = OFF, 1 = write per-phase statistics of processes and threads as JSON
+#define BATCH_MODE  0          // 0 = NONE, 1 = filter jobs of a job manifest in a single pass over query file
+#define SERVE_MODE  0          // 0 = NONE, 1 = serve extraction requests over a Unix socket
+#define AIO_MODE    0          // 0 = MMAP, 1 = IO_URING (buffered reads and queued writes), 2 = DIRECT (io_uring with O_DIRECT)
+#define MEM_BUDGET  0LL        // 0 = NONE, # = bytes of memory of processes of a node, BUDGET_AUTO = cgroup limit or physical memory
+#define FORMAT_WIDTH -1        // -1 = write sequences as in query file, 0 = uppercase single line, # = uppercase lines of # residues
 #define VERBOSE_OPT 0          // 0 = OFF, 1 = ON
 #define TRACE_OPT   0          // 0 = OFF, 1 = ON
 
@@ -39,13 +73,27 @@
 #define FILE_LEN    128        // FILENAME_MAX, Max length for filenames
 #define ERROR       -1         // Error code from failed functions
 #define CFGERROR    -2         // Error code from invalid configuration
+#define THREAD_LIMIT 1024      // Max number of threads per process
+#define JOB_LIMIT   256        // Max number of jobs in a job manifest
+#define SERVE_WINDOW (1LL<<24) // Bytes of query file scanned by a request between writes to client, 16MB
+#define JOBARG_CNT  64         // Max number of options and arguments in a line of job manifest
+#define JOBLINE_LEN 1024       // Max length of a line of job manifest
 
 #define IMAP_LIMIT  (1LL<<28)  // Memory map chunk limit for query file, 256MB
 #define STRM_BUFSIZ (1LL<<22)  // Size of output stream buffer, 4MB
+#define STREAM_BUFSIZ (1LL<<26) // Size of buffer for query file read as a stream, 64MB
+#define BALANCE_BINS 16        // Bins per partition sampled for estimating work of records
+#define BALANCE_SAMPLE (1LL<<16) // Bytes sampled per bin for counting records, 64KB
+#define RECORD_COST 512.0      // Work of looking up one record, in bytes scanned
+#define TMP_SUFFIX  ".tmp"     // Suffix of temporary output files of threads, removed when opened
+#define GROUPS_SUFFIX ".groups" // Suffix of manifest of groups of output file (MUSCLE pipeline)
+#define SPILL_SUFFIX ".spill"  // Suffix of spill file of hit tables larger than memory budget, removed when opened
 #define BCAST_LIMIT (1LL<<22)  // Size for broadcasting files, 4MB
-#define HITS_ID_LEN 64LL       // Max length for BLAST table query and hit IDs
+#define QUOTA_CHECK 1024LL     // Records scanned between checks of quotas shared by processes
+#define QUOTA_INIT  4096LL     // Initial number of sequences recorded for quotas
 #define VERBOSE(ctx) if(verbose||trace) {ctx} // Verbose mode
 #define TRACE(ctx)   if(trace) {ctx}   // Trace mode (debug)  
+#define STATS(ctx)   if(stats.enabled) {ctx} // Statistics mode
 #define MIN(a,b)     ((a < b) ? a : b)
 #define MAX(a,b)     ((a > b) ? a : b)
 //#define STDIN       "redirStdin.txt"
@@ -59,17 +107,57 @@ typedef struct st_args
   char	         of[FILE_LEN];           // Output file
   char	         sf[FILE_LEN];           // Search file to extract user defined sequences
   char           btable[FILE_LEN];       // BLAST table file, used to extract hit IDs
+  char           jf[FILE_LEN];           // Job manifest, a line of options per job of batch mode
+  char           stf[FILE_LEN];          // Statistics file, "-" for standard output
+  char           sock[FILE_LEN];         // Unix socket of server mode
+  char           cf[FILE_LEN];           // Result cache of hit IDs of previous runs
   long long int  rseqLen[MAXARG_CNT*2];  // Range sequence length to extract
   long long int  seqLen[MAXARG_CNT];     // Sequence length to search
   long long int  seqCnt;                 // Max number of sequences to extract
   long long int  bytesLimit;             // Max number of bytes to extract
+  long long int  memBudget;              // Bytes of memory budget of processes of a node, 0 = no budget, BUDGET_AUTO = memory limit
   int            seqLenBuf;              // Number of sequence length options
   int            rseqLenBuf;             // Number of range sequence length options
   int            annotCnt;               // Number of annotation fields to extract
   int            pipeMode;               // Pipeline program after extracting sequences 
   int            searchMode;             // Flag for search file sequence extraction 
+  int            batchMode;              // Flag for jobs of job manifest filtered in a single pass
+  int            statsMode;              // Flag for recording statistics of phases
+  int            serveMode;              // Flag for serving extraction requests over a Unix socket
+  int            formatWidth;            // Residues per line of rewritten sequences, -1 = sequences are not rewritten
+  int            aioMode;                // I/O backend of query file windows and output file (AIO_NONE, AIO_RING or AIO_DIRECT)
+  int            indexMode;              // Flag for building offset index of query file
+  int            shardCnt;               // Number of shards to split query file into, 0 = query file is not split
+  int            shardMode;              // Flag for query file given as a shard manifest
+  int            cacheMode;              // Flag for result cache of hit IDs of previous runs
+  int            bgzfMode;               // Flag for BGZF compressed output file
+  int            balanceMode;            // Balancing policy of partitions
+  int            distMode;               // Distribution mode of input files
+  int            sliceMode;              // Flag for query file of other nodes holding only partitions of their processes
+  int            mergeMode;              // Merge mode of output files of MPI processes
+  int            threadCnt;              // Number of threads per process
 } args_t;
 
+// Structure for sequence count and size quotas shared by processes
+// Output of a process is the prefix of its sequences that fits after output of previous processes
+typedef struct st_quota
+{
+  long long int  seqCnt;      // Quota of sequences, in order of query file
+  long long int  bytesLimit;  // Quota of bytes, in order of query file
+  long long int  hitCnt;      // Total of hit IDs, all processes stop when found, 0 = not pipeline or search mode
+  long long int  nrecs;       // Number of sequences extracted
+  long long int  maxRecs;     // Number of sequences allocated
+  long long int *cum;         // Bytes written after each sequence extracted
+  long long int *hend;        // End in hlist of hit ID indices of each sequence extracted
+  long long int  maxHits;     // Number of hit ID indices allocated
+  long long int *hlist;       // Hit ID indices matched by sequences extracted, in order
+  long long int  scanned;     // Records scanned
+  long long int  next;        // Records scanned at next check of shared counters
+  long long int *shared;      // Counters of all processes fetched from master
+  int            full;        // Flag for a sequence that did not fit in bytes quota
+  MPI_Win        win;         // Shared counters in master, sequences, bytes and full flag of each process
+} quota_t;
+
 // Structure for managing I/O and memory map
 typedef struct st_iomap
 {
@@ -77,30 +165,63 @@ typedef struct st_iomap
   long long int  qfsz;        // Size of query file
   FILE          *qfd;         // File descriptor of query file
   FILE          *ofd;         // File descriptor of output file
-  long long int *fileOffs;    // File offsets for query file memory mappings
+  long long int *fileOffs;    // File offsets for query file memory mappings, one triplet per thread of each process
+  long long int  partOff;     // File offset of partition of current process
+  int            sliced;      // Flag for query file of other nodes holding only their partitions
+  int            stream;      // Flag for query file read as a stream (standard input, pipe, gzip)
+  int            comp;        // Compression of query file (COMP_NONE, COMP_GZIP or COMP_BGZF)
   char          *iMap;        // Pointer to initial mapped memory
   char          *fMap;	      // Pointer to last mapped memory
+  long long int  mapOff;      // File offset of initial mapped memory
+  spanlist_t    *spans;       // Output span list, NULL if output is written to output file
+  outvec_t      *ovec;        // Batched output, NULL if output is written with stream buffers
+  ffindex_t     *qidx;        // Offset index of query file, NULL if query file is scanned
+  fflens_t      *qlens;       // Length table of query file, NULL if query file is scanned
+  quota_t       *quota;       // Quotas shared by processes, NULL if quotas are not shared
+  shardmf_t     *shards;      // Shard manifest, query file is current shard of current process, NULL if query file is not sharded
+  cache_t       *cache;       // Result cache, NULL if records of hit IDs are not cached
+  struct st_job *jobs;        // Jobs of batch mode, NULL if records are filtered for a single output
+  int            njobs;       // Number of jobs of batch mode
 } iomap_t;
 
+// Structure for output file of current process
+typedef struct st_output
+{
+  char           outfile[FILE_LEN]; // Output file of current process
+  long long int  bytesWritten;      // Count number of bytes written to output file
+  spanlist_t     spans;             // Output span list
+  outvec_t       ovec;              // Batched output
+  zwriter_t      zw;                // BGZF compression of output
+  aiowr_t        aw;                // Write-behind queue of output
+  quota_t        quota;             // Quotas shared by processes
+} output_t;
+
 // Structure for managing queries
 typedef struct st_query
 {
-  long long int  buflen;      // Length of intermediate buffer
-  char          *buf;         // Intermediate buffer to store sequences between memory map partitions
-  char          *fbuf;        // Pointer to end of buffer
   char          *iaq;         // Pointer to start of current annotation
   char          *faq;         // Pointer to end of current annotation
   char          *isq;         // Pointer to start of current sequence
   char          *fsq;         // Pointer to end of current sequence
+  int            hdrCopy;     // Flag for annotations beginning at a matched "^A" annotation, written as ">"
+  long long int  hidx;        // Lowest hit ID index matched, its annotation begins header
+  long long int  nhits;       // Number of hit IDs matched by annotations
+  long long int *mhits;       // Hit ID indices matched by annotations, once each
+  long long int  maxHits;     // Hit ID indices allocated in mhits
+  long long int  hann;        // Index of annotation in header token table where annotations begin
+  hdrtok_t      *tok;         // Annotations and fields of current header, NULL if header is not tokenized
+  seqfmt_t      *fmt;         // Rewritten sequence of current query
 } query_t;
 
 // Structure for BLAST table query and hit IDs
 typedef struct st_hits
 {
-  long long int  total;        // Total number of lines in BLAST table file
+  long long int  total;        // Total number of hits in BLAST table file, lines of tabular output or hits of XML output
   long long int  qtotal;       // Number of distinct query IDs in BLAST table file
   long long int  htotal;       // Number of distinct hit IDs in BLAST table file
-  long long int *idxList;      // Array to index hit IDs corresponding to query IDs (MUSCLE pipeline)
+  long long int  npairs;       // Number of query and hit ID pairs in idxList (MUSCLE pipeline)
+  long long int  maxPairs;     // Number of query and hit ID pairs allocated in idxList
+  long long int *idxList;      // Pairs of query and hit ID indices of each line of BLAST table file (MUSCLE pipeline)
   FILE          *tfd;          // File descriptor of BLAST table file 
   FILE          *ofd;          // File descriptor of output file for sequences not found
   int            pipeMode;     // Pipeline program after extracting sequences 
@@ -108,15 +229,45 @@ typedef struct st_hits
   int           *charVect;     // Characteristic vector used to determine sequences found or not 
   char          *iMap;         // Pointer to initial mapped memory
   char          *fMap;	       // Pointer to last mapped memory
-  char         **queryList;    // List of queries in BLAST table file
-  char         **hitList;      // List of hit IDs in BLAST table file
+  idtable_t      queryIDs;     // Table of distinct query IDs in BLAST table file
+  idtable_t      hitIDs;       // Table of distinct hit IDs in BLAST table file or search file
+  int            sfd;          // Spill file of tables larger than spillLimit
+  long long int  spillLimit;   // Bytes of a table kept in memory, 0 = tables are never spilled
+  groups_t       groups;       // Groups of hit IDs by query ID (MUSCLE pipeline)
 } hits_t;
 
+// Structure for a job of batch mode
+// Records of a single pass over query file are filtered by every job, input of its iomap follows the memory map of the pass
+typedef struct st_job
+{
+  args_t         args;        // Options of job
+  hits_t         hits;        // BLAST table or search IDs of job
+  iomap_t        map;         // Output of job
+  output_t       out;         // Output file of job
+  int            done;        // Flag for quotas of job met
+} job_t;
+
+
+// Structure for requests of server mode
+// Query file is mapped once, requests are filtered over the mapping with hit sets of their own
+typedef struct st_servectx
+{
+  args_t              *args;        // Command line options of server
+  struct st_iomap     *iomap;       // Query file of server
+  struct st_mpi       *mpi;         // MPI environment of server
+  char                *map;         // Mapped query file
+  long long int        mapSz;       // Size of mapped query file
+  ffindex_t           *qidx;        // Offset index of query file, NULL if it is not up to date
+  long long int        nreqs;       // Number of requests served
+  int                  verbose;     // Verbose option of server, global options are reset by parser of requests
+  pthread_mutex_t      parseLock;   // Lock of command line parser, getopt_long() is not reentrant
+} servectx_t;
 
 typedef struct st_mpi
 {
   int       procCnt;	      // Total number of processes in world
   int       procRank;         // Rank index of current process
+  int       threadCnt;        // Number of threads per process
   int       nameLen;          // Length of processor name
   char      procName[MPI_MAX_PROCESSOR_NAME];     // Processor name
   MPI_Comm  MPI_MY_WORLD;     // MPI communicator object
@@ -127,22 +278,76 @@ int displayHelp();
 int parseCmdline(int, char **, args_t *, mpi_t *);
 int getAnnot(iomap_t *, query_t *);
 int getSequence(long long int *, iomap_t *, query_t *);
-int initQueryMap(long long int, long long int, iomap_t *, mpi_t *);
+int isStreamFile(char *);
 int openQueryFile(char *, iomap_t *);
 int parseAnnot(int, long long int *, query_t *);
+int selectLength(args_t *, long long int);
+int matchHitIDs(args_t *, query_t *, hits_t *);
+int recordCacheHits(iomap_t *, query_t *, const char *);
+long long int getParsedBytes(iomap_t *, query_t *);
+long long int getFileOffset(iomap_t *, const char *);
+long long int writeCopy(iomap_t *, const char *, long long int);
+long long int writeSequence(iomap_t *, query_t *, const char *, long long int);
+long long int writeQuery(iomap_t *, query_t *, const char *, long long int);
+int isQuotaMet(args_t *, iomap_t *, hits_t *, mpi_t *);
+int filterQuery(args_t *, iomap_t *, query_t *, hits_t *, long long int *, long long int, long long int, long long int);
+int filterJobs(iomap_t *, query_t *, mpi_t *, long long int, long long int, long long int);
+int setHeaderTokens(args_t *, iomap_t *, hits_t *, int *, long long int *);
 int extractQueries(args_t *, iomap_t *, query_t *, hits_t *, mpi_t *, long long int *, int *);
-int adjustMapBegin(long long int *, iomap_t *, query_t *);
-int adjustMapEnd(iomap_t *, query_t *);
+int extractSpan(args_t *, iomap_t *, hits_t *, mpi_t *, long long int, long long int, char **, long long int *, long long int *, int *);
+int extractIndexedQueries(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int extractLengthQueries(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int adjustMapEnd(long long int *, iomap_t *);
+int allocQuota(args_t *, hits_t *, quota_t *);
+int freeQuota(quota_t *);
+int initQuota(args_t *, iomap_t *, hits_t *, mpi_t *, quota_t *);
+int publishQuota(quota_t *, mpi_t *);
+int checkQuota(quota_t *, mpi_t *);
+int addQuotaRecord(quota_t *, long long int, const long long int *, long long int);
+long long int keepQuota(quota_t *, const long long int *);
+int trimThreadQuotas(quota_t *, int, spanlist_t *, long long int *, long long int *, iomap_t *, hits_t *, const int *, long long int);
+int trimQuota(quota_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
 int combineOutputFiles(args_t *, iomap_t *, mpi_t *, long long int);
+int mergeOutputFiles(args_t *, iomap_t *, mpi_t *, long long int);
 int writeHitsNotFound(char *, hits_t *, mpi_t *);
+int writeGroupChunk(int, int, mpi_t *, char *, long long int, long long int);
+int writeGroups(args_t *, iomap_t *, hits_t *, mpi_t *);
+int scanQueryRange(args_t *, iomap_t *, hits_t *, mpi_t *, long long int, long long int, long long int *);
+int scanQueryFile(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int streamQueryRange(args_t *, iomap_t *, hits_t *, mpi_t *, zreader_t *, long long int, int, long long int *);
+int streamQueryFile(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int scanBlockRange(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *, int, long long int *);
+int scanBlockFile(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int isWorkerThread();
+int scanQueryThreads(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int scanShardFiles(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int openOutput(args_t *, iomap_t *, hits_t *, mpi_t *, output_t *);
+int closeOutput(args_t *, iomap_t *, hits_t *, mpi_t *, output_t *, int);
 int partQueryFile(args_t *, iomap_t *, hits_t *, mpi_t *);
-int parseBlastTableIDs(hits_t *, char *);
+int addBlastIDs(hits_t *, const char *, long long int, const char *, long long int);
 int freeHitsMemory(hits_t *);
+int openSpillFile(args_t *, hits_t *, mpi_t *);
 int loadSearchIDs(char *, hits_t *);
+int loadSearchBuffer(hits_t *, const char *, long long int);
 int loadBlastTable(char *, hits_t *);
+int distributeHits(args_t *, hits_t *, mpi_t *);
+int loadJobs(args_t *, iomap_t *, mpi_t *);
+int freeJobs(iomap_t *);
+int openResultCache(args_t *, iomap_t *, hits_t *, mpi_t *, cache_t *);
+int extractCachedQueries(args_t *, iomap_t *, hits_t *, mpi_t *, long long int *);
+int updateResultCache(args_t *, iomap_t *, hits_t *, mpi_t *, cache_t *, int);
+int extractMappedSpan(args_t *, iomap_t *, hits_t *, mpi_t *, char *, long long int, long long int, long long int *, int *);
+int runRequest(servectx_t *, args_t *, hits_t *, int, long long int *);
+int serveRequest(int, void *);
+int serveQueries(args_t *, iomap_t *, mpi_t *);
 int adjustMPIProcs(mpi_t *, int);
 int getInputFilesComm(mpi_t *, MPI_Comm *);
 int distributeInputFiles(args_t *, mpi_t *);
-int setOffs(iomap_t *, mpi_t *);
+int scatterQueryFile(char *, iomap_t *, mpi_t *);
+int openShardFiles(args_t *, iomap_t *, mpi_t *, shardmf_t *);
+int computeQueryOffsets(iomap_t *, int *);
+int estimateWork(iomap_t *, mpi_t *, double **, long long int *, int *);
+int computeDistributedOffsets(iomap_t *, mpi_t *, int);
+int setOffs(iomap_t *, mpi_t *, int);
 
 #endif
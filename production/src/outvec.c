@@ -0,0 +1,279 @@
+// copy_file_range() is a GNU extension
+#define _GNU_SOURCE
+#include "outvec.h"
+
+
+// Copy data from query file to output file inside the kernel
+// If output offset is NULL, data is written at current position of output file
+// Returns number of bytes copied, less than requested if kernel copies are not supported
+long long int copyRange(int qfd, long long int off, int ofd, long long int *outOff, long long int len)
+{
+  loff_t inOff;         // Offset in query file
+  loff_t dstOff;        // Offset in output file
+  long long int done;   // Bytes copied
+  ssize_t n;            // Bytes copied by copy_file_range()
+
+  inOff = (loff_t)off;
+  dstOff = (outOff != NULL) ? (loff_t)*outOff : 0;
+  for(done = 0LL; done < len; done = done + n)
+  {
+    n = copy_file_range(qfd, &inOff, ofd, (outOff != NULL) ? &dstOff : NULL, (size_t)(len - done), 0);
+    if( n <= 0 )
+      break;
+  }
+
+  if( outOff != NULL )
+    *outOff = *outOff + done;
+
+  return done;
+}
+
+
+// Write all iovecs, handling partial writes
+static int writeIovecs(int ofd, struct iovec *iov, int cnt)
+{
+  ssize_t n;   // Bytes written by writev()
+
+  while( cnt > 0 )
+  {
+    n = writev(ofd, iov, cnt);
+    if( n < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      fprintf(stderr, "\n");
+      perror("writev()");
+      return ERROR;
+    }
+
+    // Skip iovecs completely written
+    while( cnt > 0 && (size_t)n >= iov->iov_len )
+    {
+      n = n - (ssize_t)iov->iov_len;
+      iov++;
+      cnt--;
+    }
+
+    // Partially written iovec
+    if( cnt > 0 )
+    {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len = iov->iov_len - (size_t)n;
+    }
+  }
+
+  return 0;
+}
+
+
+// Initialize an empty batch for output file
+int initOutVec(outvec_t *ovec, int qfd, int ofd)
+{
+  memset(ovec, 0, sizeof(outvec_t));
+
+  ovec->qfd = qfd;
+  ovec->ofd = ofd;
+  ovec->useCopy = 1;
+  ovec->maxEnts = OUTVEC_INIT;
+  ovec->ents = (outentry_t *)malloc(sizeof(outentry_t) * ovec->maxEnts);
+  ovec->iov = (struct iovec *)malloc(sizeof(struct iovec) * OUTVEC_IOV);
+  if( ovec->ents == NULL || ovec->iov == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate output vector\n");
+    freeOutVec(ovec);
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Add data to batch, merging it with last entry if it is contiguous
+// Data has to stay valid in memory until flushOutVec() is called
+int addOutVec(outvec_t *ovec, const char *p, long long int len, long long int off)
+{
+  outentry_t *last;   // Last entry
+  void *q;            // Reallocated memory
+
+  if( len <= 0LL )
+    return 0;
+
+  if( ovec->nents > 0LL )
+  {
+    last = &ovec->ents[ovec->nents - 1];
+    if( (last->p + last->len) == p &&
+        ((off == ERROR && last->off == ERROR) || (off != ERROR && last->off != ERROR && (last->off + last->len) == off)) )
+    {
+      last->len = last->len + len;
+      return 0;
+    }
+  }
+
+  if( ovec->nents == ovec->maxEnts )
+  {
+    q = realloc(ovec->ents, sizeof(outentry_t) * (size_t)(ovec->maxEnts * 2LL));
+    if( q == NULL )
+    {
+      fprintf(stdout, "\nError: failed to grow output vector\n");
+      return ERROR;
+    }
+    ovec->ents = (outentry_t *)q;
+    ovec->maxEnts = ovec->maxEnts * 2LL;
+  }
+
+  ovec->ents[ovec->nents].p = p;
+  ovec->ents[ovec->nents].len = len;
+  ovec->ents[ovec->nents].off = off;
+  ovec->nents++;
+
+  return 0;
+}
+
+
+// Copy data to pool of batch and add it, for data that does not stay valid until flushOutVec() is called
+// Copies to same chunk are contiguous, so they are merged in a single entry
+int copyOutVec(outvec_t *ovec, const char *p, long long int len)
+{
+  outchunk_t *chunk;   // Current chunk
+  void *q;             // Reallocated memory
+
+  if( len <= 0LL )
+    return 0;
+
+  // Use next chunk if data does not fit in current chunk
+  chunk = (ovec->npool > 0LL) ? &ovec->pool[ovec->npool - 1] : NULL;
+  if( chunk == NULL || (chunk->len + len) > chunk->sz )
+  {
+    if( ovec->npool == ovec->maxPool )
+    {
+      q = realloc(ovec->pool, sizeof(outchunk_t) * (size_t)(ovec->maxPool + 16LL));
+      if( q == NULL )
+      {
+        fprintf(stdout, "\nError: failed to grow output pool\n");
+        return ERROR;
+      }
+      ovec->pool = (outchunk_t *)q;
+      memset(ovec->pool + ovec->maxPool, 0, sizeof(outchunk_t) * 16);
+      ovec->maxPool = ovec->maxPool + 16LL;
+    }
+
+    // Chunks of previous flushes are reused, no entry points to them
+    chunk = &ovec->pool[ovec->npool];
+    if( chunk->sz < len )
+    {
+      free(chunk->data);
+      chunk->sz = (len > POOL_CHUNK) ? len : POOL_CHUNK;
+      chunk->data = (char *)malloc((size_t)chunk->sz);
+      if( chunk->data == NULL )
+      {
+        chunk->sz = 0LL;
+        fprintf(stdout, "\nError: failed to allocate output pool\n");
+        return ERROR;
+      }
+    }
+    chunk->len = 0LL;
+    ovec->npool++;
+  }
+
+  memcpy(chunk->data + chunk->len, p, (size_t)len);
+  chunk->len = chunk->len + len;
+
+  return addOutVec(ovec, chunk->data + chunk->len - len, len, ERROR);
+}
+
+
+// Write all pending entries to output file, in order
+// Large runs of query file data are copied by the kernel, rest is gathered with writev()
+// Compressed output goes through BGZF writer instead, asynchronous output through write-behind queue
+int flushOutVec(outvec_t *ovec)
+{
+  long long int i;      // Iteration variable
+  long long int n;      // Bytes copied by the kernel
+  int cnt;              // Pending iovecs
+  outentry_t *ent;      // Current entry
+
+  if( ovec->zw != NULL )
+  {
+    for(i = 0LL; i < ovec->nents; i++)
+    {
+      if( writeWriter(ovec->zw, ovec->ents[i].p, ovec->ents[i].len) != 0 )
+        return ERROR;
+      ovec->written = ovec->written + ovec->ents[i].len;
+    }
+    ovec->nents = 0LL;
+    ovec->npool = 0LL;
+    return 0;
+  }
+
+  // Entries are copied to write-behind queue, caller does not wait for writes
+  if( ovec->aw != NULL )
+  {
+    for(i = 0LL; i < ovec->nents; i++)
+    {
+      if( writeAio(ovec->aw, ovec->ents[i].p, ovec->ents[i].len) != 0 )
+        return ERROR;
+      ovec->written = ovec->written + ovec->ents[i].len;
+    }
+    ovec->nents = 0LL;
+    ovec->npool = 0LL;
+    return 0;
+  }
+
+  cnt = 0;
+  for(i = 0LL; i < ovec->nents; i++)
+  {
+    ent = &ovec->ents[i];
+
+    // Copy from query file, iovecs before it have to be written first
+    n = 0LL;
+    if( ovec->useCopy != 0 && ent->off != ERROR && ent->len >= COPY_MIN )
+    {
+      if( writeIovecs(ovec->ofd, ovec->iov, cnt) != 0 )
+        return ERROR;
+      cnt = 0;
+
+      n = copyRange(ovec->qfd, ent->off, ovec->ofd, NULL, ent->len);
+      ovec->copied = ovec->copied + n;
+
+      // Kernel copies not supported for these files, write from memory from now on
+      if( n < ent->len )
+        ovec->useCopy = 0;
+      if( n == ent->len )
+        continue;
+    }
+
+    ovec->iov[cnt].iov_base = (void *)(ent->p + n);
+    ovec->iov[cnt].iov_len = (size_t)(ent->len - n);
+    ovec->written = ovec->written + (ent->len - n);
+    cnt++;
+    if( cnt == OUTVEC_IOV )
+    {
+      if( writeIovecs(ovec->ofd, ovec->iov, cnt) != 0 )
+        return ERROR;
+      cnt = 0;
+    }
+  }
+
+  if( writeIovecs(ovec->ofd, ovec->iov, cnt) != 0 )
+    return ERROR;
+  ovec->nents = 0LL;
+  ovec->npool = 0LL;
+
+  return 0;
+}
+
+
+// Free batch memory
+int freeOutVec(outvec_t *ovec)
+{
+  long long int i;   // Iteration variable
+
+  for(i = 0LL; i < ovec->maxPool; i++)
+    free(ovec->pool[i].data);
+  free(ovec->pool);
+  free(ovec->ents);
+  free(ovec->iov);
+  memset(ovec, 0, sizeof(outvec_t));
+
+  return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef OUTVEC_H
+#define OUTVEC_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "bgzf.h"
+#include "aio.h"
+
+#define ERROR        -1         // Error code from failed functions
+
+#define OUTVEC_INIT  1024LL     // Initial number of entries allocated
+#define OUTVEC_IOV   1024       // Max number of iovecs per writev() call (IOV_MAX)
+#define COPY_MIN     (1LL<<16)  // Runs of query file data at least this large are copied by the kernel, 64KB
+#define POOL_CHUNK   (1LL<<20)  // Size of chunks of data copied to batch, 1MB
+
+// Pending output data
+// Data from query file also keeps its file offset, so large runs can be copied without user space buffers
+typedef struct st_outentry
+{
+  const char    *p;           // Pointer to data in memory
+  long long int  len;         // Length of data
+  long long int  off;         // Offset of data in query file, ERROR if data is not in query file
+} outentry_t;
+
+// Chunk of data copied to batch
+typedef struct st_outchunk
+{
+  char          *data;        // Copied data
+  long long int  len;         // Bytes used
+  long long int  sz;          // Bytes allocated
+} outchunk_t;
+
+// Batched output of query data
+// Adjacent writes are merged, then flushed with writev() or copy_file_range(), or queued for asynchronous writes
+typedef struct st_outvec
+{
+  int            qfd;         // Query file descriptor
+  int            ofd;         // Output file descriptor
+  int            useCopy;     // Flag for kernel copies, cleared if copy_file_range() fails
+  long long int  nents;       // Number of pending entries
+  long long int  maxEnts;     // Number of entries allocated
+  long long int  copied;      // Bytes copied by the kernel
+  long long int  written;     // Bytes written from memory
+  outentry_t    *ents;        // Pending entries in output order
+  struct iovec  *iov;         // Vector for writev()
+  long long int  npool;       // Number of chunks in use
+  long long int  maxPool;     // Number of chunks allocated
+  outchunk_t    *pool;        // Data that does not stay valid until flush, chunks are kept until flushOutVec() is called
+  zwriter_t     *zw;          // BGZF compression of output, NULL if output is not compressed
+  aiowr_t       *aw;          // Write-behind queue of output, NULL if output is written with writev()
+} outvec_t;
+
+long long int copyRange(int, long long int, int, long long int *, long long int);
+int initOutVec(outvec_t *, int, int);
+int addOutVec(outvec_t *, const char *, long long int, long long int);
+int copyOutVec(outvec_t *, const char *, long long int);
+int flushOutVec(outvec_t *);
+int freeOutVec(outvec_t *);
+
+
+#endif
@@ -0,0 +1,583 @@
+#include "scan.h"
+
+// Kernels selected at runtime by initScanner()
+static long long int (*scanKernel)(const char *, const char *, const char **) = NULL;
+static int (*tokenKernel)(hdrtok_t *, const char *, const char *) = NULL;
+static void (*foldKernel)(char *, const char *, long long int) = NULL;
+static int scanType = SCAN_SCALAR;
+
+
+// Scalar kernel, used for tails and when no vector unit is available
+static long long int scanScalar(const char *p, const char *end, const char **stop)
+{
+  long long int nl;   // Newlines found
+
+  nl = 0LL;
+  while( p != end )
+  {
+    if( *p == '>' )
+      break;
+    else if( *p == '\n' )
+      nl++;
+    p++;
+  }
+
+  *stop = p;
+
+  return nl;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+// SSE2 kernel, 16 bytes per block
+static long long int scanSSE2(const char *p, const char *end, const char **stop)
+{
+  long long int nl;          // Newlines found
+  unsigned int gtMask;       // Positions of '>' in block
+  unsigned int nlMask;       // Positions of '\n' in block
+  __m128i gt;                // '>' in every lane
+  __m128i lf;                // '\n' in every lane
+  __m128i blk;               // Current block
+
+  nl = 0LL;
+  gt = _mm_set1_epi8('>');
+  lf = _mm_set1_epi8('\n');
+  while( (end - p) >= 16 )
+  {
+    blk = _mm_loadu_si128((const __m128i *)p);
+    gtMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(blk, gt));
+    nlMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(blk, lf));
+
+    // Found start of next query, count newlines before it
+    if( gtMask != 0 )
+    {
+      gtMask = (unsigned int)__builtin_ctz(gtMask);
+      nl = nl + __builtin_popcount(nlMask & ((1U << gtMask) - 1U));
+      *stop = p + gtMask;
+      return nl;
+    }
+
+    nl = nl + __builtin_popcount(nlMask);
+    p = p + 16;
+  }
+
+  return nl + scanScalar(p, end, stop);
+}
+
+
+// AVX2 kernel, 32 bytes per block
+__attribute__((target("avx2")))
+static long long int scanAVX2(const char *p, const char *end, const char **stop)
+{
+  long long int nl;          // Newlines found
+  unsigned int gtMask;       // Positions of '>' in block
+  unsigned int nlMask;       // Positions of '\n' in block
+  __m256i gt;                // '>' in every lane
+  __m256i lf;                // '\n' in every lane
+  __m256i blk;               // Current block
+
+  nl = 0LL;
+  gt = _mm256_set1_epi8('>');
+  lf = _mm256_set1_epi8('\n');
+  while( (end - p) >= 32 )
+  {
+    blk = _mm256_loadu_si256((const __m256i *)p);
+    gtMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(blk, gt));
+    nlMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(blk, lf));
+
+    // Found start of next query, count newlines before it
+    if( gtMask != 0 )
+    {
+      gtMask = (unsigned int)__builtin_ctz(gtMask);
+      nl = nl + __builtin_popcount(nlMask & (unsigned int)((1ULL << gtMask) - 1ULL));
+      *stop = p + gtMask;
+      return nl;
+    }
+
+    nl = nl + __builtin_popcount(nlMask);
+    p = p + 32;
+  }
+
+  return nl + scanSSE2(p, end, stop);
+}
+#endif
+
+
+#if defined(__aarch64__)
+// NEON kernel, 16 bytes per block
+static long long int scanNEON(const char *p, const char *end, const char **stop)
+{
+  long long int nl;          // Newlines found
+  uint8x16_t gt;             // '>' in every lane
+  uint8x16_t lf;             // '\n' in every lane
+  uint8x16_t blk;            // Current block
+  uint8x16_t cmp;            // Lanes equal to '>'
+
+  nl = 0LL;
+  gt = vdupq_n_u8('>');
+  lf = vdupq_n_u8('\n');
+  while( (end - p) >= 16 )
+  {
+    blk = vld1q_u8((const uint8_t *)p);
+    cmp = vceqq_u8(blk, gt);
+
+    // Found start of next query, finish block with scalar kernel
+    if( vmaxvq_u8(cmp) != 0 )
+      return nl + scanScalar(p, end, stop);
+
+    // Matching lanes are 0xFF, add 1 per lane
+    nl = nl + vaddvq_u8(vandq_u8(vceqq_u8(blk, lf), vdupq_n_u8(1)));
+    p = p + 16;
+  }
+
+  return nl + scanScalar(p, end, stop);
+}
+#endif
+
+
+// Double arrays of header token table
+static int growHeaderTokens(hdrtok_t *tok)
+{
+  long long int n;    // Number of field delimiters allocated
+  void *p;            // Reallocated memory
+
+  n = (tok->maxToks > 0LL) ? tok->maxToks * 2LL : HDRTOK_INIT;
+
+  // Annotations are one more than "^A" delimiters
+  p = realloc(tok->annot, sizeof(long long int) * (n + 1));
+  if( p == NULL )
+    return ERROR;
+  tok->annot = (long long int *)p;
+  p = realloc(tok->first, sizeof(long long int) * (n + 1));
+  if( p == NULL )
+    return ERROR;
+  tok->first = (long long int *)p;
+  p = realloc(tok->field, sizeof(long long int) * n);
+  if( p == NULL )
+    return ERROR;
+  tok->field = (long long int *)p;
+  tok->maxToks = n;
+
+  return 0;
+}
+
+
+// Add field delimiter at offset, "^A" also begins an annotation
+static int addDelim(hdrtok_t *tok, long long int off, int soh)
+{
+  if( tok->nfields == tok->maxToks && growHeaderTokens(tok) != 0 )
+    return ERROR;
+
+  if( soh != 0 )
+  {
+    tok->annot[tok->nannots] = off;
+    tok->first[tok->nannots] = tok->nfields + 1;
+    tok->nannots++;
+  }
+  tok->field[tok->nfields] = off;
+  tok->nfields++;
+
+  return 0;
+}
+
+
+// Scalar tokenizer, used for tails and when no vector unit is available
+static int tokenScalar(hdrtok_t *tok, const char *p, const char *end)
+{
+  char bar;   // Field delimiter, "^A" if fields are not recorded
+
+  bar = (tok->fields != 0) ? '|' : 1;
+  for(; p < end && tok->nfields < tok->limit; p++)
+    if( (*p == bar || *p == 1) && addDelim(tok, (long long int)(p - tok->hdr), *p == 1) != 0 )
+      return ERROR;
+
+  return 0;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+// Add delimiters of a block from mask of their positions
+static inline int addDelimMask(hdrtok_t *tok, const char *p, unsigned int mask)
+{
+  int i;   // Position of delimiter in block
+
+  while( mask != 0 )
+  {
+    i = __builtin_ctz(mask);
+    if( addDelim(tok, (long long int)(p + i - tok->hdr), p[i] == 1) != 0 )
+      return ERROR;
+    mask = mask & (mask - 1U);
+  }
+
+  return 0;
+}
+
+
+// SSE2 tokenizer, 16 bytes per block
+static int tokenSSE2(hdrtok_t *tok, const char *p, const char *end)
+{
+  unsigned int mask;         // Positions of delimiters in block
+  __m128i bar;               // '|' in every lane
+  __m128i soh;               // "^A" in every lane
+  __m128i blk;               // Current block
+
+  bar = _mm_set1_epi8((tok->fields != 0) ? '|' : 1);
+  soh = _mm_set1_epi8(1);
+  while( (end - p) >= 16 && tok->nfields < tok->limit )
+  {
+    blk = _mm_loadu_si128((const __m128i *)p);
+    mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(blk, bar), _mm_cmpeq_epi8(blk, soh)));
+    if( mask != 0 && addDelimMask(tok, p, mask) != 0 )
+      return ERROR;
+    p = p + 16;
+  }
+
+  return tokenScalar(tok, p, end);
+}
+
+
+// AVX2 tokenizer, 32 bytes per block
+__attribute__((target("avx2")))
+static int tokenAVX2(hdrtok_t *tok, const char *p, const char *end)
+{
+  unsigned int mask;         // Positions of delimiters in block
+  __m256i bar;               // '|' in every lane
+  __m256i soh;               // "^A" in every lane
+  __m256i blk;               // Current block
+
+  bar = _mm256_set1_epi8((tok->fields != 0) ? '|' : 1);
+  soh = _mm256_set1_epi8(1);
+  while( (end - p) >= 32 && tok->nfields < tok->limit )
+  {
+    blk = _mm256_loadu_si256((const __m256i *)p);
+    mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(blk, bar), _mm256_cmpeq_epi8(blk, soh)));
+    if( mask != 0 && addDelimMask(tok, p, mask) != 0 )
+      return ERROR;
+    p = p + 32;
+  }
+
+  return tokenSSE2(tok, p, end);
+}
+#endif
+
+
+#if defined(__aarch64__)
+// NEON tokenizer, 16 bytes per block, blocks with delimiters are finished by scalar tokenizer
+static int tokenNEON(hdrtok_t *tok, const char *p, const char *end)
+{
+  uint8x16_t bar;            // '|' in every lane
+  uint8x16_t soh;            // "^A" in every lane
+  uint8x16_t blk;            // Current block
+
+  bar = vdupq_n_u8((tok->fields != 0) ? '|' : 1);
+  soh = vdupq_n_u8(1);
+  while( (end - p) >= 16 && tok->nfields < tok->limit )
+  {
+    blk = vld1q_u8((const uint8_t *)p);
+    if( vmaxvq_u8(vorrq_u8(vceqq_u8(blk, bar), vceqq_u8(blk, soh))) != 0 && tokenScalar(tok, p, p + 16) != 0 )
+      return ERROR;
+    p = p + 16;
+  }
+
+  return tokenScalar(tok, p, end);
+}
+#endif
+
+
+// Scalar case folding, copies residues in uppercase
+static void foldScalar(char *dst, const char *src, long long int n)
+{
+  long long int i;   // Iteration variable
+
+  for(i = 0LL; i < n; i++)
+    dst[i] = (src[i] >= 'a' && src[i] <= 'z') ? (char)(src[i] - 32) : src[i];
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+// SSE2 case folding, 16 bytes per block
+// Lowercase letters are 'a' to 'z' after biasing to signed range, so a single signed compare finds them
+static void foldSSE2(char *dst, const char *src, long long int n)
+{
+  __m128i bias;              // Moves 'a' to lowest signed value
+  __m128i lim;               // Biased 'z' plus 1
+  __m128i cs;                // Case bit in every lane
+  __m128i blk;               // Current block
+  __m128i low;               // Lanes with lowercase letters
+
+  bias = _mm_set1_epi8((char)(128 - 'a'));
+  lim = _mm_set1_epi8((char)(-128 + 26));
+  cs = _mm_set1_epi8(0x20);
+  for(; n >= 16; n = n - 16)
+  {
+    blk = _mm_loadu_si128((const __m128i *)src);
+    low = _mm_cmplt_epi8(_mm_add_epi8(blk, bias), lim);
+    _mm_storeu_si128((__m128i *)dst, _mm_sub_epi8(blk, _mm_and_si128(low, cs)));
+    src = src + 16;
+    dst = dst + 16;
+  }
+
+  foldScalar(dst, src, n);
+}
+
+
+// AVX2 case folding, 32 bytes per block
+__attribute__((target("avx2")))
+static void foldAVX2(char *dst, const char *src, long long int n)
+{
+  __m256i bias;              // Moves 'a' to lowest signed value
+  __m256i lim;               // Biased 'z' plus 1
+  __m256i cs;                // Case bit in every lane
+  __m256i blk;               // Current block
+  __m256i low;               // Lanes with lowercase letters
+
+  bias = _mm256_set1_epi8((char)(128 - 'a'));
+  lim = _mm256_set1_epi8((char)(-128 + 26));
+  cs = _mm256_set1_epi8(0x20);
+  for(; n >= 32; n = n - 32)
+  {
+    blk = _mm256_loadu_si256((const __m256i *)src);
+    low = _mm256_cmpgt_epi8(lim, _mm256_add_epi8(blk, bias));
+    _mm256_storeu_si256((__m256i *)dst, _mm256_sub_epi8(blk, _mm256_and_si256(low, cs)));
+    src = src + 32;
+    dst = dst + 32;
+  }
+
+  foldSSE2(dst, src, n);
+}
+#endif
+
+
+#if defined(__aarch64__)
+// NEON case folding, 16 bytes per block
+static void foldNEON(char *dst, const char *src, long long int n)
+{
+  uint8x16_t blk;            // Current block
+  uint8x16_t low;            // Lanes with lowercase letters
+
+  for(; n >= 16; n = n - 16)
+  {
+    blk = vld1q_u8((const uint8_t *)src);
+    low = vcltq_u8(vsubq_u8(blk, vdupq_n_u8('a')), vdupq_n_u8(26));
+    vst1q_u8((uint8_t *)dst, vsubq_u8(blk, vandq_u8(low, vdupq_n_u8(0x20))));
+    src = src + 16;
+    dst = dst + 16;
+  }
+
+  foldScalar(dst, src, n);
+}
+#endif
+
+
+// Select fastest kernel supported by the processor
+int initScanner()
+{
+  scanKernel = scanScalar;
+  tokenKernel = tokenScalar;
+  foldKernel = foldScalar;
+  scanType = SCAN_SCALAR;
+
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports("avx2") )
+  {
+    scanKernel = scanAVX2;
+    tokenKernel = tokenAVX2;
+    foldKernel = foldAVX2;
+    scanType = SCAN_AVX2;
+  }
+  else if( __builtin_cpu_supports("sse2") )
+  {
+    scanKernel = scanSSE2;
+    tokenKernel = tokenSSE2;
+    foldKernel = foldSSE2;
+    scanType = SCAN_SSE2;
+  }
+#elif defined(__aarch64__)
+  scanKernel = scanNEON;
+  tokenKernel = tokenNEON;
+  foldKernel = foldNEON;
+  scanType = SCAN_NEON;
+#endif
+  return scanType;
+}
+
+
+// Name of kernel selected
+const char *getScannerName()
+{
+  switch( scanType )
+  {
+    case SCAN_SSE2: return "SSE2";
+    case SCAN_AVX2: return "AVX2";
+    case SCAN_NEON: return "NEON";
+    default:        return "scalar";
+  }
+}
+
+
+// Scan sequence data from p up to end (not included) for the start of the next query ('>')
+// Sets stop to the '>' found or to end, returns number of newlines before stop
+// Residue count is then (stop - p) minus newlines
+long long int scanSequence(const char *p, const char *end, const char **stop)
+{
+  if( scanKernel == NULL )
+    initScanner();
+
+  return scanKernel(p, end, stop);
+}
+
+
+// Initialize header token table, arrays are allocated by first header
+// Only "^A" delimiters are recorded if fields flag is not set, tokenizing stops at limit of delimiters
+int initHeaderTokens(hdrtok_t *tok, int fields, long long int limit)
+{
+  memset(tok, 0, sizeof(hdrtok_t));
+  tok->fields = fields;
+  tok->limit = limit;
+
+  return 0;
+}
+
+
+// Split header from p (">" of query) up to end (newline, not included) into annotations and fields
+// Every delimiter is found in a single pass, so ID matching and field trimming do not scan header again
+// If tokenizing stops at limit, annotations and fields after last delimiter recorded are not in table
+int tokenizeHeader(hdrtok_t *tok, const char *p, const char *end)
+{
+  if( tokenKernel == NULL )
+    initScanner();
+
+  if( tok->maxToks == 0LL && growHeaderTokens(tok) != 0 )
+  {
+    fprintf(stdout, "\nError: failed to allocate header token table\n");
+    return ERROR;
+  }
+
+  // First annotation begins with ">"
+  tok->hdr = p;
+  tok->len = (long long int)(end - p);
+  tok->nannots = 1LL;
+  tok->nfields = 0LL;
+  tok->annot[0] = 0LL;
+  tok->first[0] = 0LL;
+
+  if( tokenKernel(tok, p + 1, end) != 0 )
+  {
+    fprintf(stdout, "\nError: failed to allocate header token table\n");
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Free header token table
+int freeHeaderTokens(hdrtok_t *tok)
+{
+  free(tok->annot);
+  free(tok->first);
+  free(tok->field);
+  memset(tok, 0, sizeof(hdrtok_t));
+
+  return 0;
+}
+
+
+// Initialize buffer of rewritten sequences, it is allocated by first sequence
+int initSeqFormat(seqfmt_t *fmt)
+{
+  memset(fmt, 0, sizeof(seqfmt_t));
+
+  return 0;
+}
+
+
+// Rewrite sequence data from p, newlines and carriage returns are removed and residues are uppercased
+// Residues are written in lines of width residues (0 = single line), last line ends with a newline
+// Lines are found by memchr(), which is vectorized by the C library, and copied by the case folding kernel
+int formatSequence(seqfmt_t *fmt, const char *p, long long int len, int width)
+{
+  const char *src;     // Start of sequence data
+  const char *end;     // End of sequence data
+  const char *eol;     // End of current line
+  const char *run;     // End of residues of current line
+  char *q;             // Current position in buffer
+  long long int sz;    // Bytes needed in buffer
+  long long int col;   // Residues in current output line
+  long long int n;     // Residues of current line left to copy
+  long long int k;     // Residues copied to current output line
+
+  // Sequence is already rewritten for a previous job
+  if( fmt->src == p && fmt->srcLen == len && fmt->width == width )
+    return 0;
+
+  if( foldKernel == NULL )
+    initScanner();
+
+  // Residues plus a newline per output line
+  sz = len + ((width > 0) ? len / width : 0LL) + 2LL;
+  if( sz > fmt->sz )
+  {
+    free(fmt->buf);
+    fmt->buf = (char *)malloc((size_t)sz);
+    if( fmt->buf == NULL )
+    {
+      fmt->sz = 0LL;
+      fmt->src = NULL;
+      fprintf(stdout, "\nError: failed to allocate buffer for rewritten sequences\n");
+      return ERROR;
+    }
+    fmt->sz = sz;
+  }
+
+  q = fmt->buf;
+  col = 0LL;
+  src = p;
+  end = p + len;
+  while( p < end )
+  {
+    eol = (const char *)memchr(p, '\n', (size_t)(end - p));
+    if( eol == NULL )
+      eol = end;
+    run = eol;
+    if( run > p && *(run - 1) == '\r' )
+      run--;
+
+    // Split residues of current line at width of output lines
+    for(n = (long long int)(run - p); n > 0LL; n = n - k)
+    {
+      k = (width > 0 && n > ((long long int)width - col)) ? (long long int)width - col : n;
+      foldKernel(q, p, k);
+      q = q + k;
+      p = p + k;
+      col = col + k;
+      if( width > 0 && col == width )
+      {
+        *q++ = '\n';
+        col = 0LL;
+      }
+    }
+
+    p = eol + 1;
+  }
+  if( col > 0LL || q == fmt->buf )
+    *q++ = '\n';
+
+  fmt->src = src;
+  fmt->srcLen = len;
+  fmt->width = width;
+  fmt->len = (long long int)(q - fmt->buf);
+
+  return 0;
+}
+
+
+// Free buffer of rewritten sequences
+int freeSeqFormat(seqfmt_t *fmt)
+{
+  free(fmt->buf);
+  memset(fmt, 0, sizeof(seqfmt_t));
+
+  return 0;
+}
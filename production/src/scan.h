@@ -0,0 +1,64 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Kernels available for scanning FASTA records
+#define SCAN_SCALAR 0          // Byte at a time
+#define SCAN_SSE2   1          // 16 bytes at a time
+#define SCAN_AVX2   2          // 32 bytes at a time
+#define SCAN_NEON   3          // 16 bytes at a time
+
+#define ERROR       -1         // Error code from failed functions
+#define HDRTOK_INIT 256LL      // Initial number of field delimiters allocated in header token table
+
+// Delimiters of a query header found in a single pass
+// Annotations begin with ">" or "^A" (start of heading = 1), fields are delimited by '|' (vertical bar) or "^A"
+// Offsets are from the ">" of the query
+typedef struct st_hdrtok
+{
+  int            fields;      // Flag for recording '|' delimiters, otherwise only "^A" delimiters are recorded
+  long long int  limit;       // Tokenizing stops once this many delimiters are recorded
+  const char    *hdr;         // Start of header, ">" of query
+  long long int  len;         // Bytes of header, newline not included
+  long long int  nannots;     // Number of annotations
+  long long int  nfields;     // Number of field delimiters
+  long long int  maxToks;     // Number of field delimiters allocated
+  long long int *annot;       // Offset of beginning of each annotation
+  long long int *first;       // Index of first field delimiter after beginning of each annotation
+  long long int *field;       // Offset of each field delimiter
+} hdrtok_t;
+
+// Sequence data rewritten for output
+// Newlines are removed, residues are uppercased and wrapped in lines of a fixed width
+typedef struct st_seqfmt
+{
+  const char    *src;         // Sequence data in buffer, so it is not rewritten again for other jobs
+  long long int  srcLen;      // Bytes of sequence data
+  int            width;       // Residues per line, 0 = single line
+  long long int  len;         // Bytes of rewritten data
+  long long int  sz;          // Bytes allocated
+  char          *buf;         // Rewritten data
+} seqfmt_t;
+
+int initScanner();
+const char *getScannerName();
+long long int scanSequence(const char *, const char *, const char **);
+int initHeaderTokens(hdrtok_t *, int, long long int);
+int tokenizeHeader(hdrtok_t *, const char *, const char *);
+int freeHeaderTokens(hdrtok_t *);
+int initSeqFormat(seqfmt_t *);
+int formatSequence(seqfmt_t *, const char *, long long int, int);
+int freeSeqFormat(seqfmt_t *);
+
+
+#endif
@@ -0,0 +1,180 @@
+#include "serve.h"
+
+// Set by SIGINT and SIGTERM, accept loop of runServer() exits
+static volatile sig_atomic_t serverStop = 0;
+
+
+// Signal handler for stopping server
+static void stopServer(int sig)
+{
+  (void)sig;
+  serverStop = 1;
+}
+
+
+// Worker thread, serves connections of queue until server stops
+static void *serveWorker(void *arg)
+{
+  int fd;              // Current connection
+  server_t *srv;       // Server
+
+  srv = (server_t *)arg;
+  while( 1 )
+  {
+    pthread_mutex_lock(&srv->lock);
+    while( srv->nqueued == 0 && srv->stop == 0 )
+      pthread_cond_wait(&srv->ready, &srv->lock);
+    if( srv->nqueued == 0 )
+    {
+      pthread_mutex_unlock(&srv->lock);
+      break;
+    }
+    fd = srv->queue[srv->head];
+    srv->head = (srv->head + 1) % SERVE_QUEUE;
+    srv->nqueued--;
+    pthread_mutex_unlock(&srv->lock);
+
+    srv->fn(fd, srv->ctx);
+  }
+
+  return NULL;
+}
+
+
+// Listen on Unix socket at path and start worker threads
+// An existing socket file at path is replaced
+int openServer(server_t *srv, const char *path, int nworkers, servefn_t fn, void *ctx)
+{
+  int i;                     // Iteration variable
+  struct sockaddr_un addr;   // Address of socket
+
+  memset(srv, 0, sizeof(server_t));
+  srv->lfd = -1;
+  if( strlen(path) >= sizeof(addr.sun_path) )
+  {
+    fprintf(stderr, "\nError: socket path is too long (%d characters max)\n", (int)sizeof(addr.sun_path) - 1);
+    return ERROR;
+  }
+  strncpy(srv->path, path, sizeof(srv->path) - 1);
+  srv->nworkers = (nworkers > 0) ? nworkers : 1;
+  srv->fn = fn;
+  srv->ctx = ctx;
+
+  srv->lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if( srv->lfd < 0 )
+  {
+    perror("socket()");
+    return ERROR;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+  if( bind(srv->lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(srv->lfd, SERVE_BACKLOG) != 0 )
+  {
+    perror("bind()");
+    close(srv->lfd);
+    srv->lfd = -1;
+    return ERROR;
+  }
+
+  pthread_mutex_init(&srv->lock, NULL);
+  pthread_cond_init(&srv->ready, NULL);
+  srv->workers = (pthread_t *)malloc(sizeof(pthread_t) * srv->nworkers);
+  if( srv->workers == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate server workers\n");
+    closeServer(srv);
+    return ERROR;
+  }
+  for(i = 0; i < srv->nworkers; i++)
+  {
+    if( pthread_create(&srv->workers[i], NULL, serveWorker, srv) != 0 )
+    {
+      fprintf(stdout, "\nError: failed to start server worker\n");
+      srv->nworkers = i;
+      closeServer(srv);
+      return ERROR;
+    }
+  }
+
+  return 0;
+}
+
+
+// Accept connections and queue them for workers until SIGINT or SIGTERM
+// Connections are refused while queue is full
+int runServer(server_t *srv)
+{
+  int fd;                    // Accepted connection
+  struct sigaction sa;       // Handler of stop signals
+
+  // Accept is interrupted by stop signals, clients closing early do not terminate server
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stopServer;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  serverStop = 0;
+  while( serverStop == 0 )
+  {
+    fd = accept(srv->lfd, NULL, NULL);
+    if( fd < 0 )
+    {
+      if( errno == EINTR || errno == ECONNABORTED )
+        continue;
+      perror("accept()");
+      return ERROR;
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    if( srv->nqueued == SERVE_QUEUE )
+    {
+      pthread_mutex_unlock(&srv->lock);
+      if( write(fd, "Error: server is busy\n", 22) < 0 )
+        perror("write()");
+      close(fd);
+      continue;
+    }
+    srv->queue[(srv->head + srv->nqueued) % SERVE_QUEUE] = fd;
+    srv->nqueued++;
+    srv->nconns++;
+    pthread_cond_signal(&srv->ready);
+    pthread_mutex_unlock(&srv->lock);
+  }
+
+  return 0;
+}
+
+
+// Stop workers once connections in queue are served, close and remove socket
+int closeServer(server_t *srv)
+{
+  int i;   // Iteration variable
+
+  if( srv->workers != NULL )
+  {
+    pthread_mutex_lock(&srv->lock);
+    srv->stop = 1;
+    pthread_cond_broadcast(&srv->ready);
+    pthread_mutex_unlock(&srv->lock);
+    for(i = 0; i < srv->nworkers; i++)
+      pthread_join(srv->workers[i], NULL);
+    free(srv->workers);
+    srv->workers = NULL;
+    pthread_cond_destroy(&srv->ready);
+    pthread_mutex_destroy(&srv->lock);
+  }
+
+  if( srv->lfd >= 0 )
+  {
+    close(srv->lfd);
+    unlink(srv->path);
+    srv->lfd = -1;
+  }
+
+  return 0;
+}
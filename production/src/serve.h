@@ -0,0 +1,48 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define ERROR         -1         // Error code from failed functions
+
+#define SERVE_QUEUE   256        // Max number of connections waiting for a worker
+#define SERVE_BACKLOG 64         // Backlog of listening socket
+
+// Handler of a connection, called by a worker thread, closes connection when done
+typedef int (*servefn_t)(int, void *);
+
+// Server of connections over a Unix socket
+// Main thread accepts connections and queues them, a pool of worker threads serves them concurrently
+typedef struct st_server
+{
+  int             lfd;                  // Listening socket
+  char            path[108];            // Path of socket, sizeof(sun_path)
+  int             nworkers;             // Number of worker threads
+  pthread_t      *workers;              // Worker threads
+  int             queue[SERVE_QUEUE];   // Connections waiting for a worker
+  int             head;                 // Index of first connection in queue
+  int             nqueued;              // Number of connections in queue
+  int             stop;                 // Flag for workers to exit once queue is empty
+  long long int   nconns;               // Number of connections accepted
+  servefn_t       fn;                   // Handler of connections
+  void           *ctx;                  // Context of handler
+  pthread_mutex_t lock;                 // Lock of queue
+  pthread_cond_t  ready;                // Signals connections in queue or stop
+} server_t;
+
+int openServer(server_t *, const char *, int, servefn_t, void *);
+int runServer(server_t *);
+int closeServer(server_t *);
+
+
+#endif
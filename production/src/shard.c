@@ -0,0 +1,258 @@
+#include "shard.h"
+
+
+// Check if a file is a shard manifest, by its first word
+int isShardManifest(const char *fn)
+{
+  FILE *fd;                       // Manifest file
+  char magic[sizeof(SHARD_MAGIC)]; // First bytes of file
+  int found;                      // Flag for magic string found
+
+  fd = fopen(fn, "rb");
+  if( fd == NULL )
+    return 0;
+  found = (fread(magic, 1, sizeof(magic) - 1, fd) == sizeof(magic) - 1 && memcmp(magic, SHARD_MAGIC, sizeof(magic) - 1) == 0);
+  fclose(fd);
+
+  return found;
+}
+
+
+// Copy a range of query file to a shard file, by the kernel if supported
+static int copyShard(int qfd, long long int off, long long int len, int sfd)
+{
+  char *buf;            // Buffer of copies through user space
+  long long int done;   // Bytes copied
+  long long int outOff; // Offset in shard file
+  long long int n;      // Bytes of current chunk
+
+  outOff = 0LL;
+  done = copyRange(qfd, off, sfd, &outOff, len);
+  if( done == len )
+    return 0;
+
+  buf = (char *)malloc(sizeof(char) * SHARD_COPY);
+  if( buf == NULL )
+    return ERROR;
+  while( done < len )
+  {
+    n = MIN(SHARD_COPY, len - done);
+    if( pread(qfd, buf, n, off + done) != n || pwrite(sfd, buf, n, done) != n )
+      break;
+    done = done + n;
+  }
+  free(buf);
+
+  return (done == len) ? 0 : ERROR;
+}
+
+
+// Split query file into nshards record aligned shards of balanced sizes, and write their manifest
+// Shards are written next to query file as <qf>.shard<i>, manifest as <qf>.shards, it is written last
+int buildShards(char *qf, int nshards)
+{
+  char path[SHARD_NAMELEN + 16];  // Current shard file or manifest
+  const char *base;               // Name of shard file without directory
+  int fd;                         // Query file descriptor
+  int sfd;                        // Current shard file
+  int nparts;                     // Number of shards computed
+  int i;                          // Iteration variable
+  int err;                        // Trap errors
+  long long int *offs;            // Offset triplets of shards
+  long long int *nrecs;           // Records of each shard
+  long long int total;            // Records of query file
+  long long int begin;            // File offset of current shard
+  long long int len;              // Bytes of current shard
+  FILE *mfd;                      // Manifest file
+  struct stat stbuf;
+
+  if( nshards < 1 || nshards > SHARD_LIMIT )
+  {
+    fprintf(stderr, "\nError: number of shards must be between 1 and %d\n", SHARD_LIMIT);
+    return ERROR;
+  }
+
+  fd = open(qf, O_RDONLY);
+  if( fd < 0 )
+  {
+    fprintf(stderr, "\n");
+    perror("open()");
+    return ERROR;
+  }
+  fstat(fd, &stbuf);
+  if( stbuf.st_size <= 0L )
+  {
+    fprintf(stderr, "\nError: query file is empty\n");
+    close(fd);
+    return ERROR;
+  }
+
+  // Previous manifest is not valid while shards are rewritten
+  snprintf(path, sizeof(path), "%s%s", qf, SHARD_SUFFIX);
+  unlink(path);
+
+  // Same record aligned partitions as a single process with nshards threads
+  offs = NULL;
+  nparts = nshards;
+  if( computePartitionOffsets(&offs, &nparts, fd, (long int)stbuf.st_size, '>') != 0 )
+  {
+    free(offs);
+    close(fd);
+    return ERROR;
+  }
+  if( nparts < nshards )
+    fprintf(stdout, "Warning: query file split in %d shards\n", nparts);
+
+  nrecs = (long long int *)malloc(sizeof(long long int) * nparts);
+  err = (nrecs == NULL) ? ERROR : 0;
+  total = 0LL;
+  for(i = 0; i < nparts && err == 0; i++)
+  {
+    begin = offs[i*3] + offs[i*3+1];
+    len = offs[i*3+2];
+    snprintf(path, sizeof(path), "%s%s%d", qf, SHARD_FILE, i);
+    sfd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if( sfd < 0 )
+    {
+      fprintf(stderr, "\n");
+      perror("open()");
+      err = ERROR;
+      break;
+    }
+    posix_fadvise(fd, (off_t)begin, (off_t)len, POSIX_FADV_SEQUENTIAL | POSIX_FADV_WILLNEED | POSIX_FADV_NOREUSE);
+    err = copyShard(fd, begin, len, sfd);
+    if( close(sfd) != 0 || err != 0 )
+    {
+      fprintf(stderr, "\nError: failed writing shard file %s\n", path);
+      err = ERROR;
+      break;
+    }
+    nrecs[i] = MAX(0LL, countRecords(fd, begin, len, '>'));
+    total = total + nrecs[i];
+  }
+  close(fd);
+
+  // Manifest lists names of shards without directory, they are found next to manifest
+  if( err == 0 )
+  {
+    snprintf(path, sizeof(path), "%s%s", qf, SHARD_SUFFIX);
+    mfd = fopen(path, "w");
+    if( mfd == NULL )
+    {
+      fprintf(stderr, "\n");
+      perror("fopen()");
+      err = ERROR;
+    }
+    else
+    {
+      base = strrchr(qf, '/');
+      base = (base != NULL) ? base + 1 : qf;
+      fprintf(mfd, "%s\t%d\t%lld\t%lld\n", SHARD_MAGIC, nparts, (long long int)stbuf.st_size, total);
+      for(i = 0; i < nparts; i++)
+        fprintf(mfd, "%s%s%d\t%lld\t%lld\t%lld\n", base, SHARD_FILE, i, nrecs[i], offs[i*3] + offs[i*3+1], offs[i*3] + offs[i*3+1] + offs[i*3+2]);
+      if( fclose(mfd) != 0 )
+        err = ERROR;
+      else
+        fprintf(stdout, "Shard manifest = %s (%d shards, %lld records)\n", path, nparts, total);
+    }
+  }
+  free(nrecs);
+  free(offs);
+
+  return err;
+}
+
+
+// Read a shard manifest, shards must cover query file in order
+// Returns 1 if file is not a shard manifest
+int openShards(const char *fn, shardmf_t *mf)
+{
+  FILE *fd;                       // Manifest file
+  char line[SHARD_NAMELEN + 128]; // Current line
+  char magic[16];                 // First word of manifest
+  char *slash;                    // Last directory separator of manifest name
+  int i;                          // Iteration variable
+  int err;                        // Trap errors
+  shard_t *s;                     // Current shard
+
+  memset(mf, 0, sizeof(shardmf_t));
+  fd = fopen(fn, "r");
+  if( fd == NULL )
+  {
+    fprintf(stderr, "\n");
+    perror("fopen()");
+    return ERROR;
+  }
+
+  if( fgets(line, sizeof(line), fd) == NULL || sscanf(line, "%15s\t%d\t%lld\t%lld", magic, &mf->nshards, &mf->qfsz, &mf->nrecs) != 4 || strcmp(magic, SHARD_MAGIC) != 0 )
+  {
+    fclose(fd);
+    return 1;
+  }
+  if( mf->nshards < 1 || mf->nshards > SHARD_LIMIT )
+  {
+    fprintf(stderr, "\nError: invalid number of shards in manifest = %d\n", mf->nshards);
+    fclose(fd);
+    return ERROR;
+  }
+
+  mf->shards = (shard_t *)calloc(mf->nshards, sizeof(shard_t));
+  err = (mf->shards == NULL) ? ERROR : 0;
+  for(i = 0; i < mf->nshards && err == 0; i++)
+  {
+    s = &mf->shards[i];
+    if( fgets(line, sizeof(line), fd) == NULL ||
+        sscanf(line, "%127[^\t]\t%lld\t%lld\t%lld", s->name, &s->nrecs, &s->begin, &s->end) != 4 ||
+        s->end <= s->begin || s->begin != ((i > 0) ? mf->shards[i-1].end : 0LL) )
+    {
+      fprintf(stderr, "\nError: invalid shard %d in manifest\n", i);
+      err = ERROR;
+    }
+  }
+  fclose(fd);
+  if( err == 0 && mf->shards[mf->nshards-1].end != mf->qfsz )
+  {
+    fprintf(stderr, "\nError: shards of manifest do not cover query file\n");
+    err = ERROR;
+  }
+  if( err != 0 )
+  {
+    freeShards(mf);
+    return ERROR;
+  }
+
+  // Shard files are next to manifest
+  snprintf(mf->dir, SHARD_NAMELEN, "%s", fn);
+  slash = strrchr(mf->dir, '/');
+  if( slash != NULL )
+    *slash = '\0';
+  else
+    strcpy(mf->dir, ".");
+  mf->first = 0;
+  mf->last = mf->nshards;
+  mf->cur = 0;
+
+  return 0;
+}
+
+
+// Path of a shard file, names of manifest are relative to its directory unless absolute
+int getShardPath(shardmf_t *mf, int i, char *path, size_t sz)
+{
+  if( mf->shards[i].name[0] == '/' )
+    snprintf(path, sz, "%s", mf->shards[i].name);
+  else
+    snprintf(path, sz, "%s/%s", mf->dir, mf->shards[i].name);
+
+  return (strlen(path) < sz - 1) ? 0 : ERROR;
+}
+
+
+// Free shard manifest
+int freeShards(shardmf_t *mf)
+{
+  free(mf->shards);
+  memset(mf, 0, sizeof(shardmf_t));
+
+  return 0;
+}
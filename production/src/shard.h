@@ -0,0 +1,54 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "utilities.h"
+#include "outvec.h"
+
+#define ERROR         -1          // Error code from failed functions
+
+#define SHARD_SUFFIX  ".shards"   // Suffix of shard manifest, placed next to query file
+#define SHARD_FILE    ".shard"    // Suffix of shard files before shard index, placed next to query file
+#define SHARD_MAGIC   "#FFSHARD01" // First word of shard manifest
+#define SHARD_LIMIT   4096        // Max number of shards of a manifest
+#define SHARD_NAMELEN 128         // Max length of shard file names
+#define SHARD_COPY    (1LL<<22)   // Bytes copied per read when kernel copies are not supported, 4MB
+
+// Shard of query file, a record aligned range copied to its own file
+typedef struct st_shard
+{
+  char           name[SHARD_NAMELEN]; // Shard file, relative to directory of manifest
+  long long int  nrecs;       // Number of records
+  long long int  begin;       // File offset of shard in query file
+  long long int  end;         // End of shard in query file
+} shard_t;
+
+// Shard manifest, shards are listed in order of query file
+// Line "SHARD_MAGIC <shards> <bytes> <records>" is followed by a line "<file> <records> <begin> <end>" per shard, tab separated
+typedef struct st_shardmf
+{
+  char           dir[SHARD_NAMELEN];  // Directory of manifest, shard files are found in it
+  int            nshards;     // Number of shards
+  int            first;       // First shard of current process
+  int            last;        // Shard after last shard of current process
+  int            cur;         // Shard being read by current process
+  long long int  qfsz;        // Size of query file
+  long long int  nrecs;       // Number of records of query file
+  shard_t       *shards;      // Shards in order of query file
+} shardmf_t;
+
+int isShardManifest(const char *);
+int buildShards(char *, int);
+int openShards(const char *, shardmf_t *);
+int getShardPath(shardmf_t *, int, char *, size_t);
+int freeShards(shardmf_t *);
+
+
+#endif
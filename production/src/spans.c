@@ -0,0 +1,257 @@
+#include "spans.h"
+#include "outvec.h"
+
+// Append a span, merging it with last span if data is contiguous
+static int appendSpan(spanlist_t *list, long long int off, long long int len)
+{
+  span_t *last;   // Last span in list
+  void *p;        // Reallocated memory
+
+  list->total = list->total + len;
+
+  // Contiguous with last span, same source
+  if( list->nspans > 0LL )
+  {
+    last = &list->spans[list->nspans - 1];
+    if( (off >= 0LL && last->off >= 0LL && (last->off + last->len) == off) ||
+        (off < 0LL && last->off < 0LL && (last->off - last->len) == off) )
+    {
+      last->len = last->len + len;
+      return 0;
+    }
+  }
+
+  if( list->nspans == list->maxSpans )
+  {
+    p = realloc(list->spans, sizeof(span_t) * (size_t)(list->maxSpans * 2LL));
+    if( p == NULL )
+    {
+      fprintf(stdout, "\nError: failed to grow output span list\n");
+      return ERROR;
+    }
+    list->spans = (span_t *)p;
+    list->maxSpans = list->maxSpans * 2LL;
+  }
+
+  list->spans[list->nspans].off = off;
+  list->spans[list->nspans].len = len;
+  list->nspans++;
+
+  return 0;
+}
+
+
+// Initialize an empty span list
+int initSpans(spanlist_t *list)
+{
+  memset(list, 0, sizeof(spanlist_t));
+
+  list->maxSpans = SPANS_INIT;
+  list->poolSz = POOL_INIT;
+  list->spans = (span_t *)malloc(sizeof(span_t) * list->maxSpans);
+  list->pool = (char *)malloc(sizeof(char) * list->poolSz);
+  if( list->spans == NULL || list->pool == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate output span list\n");
+    freeSpans(list);
+    return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Add a span of query file data
+int addFileSpan(spanlist_t *list, long long int off, long long int len)
+{
+  if( len <= 0LL )
+    return 0;
+
+  return appendSpan(list, off, len);
+}
+
+
+// Copy data to pool and add a span of it
+int addPoolSpan(spanlist_t *list, const char *data, long long int len)
+{
+  long long int sz;   // New pool size
+  void *p;            // Reallocated memory
+
+  if( len <= 0LL )
+    return 0;
+
+  if( (list->poolLen + len) > list->poolSz )
+  {
+    sz = list->poolSz * 2LL;
+    while( sz < (list->poolLen + len) )
+      sz = sz * 2LL;
+
+    p = realloc(list->pool, (size_t)sz);
+    if( p == NULL )
+    {
+      fprintf(stdout, "\nError: failed to grow output span pool\n");
+      return ERROR;
+    }
+    list->pool = (char *)p;
+    list->poolSz = sz;
+  }
+
+  memcpy(list->pool + list->poolLen, data, (size_t)len);
+  list->poolLen = list->poolLen + len;
+
+  return appendSpan(list, -(list->poolLen - len) - 1LL, len);
+}
+
+
+// Write a complete block of data at an output offset
+static int writeAt(int ofd, const char *data, long long int len, long long int off)
+{
+  long long int n;   // Bytes written by pwrite()
+
+  while( len > 0LL )
+  {
+    n = (long long int)pwrite(ofd, data, (size_t)len, (off_t)off);
+    if( n <= 0LL )
+    {
+      fprintf(stderr, "\n");
+      perror("pwrite()");
+      return ERROR;
+    }
+    data = data + n;
+    len = len - n;
+    off = off + n;
+  }
+
+  return 0;
+}
+
+
+// Write all spans to output file beginning at output offset
+// Query file data is copied with copy_file_range(), or read in chunks of SPAN_BUFSIZ
+int writeSpans(spanlist_t *list, int qfd, int ofd, long long int outOff)
+{
+  char *buf;            // Buffer for query file data
+  long long int i;      // Iteration variable
+  long long int done;   // Bytes of current span written
+  long long int sz;     // Bytes of current chunk
+  long long int n;      // Bytes read by pread()
+  int useCopy;          // Flag for kernel copies
+  span_t *span;         // Current span
+
+  useCopy = 1;
+  buf = (char *)malloc(sizeof(char) * SPAN_BUFSIZ);
+  if( buf == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate buffer for writing output spans\n");
+    return ERROR;
+  }
+
+  for(i = 0LL; i < list->nspans; i++)
+  {
+    span = &list->spans[i];
+
+    // Pool data
+    if( span->off < 0LL )
+    {
+      if( writeAt(ofd, list->pool + (-span->off - 1LL), span->len, outOff) != 0 )
+      {
+        free(buf);
+        return ERROR;
+      }
+      outOff = outOff + span->len;
+      continue;
+    }
+
+    // Query file data, copied by the kernel if supported, rest through buffer
+    done = 0LL;
+    if( useCopy != 0 )
+    {
+      done = copyRange(qfd, span->off, ofd, &outOff, span->len);
+      if( done < span->len )
+        useCopy = 0;
+    }
+    for(; done < span->len; done = done + sz)
+    {
+      sz = (span->len - done < SPAN_BUFSIZ) ? (span->len - done) : SPAN_BUFSIZ;
+      n = (long long int)pread(qfd, buf, (size_t)sz, (off_t)(span->off + done));
+      if( n != sz )
+      {
+        fprintf(stderr, "\n");
+        perror("pread()");
+        free(buf);
+        return ERROR;
+      }
+
+      if( writeAt(ofd, buf, sz, outOff) != 0 )
+      {
+        free(buf);
+        return ERROR;
+      }
+      outOff = outOff + sz;
+    }
+  }
+
+  free(buf);
+
+  return 0;
+}
+
+
+// Append all spans of a list to another list, pool data is copied
+int appendSpans(spanlist_t *dst, spanlist_t *src)
+{
+  long long int i;   // Iteration variable
+  span_t *span;      // Current span
+  int err;           // Trap errors
+
+  for(i = 0LL; i < src->nspans; i++)
+  {
+    span = &src->spans[i];
+    if( span->off < 0LL )
+      err = addPoolSpan(dst, src->pool + (-span->off - 1LL), span->len);
+    else
+      err = addFileSpan(dst, span->off, span->len);
+    if( err != 0 )
+      return ERROR;
+  }
+
+  return 0;
+}
+
+
+// Truncate span list to its first bytes of output data, pool is kept
+int truncateSpans(spanlist_t *list, long long int len)
+{
+  long long int i;     // Iteration variable
+  long long int sz;    // Bytes of spans before current span
+
+  if( len >= list->total )
+    return 0;
+
+  sz = 0LL;
+  for(i = 0LL; i < list->nspans && (sz + list->spans[i].len) < len; i++)
+    sz = sz + list->spans[i].len;
+
+  // Last span kept ends at length
+  list->nspans = 0LL;
+  if( len > 0LL )
+  {
+    list->spans[i].len = len - sz;
+    list->nspans = i + 1;
+  }
+  list->total = len;
+
+  return 0;
+}
+
+
+// Free span list memory
+int freeSpans(spanlist_t *list)
+{
+  free(list->spans);
+  free(list->pool);
+  memset(list, 0, sizeof(spanlist_t));
+
+  return 0;
+}
+
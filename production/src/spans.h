@@ -0,0 +1,47 @@
+#ifndef SPANS_H
+#define SPANS_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define ERROR        -1         // Error code from failed functions
+
+#define SPANS_INIT   4096LL     // Initial number of spans allocated
+#define POOL_INIT    (1LL<<16)  // Initial size of pool for bytes not in query file, 64KB
+#define SPAN_BUFSIZ  (1LL<<22)  // Size of buffer to copy spans from query file, 4MB
+
+// Span of output data
+// Non-negative offsets refer to query file, negative offsets refer to pool (-offset - 1)
+typedef struct st_span
+{
+  long long int  off;         // Offset of data
+  long long int  len;         // Length of data
+} span_t;
+
+// Output kept as a list of spans instead of an output file
+// Bytes that are not a slice of query file (rewritten annotations, newlines) are kept in pool
+typedef struct st_spanlist
+{
+  long long int  nspans;      // Number of spans
+  long long int  maxSpans;    // Number of spans allocated
+  long long int  poolLen;     // Bytes used in pool
+  long long int  poolSz;      // Bytes allocated in pool
+  long long int  total;       // Total bytes of output data
+  span_t        *spans;       // Spans in output order
+  char          *pool;        // Bytes not in query file
+} spanlist_t;
+
+int initSpans(spanlist_t *);
+int addFileSpan(spanlist_t *, long long int, long long int);
+int addPoolSpan(spanlist_t *, const char *, long long int);
+int writeSpans(spanlist_t *, int, int, long long int);
+int appendSpans(spanlist_t *, spanlist_t *);
+int truncateSpans(spanlist_t *, long long int);
+int freeSpans(spanlist_t *);
+
+
+#endif
@@ -0,0 +1,254 @@
+#include "stats.h"
+
+// Names of phases and counters in JSON output
+static const char *phaseNames[STATS_PHASES] = {"open", "offsets", "distribute", "load", "map", "parse", "lookup", "write", "combine", "filter", "total"};
+static const char *countNames[STATS_COUNTERS] = {"bytes_scanned", "records_scanned", "records_selected", "bytes_written", "windows", "straddle_records", "straddle_bytes"};
+
+
+// Initialize statistics of threads of current process
+int initStats(stats_t *stats, int nthreads, int enabled)
+{
+  memset(stats, 0, sizeof(stats_t));
+  if( enabled == 0 )
+    return 0;
+
+  stats->threads = (statsrec_t *)calloc(nthreads, sizeof(statsrec_t));
+  if( stats->threads == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate statistics\n");
+    return ERROR;
+  }
+  stats->nthreads = nthreads;
+  stats->enabled = 1;
+
+  return 0;
+}
+
+
+// Monotonic time in seconds, cheaper than gettimeofday() for timing records
+double statsTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+
+// Statistics of calling thread
+statsrec_t *statsThread(stats_t *stats)
+{
+  int t = 0;
+
+#ifdef _OPENMP
+  t = omp_get_thread_num();
+#endif
+  if( t >= stats->nthreads )
+    t = 0;
+
+  return &stats->threads[t];
+}
+
+
+// Write minimum, maximum and mean of a value over processes
+static void writeSummary(FILE *fd, const char *name, double *vals, int nprocs, int last)
+{
+  int r;
+  double lo, hi, sum;
+
+  lo = hi = sum = vals[0];
+  for(r = 1; r < nprocs; r++)
+  {
+    lo = (vals[r] < lo) ? vals[r] : lo;
+    hi = (vals[r] > hi) ? vals[r] : hi;
+    sum = sum + vals[r];
+  }
+  fprintf(fd, "    \"%s\": {\"min\": %.6f, \"max\": %.6f, \"mean\": %.6f, \"sum\": %.6f, \"imbalance\": %.4f}%s\n", name, lo, hi, sum / nprocs, sum, (sum > 0.0) ? hi / (sum / nprocs) : 1.0, last ? "" : ",");
+}
+
+
+// Write phases and counters of a thread or process
+static void writeRecord(FILE *fd, double *phase, long long int *count)
+{
+  int i;
+
+  fprintf(fd, "\"phases\": {");
+  for(i = 0; i < STATS_PHASES; i++)
+    fprintf(fd, "\"%s\": %.6f%s", phaseNames[i], phase[i], (i < STATS_PHASES - 1) ? ", " : "");
+  fprintf(fd, "}, \"counters\": {");
+  for(i = 0; i < STATS_COUNTERS; i++)
+    fprintf(fd, "\"%s\": %lld%s", countNames[i], count[i], (i < STATS_COUNTERS - 1) ? ", " : "");
+  fprintf(fd, "}");
+}
+
+
+// Reduce statistics of all processes to master and write them as JSON
+// Time of a phase of a process is the longest of its threads, counters of a process are the sums of its threads
+// Summaries have minimum, maximum, mean and sum over processes, imbalance is maximum over mean
+// Statistics file is written by master, "-" writes to standard output
+int writeStats(stats_t *stats, const char *fn, MPI_Comm comm, const char *procName)
+{
+  int i;
+  int r;
+  int t;
+  int rank;
+  int nprocs;
+  int err;
+  double *allThreads;            // Phases of every thread of every process
+  long long int *allCounts;      // Counters of every thread of every process
+  double *procPhase;             // Phases of each process
+  double *vals;                  // Values of current summary
+  long long int *procCount;      // Counters of each process
+  double phase[STATS_PHASES];    // Phases of current process
+  long long int count[STATS_COUNTERS];   // Counters of current process
+  double *myThreads;
+  long long int *myCounts;
+  char *names;                   // Processor names of all processes
+  FILE *fd;
+
+  if( stats->enabled == 0 )
+    return 0;
+
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &nprocs);
+
+  // Pack statistics of threads of current process
+  myThreads = (double *)malloc(sizeof(double) * stats->nthreads * STATS_PHASES);
+  myCounts = (long long int *)malloc(sizeof(long long int) * stats->nthreads * STATS_COUNTERS);
+  allThreads = NULL;
+  allCounts = NULL;
+  names = NULL;
+  if( rank == 0 )
+  {
+    allThreads = (double *)malloc(sizeof(double) * nprocs * stats->nthreads * STATS_PHASES);
+    allCounts = (long long int *)malloc(sizeof(long long int) * nprocs * stats->nthreads * STATS_COUNTERS);
+    names = (char *)calloc((size_t)nprocs * MPI_MAX_PROCESSOR_NAME, sizeof(char));
+  }
+  err = (myThreads == NULL || myCounts == NULL || (rank == 0 && (allThreads == NULL || allCounts == NULL || names == NULL))) ? ERROR : 0;
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MIN, comm);
+  if( err != 0 )
+  {
+    fprintf(stdout, "\nError: failed to allocate statistics of processes\n");
+    free(myThreads);
+    free(myCounts);
+    free(allThreads);
+    free(allCounts);
+    free(names);
+    return ERROR;
+  }
+  for(t = 0; t < stats->nthreads; t++)
+  {
+    memcpy(myThreads + t * STATS_PHASES, stats->threads[t].phase, sizeof(double) * STATS_PHASES);
+    memcpy(myCounts + t * STATS_COUNTERS, stats->threads[t].count, sizeof(long long int) * STATS_COUNTERS);
+  }
+
+  // Threads per process are the same in all processes
+  MPI_Gather(myThreads, stats->nthreads * STATS_PHASES, MPI_DOUBLE, allThreads, stats->nthreads * STATS_PHASES, MPI_DOUBLE, 0, comm);
+  MPI_Gather(myCounts, stats->nthreads * STATS_COUNTERS, MPI_LONG_LONG_INT, allCounts, stats->nthreads * STATS_COUNTERS, MPI_LONG_LONG_INT, 0, comm);
+  MPI_Gather(procName, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, names, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, comm);
+  free(myThreads);
+  free(myCounts);
+  if( rank != 0 )
+    return 0;
+
+  procPhase = (double *)calloc((size_t)nprocs * STATS_PHASES, sizeof(double));
+  procCount = (long long int *)calloc((size_t)nprocs * STATS_COUNTERS, sizeof(long long int));
+  vals = (double *)malloc(sizeof(double) * nprocs);
+  fd = (strcmp(fn, "-") == 0) ? stdout : fopen(fn, "w");
+  if( procPhase == NULL || procCount == NULL || vals == NULL || fd == NULL )
+  {
+    if( fd == NULL )
+      perror("fopen()");
+    fprintf(stdout, "\nError: failed to write statistics file\n");
+    if( fd != NULL && fd != stdout )
+      fclose(fd);
+    free(procPhase);
+    free(procCount);
+    free(vals);
+    free(allThreads);
+    free(allCounts);
+    free(names);
+    return ERROR;
+  }
+
+  // Combine threads of each process
+  for(r = 0; r < nprocs; r++)
+  {
+    for(t = 0; t < stats->nthreads; t++)
+    {
+      for(i = 0; i < STATS_PHASES; i++)
+        if( allThreads[(r * stats->nthreads + t) * STATS_PHASES + i] > procPhase[r * STATS_PHASES + i] )
+          procPhase[r * STATS_PHASES + i] = allThreads[(r * stats->nthreads + t) * STATS_PHASES + i];
+      for(i = 0; i < STATS_COUNTERS; i++)
+        procCount[r * STATS_COUNTERS + i] = procCount[r * STATS_COUNTERS + i] + allCounts[(r * stats->nthreads + t) * STATS_COUNTERS + i];
+    }
+  }
+
+  fprintf(fd, "{\n");
+  fprintf(fd, "  \"processes\": %d,\n", nprocs);
+  fprintf(fd, "  \"threads\": %d,\n", stats->nthreads);
+
+  // Summaries over processes
+  fprintf(fd, "  \"phases\": {\n");
+  for(i = 0; i < STATS_PHASES; i++)
+  {
+    for(r = 0; r < nprocs; r++)
+      vals[r] = procPhase[r * STATS_PHASES + i];
+    writeSummary(fd, phaseNames[i], vals, nprocs, i == STATS_PHASES - 1);
+  }
+  fprintf(fd, "  },\n");
+  fprintf(fd, "  \"counters\": {\n");
+  for(i = 0; i < STATS_COUNTERS; i++)
+  {
+    for(r = 0; r < nprocs; r++)
+      vals[r] = (double)procCount[r * STATS_COUNTERS + i];
+    writeSummary(fd, countNames[i], vals, nprocs, i == STATS_COUNTERS - 1);
+  }
+  fprintf(fd, "  },\n");
+
+  // Breakdown per process and per thread
+  fprintf(fd, "  \"ranks\": [\n");
+  for(r = 0; r < nprocs; r++)
+  {
+    for(i = 0; i < STATS_PHASES; i++)
+      phase[i] = procPhase[r * STATS_PHASES + i];
+    for(i = 0; i < STATS_COUNTERS; i++)
+      count[i] = procCount[r * STATS_COUNTERS + i];
+    fprintf(fd, "    {\"rank\": %d, \"host\": \"%s\", ", r, names + (size_t)r * MPI_MAX_PROCESSOR_NAME);
+    writeRecord(fd, phase, count);
+    fprintf(fd, ",\n     \"threads\": [\n");
+    for(t = 0; t < stats->nthreads; t++)
+    {
+      fprintf(fd, "       {\"thread\": %d, ", t);
+      writeRecord(fd, allThreads + (r * stats->nthreads + t) * STATS_PHASES, allCounts + (r * stats->nthreads + t) * STATS_COUNTERS);
+      fprintf(fd, "}%s\n", (t < stats->nthreads - 1) ? "," : "");
+    }
+    fprintf(fd, "     ]}%s\n", (r < nprocs - 1) ? "," : "");
+  }
+  fprintf(fd, "  ]\n");
+  fprintf(fd, "}\n");
+
+  if( fd != stdout )
+    fclose(fd);
+  else
+    fflush(fd);
+  free(procPhase);
+  free(procCount);
+  free(vals);
+  free(allThreads);
+  free(allCounts);
+  free(names);
+
+  return 0;
+}
+
+
+// Free statistics of threads
+int freeStats(stats_t *stats)
+{
+  free(stats->threads);
+  memset(stats, 0, sizeof(stats_t));
+
+  return 0;
+}
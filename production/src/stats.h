@@ -0,0 +1,63 @@
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define ERROR        -1         // Error code from failed functions
+
+// Phases timed by each thread, in seconds
+#define PH_OPEN       0         // Open query file
+#define PH_OFFSETS    1         // Partition boundaries of query file
+#define PH_DISTRIBUTE 2         // Distribute input files and partitions of query file to other nodes
+#define PH_LOAD       3         // Load BLAST table, search file and job manifest
+#define PH_MAP        4         // Wait for memory map windows and stream refills
+#define PH_PARSE      5         // Find annotations and sequences of records
+#define PH_LOOKUP     6         // Select records by lengths or hit IDs
+#define PH_WRITE      7         // Write selected records to output
+#define PH_COMBINE    8         // Combine outputs of processes into output file
+#define PH_FILTER     9         // Filter query file, including map, parse, lookup, write and combine phases
+#define PH_TOTAL     10         // Whole run
+#define STATS_PHASES 11
+
+// Counters of each thread
+#define CN_BYTES_SCANNED  0     // Bytes of query file parsed
+#define CN_RECS_SCANNED   1     // Records parsed
+#define CN_RECS_SELECTED  2     // Records written to output
+#define CN_BYTES_WRITTEN  3     // Bytes written to output
+#define CN_WINDOWS        4     // Memory map windows and stream refills
+#define CN_STRADDLE       5     // Records straddling windows, parsed again by next window or carried over in stream buffer
+#define CN_STRADDLE_BYTES 6     // Bytes of records straddling windows
+#define STATS_COUNTERS    7
+
+// Statistics of a thread, padded to its own cache lines
+typedef struct st_statsrec
+{
+  double         phase[STATS_PHASES];    // Time of each phase
+  long long int  count[STATS_COUNTERS];  // Counters
+  char           pad[64];
+} statsrec_t;
+
+// Statistics of current process
+typedef struct st_stats
+{
+  int            enabled;     // Flag for recording statistics
+  int            nthreads;    // Number of threads recorded
+  statsrec_t    *threads;     // Statistics of each thread
+} stats_t;
+
+int initStats(stats_t *, int, int);
+double statsTime();
+statsrec_t *statsThread(stats_t *);
+int writeStats(stats_t *, const char *, MPI_Comm, const char *);
+int freeStats(stats_t *);
+
+
+#endif
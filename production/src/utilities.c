@@ -90,8 +90,6 @@ int computePartitionOffsets(long long int **offs, int *parts, int fd, long int s
       // Compute partition size aligned to page size 
       partSz = chunks * multiplier;
      
-fprintf(stdout, "Maxparts = %f, Multiplier = %ld, partSz = %lld\n", maxparts, multiplier, partSz);
- 
       // Find offsets for each partition
       for(i = 0; i < lparts && err == 0; i++)
       {
@@ -196,3 +194,110 @@ fprintf(stdout, "Maxparts = %f, Multiplier = %ld, partSz = %lld\n", maxparts, mu
   return 0;
 }
 
+
+// Find last separator symbol before a file offset, reading backwards in chunks of page size
+// Returns offset of symbol, 0 if there is no symbol before offset, ERROR if read fails
+long long int findSymbolBefore(int fd, long long int off, char sym)
+{
+  char *buffer;
+  long long int chunks;
+  long long int begin;
+  long long int bytesRead;
+  long long int j;
+
+  chunks = (long long int)sysconf(_SC_PAGESIZE);
+  buffer = malloc(chunks * sizeof(char));
+  if( buffer == NULL )
+    return ERROR;
+
+  // Chunks are aligned to page size, first one ends at offset
+  while( off > 0 )
+  {
+    begin = ((off - 1) / chunks) * chunks;
+    bytesRead = pread(fd, buffer, off - begin, begin);
+    if( bytesRead != (off - begin) )
+    {
+      fprintf(stdout, "Warning: data read does not match in partition offsets\n");
+      free(buffer);
+      return ERROR;
+    }
+
+    for(j = bytesRead - 1; j >= 0; j--)
+    {
+      if( buffer[j] == sym )
+      {
+        free(buffer);
+        return begin + j;
+      }
+    }
+    off = begin;
+  }
+
+  free(buffer);
+
+  return 0;
+}
+
+
+// Count separator symbols in a range of data
+// Returns count of symbols, ERROR if read fails
+long long int countSymbol(int fd, long long int off, long long int len, char sym)
+{
+  char *buffer;
+  char *c;
+  long long int cnt;
+  long long int bytesRead;
+
+  buffer = malloc(len * sizeof(char));
+  if( buffer == NULL )
+    return ERROR;
+
+  bytesRead = pread(fd, buffer, len, off);
+  if( bytesRead != len )
+  {
+    free(buffer);
+    return ERROR;
+  }
+
+  cnt = 0;
+  for(c = memchr(buffer, sym, len); c != NULL; c = memchr(c + 1, sym, len - (c + 1 - buffer)))
+    cnt++;
+
+  free(buffer);
+
+  return cnt;
+}
+
+
+// Count records in a range of data beginning at a record, a record begins with symbol at beginning of a line
+// Returns count of records, ERROR if read fails
+long long int countRecords(int fd, long long int off, long long int len, char sym)
+{
+  char *buffer;
+  char *c;
+  long long int cnt;
+  long long int bytesRead;
+
+  if( len <= 0 )
+    return 0;
+
+  buffer = malloc(len * sizeof(char));
+  if( buffer == NULL )
+    return ERROR;
+
+  bytesRead = pread(fd, buffer, len, off);
+  if( bytesRead != len )
+  {
+    free(buffer);
+    return ERROR;
+  }
+
+  cnt = (buffer[0] == sym) ? 1 : 0;
+  for(c = memchr(buffer, '\n', len); c != NULL && (c + 1 - buffer) < len; c = memchr(c + 1, '\n', len - (c + 1 - buffer)))
+    if( c[1] == sym )
+      cnt++;
+
+  free(buffer);
+
+  return cnt;
+}
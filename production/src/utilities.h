@@ -13,6 +13,9 @@
 
 double get_wtime();
 int computePartitionOffsets(long long int **, int *, int, long int, char);
+long long int findSymbolBefore(int, long long int, char);
+long long int countSymbol(int, long long int, long long int, char);
+long long int countRecords(int, long long int, long long int, char);
 
 
 #endif
@@ -187,3 +187,76 @@ int computePartitionOffsets(long long int **offs, int *parts, int fd, long int s
   return 0;
 }
 
+
+// Find last separator symbol before a file offset, reading backwards in chunks of page size
+// Returns offset of symbol, 0 if there is no symbol before offset, ERROR if read fails
+long long int findSymbolBefore(int fd, long long int off, char sym)
+{
+  char *buffer;
+  long long int chunks;
+  long long int begin;
+  long long int bytesRead;
+  long long int j;
+
+  chunks = (long long int)sysconf(_SC_PAGESIZE);
+  buffer = malloc(chunks * sizeof(char));
+  if( buffer == NULL )
+    return ERROR;
+
+  // Chunks are aligned to page size, first one ends at offset
+  while( off > 0 )
+  {
+    begin = ((off - 1) / chunks) * chunks;
+    bytesRead = pread(fd, buffer, off - begin, begin);
+    if( bytesRead != (off - begin) )
+    {
+      fprintf(stdout, "Warning: data read does not match in partition offsets\n");
+      free(buffer);
+      return ERROR;
+    }
+
+    for(j = bytesRead - 1; j >= 0; j--)
+    {
+      if( buffer[j] == sym )
+      {
+        free(buffer);
+        return begin + j;
+      }
+    }
+    off = begin;
+  }
+
+  free(buffer);
+
+  return 0;
+}
+
+
+// Count separator symbols in a range of data
+// Returns count of symbols, ERROR if read fails
+long long int countSymbol(int fd, long long int off, long long int len, char sym)
+{
+  char *buffer;
+  char *c;
+  long long int cnt;
+  long long int bytesRead;
+
+  buffer = malloc(len * sizeof(char));
+  if( buffer == NULL )
+    return ERROR;
+
+  bytesRead = pread(fd, buffer, len, off);
+  if( bytesRead != len )
+  {
+    free(buffer);
+    return ERROR;
+  }
+
+  cnt = 0;
+  for(c = memchr(buffer, sym, len); c != NULL; c = memchr(c + 1, sym, len - (c + 1 - buffer)))
+    cnt++;
+
+  free(buffer);
+
+  return cnt;
+}
@@ -46,6 +46,8 @@
 #define STRM_BUFSIZ (1LL<<20)  // Size of output stream buffer, 1MB
 #define HITS_ID_LEN 64LL       // Max length for BLAST table query and hit IDs
 #define VERBOSE(ctx) if(verbose) {ctx} // Verbose mode
+#define FNV_OFFSET  14695981039346656037ULL  // FNV-1a 64-bit offset basis
+#define FNV_PRIME   1099511628211ULL         // FNV-1a 64-bit prime
 
 // Global variable for verbose mode
 static int verbose;
@@ -101,6 +103,11 @@ typedef struct st_hits
   int            pipeProg;     // Pipeline program after extracting sequences 
   char         **queryList;    // List of queries in BLAST table file
   char         **hitList;      // List of hit IDs in BLAST table file
+  long long int  mask;         // Number of hash table slots minus 1, slots are a power of 2
+  long long int  maxLen;       // Length of longest hit ID
+  long long int *slots;        // Hash table of hit IDs, hit ID index plus 1 stored in each slot, 0 = empty
+  long long int *lens;         // Length of each hit ID
+  unsigned char *lenMask;      // Non-zero if at least one hit ID has the given length
 } hits_t;
 
 
@@ -801,12 +808,107 @@ int parseAnnot(int annotCnt, long long int *annotSz, query_t *query)
 }
 
 
+// Build hash table of hit IDs for selecting sequences
+int buildHitsTable(hits_t *hits)
+{
+  long long int i;              // Iteration variable
+  long long int j;              // Iteration variable
+  long long int nslots;         // Number of slots in hash table
+  long long int slot;           // Current slot
+  unsigned long long int hash;  // Hash value of current hit ID
+
+  // Keep load factor at or below 0.5
+  nslots = 1LL;
+  while( nslots < (hits->htotal * 2LL) )
+    nslots = nslots << 1;
+  hits->mask = nslots - 1;
+
+  hits->slots = (long long int *)calloc(nslots, sizeof(long long int));
+  hits->lens = (long long int *)malloc(sizeof(long long int) * (hits->htotal + 1));
+  if( hits->slots == NULL || hits->lens == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate hash table for hit IDs\n");
+    return ERROR;
+  }
+
+  hits->maxLen = 0LL;
+  for(i = 0LL; i < hits->htotal; i++)
+  {
+    hits->lens[i] = (long long int)strlen(hits->hitList[i]);
+    if( hits->lens[i] > hits->maxLen )
+      hits->maxLen = hits->lens[i];
+  }
+
+  hits->lenMask = (unsigned char *)calloc(hits->maxLen + 1, sizeof(unsigned char));
+  if( hits->lenMask == NULL )
+  {
+    fprintf(stdout, "\nError: failed to allocate hash table for hit IDs\n");
+    return ERROR;
+  }
+
+  // Insert hit IDs using linear probing, hit IDs are already unique
+  for(i = 0LL; i < hits->htotal; i++)
+  {
+    hash = FNV_OFFSET;
+    for(j = 0LL; j < hits->lens[i]; j++)
+      hash = (hash ^ (unsigned char)hits->hitList[i][j]) * FNV_PRIME;
+
+    slot = (long long int)(hash & (unsigned long long int)hits->mask);
+    while( hits->slots[slot] != 0LL )
+      slot = (slot + 1) & hits->mask;
+
+    hits->slots[slot] = i + 1;
+    hits->lenMask[hits->lens[i]] = 1;
+  }
+
+  return 0;
+}
+
+
+// Check if any hit ID is a prefix of the annotation, same as strncmp(hitId, annot, strlen(hitId))
+// Hash is computed incrementally and hash table is probed only at lengths that have hit IDs
+// Returns 1 if a hit ID is found, 0 otherwise
+int findHitID(hits_t *hits, char *annot, long long int annotLen)
+{
+  long long int i;              // Iteration variable
+  long long int len;            // Prefix length to check
+  long long int slot;           // Current slot
+  long long int idx;            // Index of hit ID stored in slot
+  unsigned long long int hash;  // Hash value of current prefix
+
+  if( hits->htotal == 0LL )
+    return 0;
+
+  hash = FNV_OFFSET;
+  len = (annotLen < hits->maxLen) ? annotLen : hits->maxLen;
+  for(i = 0LL; i < len; i++)
+  {
+    hash = (hash ^ (unsigned char)annot[i]) * FNV_PRIME;
+
+    // No hit ID of this length
+    if( hits->lenMask[i+1] == 0 )
+      continue;
+
+    slot = (long long int)(hash & (unsigned long long int)hits->mask);
+    while( hits->slots[slot] != 0LL )
+    {
+      idx = hits->slots[slot] - 1;
+      if( hits->lens[idx] == (i + 1) && memcmp(hits->hitList[idx], annot, i + 1) == 0 )
+        return 1;
+
+      slot = (slot + 1) & hits->mask;
+    }
+  }
+
+  return 0;
+}
+
+
 // Extract queries in current memory map
 int extractQueries(args_t *args, iomap_t *iomap, query_t *query, hits_t *hits, int *done)
 {
   int err = 0;                 // Trap errors
   int seqSelect = 0;           // Number of sequences selected
-  long long int hlen;          // Length of hit ID
   long long int lerr;          // Trap number of elements written by write()
   long long int annotSz;       // Size of annotations in bytes
   long long int seqSz;         // Size of sequence data in bytes
@@ -844,18 +946,9 @@ int extractQueries(args_t *args, iomap_t *iomap, query_t *query, hits_t *hits, i
     // Perform BLAST hits table filtering
     if( hits->pipeProg != 0 )
     {
-      // Need to compare all sequences in query file with table file, do not select anything yet
-      for(i = 0LL; i < hits->htotal; i++)
-      {
-        hlen = (long long int)strlen(hits->hitList[i]);
-
-        // Compare hit ids, plus 1 to skip ">" at beginning of each sequence
-        if( strncmp(hits->hitList[i], query->iaq+1, hlen) == 0 )
-        {
-          seqSelect = 1;
-          break;
-        }
-      }
+      // Look up hit IDs, plus 1 to skip ">" at beginning of each sequence
+      if( findHitID(hits, query->iaq+1, (long long int)(query->faq - query->iaq)) != 0 )
+        seqSelect = 1;
     }
     // Perform normal filtering
     else
@@ -1341,6 +1434,9 @@ int freeHitsMemory(hits_t *hits)
     free(hits->queryList);
     free(hits->hitList);
     free(hits->idxList);
+    free(hits->slots);
+    free(hits->lens);
+    free(hits->lenMask);
   }
    
   return 0;
@@ -1446,6 +1542,15 @@ int loadBlastTable(char *fn, hits_t *hits)
   // Close BLAST table file
   fclose(hits->tfd);
 
+  // Build lookup table of hit IDs
+  err = buildHitsTable(hits);
+  if( err != 0 )
+  {
+    fprintf(stdout, "Error: failed building hit IDs table\n");
+    freeHitsMemory(hits);
+    return ERROR;
+  }
+
   return 0;
 }
 